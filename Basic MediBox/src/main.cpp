@@ -3,6 +3,9 @@
 #include <Adafruit_SSD1306.h>
 #include <DHTesp.h>
 #include <WiFi.h>
+#include <MediboxUi.h>
+#include <AlarmTable.h>
+#include <EnvironmentCheck.h>
 
 #define SCREEN_WIDTH 128
 #define SCREEN_HEIGHT 64
@@ -24,7 +27,6 @@
 
 //Declare functions
 
-void print_line(String text, int column, int row, int text_size);
 void update_time();
 void update_time_with_check_alarm(void);
 void ring_alarm(int alarm_index);
@@ -40,6 +42,7 @@ void Warning_alarm();
 
 //Declare objects
 Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET);
+MediboxUi ui(display, {PB_UP, PB_DOWN, PB_OK, PB_CANCEL});
 DHTesp dhtSensor;
 //global variables
 float utc_offset = 0.0;
@@ -49,12 +52,8 @@ int minutes = 0;
 int hours = 0;
 
 
-bool alarm_enabled = true;
+AlarmTable alarms;
 bool Warning_given = false;
-int n_alarms = 2;
-int alarm_hours[] = {-1, -1};
-int alarm_minute[] = {-1, -1};
-bool alarm_triggered[] = {false, false};
 
 int n_notes = 8;
 int C = 262;
@@ -74,35 +73,12 @@ String modes[] = {"1 - Set Time", "2 - Set Alarm 1", "3 - Set Alarm 2", "4- Disa
 
 
 
-void print_line(String text, int column, int row, int text_size) {
-
-  //display a custom message
-  display.setTextSize(text_size);
-  display.setTextColor(SSD1306_WHITE);
-  display.setCursor(column, row);
-  display.println(text);
-  display.display();
-  //delay(2000);
-
-}
-
-void print_time_now(void) {
-  print_line(String(days), 0, 0, 2);
-  print_line(":", 20, 0, 2);
-  print_line(String(hours), 30, 0, 2);
-  print_line(":", 50, 0, 2);
-  print_line(String(minutes), 60, 0, 2);
-  print_line(":", 80, 0, 2);
-  print_line(String(seconds), 90, 0, 2);
-
-}
-
 //time update function and fetch current time from NTP Server
 void update_time() {
   struct tm timeinfo;
   if (!getLocalTime(&timeinfo)) {
     display.clearDisplay();
-    print_line("Failed to get time", 0, 0, 1);
+    ui.printLine("Failed to get time", 0, 0, 1);
     delay(2000);
     return;
   }
@@ -127,7 +103,7 @@ void update_time() {
 
 void ring_alarm(int alarm_index) {
   display.clearDisplay();
-  print_line("MEDICINE TIME", 0, 0, 2);
+  ui.printLine("MEDICINE TIME", 0, 0, 2);
 
   digitalWrite(LED_1, HIGH);
 
@@ -140,21 +116,16 @@ void ring_alarm(int alarm_index) {
         // Stop the alarm
         delay(200);
         break_happened = true;
-        alarm_triggered[alarm_index] = true; // Mark alarm as triggered
+        alarms.triggered[alarm_index] = true; // Mark alarm as triggered
         break;
       }
 
       if (digitalRead(PB_OK) == LOW) {
         // Snooze the alarm for 5 minutes
         delay(200);
-        alarm_triggered[alarm_index] = false; // Reset the triggered state
+        alarms.snooze(alarm_index);
         Serial.println("Snoozing alarm for 5 minutes");
-        Serial.println(alarm_triggered[alarm_index]);
-        alarm_minute[alarm_index] += 5; // Add 5 minutes to the alarm time
-        if (alarm_minute[alarm_index] >= 60) {
-          alarm_minute[alarm_index] -= 60;
-          alarm_hours[alarm_index] = (alarm_hours[alarm_index] + 1) % 24;
-        }
+        Serial.println(alarms.triggered[alarm_index]);
         break_happened = true;
         break;
       }
@@ -172,79 +143,16 @@ void ring_alarm(int alarm_index) {
 
 void update_time_with_check_alarm(void) {
   update_time();
-  print_time_now();
-
-  if (alarm_enabled == true) {
-    for (int i = 0; i < n_alarms; i++) {
-      if (alarm_triggered[i] == false && alarm_hours[i] == hours && alarm_minute[i] == minutes) {
-        alarm_triggered[i] = true;
-        ring_alarm(i);
-        
-      }
-    }
-  }
-}
-
-int wait_for_button_press() {
-
-  while (true) {
-    if (digitalRead(PB_UP) == LOW) {
-      delay(200);
-      return PB_UP;
-    }
-
-    else if (digitalRead(PB_DOWN) == LOW) {
-      delay(200);
-      return PB_DOWN;
-    }
-
-    else if (digitalRead(PB_OK) == LOW) {
-      delay(200);
-      return PB_OK;
-    }
-
-    else if (digitalRead(PB_CANCEL) == LOW) {
-      delay(200);
-      return PB_CANCEL;
-    }
+  ui.printTime(days, hours, minutes, seconds);
 
-    update_time();
+  int due = alarms.due(hours, minutes);
+  if (due >= 0) {
+    ring_alarm(due);
   }
 }
 
 void go_to_menu() {
-  while (digitalRead(PB_CANCEL) == HIGH) {
-    display.clearDisplay();
-    print_line(modes[current_mode], 0, 0, 2);
-
-    int pressed = wait_for_button_press();
-
-    if (pressed == PB_UP) {
-      delay(200);
-      current_mode += 1;
-      current_mode = current_mode % max_modes;
-    }
-
-    if (pressed == PB_DOWN) {
-      delay(200);
-      current_mode -= 1;
-
-      if (current_mode < 0 ) {
-        current_mode = max_modes - 1;
-      }
-    }
-
-    else if (pressed == PB_OK) {
-      delay(200);
-      Serial.println(current_mode);
-      run_mode(current_mode);
-    }
-
-    else if (pressed == PB_CANCEL) {
-      delay(200);
-      break;
-    }
-  }
+  ui.runMenu(modes, max_modes, current_mode, run_mode);
 }
 
 void run_mode(int mode) {
@@ -257,7 +165,7 @@ void run_mode(int mode) {
   }
 
   else if (mode == 3) {
-    alarm_enabled = false;
+    alarms.enabled = false;
   }
   
   else if (mode == 4) {
@@ -276,273 +184,52 @@ void run_mode(int mode) {
 
 void set_time() {
   int temp_hours = hours;
-
-  while (true) {
-    display.clearDisplay();
-    print_line("Enter hour: " + String(temp_hours), 0, 0, 2);
-
-    int pressed = wait_for_button_press();
-
-    if (pressed == PB_UP) {
-      delay(200);
-      temp_hours += 1;
-      temp_hours = temp_hours % 24;
-
-    }
-
-    if (pressed == PB_DOWN) {
-      delay(200);
-      temp_hours -= 1;
-      if (temp_hours < 0) {
-        temp_hours = 23;
-
-      }
-    }
-
-    else if (pressed == PB_OK) {
-      delay(200);
-      hours = temp_hours;
-
-    }
-
-    else if (pressed == PB_CANCEL) {
-      delay(200);
-      break;
-    }
+  if (ui.editNumber("Enter hour: ", temp_hours, 24)) {
+    hours = temp_hours;
   }
 
-
   int temp_minutes = minutes;
-
-  while (true) {
-    display.clearDisplay();
-    print_line("Enter minutes: " + String(temp_minutes), 0, 0, 2);
-
-    int pressed = wait_for_button_press();
-
-    if (pressed == PB_UP) {
-      delay(200);
-      temp_minutes += 1;
-      temp_minutes = temp_minutes % 60;
-
-    }
-
-    if (pressed == PB_DOWN) {
-      delay(200);
-      temp_minutes -= 1;
-      if (temp_minutes < 0) {
-        temp_minutes = 59;
-
-      }
-    }
-
-    else if (pressed == PB_OK) {
-      delay(200);
-      minutes = temp_minutes;
-
-    }
-
-    else if (pressed == PB_CANCEL) {
-      delay(200);
-      break;
-    }
+  if (ui.editNumber("Enter minutes: ", temp_minutes, 60)) {
+    minutes = temp_minutes;
   }
 
-  display.clearDisplay();
-  print_line("Time is set", 0, 0, 2);
-  delay(2000);
+  ui.notice("Time is set");
 }
 
 void set_alarm (int alarm) {
-  int temp_hour = alarm_hours[alarm];
-
-  while (true) {
-    display.clearDisplay();
-    print_line("Enter hour: " + String(temp_hour), 0, 0, 2);
-
-    int pressed = wait_for_button_press();
-
-    if (pressed == PB_UP) {
-      delay(200);
-      temp_hour += 1;
-      temp_hour = temp_hour % 24;
-
-    }
-
-    if (pressed == PB_DOWN) {
-      delay(200);
-      temp_hour -= 1;
-      if (temp_hour < 0) {
-        temp_hour = 23;
-
-      }
-    }
-
-    else if (pressed == PB_OK) {
-      delay(200);
-      alarm_hours[alarm] = temp_hour;
-      alarm_triggered[alarm] = false;
-
-    }
-
-    else if (pressed == PB_CANCEL) {
-      delay(200);
-      break;
-    }
+  int temp_hour = alarms.hours[alarm];
+  if (ui.editNumber("Enter hour: ", temp_hour, 24)) {
+    alarms.setHour(alarm, temp_hour);
   }
 
-
-  int temp_minutes = alarm_minute[alarm];
-
-  while (true) {
-    display.clearDisplay();
-    print_line("Enter minutes: " + String(temp_minutes), 0, 0, 2);
-
-    int pressed = wait_for_button_press();
-
-    if (pressed == PB_UP) {
-      delay(200);
-      temp_minutes += 1;
-      temp_minutes = temp_minutes % 60;
-
-    }
-
-    if (pressed == PB_DOWN) {
-      delay(200);
-      temp_minutes -= 1;
-      if (temp_minutes < 0) {
-        temp_minutes = 59;
-
-      }
-    }
-
-    else if (pressed == PB_OK) {
-      delay(200);
-      alarm_minute[alarm] = temp_minutes;
-
-    }
-
-    else if (pressed == PB_CANCEL) {
-      delay(200);
-      break;
-    }
-
+  int temp_minutes = alarms.minutes[alarm];
+  if (ui.editNumber("Enter minutes: ", temp_minutes, 60)) {
+    alarms.setMinute(alarm, temp_minutes);
   }
 }
 
 // Function to set the time zone offset (supports fractional offsets)
 void set_time_zone() {
-  float temp_offset = utc_offset;
-
-  while (true) {
-    display.clearDisplay();
-    print_line("UTC Offset: " + String(temp_offset, 1), 0, 0, 2); // Display with 1 decimal place
-
-    int pressed = wait_for_button_press();
-
-    if (pressed == PB_UP) {
-      delay(200);
-      temp_offset += 0.5; 
-
-      // Wrap around if it exceeds the maximum offset
-      if(temp_offset > 14.0) {
-        temp_offset = -12.0; 
-      }
-    }
-
-    if (pressed == PB_DOWN) {
-      delay(200);
-      temp_offset -= 0.5; // Decrement by 0.5
-
-      // Wrap around to the maximum offset
-      if(temp_offset < -12.0) {
-        temp_offset = 14.0; 
-      }
-    }
-
-    else if (pressed == PB_OK) {
-      delay(200);
-      utc_offset = temp_offset;
-      configTime(utc_offset * 3600, UTC_OFFSET_DST, NTP_SERVER); // Convert offset to seconds
-      break;
-    }
-
-    else if (pressed == PB_CANCEL) {
-      delay(200);
-      break;
-    }
+  if (ui.editOffset(utc_offset)) {
+    configTime(utc_offset * 3600, UTC_OFFSET_DST, NTP_SERVER); // Convert offset to seconds
   }
 
-  display.clearDisplay();
-  print_line("Time Zone Set", 0, 0, 2);
-  delay(2000);
+  ui.notice("Time Zone Set");
 }
 
 // Function to view active alarms
 void view_alarms() {
-  while(true){
-  display.clearDisplay();
-  int row = 0;
-  for (int i = 0; i < n_alarms; i++) {
-    if(alarm_hours[i] == -1 || alarm_minute[i] == -1) {
-      continue;
-    }
-
-    print_line("Alarm " + String(i + 1) + ": " + String(alarm_hours[i]) + ":" + String(alarm_minute[i]), 0, i * 15, 2);
-    row++;
-  }
-
-    // If no active alarms, display a message
-    if (row == 0) {
-      print_line("No Active Alarms", 0, 0, 2);
-    }
-
-  int pressed = wait_for_button_press();
-
-  if (pressed == PB_CANCEL) {
-    delay(200);
-    break;
-  }
-  }
+  ui.viewAlarms(alarms);
 }
 
 // Function to delete a specific alarm
 void delete_alarm() {
-  int alarm_to_delete = 0;
-
-  while (true) {
-    display.clearDisplay();
-    print_line("Del Alarm: " + String(alarm_to_delete + 1), 0, 0, 2);
-
-    int pressed = wait_for_button_press();
-
-    if (pressed == PB_UP) {
-      delay(200);
-      alarm_to_delete = (alarm_to_delete + 1) % n_alarms;
-    }
-
-    if (pressed == PB_DOWN) {
-      delay(200);
-      alarm_to_delete = (alarm_to_delete - 1 + n_alarms) % n_alarms;
-    }
-
-    else if (pressed == PB_OK) {
-      delay(200);
-      alarm_hours[alarm_to_delete] = -1; // Mark alarm as deleted
-      alarm_minute[alarm_to_delete] = -1;
-      alarm_triggered[alarm_to_delete] = false;
-      break;
-    }
-
-    else if (pressed == PB_CANCEL) {
-      delay(200);
-      break;
-    }
+  int alarm_to_delete = ui.pick("Del Alarm: ", ALARM_SLOTS, 0, nullptr);
+  if (alarm_to_delete >= 0) {
+    alarms.remove(alarm_to_delete); // Mark alarm as deleted
   }
 
-  display.clearDisplay();
-  print_line("Alarm Deleted", 0, 0, 2);
-  delay(2000);
+  ui.notice("Alarm Deleted");
 }
 
 void Warning_alarm() {
@@ -572,41 +259,10 @@ void Warning_alarm() {
 
 void check_temp() {
   TempAndHumidity data = dhtSensor.getTempAndHumidity();
-  bool warning = false;
-  if (data.temperature > 35) {
-    display.clearDisplay();
-    print_line("TEMP HIGH", 0, 35, 1);
-  }
-
-  if (data.temperature < 35) {
-    display.clearDisplay();
-    print_line("TEMP LOW", 0, 35, 1);
-  }
+  uint8_t status = environmentStatus(data.temperature, data.humidity);
+  ui.showEnvironment(status);
 
-  if (data.humidity > 40) {
-    display.clearDisplay();
-    print_line("HUMIDITY HIGH", 0, 45, 1);
-  }
-
-  if (data.humidity < 20) {
-    display.clearDisplay();
-    print_line("HUMIDITY LOW", 0, 45, 1);
-  }
-
-  if (data.temperature >32 || data.temperature < 24) {
-    display.clearDisplay();
-    print_line("Temperature Warning",0, 25,1);
-    // digitalWrite(LED_1,HIGH);
-    warning = true;
-  }
-
-  if (data.humidity >85 || data.humidity < 65) {
-    display.clearDisplay();
-    print_line("Humidity Warning",0, 30,1);
-    warning = true;
-  }
-
-  if (warning) {
+  if (environmentWarning(status)) {
     Warning_given = false;
     if(!Warning_given){
     Warning_alarm();
@@ -630,6 +286,9 @@ void setup() {
 
   dhtSensor.setup(DHTPIN, DHTesp::DHT22);
 
+  // The clock keeps ticking while the menu waits for a button
+  ui.setIdle(update_time);
+
   //Initialize serial monitor and OLED display
   Serial.begin(115200);
   if (! display.begin(SSD1306_SWITCHCAPVCC, SCREEN_ADDRESS)) {
@@ -645,17 +304,17 @@ void setup() {
   while (WiFi.status() != WL_CONNECTED) {
     delay(250);
     display.clearDisplay();
-    print_line("Connecting to WIFI", 0, 0, 2);
+    ui.printLine("Connecting to WIFI", 0, 0, 2);
   }
 
   display.clearDisplay();
-  print_line("Connected to WIFI", 0, 0, 2);
+  ui.printLine("Connected to WIFI", 0, 0, 2);
 
   configTime(UTC_OFFSET, UTC_OFFSET_DST, NTP_SERVER);
 
   display.clearDisplay();
 
-  print_line("Welcome to Medibox!", 10, 20, 2);
+  ui.printLine("Welcome to Medibox!", 10, 20, 2);
   delay(2000);
   display.clearDisplay();
 
@@ -0,0 +1,6 @@
+#ifndef HOST_ADAFRUIT_GFX_H
+#define HOST_ADAFRUIT_GFX_H
+
+#include <Arduino.h>
+
+#endif
@@ -0,0 +1,171 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// Host stand-in for the parts of the Arduino-ESP32 core the firmware uses.
+// Time is virtual (see host_platform.h) and hardware I/O goes to the
+// emulated board instead of pins.
+
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include <algorithm>
+#include <string>
+
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+// Default I2C pins of the ESP32 DevKit
+static const uint8_t SDA = 21;
+static const uint8_t SCL = 22;
+
+#define DEC 10
+#define HEX 16
+
+#define F(string_literal) (string_literal)
+#define IRAM_ATTR
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t level);
+int digitalRead(uint8_t pin);
+uint16_t analogRead(uint8_t pin);
+void tone(uint8_t pin, unsigned int frequency, unsigned long duration = 0);
+void noTone(uint8_t pin);
+
+// Seeded PRNG, so host runs are repeatable
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+using std::max;
+using std::min;
+
+class String {
+public:
+  String() {}
+  String(const char* text) : s(text != nullptr ? text : "") {}
+  String(const std::string& text) : s(text) {}
+  String(char c) : s(1, c) {}
+  String(int value, unsigned char base = 10) : s(format(value, base)) {}
+  String(unsigned int value, unsigned char base = 10) : s(format(value, base)) {}
+  String(long value, unsigned char base = 10) : s(format(value, base)) {}
+  String(unsigned long value, unsigned char base = 10) : s(format(value, base)) {}
+  String(float value, unsigned char decimals = 2) : s(fixed(value, decimals)) {}
+  String(double value, unsigned char decimals = 2) : s(fixed(value, decimals)) {}
+
+  const char* c_str() const { return s.c_str(); }
+  unsigned int length() const { return s.size(); }
+  long toInt() const { return atol(s.c_str()); }
+  float toFloat() const { return atof(s.c_str()); }
+
+  void toCharArray(char* buffer, unsigned int size) const {
+    if (size == 0) return;
+    size_t n = std::min<size_t>(size - 1, s.size());
+    memcpy(buffer, s.data(), n);
+    buffer[n] = '\0';
+  }
+
+  String& operator+=(const String& other) { s += other.s; return *this; }
+  String operator+(const String& other) const { return String(s + other.s); }
+  friend String operator+(const char* left, const String& right) { return String(std::string(left) + right.s); }
+  bool operator==(const String& other) const { return s == other.s; }
+  bool operator!=(const String& other) const { return s != other.s; }
+
+private:
+  static std::string format(long long value, unsigned char base) {
+    char buffer[40];
+    snprintf(buffer, sizeof(buffer), base == 16 ? "%llx" : "%lld", value);
+    return buffer;
+  }
+  static std::string format(unsigned long long value, unsigned char base) {
+    char buffer[40];
+    snprintf(buffer, sizeof(buffer), base == 16 ? "%llx" : "%llu", value);
+    return buffer;
+  }
+  static std::string format(int value, unsigned char base) { return format((long long)value, base); }
+  static std::string format(long value, unsigned char base) { return format((long long)value, base); }
+  static std::string format(unsigned int value, unsigned char base) { return format((unsigned long long)value, base); }
+  static std::string format(unsigned long value, unsigned char base) { return format((unsigned long long)value, base); }
+  static std::string fixed(double value, unsigned char decimals) {
+    char buffer[48];
+    snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+    return buffer;
+  }
+
+  std::string s;
+};
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(const uint8_t* data, size_t length) = 0;
+  size_t write(uint8_t b) { return write(&b, 1); }
+
+  size_t print(const char* text) { return write((const uint8_t*)text, strlen(text)); }
+  size_t print(const String& text) { return print(text.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int value, int base = DEC) { return print(String(value, base)); }
+  size_t print(unsigned int value, int base = DEC) { return print(String(value, base)); }
+  size_t print(long value, int base = DEC) { return print(String(value, base)); }
+  size_t print(unsigned long value, int base = DEC) { return print(String(value, base)); }
+  size_t print(long long value, int base = DEC) { return print(String((long)value, base)); }
+  size_t print(unsigned long long value, int base = DEC) { return print(String((unsigned long)value, base)); }
+  size_t print(double value, int digits = 2) { return print(String(value, digits)); }
+
+  size_t println() { return print("\r\n"); }
+  template <typename T> size_t println(const T& value) { size_t n = print(value); return n + println(); }
+  template <typename T> size_t println(const T& value, int format) { size_t n = print(value, format); return n + println(); }
+
+  size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print {
+public:
+  virtual int available() { return 0; }
+  virtual int read() { return -1; }
+};
+
+class HardwareSerial : public Stream {
+public:
+  void begin(unsigned long baud) { (void)baud; }
+  size_t write(const uint8_t* data, size_t length) override;
+};
+
+extern HardwareSerial Serial;
+
+class Client : public Stream {
+public:
+  size_t write(const uint8_t* data, size_t length) override { (void)data; return length; }
+};
+
+class EspClass {
+public:
+  void restart();
+  // Cycles of a 240 MHz CPU in virtual time
+  uint32_t getCycleCount();
+  uint32_t getCpuFreqMHz() { return 240; }
+  // No heap budget is modelled on the host
+  uint32_t getFreeHeap() { return 0; }
+};
+
+extern EspClass ESP;
+
+#endif
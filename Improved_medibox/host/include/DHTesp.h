@@ -0,0 +1,27 @@
+#ifndef HOST_DHTESP_H
+#define HOST_DHTESP_H
+
+#include <Arduino.h>
+
+struct TempAndHumidity {
+  float temperature;
+  float humidity;
+};
+
+// Serves the emulated board's temperature/humidity. Like the real library,
+// a read within the 2 s minimum sampling period returns the cached values.
+class DHTesp {
+public:
+  enum DHT_MODEL_t { AUTO_DETECT, DHT11, DHT22, AM2302, RHT03 };
+
+  void setup(uint8_t pin, DHT_MODEL_t model) { (void)pin; (void)model; }
+  TempAndHumidity getTempAndHumidity();
+  int getMinimumSamplingPeriod() { return 2000; }
+
+private:
+  bool has_reading = false;
+  unsigned long last_read = 0;
+  TempAndHumidity cached = {NAN, NAN};
+};
+
+#endif
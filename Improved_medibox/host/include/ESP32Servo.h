@@ -0,0 +1,18 @@
+#ifndef HOST_ESP32SERVO_H
+#define HOST_ESP32SERVO_H
+
+#include <Arduino.h>
+
+// Angle changes are reported to the host output
+class Servo {
+public:
+  int attach(int pin) { attached_pin = pin; return 0; }
+  void write(int angle);
+  int read() { return last_angle; }
+
+private:
+  int attached_pin = -1;
+  int last_angle = -1;
+};
+
+#endif
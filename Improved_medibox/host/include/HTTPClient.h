@@ -0,0 +1,24 @@
+#ifndef HOST_HTTPCLIENT_H
+#define HOST_HTTPCLIENT_H
+
+#include <WiFi.h>
+
+#define HTTP_CODE_OK 200
+
+// No network on the host: every request fails up front
+class HTTPClient {
+public:
+  bool begin(const char* url) { (void)url; return false; }
+  bool begin(const String& url) { return begin(url.c_str()); }
+  void setConnectTimeout(int32_t timeout) { (void)timeout; }
+  void setTimeout(uint16_t timeout) { (void)timeout; }
+  int GET() { return -1; }
+  int getSize() { return -1; }
+  WiFiClient* getStreamPtr() { return &client; }
+  void end() {}
+
+private:
+  WiFiClient client;
+};
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef HOST_LITTLEFS_H
+#define HOST_LITTLEFS_H
+
+#include <Arduino.h>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+// Files live under the directory given to host_set_fs_root()
+class File : public Stream {
+public:
+  File() : f(nullptr) {}
+  explicit File(FILE* file) : f(file) {}
+
+  explicit operator bool() const { return f != nullptr; }
+  size_t write(const uint8_t* data, size_t length) override;
+  int available() override;
+  int read() override;
+  size_t read(uint8_t* buffer, size_t length);
+  bool seek(uint32_t position);
+  size_t position();
+  size_t size();
+  void flush();
+  void close();
+
+private:
+  FILE* f;
+};
+
+class LittleFSFS {
+public:
+  bool begin(bool format_on_fail = false) { (void)format_on_fail; return true; }
+  File open(const char* path, const char* mode = FILE_READ);
+  bool exists(const char* path);
+  bool remove(const char* path);
+  bool rename(const char* from, const char* to);
+};
+
+extern LittleFSFS LittleFS;
+
+#endif
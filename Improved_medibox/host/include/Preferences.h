@@ -0,0 +1,41 @@
+#ifndef HOST_PREFERENCES_H
+#define HOST_PREFERENCES_H
+
+#include <Arduino.h>
+
+// NVS stand-in: one in-memory key/value map shared by all namespaces,
+// preloaded by the host run (e.g. from a trace) before setup()
+class Preferences {
+public:
+  bool begin(const char* name, bool read_only = false) { (void)name; (void)read_only; return true; }
+  void end() {}
+
+  bool isKey(const char* key);
+  bool remove(const char* key);
+
+  size_t putBytes(const char* key, const void* value, size_t length);
+  size_t getBytes(const char* key, void* buffer, size_t max_length);
+
+  size_t putBool(const char* key, bool value) { return putBytes(key, &value, sizeof(value)); }
+  bool getBool(const char* key, bool default_value = false) { return get(key, default_value); }
+  size_t putInt(const char* key, int32_t value) { return putBytes(key, &value, sizeof(value)); }
+  int32_t getInt(const char* key, int32_t default_value = 0) { return get(key, default_value); }
+  size_t putUInt(const char* key, uint32_t value) { return putBytes(key, &value, sizeof(value)); }
+  uint32_t getUInt(const char* key, uint32_t default_value = 0) { return get(key, default_value); }
+  size_t putULong(const char* key, uint32_t value) { return putBytes(key, &value, sizeof(value)); }
+  uint32_t getULong(const char* key, uint32_t default_value = 0) { return get(key, default_value); }
+  size_t putFloat(const char* key, float value) { return putBytes(key, &value, sizeof(value)); }
+  float getFloat(const char* key, float default_value = 0) { return get(key, default_value); }
+
+  size_t putString(const char* key, const char* value) { return putBytes(key, value, strlen(value) + 1); }
+  size_t getString(const char* key, char* buffer, size_t max_length);
+  String getString(const char* key, String default_value = String());
+
+private:
+  template <typename T> T get(const char* key, T default_value) {
+    T value;
+    return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : default_value;
+  }
+};
+
+#endif
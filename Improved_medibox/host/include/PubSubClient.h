@@ -0,0 +1,47 @@
+#ifndef HOST_PUBSUBCLIENT_H
+#define HOST_PUBSUBCLIENT_H
+
+#include <Arduino.h>
+#include <functional>
+
+#define MQTT_CALLBACK_SIGNATURE std::function<void(char*, uint8_t*, unsigned int)> callback
+
+#define MQTT_CONNECTION_TIMEOUT -4
+#define MQTT_CONNECTION_LOST -3
+#define MQTT_CONNECT_FAILED -2
+#define MQTT_DISCONNECTED -1
+#define MQTT_CONNECTED 0
+
+// Same surface as knolleary/PubSubClient, backed by host.broker
+class PubSubClient {
+public:
+  explicit PubSubClient(Client& client) { (void)client; }
+
+  PubSubClient& setServer(const char* domain, uint16_t port) { (void)domain; (void)port; return *this; }
+  PubSubClient& setCallback(MQTT_CALLBACK_SIGNATURE) { this->callback = callback; return *this; }
+  bool setBufferSize(uint16_t size) { buffer_size = size; return true; }
+  uint16_t getBufferSize() { return buffer_size; }
+
+  bool connect(const char* id);
+  bool connect(const char* id, const char* will_topic, uint8_t will_qos, bool will_retain, const char* will_message);
+  bool connect(const char* id, const char* user, const char* pass, const char* will_topic,
+               uint8_t will_qos, bool will_retain, const char* will_message, bool clean_session = true);
+  void disconnect();
+  bool connected();
+  int state();
+
+  bool subscribe(const char* topic);
+  bool publish(const char* topic, const char* payload);
+  bool publish(const char* topic, const char* payload, bool retained);
+  bool publish(const char* topic, const uint8_t* payload, unsigned int length);
+  bool publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained);
+
+  bool loop();
+
+private:
+  MQTT_CALLBACK_SIGNATURE;
+  uint16_t buffer_size = 256;
+  int connection_state = MQTT_DISCONNECTED;
+};
+
+#endif
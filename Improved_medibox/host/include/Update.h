@@ -0,0 +1,19 @@
+#ifndef HOST_UPDATE_H
+#define HOST_UPDATE_H
+
+#include <Arduino.h>
+
+#define UPDATE_SIZE_UNKNOWN 0xFFFFFFFF
+
+class UpdateClass {
+public:
+  bool begin(size_t size) { (void)size; return false; }
+  size_t write(uint8_t* data, size_t length) { (void)data; (void)length; return 0; }
+  bool end(bool even_if_remaining = false) { (void)even_if_remaining; return false; }
+  void abort() {}
+  const char* errorString() { return "not supported on host"; }
+};
+
+extern UpdateClass Update;
+
+#endif
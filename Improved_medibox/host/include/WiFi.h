@@ -0,0 +1,36 @@
+#ifndef HOST_WIFI_H
+#define HOST_WIFI_H
+
+#include <Arduino.h>
+
+#define WL_IDLE_STATUS 0
+#define WL_CONNECTED 3
+#define WL_DISCONNECTED 6
+
+#define WIFI_STA 1
+
+class WiFiClass {
+public:
+  void begin(const char* ssid, const char* password = nullptr, int32_t channel = 0) {
+    (void)ssid; (void)password; (void)channel;
+  }
+  int status() { return WL_CONNECTED; }
+  bool isConnected() { return true; }
+  bool mode(int mode) { (void)mode; return true; }
+  bool setAutoReconnect(bool enable) { (void)enable; return true; }
+  uint8_t* macAddress(uint8_t* mac);
+};
+
+extern WiFiClass WiFi;
+
+class WiFiClient : public Client {
+public:
+  int available() override { return 0; }
+  size_t readBytes(uint8_t* buffer, size_t length) { (void)buffer; (void)length; return 0; }
+  uint8_t connected() { return 0; }
+};
+
+void configTime(long gmt_offset_sec, int daylight_offset_sec, const char* server1,
+                const char* server2 = nullptr, const char* server3 = nullptr);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef HOST_ESP_OTA_OPS_H
+#define HOST_ESP_OTA_OPS_H
+
+#include <esp_err.h>
+
+typedef struct {
+  const char* label;
+} esp_partition_t;
+
+typedef enum {
+  ESP_OTA_IMG_NEW = 0,
+  ESP_OTA_IMG_PENDING_VERIFY,
+  ESP_OTA_IMG_VALID,
+  ESP_OTA_IMG_INVALID,
+  ESP_OTA_IMG_ABORTED,
+  ESP_OTA_IMG_UNDEFINED
+} esp_ota_img_states_t;
+
+// The host always runs a confirmed image
+static inline const esp_partition_t* esp_ota_get_running_partition() { return nullptr; }
+static inline esp_err_t esp_ota_get_state_partition(const esp_partition_t* partition, esp_ota_img_states_t* state) {
+  (void)partition; *state = ESP_OTA_IMG_VALID; return ESP_OK;
+}
+static inline esp_err_t esp_ota_mark_app_valid_cancel_rollback() { return ESP_OK; }
+static inline esp_err_t esp_ota_mark_app_invalid_rollback_and_reboot() { return ESP_FAIL; }
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef HOST_ESP_SNTP_H
+#define HOST_ESP_SNTP_H
+
+#include <sys/time.h>
+
+typedef void (*sntp_sync_time_cb_t)(struct timeval* tv);
+
+// Called back by host_sntp_sync()
+void sntp_set_time_sync_notification_cb(sntp_sync_time_cb_t callback);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef HOST_ESP_SYSTEM_H
+#define HOST_ESP_SYSTEM_H
+
+#include <stdint.h>
+
+typedef enum {
+  ESP_RST_UNKNOWN = 0,
+  ESP_RST_POWERON,
+  ESP_RST_EXT,
+  ESP_RST_SW,
+  ESP_RST_PANIC,
+  ESP_RST_INT_WDT,
+  ESP_RST_TASK_WDT,
+  ESP_RST_WDT,
+  ESP_RST_DEEPSLEEP,
+  ESP_RST_BROWNOUT,
+  ESP_RST_SDIO
+} esp_reset_reason_t;
+
+// Every host run is a cold boot
+static inline esp_reset_reason_t esp_reset_reason() { return ESP_RST_POWERON; }
+
+// Base MAC of the emulated chip, host.mac
+int esp_efuse_mac_get_default(uint8_t* mac);
+
+#endif
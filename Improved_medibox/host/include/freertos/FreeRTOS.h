@@ -0,0 +1,53 @@
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+// Cooperative stand-in for the FreeRTOS calls the firmware uses.
+//
+// Each task runs on its own thread, but only one of the firmware's threads
+// (loop() or a task) runs at a time: a task runs when something it blocks
+// on becomes ready while the loop moves the clock or posts to its queue,
+// and hands back as soon as it blocks again, including on a mutex the
+// loop holds across a delay. Runs stay deterministic in virtual time.
+// Blocking with a timeout other than 0 or portMAX_DELAY is not emulated.
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define errQUEUE_FULL 0
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+typedef void (*TaskFunction_t)(void* arg);
+typedef struct host_task* TaskHandle_t;
+typedef struct host_queue* QueueHandle_t;
+typedef struct host_semaphore* SemaphoreHandle_t;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_depth,
+                                   void* arg, UBaseType_t priority, TaskHandle_t* created, BaseType_t core);
+static inline BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_depth,
+                                     void* arg, UBaseType_t priority, TaskHandle_t* created) {
+  return xTaskCreatePinnedToCore(function, name, stack_depth, arg, priority, created, 0);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t wait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t wait);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+
+SemaphoreHandle_t xSemaphoreCreateMutex();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+
+// Let tasks whose queue became ready run; called as the clock moves
+void host_rtos_dispatch();
+
+#endif
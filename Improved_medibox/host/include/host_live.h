@@ -0,0 +1,98 @@
+#ifndef HOST_LIVE_H
+#define HOST_LIVE_H
+
+// Live runs of the host firmware: a real MQTT connection and simulated
+// hardware, so many instances can be pointed at one broker (tools/fleet_sim.py).
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "host_platform.h"
+
+struct LiveStats {
+  unsigned long connects = 0;
+  unsigned long connect_failures = 0;
+  unsigned long disconnects = 0;
+  unsigned long published = 0;
+  unsigned long publish_bytes = 0;
+  unsigned long received = 0;
+};
+
+// Minimal MQTT 3.1.1 client over TCP: QoS 0 only, clean sessions
+class SocketBroker : public HostBroker {
+public:
+  SocketBroker(const std::string& host_name, uint16_t port, uint16_t keep_alive_s = 15);
+  ~SocketBroker();
+
+  bool connect(const char* client_id, const char* will_topic, const char* will_message, bool will_retain) override;
+  bool connected() override { return fd >= 0; }
+  void disconnect() override;
+  bool subscribe(const char* topic) override;
+  bool publish(const char* topic, const uint8_t* payload, size_t length, bool retained) override;
+  void poll(const Callback& callback) override;
+
+  const LiveStats& stats() const { return counters; }
+  // Close the socket without a DISCONNECT, as a lost network does
+  void drop();
+
+private:
+  bool send(const std::vector<uint8_t>& packet);
+
+  std::string host_name;
+  uint16_t port;
+  uint16_t keep_alive_s;
+  int fd;
+  uint16_t next_packet_id;
+  std::vector<uint8_t> rx;
+  std::chrono::steady_clock::time_point last_send;
+  LiveStats counters;
+};
+
+// Stand-in hardware: LDR and DHT follow a day curve with seeded noise,
+// buttons stay released, and SNTP answers a few seconds after boot with
+// the host's clock.
+class SimInput : public HostInput {
+public:
+  explicit SimInput(uint32_t seed);
+
+  void pump(uint64_t now_us) override;
+  bool finished(uint64_t now_us) const override { (void)now_us; return false; }
+
+private:
+  float noise();
+
+  uint32_t rng;
+  uint64_t next_update_us;
+  bool synced;
+  int64_t boot_utc_ms;
+};
+
+// SimInput steered line by line from stdin, for benches that need to
+// step a sensor, press a button or cut the network at a known moment:
+//
+//   analog <pin> <value>   hold an analog pin (the LDR is 36)
+//   analog <pin> off       hand it back to the simulation
+//   digital <pin> <0|1>    set a button level (released is 1)
+//   press <pin>            press a button for exactly one read of it,
+//                          however long the firmware's loop takes
+//   drop                   lose the broker connection
+class ControlInput : public HostInput {
+public:
+  ControlInput(uint32_t seed, SocketBroker& broker);
+
+  void pump(uint64_t now_us) override;
+  bool finished(uint64_t now_us) const override { (void)now_us; return false; }
+
+private:
+  void command(const std::string& line);
+
+  SimInput sim;
+  SocketBroker& broker;
+  uint64_t next_poll_us;
+  bool stdin_open;
+  std::string pending;
+  int held[HOST_PINS];   // -1 when the simulation drives the pin
+};
+
+#endif
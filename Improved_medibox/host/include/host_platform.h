@@ -0,0 +1,112 @@
+#ifndef HOST_PLATFORM_H
+#define HOST_PLATFORM_H
+
+// Emulated board for host builds of the firmware.
+//
+// The firmware's setup()/loop() run unchanged against a virtual clock. Every
+// emulated call that would take time on the ESP32 (delay(), a display flush,
+// a DHT read) advances that clock instead of sleeping, so a host run goes as
+// fast as the CPU allows. Input sources (trace replay, simulators) feed pin
+// levels, sensor values and MQTT messages through this interface and receive
+// everything the firmware outputs.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <functional>
+#include <string>
+
+#define HOST_PINS 64
+
+// Things the firmware did, in the order it did them
+class HostOutput {
+public:
+  virtual ~HostOutput() {}
+  virtual void publish(uint64_t t_us, const char* topic, const uint8_t* payload, size_t length, bool retained) = 0;
+  virtual void servo(uint64_t t_us, uint8_t pin, int angle) = 0;
+  virtual void tone(uint64_t t_us, uint8_t pin, unsigned int frequency) = 0;
+  virtual void pin(uint64_t t_us, uint8_t pin, int level) = 0;
+  virtual void serial(const char* text, size_t length) { (void)text; (void)length; }
+};
+
+// Where inputs come from; pump() runs whenever the virtual clock moves
+class HostInput {
+public:
+  virtual ~HostInput() {}
+  virtual void pump(uint64_t now_us) = 0;
+  // True once the input has nothing left to deliver
+  virtual bool finished(uint64_t now_us) const = 0;
+};
+
+// MQTT transport behind the emulated PubSubClient
+class HostBroker {
+public:
+  typedef std::function<void(char*, uint8_t*, unsigned int)> Callback;
+
+  virtual ~HostBroker() {}
+  virtual bool connect(const char* client_id, const char* will_topic, const char* will_message, bool will_retain) = 0;
+  virtual bool connected() = 0;
+  virtual void disconnect() = 0;
+  virtual bool subscribe(const char* topic) = 0;
+  virtual bool publish(const char* topic, const uint8_t* payload, size_t length, bool retained) = 0;
+  // Deliver pending messages through 'callback'
+  virtual void poll(const Callback& callback) = 0;
+};
+
+struct HostCosts {
+  uint32_t display_flush_us = 23000;   // 1 KB over I2C at 400 kHz
+  uint32_t dht_read_us = 5000;         // bit-banged, interrupts off
+  uint32_t analog_read_us = 10;
+  uint32_t digital_read_us = 1;
+};
+
+struct HostBoard {
+  uint64_t now_us = 0;
+  int digital[HOST_PINS];
+  // A press that lasts until the firmware has read the pin once
+  bool pressed_once[HOST_PINS];
+  int analog[HOST_PINS];
+  float temperature = 25.0f;
+  float humidity = 70.0f;
+  uint8_t mac[6] = {0x24, 0x0a, 0xc4, 0x00, 0x00, 0x01};
+  HostCosts costs;
+
+  // Virtual seconds per wall second; 0 runs as fast as possible
+  double speed = 0;
+
+  HostOutput* output = nullptr;
+  HostInput* input = nullptr;
+  HostBroker* broker = nullptr;
+
+  // The run ends when the clock reaches this or on ESP.restart(). Both
+  // unwind the firmware with HostStop, which never returns on the device
+  // either, so a run can end inside a menu loop.
+  uint64_t end_us = UINT64_MAX;
+  bool stop = false;
+  std::string stop_reason;
+
+  HostBoard();
+};
+
+extern HostBoard host;
+
+struct HostStop {};
+
+// Advance the virtual clock and let the input catch up
+void host_advance(uint64_t us);
+
+// Deliver a SNTP result to the firmware's sync callback
+void host_sntp_sync(int64_t utc_ms);
+
+// Key/value store behind the emulated Preferences, for preloading NVS
+void host_pref_set(const char* key, const void* value, size_t length);
+
+// Directory the emulated LittleFS lives in
+void host_set_fs_root(const char* path);
+
+// Earliest armed esp_timer deadline, UINT64_MAX if none
+uint64_t host_timer_deadline();
+// Run the callbacks of the timers due at host.now_us
+void host_timer_fire();
+
+#endif
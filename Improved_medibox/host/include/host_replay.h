@@ -0,0 +1,92 @@
+#ifndef HOST_REPLAY_H
+#define HOST_REPLAY_H
+
+// Replays a recorded trace (lib/TraceLog) into the emulated board.
+//
+// Each input takes the latest recorded value at or before the virtual time,
+// MQTT messages are delivered by the next mqttClient.loop() after their
+// timestamp, and the NVS snapshot at the start of the trace is loaded
+// before setup(). Everything the firmware does is logged as text, one line
+// per event, so two firmware builds can be compared with diff.
+
+#include <deque>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <TraceLog.h>
+
+#include "host_platform.h"
+
+// Output log lines: "<ms> publish <topic> <payload>", "<ms> servo <pin> <angle>",
+// "<ms> tone <pin> <hz>", "<ms> pin <pin> <level>"
+class TextOutput : public HostOutput {
+public:
+  TextOutput(FILE* out, bool echo_serial);
+
+  void publish(uint64_t t_us, const char* topic, const uint8_t* payload, size_t length, bool retained) override;
+  void servo(uint64_t t_us, uint8_t pin, int angle) override;
+  void tone(uint64_t t_us, uint8_t pin, unsigned int frequency) override;
+  void pin(uint64_t t_us, uint8_t pin, int level) override;
+  void serial(const char* text, size_t length) override;
+
+private:
+  FILE* out;
+  bool echo_serial;
+  unsigned int last_tone[HOST_PINS];
+};
+
+struct HostMessage {
+  std::string topic;
+  std::vector<uint8_t> payload;
+};
+
+// Always-connected broker: publishes go to the output, queued messages
+// come back through poll()
+class ReplayBroker : public HostBroker {
+public:
+  bool connect(const char* client_id, const char* will_topic, const char* will_message, bool will_retain) override;
+  bool connected() override { return is_connected; }
+  void disconnect() override { is_connected = false; }
+  bool subscribe(const char* topic) override;
+  bool publish(const char* topic, const uint8_t* payload, size_t length, bool retained) override;
+  void poll(const Callback& callback) override;
+
+  void deliver(const char* topic, const uint8_t* payload, size_t length);
+
+private:
+  bool is_connected = false;
+  std::set<std::string> subscriptions;
+  std::deque<HostMessage> inbox;
+};
+
+class ReplayInput : public HostInput {
+public:
+  ReplayInput(std::vector<uint8_t> trace, ReplayBroker& broker);
+
+  bool valid() const { return reader.valid(); }
+  bool corrupt() const { return reader.corrupt(); }
+  size_t events() const { return applied; }
+
+  // Load the NVS snapshot; call before setup()
+  void preload();
+
+  void pump(uint64_t now_us) override;
+  bool finished(uint64_t now_us) const override;
+  // Time of the last record
+  uint64_t endUs() const { return end_us; }
+
+private:
+  void apply(const TraceRecord& record, uint64_t now_us);
+  void advance();
+
+  std::vector<uint8_t> data;
+  TraceReader reader;
+  ReplayBroker& broker;
+  TraceRecord pending;
+  bool has_pending;
+  size_t applied;
+  uint64_t end_us;
+};
+
+#endif
@@ -0,0 +1,482 @@
+// Emulated Arduino-ESP32 core and libraries on top of HostBoard
+
+#include <Arduino.h>
+#include <Adafruit_SSD1306.h>
+#include <DHTesp.h>
+#include <ESP32Servo.h>
+#include <LittleFS.h>
+#include <Preferences.h>
+#include <PubSubClient.h>
+#include <Update.h>
+#include <WiFi.h>
+#include <Wire.h>
+#include <esp_sntp.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+
+#include <stdarg.h>
+#include <unistd.h>
+
+#include <chrono>
+
+#include <map>
+#include <vector>
+
+#include "host_platform.h"
+
+// PubSubClient refuses packets that do not fit its buffer
+#define MQTT_MAX_HEADER_SIZE 5
+
+// Last level written per pin, so output only sees changes
+static int pin_level[HOST_PINS];
+
+HostBoard host;
+
+HardwareSerial Serial;
+EspClass ESP;
+TwoWire Wire;
+WiFiClass WiFi;
+UpdateClass Update;
+LittleFSFS LittleFS;
+
+static std::map<std::string, std::vector<uint8_t> > nvs;
+static std::string fs_root = ".";
+static sntp_sync_time_cb_t sntp_callback = nullptr;
+
+HostBoard::HostBoard() {
+  for (int i = 0; i < HOST_PINS; i++) {
+    digital[i] = HIGH;   // buttons idle high on their pull-ups
+    pressed_once[i] = false;
+    analog[i] = 0;
+    pin_level[i] = -1;
+  }
+}
+
+// Hold the virtual clock to host.speed times wall time
+static void pace() {
+  static std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  double wall_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+  double ahead_us = host.now_us / host.speed - wall_us;
+  // Small leads are left to accumulate; sleeping per digitalRead() would
+  // cost more than the call it paces
+  if (ahead_us >= 1000) {
+    usleep((useconds_t)ahead_us);
+  }
+}
+
+static void host_step() {
+  if (host.speed > 0) {
+    pace();
+  }
+  if (host.input != nullptr) {
+    host.input->pump(host.now_us);
+  }
+  if (host.now_us >= host.end_us && !host.stop) {
+    host.stop = true;
+    host.stop_reason = "end of input";
+    throw HostStop();
+  }
+}
+
+void host_advance(uint64_t us) {
+  uint64_t target = host.now_us + us;
+
+  // Stop at each timer deadline on the way, so periodic callbacks (and the
+  // tasks they wake) see their exact times even across a long delay()
+  uint64_t deadline;
+  while ((deadline = host_timer_deadline()) <= target) {
+    host.now_us = std::max(host.now_us, deadline);
+    host_step();
+    host_timer_fire();
+    host_rtos_dispatch();
+  }
+
+  // A task woken on the way may have used up more than 'us'
+  host.now_us = std::max(host.now_us, target);
+  host_step();
+  host_rtos_dispatch();
+}
+
+void host_sntp_sync(int64_t utc_ms) {
+  if (sntp_callback == nullptr) {
+    return;
+  }
+  struct timeval tv;
+  tv.tv_sec = (time_t)(utc_ms / 1000);
+  tv.tv_usec = (suseconds_t)(utc_ms % 1000) * 1000;
+  sntp_callback(&tv);
+}
+
+void host_pref_set(const char* key, const void* value, size_t length) {
+  const uint8_t* bytes = (const uint8_t*)value;
+  nvs[key].assign(bytes, bytes + length);
+}
+
+void host_set_fs_root(const char* path) {
+  fs_root = path;
+}
+
+// Time
+
+unsigned long millis() {
+  return (unsigned long)(host.now_us / 1000);
+}
+
+unsigned long micros() {
+  return (unsigned long)host.now_us;
+}
+
+void delay(unsigned long ms) {
+  host_advance((uint64_t)ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+  host_advance(us);
+}
+
+void yield() {
+  host_advance(1);
+}
+
+int64_t esp_timer_get_time() {
+  return (int64_t)host.now_us;
+}
+
+void sntp_set_time_sync_notification_cb(sntp_sync_time_cb_t callback) {
+  sntp_callback = callback;
+}
+
+void configTime(long gmt_offset_sec, int daylight_offset_sec, const char* server1,
+                const char* server2, const char* server3) {
+  // SNTP results come from the input via host_sntp_sync()
+  (void)gmt_offset_sec; (void)daylight_offset_sec;
+  (void)server1; (void)server2; (void)server3;
+}
+
+// Pins
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  (void)pin; (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t level) {
+  if (pin >= HOST_PINS || pin_level[pin] == level) {
+    return;
+  }
+  pin_level[pin] = level;
+  if (host.output != nullptr) {
+    host.output->pin(host.now_us, pin, level);
+  }
+}
+
+int digitalRead(uint8_t pin) {
+  // Costs time so that polling loops still move the clock forward
+  host_advance(host.costs.digital_read_us);
+  if (pin >= HOST_PINS) {
+    return LOW;
+  }
+  if (host.pressed_once[pin]) {
+    host.pressed_once[pin] = false;
+    return LOW;
+  }
+  return host.digital[pin];
+}
+
+uint16_t analogRead(uint8_t pin) {
+  host_advance(host.costs.analog_read_us);
+  return pin < HOST_PINS ? (uint16_t)host.analog[pin] : 0;
+}
+
+void tone(uint8_t pin, unsigned int frequency, unsigned long duration) {
+  (void)duration;
+  if (host.output != nullptr) {
+    host.output->tone(host.now_us, pin, frequency);
+  }
+}
+
+void noTone(uint8_t pin) {
+  tone(pin, 0);
+}
+
+static uint32_t random_state = 1;
+
+void randomSeed(unsigned long seed) {
+  random_state = seed != 0 ? (uint32_t)seed : 1;
+}
+
+long random(long max) {
+  if (max <= 0) {
+    return 0;
+  }
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return (long)(random_state % (uint32_t)max);
+}
+
+long random(long min, long max) {
+  return min >= max ? min : min + random(max - min);
+}
+
+// Serial and ESP
+
+size_t Print::printf(const char* format, ...) {
+  char buffer[256];
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  if (n < 0) {
+    return 0;
+  }
+  return write((const uint8_t*)buffer, std::min<size_t>(n, sizeof(buffer) - 1));
+}
+
+size_t HardwareSerial::write(const uint8_t* data, size_t length) {
+  if (host.output != nullptr) {
+    host.output->serial((const char*)data, length);
+  }
+  return length;
+}
+
+void EspClass::restart() {
+  host.stop = true;
+  host.stop_reason = "restart";
+  throw HostStop();
+}
+
+uint32_t EspClass::getCycleCount() {
+  return (uint32_t)(host.now_us * 240);
+}
+
+uint8_t* WiFiClass::macAddress(uint8_t* mac) {
+  memcpy(mac, host.mac, sizeof(host.mac));
+  return mac;
+}
+
+int esp_efuse_mac_get_default(uint8_t* mac) {
+  memcpy(mac, host.mac, sizeof(host.mac));
+  return 0;
+}
+
+// Peripherals
+
+void Adafruit_SSD1306::display() {
+  host_advance(host.costs.display_flush_us);
+}
+
+TempAndHumidity DHTesp::getTempAndHumidity() {
+  if (!has_reading || millis() - last_read >= (unsigned long)getMinimumSamplingPeriod()) {
+    host_advance(host.costs.dht_read_us);
+    cached.temperature = host.temperature;
+    cached.humidity = host.humidity;
+    last_read = millis();
+    has_reading = true;
+  }
+  return cached;
+}
+
+void Servo::write(int angle) {
+  angle = std::max(0, std::min(180, angle));
+  if (angle == last_angle) {
+    return;
+  }
+  last_angle = angle;
+  if (host.output != nullptr) {
+    host.output->servo(host.now_us, (uint8_t)attached_pin, angle);
+  }
+}
+
+// Preferences
+
+bool Preferences::isKey(const char* key) {
+  return nvs.count(key) != 0;
+}
+
+bool Preferences::remove(const char* key) {
+  return nvs.erase(key) != 0;
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t length) {
+  host_pref_set(key, value, length);
+  return length;
+}
+
+size_t Preferences::getBytes(const char* key, void* buffer, size_t max_length) {
+  std::map<std::string, std::vector<uint8_t> >::const_iterator it = nvs.find(key);
+  if (it == nvs.end() || it->second.size() > max_length) {
+    return 0;
+  }
+  memcpy(buffer, it->second.data(), it->second.size());
+  return it->second.size();
+}
+
+size_t Preferences::getString(const char* key, char* buffer, size_t max_length) {
+  size_t n = getBytes(key, buffer, max_length);
+  if (n == 0 || buffer[n - 1] != '\0') {
+    return 0;
+  }
+  return n;
+}
+
+String Preferences::getString(const char* key, String default_value) {
+  std::map<std::string, std::vector<uint8_t> >::const_iterator it = nvs.find(key);
+  if (it == nvs.end() || it->second.empty()) {
+    return default_value;
+  }
+  return String((const char*)it->second.data());
+}
+
+// PubSubClient
+
+bool PubSubClient::connect(const char* id) {
+  return connect(id, nullptr, nullptr, nullptr, 0, false, nullptr);
+}
+
+bool PubSubClient::connect(const char* id, const char* will_topic, uint8_t will_qos,
+                           bool will_retain, const char* will_message) {
+  return connect(id, nullptr, nullptr, will_topic, will_qos, will_retain, will_message);
+}
+
+bool PubSubClient::connect(const char* id, const char* user, const char* pass, const char* will_topic,
+                           uint8_t will_qos, bool will_retain, const char* will_message, bool clean_session) {
+  (void)user; (void)pass; (void)will_qos; (void)clean_session;
+  if (host.broker == nullptr || !host.broker->connect(id, will_topic, will_message, will_retain)) {
+    connection_state = MQTT_CONNECT_FAILED;
+    return false;
+  }
+  connection_state = MQTT_CONNECTED;
+  return true;
+}
+
+void PubSubClient::disconnect() {
+  if (host.broker != nullptr) {
+    host.broker->disconnect();
+  }
+  connection_state = MQTT_DISCONNECTED;
+}
+
+bool PubSubClient::connected() {
+  if (connection_state == MQTT_CONNECTED && (host.broker == nullptr || !host.broker->connected())) {
+    connection_state = MQTT_CONNECTION_LOST;
+  }
+  return connection_state == MQTT_CONNECTED;
+}
+
+int PubSubClient::state() {
+  return connection_state;
+}
+
+bool PubSubClient::subscribe(const char* topic) {
+  return connected() && host.broker->subscribe(topic);
+}
+
+bool PubSubClient::publish(const char* topic, const char* payload) {
+  return publish(topic, (const uint8_t*)payload, strlen(payload), false);
+}
+
+bool PubSubClient::publish(const char* topic, const char* payload, bool retained) {
+  return publish(topic, (const uint8_t*)payload, strlen(payload), retained);
+}
+
+bool PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int length) {
+  return publish(topic, payload, length, false);
+}
+
+bool PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained) {
+  if (!connected()) {
+    return false;
+  }
+  if (buffer_size < MQTT_MAX_HEADER_SIZE + 2 + strlen(topic) + length) {
+    return false;
+  }
+  return host.broker->publish(topic, payload, length, retained);
+}
+
+bool PubSubClient::loop() {
+  if (!connected()) {
+    return false;
+  }
+  host.broker->poll(callback);
+  return true;
+}
+
+// LittleFS
+
+static std::string fs_path(const char* path) {
+  return fs_root + path;
+}
+
+size_t File::write(const uint8_t* data, size_t length) {
+  return f != nullptr ? fwrite(data, 1, length, f) : 0;
+}
+
+int File::available() {
+  if (f == nullptr) {
+    return 0;
+  }
+  return (int)(size() - position());
+}
+
+int File::read() {
+  return f != nullptr ? fgetc(f) : -1;
+}
+
+size_t File::read(uint8_t* buffer, size_t length) {
+  return f != nullptr ? fread(buffer, 1, length, f) : 0;
+}
+
+bool File::seek(uint32_t position) {
+  return f != nullptr && fseek(f, position, SEEK_SET) == 0;
+}
+
+size_t File::position() {
+  return f != nullptr ? (size_t)ftell(f) : 0;
+}
+
+size_t File::size() {
+  if (f == nullptr) {
+    return 0;
+  }
+  long here = ftell(f);
+  fseek(f, 0, SEEK_END);
+  long end = ftell(f);
+  fseek(f, here, SEEK_SET);
+  return (size_t)end;
+}
+
+void File::flush() {
+  if (f != nullptr) {
+    fflush(f);
+  }
+}
+
+void File::close() {
+  if (f != nullptr) {
+    fclose(f);
+    f = nullptr;
+  }
+}
+
+File LittleFSFS::open(const char* path, const char* mode) {
+  std::string stdio_mode = std::string(mode) + "b";
+  return File(fopen(fs_path(path).c_str(), stdio_mode.c_str()));
+}
+
+bool LittleFSFS::exists(const char* path) {
+  FILE* f = fopen(fs_path(path).c_str(), "rb");
+  if (f == nullptr) {
+    return false;
+  }
+  fclose(f);
+  return true;
+}
+
+bool LittleFSFS::remove(const char* path) {
+  return ::remove(fs_path(path).c_str()) == 0;
+}
+
+bool LittleFSFS::rename(const char* from, const char* to) {
+  return ::rename(fs_path(from).c_str(), fs_path(to).c_str()) == 0;
+}
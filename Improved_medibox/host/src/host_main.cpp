@@ -0,0 +1,247 @@
+// Host entry point: runs the firmware's setup()/loop() on the virtual clock,
+// either against a recorded trace or live against a MQTT broker with
+// simulated hardware.
+//
+//   program --replay trace.bin [--out events.txt] [--tail-ms 10000]
+//   program --live --broker host[:port] [--mac 24:0a:c4:00:00:01]
+//           [--seed N] [--speed 1] [--run-s N] [--events] [--control]
+//
+// --events prints servo, tone and pin events to stdout as they happen;
+// --control takes sensor, button and network commands on stdin (see
+// ControlInput), both for tools/latency_bench.py.
+//
+// Common options: --fs dir (LittleFS root), --verbose (echo Serial),
+// --pref key=hex (preload an NVS key, e.g. alarms_on=01)
+
+#include <Arduino.h>
+
+#include <chrono>
+#include <signal.h>
+
+#include "host_live.h"
+#include "host_platform.h"
+#include "host_replay.h"
+
+void setup();
+void loop();
+
+static bool read_file(const char* path, std::vector<uint8_t>& data) {
+  FILE* f = fopen(path, "rb");
+  if (f == nullptr) {
+    return false;
+  }
+  uint8_t buffer[4096];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+    data.insert(data.end(), buffer, buffer + n);
+  }
+  fclose(f);
+  return true;
+}
+
+static bool parse_mac(const char* text, uint8_t* mac) {
+  unsigned int b[6];
+  if (sscanf(text, "%x:%x:%x:%x:%x:%x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != 6) {
+    return false;
+  }
+  for (int i = 0; i < 6; i++) {
+    mac[i] = (uint8_t)b[i];
+  }
+  return true;
+}
+
+// key=hex, the raw bytes of an NVS value
+static bool parse_pref(const char* text) {
+  const char* equals = strchr(text, '=');
+  if (equals == nullptr || equals == text || strlen(equals + 1) % 2 != 0) {
+    return false;
+  }
+  std::vector<uint8_t> value;
+  for (const char* p = equals + 1; *p != '\0'; p += 2) {
+    unsigned int byte;
+    if (!isxdigit((unsigned char)p[0]) || !isxdigit((unsigned char)p[1]) || sscanf(p, "%2x", &byte) != 1) {
+      return false;
+    }
+    value.push_back((uint8_t)byte);
+  }
+  host_pref_set(std::string(text, equals - text).c_str(), value.data(), value.size());
+  return true;
+}
+
+static void usage() {
+  fprintf(stderr,
+          "usage: program --replay trace.bin [--out events.txt] [--tail-ms N] [--fs dir] [--verbose]\n"
+          "       program --live --broker host[:port] [--mac aa:bb:cc:dd:ee:ff] [--seed N]\n"
+          "               [--speed X] [--run-s N] [--events] [--control] [--fs dir] [--verbose]\n"
+          "       --pref key=hex (repeatable) preloads NVS\n");
+}
+
+// SIGINT/SIGTERM end a live run at the next clock step
+static void on_signal(int signal_number) {
+  (void)signal_number;
+  host.end_us = 0;
+}
+
+// Run until the clock reaches host.end_us or the firmware restarts
+static double run_firmware() {
+  std::chrono::steady_clock::time_point wall_start = std::chrono::steady_clock::now();
+  try {
+    setup();
+    while (true) {
+      loop();
+    }
+  } catch (const HostStop&) {
+  }
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+}
+
+static int replay(const char* trace_path, const char* out_path, uint64_t tail_ms, bool verbose) {
+  std::vector<uint8_t> trace;
+  if (!read_file(trace_path, trace)) {
+    fprintf(stderr, "cannot read %s\n", trace_path);
+    return 1;
+  }
+
+  FILE* out = stdout;
+  if (out_path != nullptr && (out = fopen(out_path, "w")) == nullptr) {
+    fprintf(stderr, "cannot write %s\n", out_path);
+    return 1;
+  }
+
+  TextOutput output(out, verbose);
+  ReplayBroker broker;
+  ReplayInput input(trace, broker);
+  if (!input.valid()) {
+    fprintf(stderr, "%s is not a trace\n", trace_path);
+    return 1;
+  }
+
+  host.output = &output;
+  host.broker = &broker;
+  host.input = &input;
+  input.preload();
+  host.end_us = input.endUs() + tail_ms * 1000;
+
+  double wall_s = run_firmware();
+  double virtual_s = host.now_us / 1e6;
+  fflush(out);
+  fprintf(stderr, "replayed %zu events, %.1f s virtual in %.3f s (%.0fx), stopped: %s%s\n",
+          input.events(), virtual_s, wall_s, wall_s > 0 ? virtual_s / wall_s : 0.0,
+          host.stop_reason.c_str(), input.corrupt() ? " (trace truncated)" : "");
+  if (out != stdout) {
+    fclose(out);
+  }
+  return 0;
+}
+
+static int live(const char* broker_address, uint32_t seed, double run_s, bool verbose, bool events,
+                bool control) {
+  std::string broker_host = broker_address;
+  uint16_t port = 1883;
+  size_t colon = broker_host.rfind(':');
+  if (colon != std::string::npos) {
+    port = (uint16_t)atoi(broker_host.c_str() + colon + 1);
+    broker_host.resize(colon);
+  }
+
+  // Publishes go to the broker; the log only keeps Serial for --verbose,
+  // and the pin events for --events
+  if (events) {
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+  }
+  TextOutput output(events ? stdout : fopen("/dev/null", "w"), verbose);
+  SocketBroker broker(broker_host, port);
+  SimInput sim_input(seed);
+  ControlInput control_input(seed, broker);
+  randomSeed(seed);
+  host.output = &output;
+  host.broker = &broker;
+  host.input = control ? (HostInput*)&control_input : &sim_input;
+  if (run_s > 0) {
+    host.end_us = (uint64_t)(run_s * 1e6);
+  }
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  double wall_s = run_firmware();
+
+  // One JSON line per device, collected by tools/fleet_sim.py
+  const LiveStats& stats = broker.stats();
+  printf("{\"mac\": \"%02x:%02x:%02x:%02x:%02x:%02x\", \"virtual_s\": %.1f, \"wall_s\": %.1f, "
+         "\"connects\": %lu, \"connect_failures\": %lu, \"disconnects\": %lu, "
+         "\"published\": %lu, \"publish_bytes\": %lu, \"received\": %lu, \"stopped\": \"%s\"}\n",
+         host.mac[0], host.mac[1], host.mac[2], host.mac[3], host.mac[4], host.mac[5],
+         host.now_us / 1e6, wall_s, stats.connects, stats.connect_failures, stats.disconnects,
+         stats.published, stats.publish_bytes, stats.received, host.stop_reason.c_str());
+  fflush(stdout);
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  const char* trace_path = nullptr;
+  const char* out_path = nullptr;
+  const char* broker_address = nullptr;
+  bool live_mode = false;
+  uint64_t tail_ms = 10000;
+  uint32_t seed = 1;
+  double run_s = 0;
+  bool verbose = false;
+  bool events = false;
+  bool control = false;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--replay" && i + 1 < argc) {
+      trace_path = argv[++i];
+    } else if (arg == "--out" && i + 1 < argc) {
+      out_path = argv[++i];
+    } else if (arg == "--tail-ms" && i + 1 < argc) {
+      tail_ms = strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--live") {
+      live_mode = true;
+    } else if (arg == "--broker" && i + 1 < argc) {
+      broker_address = argv[++i];
+    } else if (arg == "--mac" && i + 1 < argc) {
+      if (!parse_mac(argv[++i], host.mac)) {
+        usage();
+        return 2;
+      }
+    } else if (arg == "--seed" && i + 1 < argc) {
+      seed = strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--speed" && i + 1 < argc) {
+      host.speed = atof(argv[++i]);
+    } else if (arg == "--run-s" && i + 1 < argc) {
+      run_s = atof(argv[++i]);
+    } else if (arg == "--fs" && i + 1 < argc) {
+      host_set_fs_root(argv[++i]);
+    } else if (arg == "--verbose") {
+      verbose = true;
+    } else if (arg == "--events") {
+      events = true;
+    } else if (arg == "--control") {
+      control = true;
+    } else if (arg == "--pref" && i + 1 < argc) {
+      if (!parse_pref(argv[++i])) {
+        usage();
+        return 2;
+      }
+    } else {
+      usage();
+      return 2;
+    }
+  }
+
+  if (trace_path != nullptr && !live_mode) {
+    return replay(trace_path, out_path, tail_ms, verbose);
+  }
+  if (live_mode && broker_address != nullptr && trace_path == nullptr) {
+    // Live runs keep pace with the broker unless told otherwise
+    if (host.speed == 0) {
+      host.speed = 1;
+    }
+    return live(broker_address, seed, run_s, verbose, events, control);
+  }
+  usage();
+  return 2;
+}
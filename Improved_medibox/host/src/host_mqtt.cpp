@@ -0,0 +1,245 @@
+#include "host_live.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define MQTT_CONNECT 0x10
+#define MQTT_CONNACK 0x20
+#define MQTT_PUBLISH 0x30
+#define MQTT_SUBSCRIBE 0x82
+#define MQTT_PINGREQ 0xc0
+#define MQTT_DISCONNECT 0xe0
+
+#define CONNECT_TIMEOUT_MS 2000
+
+static void put_length(std::vector<uint8_t>& packet, size_t length) {
+  do {
+    uint8_t b = length % 128;
+    length /= 128;
+    packet.push_back(length > 0 ? b | 0x80 : b);
+  } while (length > 0);
+}
+
+static void put_string(std::vector<uint8_t>& body, const char* text, size_t length) {
+  body.push_back(length >> 8);
+  body.push_back(length & 0xff);
+  body.insert(body.end(), text, text + length);
+}
+
+static void put_string(std::vector<uint8_t>& body, const char* text) {
+  put_string(body, text, strlen(text));
+}
+
+static std::vector<uint8_t> packet(uint8_t type, const std::vector<uint8_t>& body) {
+  std::vector<uint8_t> out;
+  out.push_back(type);
+  put_length(out, body.size());
+  out.insert(out.end(), body.begin(), body.end());
+  return out;
+}
+
+// Length of the first complete packet in 'buffer', 0 if incomplete
+static size_t complete_packet(const std::vector<uint8_t>& buffer, size_t& header_length, size_t& body_length) {
+  body_length = 0;
+  size_t multiplier = 1;
+  for (size_t i = 1; i < buffer.size() && i <= 4; i++) {
+    body_length += (buffer[i] & 0x7f) * multiplier;
+    multiplier *= 128;
+    if ((buffer[i] & 0x80) == 0) {
+      header_length = i + 1;
+      return buffer.size() >= header_length + body_length ? header_length + body_length : 0;
+    }
+  }
+  return 0;
+}
+
+SocketBroker::SocketBroker(const std::string& name, uint16_t broker_port, uint16_t keep_alive)
+    : host_name(name), port(broker_port), keep_alive_s(keep_alive), fd(-1), next_packet_id(1) {
+}
+
+SocketBroker::~SocketBroker() {
+  disconnect();
+}
+
+void SocketBroker::drop() {
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+    counters.disconnects++;
+  }
+  rx.clear();
+}
+
+bool SocketBroker::send(const std::vector<uint8_t>& data) {
+  size_t sent = 0;
+  while (fd >= 0 && sent < data.size()) {
+    ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (n > 0) {
+      sent += n;
+    } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      struct pollfd p = {fd, POLLOUT, 0};
+      ::poll(&p, 1, 100);
+    } else {
+      drop();
+      return false;
+    }
+  }
+  last_send = std::chrono::steady_clock::now();
+  return fd >= 0;
+}
+
+bool SocketBroker::connect(const char* client_id, const char* will_topic, const char* will_message, bool will_retain) {
+  disconnect();
+
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo* addresses;
+  char port_text[8];
+  snprintf(port_text, sizeof(port_text), "%u", port);
+  if (getaddrinfo(host_name.c_str(), port_text, &hints, &addresses) != 0) {
+    counters.connect_failures++;
+    return false;
+  }
+  for (struct addrinfo* a = addresses; a != nullptr && fd < 0; a = a->ai_next) {
+    fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+    if (fd >= 0 && ::connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(addresses);
+  if (fd < 0) {
+    counters.connect_failures++;
+    return false;
+  }
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  std::vector<uint8_t> body;
+  put_string(body, "MQTT");
+  body.push_back(4);   // protocol level 3.1.1
+  uint8_t flags = 0x02;   // clean session
+  if (will_topic != nullptr && will_message != nullptr) {
+    flags |= 0x04 | (will_retain ? 0x20 : 0);
+  }
+  body.push_back(flags);
+  body.push_back(keep_alive_s >> 8);
+  body.push_back(keep_alive_s & 0xff);
+  put_string(body, client_id);
+  if (flags & 0x04) {
+    put_string(body, will_topic);
+    put_string(body, will_message);
+  }
+
+  // CONNACK is awaited with a blocking read, like PubSubClient does
+  if (!send(packet(MQTT_CONNECT, body))) {
+    counters.connect_failures++;
+    return false;
+  }
+  uint8_t connack[4];
+  size_t got = 0;
+  while (got < sizeof(connack)) {
+    struct pollfd p = {fd, POLLIN, 0};
+    ssize_t n = 0;
+    if (::poll(&p, 1, CONNECT_TIMEOUT_MS) <= 0 || (n = recv(fd, connack + got, sizeof(connack) - got, 0)) <= 0) {
+      close(fd);
+      fd = -1;
+      counters.connect_failures++;
+      return false;
+    }
+    got += n;
+  }
+  if (connack[0] != MQTT_CONNACK || connack[3] != 0) {
+    close(fd);
+    fd = -1;
+    counters.connect_failures++;
+    return false;
+  }
+
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  counters.connects++;
+  return true;
+}
+
+void SocketBroker::disconnect() {
+  if (fd >= 0) {
+    send(packet(MQTT_DISCONNECT, std::vector<uint8_t>()));
+    close(fd);
+    fd = -1;
+  }
+  rx.clear();
+}
+
+bool SocketBroker::subscribe(const char* topic) {
+  std::vector<uint8_t> body;
+  body.push_back(next_packet_id >> 8);
+  body.push_back(next_packet_id & 0xff);
+  next_packet_id = next_packet_id == 0xffff ? 1 : next_packet_id + 1;
+  put_string(body, topic);
+  body.push_back(0);   // QoS 0
+  return send(packet(MQTT_SUBSCRIBE, body));
+}
+
+bool SocketBroker::publish(const char* topic, const uint8_t* payload, size_t length, bool retained) {
+  std::vector<uint8_t> body;
+  put_string(body, topic);
+  body.insert(body.end(), payload, payload + length);
+  if (!send(packet(MQTT_PUBLISH | (retained ? 1 : 0), body))) {
+    return false;
+  }
+  counters.published++;
+  counters.publish_bytes += length;
+  return true;
+}
+
+void SocketBroker::poll(const Callback& callback) {
+  if (fd < 0) {
+    return;
+  }
+
+  uint8_t buffer[4096];
+  ssize_t n;
+  while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+    rx.insert(rx.end(), buffer, buffer + n);
+  }
+  if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+    drop();
+    return;
+  }
+
+  size_t header_length, body_length, total;
+  while ((total = complete_packet(rx, header_length, body_length)) > 0) {
+    if ((rx[0] & 0xf0) == MQTT_PUBLISH && body_length >= 2) {
+      const uint8_t* body = rx.data() + header_length;
+      size_t topic_length = (body[0] << 8) | body[1];
+      size_t skip = 2 + topic_length + (((rx[0] >> 1) & 3) > 0 ? 2 : 0);
+      if (skip <= body_length) {
+        std::vector<char> topic(body + 2, body + 2 + topic_length);
+        topic.push_back('\0');
+        std::vector<uint8_t> payload(body + skip, body + body_length);
+        payload.push_back(0);
+        counters.received++;
+        if (callback) {
+          callback(topic.data(), payload.data(), payload.size() - 1);
+        }
+      }
+    }
+    rx.erase(rx.begin(), rx.begin() + total);
+    if (fd < 0) {
+      return;   // the callback disconnected
+    }
+  }
+
+  if (std::chrono::steady_clock::now() - last_send >= std::chrono::seconds(keep_alive_s / 2)) {
+    send(packet(MQTT_PINGREQ, std::vector<uint8_t>()));
+  }
+}
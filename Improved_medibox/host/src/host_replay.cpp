@@ -0,0 +1,166 @@
+#include "host_replay.h"
+
+#include <math.h>
+
+static void print_ms(FILE* out, uint64_t t_us) {
+  fprintf(out, "%llu.%03llu", (unsigned long long)(t_us / 1000000),
+          (unsigned long long)(t_us / 1000 % 1000));
+}
+
+TextOutput::TextOutput(FILE* output, bool echo) : out(output), echo_serial(echo) {
+  for (int i = 0; i < HOST_PINS; i++) {
+    last_tone[i] = 0;
+  }
+}
+
+void TextOutput::publish(uint64_t t_us, const char* topic, const uint8_t* payload, size_t length, bool retained) {
+  bool printable = true;
+  for (size_t i = 0; i < length; i++) {
+    if (payload[i] < 0x20 || payload[i] > 0x7e) {
+      printable = false;
+      break;
+    }
+  }
+
+  print_ms(out, t_us);
+  fprintf(out, " publish%s %s ", retained ? "-retained" : "", topic);
+  if (printable) {
+    fwrite(payload, 1, length, out);
+  } else {
+    fputs("0x", out);
+    for (size_t i = 0; i < length; i++) {
+      fprintf(out, "%02x", payload[i]);
+    }
+  }
+  fputc('\n', out);
+}
+
+void TextOutput::servo(uint64_t t_us, uint8_t pin, int angle) {
+  print_ms(out, t_us);
+  fprintf(out, " servo %u %d\n", pin, angle);
+}
+
+void TextOutput::tone(uint64_t t_us, uint8_t pin, unsigned int frequency) {
+  if (pin < HOST_PINS) {
+    if (last_tone[pin] == frequency) {
+      return;
+    }
+    last_tone[pin] = frequency;
+  }
+  print_ms(out, t_us);
+  fprintf(out, " tone %u %u\n", pin, frequency);
+}
+
+void TextOutput::pin(uint64_t t_us, uint8_t pin, int level) {
+  print_ms(out, t_us);
+  fprintf(out, " pin %u %d\n", pin, level);
+}
+
+void TextOutput::serial(const char* text, size_t length) {
+  if (echo_serial) {
+    fwrite(text, 1, length, stderr);
+  }
+}
+
+bool ReplayBroker::connect(const char* client_id, const char* will_topic, const char* will_message, bool will_retain) {
+  (void)client_id; (void)will_topic; (void)will_message; (void)will_retain;
+  is_connected = true;
+  return true;
+}
+
+bool ReplayBroker::subscribe(const char* topic) {
+  subscriptions.insert(topic);
+  return true;
+}
+
+bool ReplayBroker::publish(const char* topic, const uint8_t* payload, size_t length, bool retained) {
+  if (host.output != nullptr) {
+    host.output->publish(host.now_us, topic, payload, length, retained);
+  }
+  return true;
+}
+
+void ReplayBroker::deliver(const char* topic, const uint8_t* payload, size_t length) {
+  HostMessage message;
+  message.topic = topic;
+  message.payload.assign(payload, payload + length);
+  inbox.push_back(message);
+}
+
+void ReplayBroker::poll(const Callback& callback) {
+  // Recorded messages were received by the device, so they bypass the
+  // subscription check
+  while (!inbox.empty() && callback) {
+    HostMessage message = inbox.front();
+    inbox.pop_front();
+    std::vector<char> topic(message.topic.begin(), message.topic.end());
+    topic.push_back('\0');
+    message.payload.push_back(0);   // callers may not read past length, but some do
+    callback(topic.data(), message.payload.data(), message.payload.size() - 1);
+  }
+}
+
+ReplayInput::ReplayInput(std::vector<uint8_t> trace, ReplayBroker& replay_broker)
+    : data(trace), reader(data.data(), data.size()), broker(replay_broker),
+      has_pending(false), applied(0), end_us(0) {
+  TraceReader scan(data.data(), data.size());
+  TraceRecord record;
+  while (scan.next(record)) {
+    end_us = record.t_ms * 1000;
+  }
+  advance();
+}
+
+void ReplayInput::advance() {
+  has_pending = reader.next(pending);
+}
+
+void ReplayInput::preload() {
+  while (has_pending && pending.type == TRACE_PREF) {
+    host_pref_set(pending.key, pending.payload, pending.payload_length);
+    applied++;
+    advance();
+  }
+}
+
+void ReplayInput::apply(const TraceRecord& record, uint64_t now_us) {
+  switch (record.type) {
+    case TRACE_ANALOG:
+      if (record.pin < HOST_PINS) host.analog[record.pin] = record.value;
+      break;
+    case TRACE_DIGITAL:
+      if (record.pin < HOST_PINS) host.digital[record.pin] = record.level ? 1 : 0;
+      break;
+    case TRACE_DHT:
+      host.temperature = record.temperature;
+      host.humidity = record.humidity;
+      break;
+    case TRACE_MQTT:
+      broker.deliver(record.topic, record.payload, record.payload_length);
+      break;
+    case TRACE_SNTP:
+      // The record pins UTC to its timestamp; keep that pairing when the
+      // emulated clock has already moved past it
+      host_sntp_sync(record.utc_ms + (int64_t)(now_us / 1000 - record.t_ms));
+      break;
+    default:
+      // NVS writes after boot are the firmware's own doing
+      break;
+  }
+}
+
+void ReplayInput::pump(uint64_t now_us) {
+  // apply() can call back into the firmware, which may advance the clock
+  // and re-enter pump(); the record is consumed before it is applied
+  while (has_pending && pending.t_ms * 1000 <= now_us) {
+    TraceRecord record = pending;
+    advance();
+    applied++;
+    apply(record, now_us);
+  }
+}
+
+bool ReplayInput::finished(uint64_t now_us) const {
+  (void)now_us;
+  return !has_pending;
+}
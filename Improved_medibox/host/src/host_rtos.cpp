@@ -0,0 +1,305 @@
+// Emulated esp_timer and FreeRTOS tasks, queues and mutexes (see
+// freertos/FreeRTOS.h for the threading model)
+
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "host_platform.h"
+
+struct host_timer {
+  esp_timer_cb_t callback;
+  void* arg;
+  bool armed;
+  uint64_t period_us;   // 0 for one-shot
+  uint64_t next_us;
+};
+
+struct host_queue {
+  size_t item_size;
+  size_t length;
+  std::deque<std::vector<uint8_t> > items;
+};
+
+struct host_task {
+  TaskFunction_t function;
+  void* arg;
+  host_queue* waiting_on;
+  host_semaphore* waiting_for;   // a mutex the loop holds
+  bool done;
+};
+
+struct host_semaphore {
+  bool held;
+  host_task* holder;
+};
+
+static std::vector<host_timer*> timers;
+static std::vector<host_task*> tasks;
+
+// Whoever holds the baton runs; nullptr is the loop thread. Never
+// destroyed: tasks are still waiting on them when the process exits, and
+// destroying a condition variable with waiters blocks forever.
+static std::mutex& baton_mutex = *new std::mutex;
+static std::condition_variable& baton_cv = *new std::condition_variable;
+static host_task* running = nullptr;
+static thread_local host_task* self = nullptr;
+
+// Timers
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* out_handle) {
+  if (args == nullptr || args->callback == nullptr || out_handle == nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  host_timer* timer = new host_timer();
+  timer->callback = args->callback;
+  timer->arg = args->arg;
+  timer->armed = false;
+  timers.push_back(timer);
+  *out_handle = timer;
+  return ESP_OK;
+}
+
+static esp_err_t start_timer(esp_timer_handle_t timer, uint64_t first_us, uint64_t period_us) {
+  if (timer->armed) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  timer->armed = true;
+  timer->period_us = period_us;
+  timer->next_us = host.now_us + first_us;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us) {
+  return start_timer(timer, period_us, period_us > 0 ? period_us : 1);
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+  return start_timer(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+  if (!timer->armed) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  timer->armed = false;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+  if (timer->armed) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  for (size_t i = 0; i < timers.size(); i++) {
+    if (timers[i] == timer) {
+      timers.erase(timers.begin() + i);
+      break;
+    }
+  }
+  delete timer;
+  return ESP_OK;
+}
+
+uint64_t host_timer_deadline() {
+  uint64_t deadline = UINT64_MAX;
+  for (size_t i = 0; i < timers.size(); i++) {
+    if (timers[i]->armed && timers[i]->next_us < deadline) {
+      deadline = timers[i]->next_us;
+    }
+  }
+  return deadline;
+}
+
+void host_timer_fire() {
+  // Indexed: a callback may run a task that restarts timers
+  for (size_t i = 0; i < timers.size(); i++) {
+    host_timer* timer = timers[i];
+    if (!timer->armed || timer->next_us > host.now_us) {
+      continue;
+    }
+    if (timer->period_us > 0) {
+      timer->next_us += timer->period_us;
+    } else {
+      timer->armed = false;
+    }
+    timer->callback(timer->arg);
+  }
+}
+
+// Tasks
+
+// Loop side: let 'task' run until it blocks again
+static void run_task(host_task* task) {
+  std::unique_lock<std::mutex> lock(baton_mutex);
+  running = task;
+  baton_cv.notify_all();
+  baton_cv.wait(lock, [] { return running == nullptr; });
+  lock.unlock();
+  // The run ended inside the task
+  if (host.stop) {
+    throw HostStop();
+  }
+}
+
+// Task side: give the baton back to the loop and wait to be run again
+static void block_task() {
+  std::unique_lock<std::mutex> lock(baton_mutex);
+  running = nullptr;
+  baton_cv.notify_all();
+  baton_cv.wait(lock, [] { return running == self; });
+}
+
+static void task_main(host_task* task) {
+  self = task;
+  {
+    std::unique_lock<std::mutex> lock(baton_mutex);
+    baton_cv.wait(lock, [task] { return running == task; });
+  }
+  try {
+    task->function(task->arg);
+  } catch (const HostStop&) {
+  }
+  task->done = true;
+  std::unique_lock<std::mutex> lock(baton_mutex);
+  running = nullptr;
+  baton_cv.notify_all();
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_depth,
+                                   void* arg, UBaseType_t priority, TaskHandle_t* created, BaseType_t core) {
+  (void)name; (void)stack_depth; (void)priority; (void)core;
+  if (self != nullptr) {
+    fprintf(stderr, "host: tasks can only be created from setup()/loop()\n");
+    abort();
+  }
+  host_task* task = new host_task();
+  task->function = function;
+  task->arg = arg;
+  task->waiting_on = nullptr;
+  task->waiting_for = nullptr;
+  task->done = false;
+  tasks.push_back(task);
+  // Left blocked at exit like a task at power-off
+  std::thread(task_main, task).detach();
+  if (created != nullptr) {
+    *created = task;
+  }
+  // Runs up to its first block, as a higher priority task would
+  run_task(task);
+  return pdPASS;
+}
+
+static bool task_ready(const host_task* task) {
+  if (task->done) {
+    return false;
+  }
+  if (task->waiting_for != nullptr) {
+    return !task->waiting_for->held;
+  }
+  return task->waiting_on != nullptr && !task->waiting_on->items.empty();
+}
+
+void host_rtos_dispatch() {
+  if (self != nullptr) {
+    return;
+  }
+  bool ran = true;
+  while (ran) {
+    ran = false;
+    for (size_t i = 0; i < tasks.size(); i++) {
+      host_task* task = tasks[i];
+      if (task_ready(task)) {
+        run_task(task);
+        ran = true;
+      }
+    }
+  }
+}
+
+// Queues
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+  host_queue* queue = new host_queue();
+  queue->length = length;
+  queue->item_size = item_size;
+  return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t wait) {
+  (void)wait;
+  if (queue->items.size() >= queue->length) {
+    return errQUEUE_FULL;
+  }
+  const uint8_t* bytes = (const uint8_t*)item;
+  queue->items.push_back(std::vector<uint8_t>(bytes, bytes + queue->item_size));
+  host_rtos_dispatch();
+  return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t wait) {
+  while (queue->items.empty()) {
+    if (wait == 0 || self == nullptr) {
+      return pdFALSE;
+    }
+    self->waiting_on = queue;
+    block_task();
+    self->waiting_on = nullptr;
+  }
+  memcpy(item, queue->items.front().data(), queue->item_size);
+  queue->items.pop_front();
+  return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+  return queue->items.size();
+}
+
+// Mutexes
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+  host_semaphore* semaphore = new host_semaphore();
+  semaphore->held = false;
+  semaphore->holder = nullptr;
+  return semaphore;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t wait) {
+  (void)wait;
+  // A task can find a mutex held by the loop, which moved the clock while
+  // holding it, and waits for it to be given. Any other contention cannot
+  // resolve with one thread running at a time: a firmware bug (e.g. a
+  // recursive take) or a deadlock.
+  if (semaphore->held && self != nullptr && semaphore->holder == nullptr) {
+    self->waiting_for = semaphore;
+    while (semaphore->held) {
+      block_task();
+    }
+    self->waiting_for = nullptr;
+  }
+  if (semaphore->held) {
+    fprintf(stderr, "host: mutex taken twice\n");
+    abort();
+  }
+  semaphore->held = true;
+  semaphore->holder = self;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+  if (!semaphore->held) {
+    return pdFALSE;
+  }
+  semaphore->held = false;
+  semaphore->holder = nullptr;
+  host_rtos_dispatch();
+  return pdTRUE;
+}
@@ -0,0 +1,114 @@
+#include "host_live.h"
+
+#include <Arduino.h>
+
+#include <math.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+// Wiring of the board in diagram.json
+#define SIM_LDR_PIN 36
+
+#define SIM_UPDATE_US 1000000
+#define SIM_SNTP_AFTER_US 3000000
+
+// How often ControlInput looks at stdin
+#define CONTROL_POLL_US 1000
+
+SimInput::SimInput(uint32_t seed)
+    : rng(seed != 0 ? seed : 1), next_update_us(0), synced(false) {
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  boot_utc_ms = (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+// xorshift32, uniform in [-1, 1)
+float SimInput::noise() {
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return (rng >> 8) / 8388608.0f - 1.0f;
+}
+
+void SimInput::pump(uint64_t now_us) {
+  if (!synced && now_us >= SIM_SNTP_AFTER_US) {
+    synced = true;
+    host_sntp_sync(boot_utc_ms + (int64_t)(now_us / 1000));
+  }
+
+  if (now_us < next_update_us) {
+    return;
+  }
+  next_update_us = now_us + SIM_UPDATE_US;
+
+  // Light and temperature peak mid-afternoon of the device's local day
+  double day = fmod((boot_utc_ms + now_us / 1000.0) / 86400000.0, 1.0);
+  double sun = sin(2 * M_PI * (day - 0.25));
+  host.analog[SIM_LDR_PIN] = (int)std::max(0.0, std::min(4095.0, 2000 + 1800 * sun + 100 * noise()));
+  host.temperature = (float)(28 + 4 * sun + 0.3 * noise());
+  host.humidity = (float)(72 - 6 * sun + 1.0 * noise());
+}
+
+ControlInput::ControlInput(uint32_t seed, SocketBroker& control_broker)
+    : sim(seed), broker(control_broker), next_poll_us(0), stdin_open(true) {
+  for (int i = 0; i < HOST_PINS; i++) {
+    held[i] = -1;
+  }
+}
+
+void ControlInput::pump(uint64_t now_us) {
+  sim.pump(now_us);
+
+  if (stdin_open && now_us >= next_poll_us) {
+    next_poll_us = now_us + CONTROL_POLL_US;
+    struct pollfd p = {STDIN_FILENO, POLLIN, 0};
+    while (stdin_open && ::poll(&p, 1, 0) > 0) {
+      char buffer[256];
+      ssize_t n = read(STDIN_FILENO, buffer, sizeof(buffer));
+      if (n <= 0) {
+        stdin_open = false;
+      } else {
+        pending.append(buffer, n);
+      }
+    }
+    size_t end;
+    while ((end = pending.find('\n')) != std::string::npos) {
+      command(pending.substr(0, end));
+      pending.erase(0, end + 1);
+    }
+  }
+
+  // Held pins win over the simulation's updates
+  for (int i = 0; i < HOST_PINS; i++) {
+    if (held[i] >= 0) {
+      host.analog[i] = held[i];
+    }
+  }
+}
+
+void ControlInput::command(const std::string& line) {
+  char verb[16];
+  char value[16];
+  unsigned int pin;
+  if (sscanf(line.c_str(), "%15s %u %15s", verb, &pin, value) == 3 && pin < HOST_PINS) {
+    if (strcmp(verb, "analog") == 0) {
+      held[pin] = strcmp(value, "off") == 0 ? -1 : std::max(0, std::min(4095, atoi(value)));
+      return;
+    }
+    if (strcmp(verb, "digital") == 0) {
+      host.digital[pin] = atoi(value) != 0 ? HIGH : LOW;
+      return;
+    }
+  }
+  if (sscanf(line.c_str(), "press %u", &pin) == 1 && pin < HOST_PINS) {
+    host.pressed_once[pin] = true;
+    return;
+  }
+  if (line == "drop") {
+    broker.drop();
+    return;
+  }
+  fprintf(stderr, "control: ignored '%s'\n", line.c_str());
+}
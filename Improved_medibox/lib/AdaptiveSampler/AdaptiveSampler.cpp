@@ -0,0 +1,60 @@
+#include "AdaptiveSampler.h"
+
+#include <math.h>
+
+// Calm samples before the interval doubles
+#define CALM_SAMPLES 4
+// Weight of a new step in the running variance
+#define VARIANCE_WEIGHT 0.25f
+
+AdaptiveSampler::AdaptiveSampler()
+    : adaptive_mode(false), fixed_ms(5000), min_ms(5000), max_ms(5000), threshold(0),
+      current(5000), count(0), have_previous(false), previous(0), variance(0), calm(0) {
+}
+
+void AdaptiveSampler::setFixed(uint32_t interval_ms) {
+  fixed_ms = interval_ms > 0 ? interval_ms : 1;
+  if (!adaptive_mode) {
+    current = fixed_ms;
+  }
+}
+
+void AdaptiveSampler::setAdaptive(uint32_t new_min_ms, uint32_t new_max_ms, float new_threshold) {
+  if (new_min_ms == 0 || new_max_ms < new_min_ms || !(new_threshold > 0)) {
+    // Anything else turns adaptive sampling off
+    adaptive_mode = false;
+    current = fixed_ms;
+    return;
+  }
+  adaptive_mode = true;
+  min_ms = new_min_ms;
+  max_ms = new_max_ms;
+  threshold = new_threshold;
+  current = min_ms;
+  calm = 0;
+}
+
+void AdaptiveSampler::add(float value) {
+  count++;
+  if (isnan(value)) {
+    return;
+  }
+  float step = have_previous ? value - previous : 0;
+  have_previous = true;
+  previous = value;
+  variance += VARIANCE_WEIGHT * (step * step - variance);
+
+  if (!adaptive_mode) {
+    return;
+  }
+
+  // Half the threshold as a standard deviation means a fluctuating signal
+  if (fabsf(step) > threshold || variance > threshold * threshold / 4) {
+    current = min_ms;
+    calm = 0;
+  }
+  else if (++calm >= CALM_SAMPLES) {
+    calm = 0;
+    current = current > max_ms / 2 ? max_ms : current * 2;
+  }
+}
@@ -0,0 +1,47 @@
+#ifndef ADAPTIVE_SAMPLER_H
+#define ADAPTIVE_SAMPLER_H
+
+#include <stdint.h>
+
+// Sampling interval of one sensor channel.
+//
+// In fixed mode the channel samples at one interval. In adaptive mode it
+// starts fast and backs off, doubling the interval after every few calm
+// samples up to a maximum. It drops back to the minimum as soon as a sample
+// steps by more than the threshold from the previous one, or the running
+// variance of sample-to-sample changes shows the signal is moving. A box
+// that sits closed all day is then read a few times an hour, while opening
+// it is followed at full rate.
+
+class AdaptiveSampler {
+public:
+  AdaptiveSampler();
+
+  void setFixed(uint32_t interval_ms);
+  // Bounds in ms and the step (in sensor units) that counts as change
+  void setAdaptive(uint32_t min_ms, uint32_t max_ms, float threshold);
+  bool adaptive() const { return adaptive_mode; }
+
+  uint32_t interval() const { return current; }
+
+  // Feed a reading taken now; NaN (failed read) leaves the rate alone
+  void add(float value);
+
+  uint32_t samples() const { return count; }
+
+private:
+  bool adaptive_mode;
+  uint32_t fixed_ms;
+  uint32_t min_ms;
+  uint32_t max_ms;
+  float threshold;
+
+  uint32_t current;
+  uint32_t count;
+  bool have_previous;
+  float previous;
+  float variance;    // exponentially weighted, of sample-to-sample steps
+  uint8_t calm;      // calm samples at the current interval
+};
+
+#endif
@@ -0,0 +1,229 @@
+#include "AdherenceLog.h"
+
+#define MAX_RECORD 16
+#define TEMP_SUFFIX ".tmp"
+
+static size_t put_varint(uint8_t* out, uint32_t value) {
+  size_t n = 0;
+  while (value >= 0x80) {
+    out[n++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  out[n++] = (uint8_t)value;
+  return n;
+}
+
+static bool get_varint(const uint8_t* in, size_t length, size_t& pos, uint32_t& value) {
+  value = 0;
+  for (int shift = 0; shift < 35 && pos < length; shift += 7) {
+    uint8_t b = in[pos++];
+    value |= (uint32_t)(b & 0x7f) << shift;
+    if ((b & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void temp_name(const char* path, char* out, size_t size) {
+  snprintf(out, size, "%s%s", path, TEMP_SUFFIX);
+}
+
+// Frame a record; 'previous' is the scheduled minute it is encoded against
+static size_t encode(const DoseRecord& record, uint32_t previous, uint8_t* out) {
+  uint32_t minute = record.scheduled / 60;
+  int32_t delta = (int32_t)(minute - previous);
+  size_t n = 1;
+  n += put_varint(out + n, ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+  out[n++] = (uint8_t)((record.alarm << 4) | (record.outcome & 0x0f));
+  n += put_varint(out + n, record.snoozes);
+  n += put_varint(out + n, record.delay);
+  out[0] = (uint8_t)(n - 1);
+  return n;
+}
+
+AdherenceReader::AdherenceReader() : previous(0), good(0) {
+}
+
+bool AdherenceReader::open(const char* path) {
+  previous = 0;
+  good = 0;
+  file = LittleFS.open(path, FILE_READ);
+  return (bool)file;
+}
+
+void AdherenceReader::close() {
+  file.close();
+}
+
+bool AdherenceReader::next(DoseRecord& record) {
+  if (!file) {
+    return false;
+  }
+  int length = file.read();
+  uint8_t payload[MAX_RECORD];
+  if (length <= 0 || length > MAX_RECORD || file.read(payload, length) != (size_t)length) {
+    return false;
+  }
+
+  size_t pos = 0;
+  uint32_t zigzag, snoozes, delay;
+  if (!get_varint(payload, length, pos, zigzag) || pos >= (size_t)length) {
+    return false;
+  }
+  uint8_t kind = payload[pos++];
+  if (!get_varint(payload, length, pos, snoozes) || !get_varint(payload, length, pos, delay) ||
+      pos != (size_t)length) {
+    return false;
+  }
+
+  previous += (uint32_t)((int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1));
+  record.scheduled = previous * 60;
+  record.alarm = kind >> 4;
+  record.outcome = kind & 0x0f;
+  record.snoozes = snoozes > 0xffff ? 0xffff : snoozes;
+  record.delay = delay;
+  good += 1 + length;
+  return true;
+}
+
+AdherenceLog::AdherenceLog()
+    : log_path(nullptr), max_bytes(0), bytes(0), records(0), previous(0) {
+}
+
+void AdherenceLog::begin(const char* path, size_t max_size) {
+  log_path = path;
+  max_bytes = max_size;
+  bytes = 0;
+  records = 0;
+  previous = 0;
+
+  // A rewrite cut short leaves its temp file behind. While the log is
+  // still there the copy may be partial and is dropped; a log that is
+  // gone was removed by an older firmware once the copy was complete.
+  char temp_path[32];
+  temp_name(path, temp_path, sizeof(temp_path));
+  if (LittleFS.exists(temp_path)) {
+    if (LittleFS.exists(path)) {
+      LittleFS.remove(temp_path);
+    } else {
+      LittleFS.rename(temp_path, path);
+    }
+  }
+
+  AdherenceReader reader;
+  if (!reader.open(path)) {
+    return;
+  }
+  DoseRecord record;
+  while (reader.next(record)) {
+    records++;
+    previous = record.scheduled / 60;
+  }
+  bytes = reader.position();
+  File file = LittleFS.open(path, FILE_READ);
+  size_t file_size = file.size();
+  file.close();
+  reader.close();
+
+  // A torn last record would garble everything appended after it
+  if (file_size != bytes) {
+    rewrite(0);
+  }
+}
+
+void AdherenceLog::rewrite(uint32_t skip) {
+  char temp_path[32];
+  temp_name(log_path, temp_path, sizeof(temp_path));
+
+  AdherenceReader reader;
+  if (!reader.open(log_path)) {
+    return;
+  }
+  File out = LittleFS.open(temp_path, FILE_WRITE);
+  if (!out) {
+    reader.close();
+    return;
+  }
+
+  DoseRecord record;
+  uint32_t index = 0;
+  uint32_t kept = 0;
+  uint32_t base = 0;
+  size_t written = 0;
+  bool ok = true;
+  while (ok && reader.next(record)) {
+    if (index++ < skip) {
+      continue;
+    }
+    uint8_t frame[MAX_RECORD + 1];
+    size_t n = encode(record, base, frame);
+    ok = out.write(frame, n) == n;
+    written += n;
+    base = record.scheduled / 60;
+    kept++;
+  }
+  reader.close();
+  out.close();
+
+  // The log stays as it was unless the whole copy made it to flash;
+  // rename() replaces it in one step
+  if (!ok || !LittleFS.rename(temp_path, log_path)) {
+    LittleFS.remove(temp_path);
+    return;
+  }
+  bytes = written;
+  records = kept;
+  previous = base;
+}
+
+bool AdherenceLog::append(const DoseRecord& record) {
+  if (log_path == nullptr) {
+    return false;
+  }
+  if (bytes + MAX_RECORD + 1 > max_bytes && records > 1) {
+    rewrite(records / 2);
+  }
+
+  uint8_t frame[MAX_RECORD + 1];
+  size_t n = encode(record, previous, frame);
+  File file = LittleFS.open(log_path, FILE_APPEND);
+  if (!file) {
+    return false;
+  }
+  bool ok = file.write(frame, n) == n;
+  file.close();
+  if (ok) {
+    bytes += n;
+    records++;
+    previous = record.scheduled / 60;
+  }
+  return ok;
+}
+
+AdherenceStats AdherenceLog::stats(uint32_t from, uint32_t to, uint32_t on_time_s) {
+  AdherenceStats stats = {};
+  AdherenceReader reader;
+  if (log_path == nullptr || !reader.open(log_path)) {
+    return stats;
+  }
+  DoseRecord record;
+  while (reader.next(record)) {
+    if (record.scheduled < from || record.scheduled > to) {
+      continue;
+    }
+    stats.doses++;
+    stats.snoozes += record.snoozes;
+    if (record.outcome == DOSE_MISSED) {
+      stats.missed++;
+      continue;
+    }
+    stats.taken++;
+    stats.delay_sum += record.delay;
+    if (record.delay <= on_time_s) {
+      stats.on_time++;
+    }
+  }
+  reader.close();
+  return stats;
+}
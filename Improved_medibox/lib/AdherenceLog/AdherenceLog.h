@@ -0,0 +1,88 @@
+#ifndef ADHERENCE_LOG_H
+#define ADHERENCE_LOG_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+
+// Append-only medication adherence log in flash.
+//
+// One record per dose: when it was scheduled, whether it was taken or
+// missed, how often it was snoozed and how late it was acknowledged.
+// Records are framed as a length byte and a payload of
+//
+//   scheduled minute   zigzag varint, delta from the previous record
+//   alarm << 4 | outcome
+//   snoozes            varint
+//   delay              varint, seconds from scheduled to acknowledged
+//
+// so a dose costs about 5 bytes and half a year of two daily doses fits
+// in 2 KB. Reading streams record by record from the file; nothing is
+// loaded whole. When the file outgrows its cap the older half is dropped.
+
+enum DoseOutcome {
+  DOSE_TAKEN = 0,
+  DOSE_MISSED
+};
+
+struct DoseRecord {
+  uint32_t scheduled;   // UTC seconds, on a minute
+  uint8_t alarm;
+  uint8_t outcome;
+  uint16_t snoozes;
+  uint32_t delay;       // seconds; 0 for missed doses
+};
+
+struct AdherenceStats {
+  uint32_t doses;
+  uint32_t taken;
+  uint32_t on_time;
+  uint32_t missed;
+  uint32_t snoozes;
+  uint64_t delay_sum;   // over taken doses
+};
+
+class AdherenceReader {
+public:
+  AdherenceReader();
+  bool open(const char* path);
+  void close();
+
+  // Next record in file order; false at the end or at a damaged tail
+  bool next(DoseRecord& record);
+
+  // Offset just past the last good record
+  size_t position() const { return good; }
+
+private:
+  File file;
+  uint32_t previous;
+  size_t good;
+};
+
+class AdherenceLog {
+public:
+  AdherenceLog();
+
+  // Open the log, repairing a record torn by power loss
+  void begin(const char* path, size_t max_bytes);
+
+  bool append(const DoseRecord& record);
+
+  // Doses scheduled in [from, to]; taken within 'on_time_s' counts as on time
+  AdherenceStats stats(uint32_t from, uint32_t to, uint32_t on_time_s);
+
+  const char* path() const { return log_path; }
+  size_t size() const { return bytes; }
+
+private:
+  // Rewrite the log keeping the records after the first 'skip'
+  void rewrite(uint32_t skip);
+
+  const char* log_path;
+  size_t max_bytes;
+  size_t bytes;
+  uint32_t records;
+  uint32_t previous;   // scheduled minute of the last record
+};
+
+#endif
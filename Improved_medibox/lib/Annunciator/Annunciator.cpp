@@ -0,0 +1,83 @@
+#include "Annunciator.h"
+
+Annunciator::Annunciator()
+    : playing_source(-1), note_index(0), in_gap(false), step_started(0) {
+  for (int i = 0; i < ANNUNCIATOR_SOURCES; i++) {
+    patterns[i] = {nullptr, 0, 0, 0};
+    active[i] = false;
+  }
+}
+
+void Annunciator::setPattern(AnnunciatorSource source, const int* notes, int n_notes,
+                             unsigned long note_ms, unsigned long gap_ms) {
+  patterns[source] = {notes, n_notes, note_ms, gap_ms};
+}
+
+void Annunciator::raise(AnnunciatorSource source) {
+  active[source] = true;
+}
+
+void Annunciator::clear(AnnunciatorSource source) {
+  active[source] = false;
+}
+
+bool Annunciator::isActive(AnnunciatorSource source) const {
+  return active[source];
+}
+
+int Annunciator::owner() const {
+  for (int i = ANNUNCIATOR_SOURCES - 1; i >= 0; i--) {
+    if (active[i]) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int Annunciator::update(unsigned long now) {
+  int source = owner();
+
+  // Nobody wants the buzzer, or the source has no pattern configured
+  if (source < 0 || patterns[source].n_notes == 0) {
+    playing_source = -1;
+    return 0;
+  }
+
+  const Pattern& pattern = patterns[source];
+
+  // A different source took over: restart from its first note
+  if (source != playing_source) {
+    playing_source = source;
+    note_index = 0;
+    in_gap = false;
+    step_started = now;
+  }
+
+  // After a long stall (e.g. a blocking menu) resume in step instead of
+  // replaying every missed note
+  unsigned long period = pattern.note_ms + pattern.gap_ms;
+  if (period == 0) {
+    return pattern.notes[note_index];
+  }
+  if (now - step_started >= period * pattern.n_notes) {
+    step_started = now;
+    in_gap = false;
+  }
+
+  // Catch up on every step that has elapsed since the last call
+  while (true) {
+    unsigned long step_length = in_gap ? pattern.gap_ms : pattern.note_ms;
+    if (now - step_started < step_length) {
+      break;
+    }
+    step_started += step_length;
+    if (in_gap) {
+      in_gap = false;
+      note_index = (note_index + 1) % pattern.n_notes;
+    } else {
+      in_gap = true;
+    }
+  }
+
+  return in_gap ? 0 : pattern.notes[note_index];
+}
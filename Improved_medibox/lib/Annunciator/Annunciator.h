@@ -0,0 +1,53 @@
+#ifndef ANNUNCIATOR_H
+#define ANNUNCIATOR_H
+
+// Non-blocking buzzer arbitration.
+//
+// Every alert source (medication alarm, environmental warning) raises or
+// clears a request instead of driving the buzzer itself. The highest
+// priority active source owns the buzzer and its note pattern is advanced
+// from loop() through update(), so nothing else stalls while it sounds.
+
+enum AnnunciatorSource {
+  ANNUNCIATOR_ENVIRONMENT = 0,   // lowest priority
+  ANNUNCIATOR_MEDICATION,        // always wins the buzzer
+  ANNUNCIATOR_SOURCES
+};
+
+class Annunciator {
+public:
+  Annunciator();
+
+  // Note sequence played while the given source owns the buzzer
+  void setPattern(AnnunciatorSource source, const int* notes, int n_notes,
+                  unsigned long note_ms, unsigned long gap_ms);
+
+  void raise(AnnunciatorSource source);
+  void clear(AnnunciatorSource source);
+  bool isActive(AnnunciatorSource source) const;
+
+  // Highest priority active source, or -1 when silent
+  int owner() const;
+
+  // Advance the pattern of the current owner. Returns the frequency that
+  // should be sounding at 'now' (0 for silence).
+  int update(unsigned long now);
+
+private:
+  struct Pattern {
+    const int* notes;
+    int n_notes;
+    unsigned long note_ms;
+    unsigned long gap_ms;
+  };
+
+  Pattern patterns[ANNUNCIATOR_SOURCES];
+  bool active[ANNUNCIATOR_SOURCES];
+
+  int playing_source;          // source whose pattern is in progress
+  int note_index;
+  bool in_gap;
+  unsigned long step_started;
+};
+
+#endif
@@ -0,0 +1,109 @@
+#include "Bme280Sensor.h"
+
+#include <Arduino.h>
+
+#define BME280_CHIP_ID 0x60
+#define BME280_REG_CALIBRATION_T 0x88
+#define BME280_REG_CALIBRATION_H1 0xA1
+#define BME280_REG_CHIP_ID 0xD0
+#define BME280_REG_RESET 0xE0
+#define BME280_REG_CALIBRATION_H2 0xE1
+#define BME280_REG_CTRL_HUM 0xF2
+#define BME280_REG_CTRL_MEAS 0xF4
+#define BME280_REG_CONFIG 0xF5
+#define BME280_REG_TEMPERATURE 0xFA
+
+#define BME280_RESET 0xB6
+#define BME280_RESET_MS 3
+// 1x temperature, pressure skipped, forced mode
+#define BME280_MEASURE 0x21
+// Worst case conversion of temperature and humidity at 1x
+#define BME280_MEASURE_MS 7
+#define BME280_CLOCK I2C_FAST_PLUS_CLOCK
+
+Bme280Sensor::Bme280Sensor(I2cBus& sensor_bus, uint8_t sensor_address)
+    : bus(sensor_bus), address(sensor_address), calibration() {
+}
+
+bool Bme280Sensor::begin() {
+  uint8_t id = 0;
+  {
+    I2cTransaction transaction(bus, BME280_CLOCK);
+    if (!bus.readRegisters(address, BME280_REG_CHIP_ID, &id, 1) || id != BME280_CHIP_ID ||
+        !bus.writeRegister(address, BME280_REG_RESET, BME280_RESET)) {
+      return false;
+    }
+  }
+  delay(BME280_RESET_MS);
+
+  I2cTransaction transaction(bus, BME280_CLOCK);
+  uint8_t t[6];
+  uint8_t h1;
+  uint8_t h[7];
+  if (!bus.readRegisters(address, BME280_REG_CALIBRATION_T, t, sizeof(t)) ||
+      !bus.readRegisters(address, BME280_REG_CALIBRATION_H1, &h1, 1) ||
+      !bus.readRegisters(address, BME280_REG_CALIBRATION_H2, h, sizeof(h))) {
+    return false;
+  }
+  calibration.t1 = (uint16_t)(t[1] << 8 | t[0]);
+  calibration.t2 = (int16_t)(t[3] << 8 | t[2]);
+  calibration.t3 = (int16_t)(t[5] << 8 | t[4]);
+  calibration.h1 = h1;
+  calibration.h2 = (int16_t)(h[1] << 8 | h[0]);
+  calibration.h3 = h[2];
+  calibration.h4 = (int16_t)((int8_t)h[3] * 16 | (h[4] & 0x0f));
+  calibration.h5 = (int16_t)((int8_t)h[5] * 16 | h[4] >> 4);
+  calibration.h6 = (int8_t)h[6];
+
+  // Humidity oversampling only takes effect with the next ctrl_meas write
+  return bus.writeRegister(address, BME280_REG_CTRL_HUM, 0x01) &&
+         bus.writeRegister(address, BME280_REG_CONFIG, 0x00);
+}
+
+int32_t Bme280Sensor::fineTemperature(int32_t raw) const {
+  int32_t var1 = (((raw >> 3) - ((int32_t)calibration.t1 << 1)) * calibration.t2) >> 11;
+  int32_t var2 = (((((raw >> 4) - (int32_t)calibration.t1) * ((raw >> 4) - (int32_t)calibration.t1)) >> 12) *
+                  calibration.t3) >> 14;
+  return var1 + var2;
+}
+
+uint32_t Bme280Sensor::compensateHumidity(int32_t raw, int32_t fine) const {
+  int32_t x = fine - 76800;
+  x = (((raw << 14) - ((int32_t)calibration.h4 << 20) - (calibration.h5 * x) + 16384) >> 15) *
+      (((((((x * calibration.h6) >> 10) * (((x * (int32_t)calibration.h3) >> 11) + 32768)) >> 10) + 2097152) *
+        calibration.h2 + 8192) >> 14);
+  x = x - (((((x >> 15) * (x >> 15)) >> 7) * (int32_t)calibration.h1) >> 4);
+  x = x < 0 ? 0 : x;
+  x = x > 419430400 ? 419430400 : x;
+  return (uint32_t)(x >> 12);
+}
+
+ClimateReading Bme280Sensor::read() {
+  ClimateReading reading = {NAN, NAN};
+  {
+    I2cTransaction transaction(bus, BME280_CLOCK);
+    if (!bus.writeRegister(address, BME280_REG_CTRL_MEAS, BME280_MEASURE)) {
+      return reading;
+    }
+  }
+  // Converting; the bus is free meanwhile
+  delay(BME280_MEASURE_MS);
+
+  uint8_t data[5];
+  {
+    I2cTransaction transaction(bus, BME280_CLOCK);
+    if (!bus.readRegisters(address, BME280_REG_TEMPERATURE, data, sizeof(data))) {
+      return reading;
+    }
+  }
+  int32_t raw_temperature = (int32_t)data[0] << 12 | (int32_t)data[1] << 4 | data[2] >> 4;
+  int32_t raw_humidity = (int32_t)data[3] << 8 | data[4];
+  // Still the reset value: no conversion happened
+  if (raw_temperature == 0x80000) {
+    return reading;
+  }
+  int32_t fine = fineTemperature(raw_temperature);
+  reading.temperature = ((fine * 5 + 128) >> 8) / 100.0f;
+  reading.humidity = compensateHumidity(raw_humidity, fine) / 1024.0f;
+  return reading;
+}
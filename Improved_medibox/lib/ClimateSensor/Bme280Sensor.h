@@ -0,0 +1,45 @@
+#ifndef BME280_SENSOR_H
+#define BME280_SENSOR_H
+
+#include <I2cBus.h>
+
+#include "ClimateSensor.h"
+
+#define BME280_DEFAULT_ADDRESS 0x76
+
+// Forced mode, 1x oversampling of temperature and humidity, pressure
+// skipped. The factory calibration is read once in begin() and readings
+// are compensated with the datasheet's integer formulas.
+class Bme280Sensor : public ClimateSensor {
+public:
+  Bme280Sensor(I2cBus& bus, uint8_t address = BME280_DEFAULT_ADDRESS);
+
+  const char* name() const override { return "bme280"; }
+  bool begin() override;
+  ClimateReading read() override;
+  uint32_t minInterval() const override { return 50; }
+
+private:
+  struct Calibration {
+    uint16_t t1;
+    int16_t t2;
+    int16_t t3;
+    uint8_t h1;
+    int16_t h2;
+    uint8_t h3;
+    int16_t h4;
+    int16_t h5;
+    int8_t h6;
+  };
+
+  // t_fine of the datasheet, and temperature in 0.01 C
+  int32_t fineTemperature(int32_t raw) const;
+  // Humidity in 1/1024 %RH
+  uint32_t compensateHumidity(int32_t raw, int32_t fine) const;
+
+  I2cBus& bus;
+  uint8_t address;
+  Calibration calibration;
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef CLIMATE_SENSOR_H
+#define CLIMATE_SENSOR_H
+
+#include <stdint.h>
+
+// Temperature and humidity sensor driver.
+//
+// The sampling task reads whichever driver is selected through this
+// interface, so sensors can be swapped from config without touching the
+// rest of the firmware:
+//
+//   DhtSensor     DHT22 on a GPIO, bit-banged with interrupts off for
+//                 ~5 ms per read, at most one reading every 2 s
+//   Sht3xSensor   Sensirion SHT3x on the shared I2C bus
+//   Bme280Sensor  Bosch BME280 on the shared I2C bus
+//
+// The I2C drivers never block the bus while a measurement converts, so
+// the display can flush in the meantime.
+
+struct ClimateReading {
+  float temperature;   // C, NaN when the read failed
+  float humidity;      // %RH, NaN when the read failed
+};
+
+class ClimateSensor {
+public:
+  virtual ~ClimateSensor() {}
+
+  // Config name, e.g. "sht3x"
+  virtual const char* name() const = 0;
+  // Probe and set up the sensor; false if it does not answer
+  virtual bool begin() = 0;
+  virtual ClimateReading read() = 0;
+  // Shortest time between readings the sensor supports, in ms
+  virtual uint32_t minInterval() const = 0;
+};
+
+#endif
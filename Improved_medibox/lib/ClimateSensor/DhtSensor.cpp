@@ -0,0 +1,19 @@
+#include "DhtSensor.h"
+
+DhtSensor::DhtSensor(uint8_t dht_pin) : pin(dht_pin), started(false) {
+}
+
+bool DhtSensor::begin() {
+  // The DHT has no way to say it is there; a missing one reads NaN
+  if (!started) {
+    dht.setup(pin, DHTesp::DHT22);
+    started = true;
+  }
+  return true;
+}
+
+ClimateReading DhtSensor::read() {
+  TempAndHumidity data = dht.getTempAndHumidity();
+  ClimateReading reading = {data.temperature, data.humidity};
+  return reading;
+}
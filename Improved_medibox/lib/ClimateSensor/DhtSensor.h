@@ -0,0 +1,23 @@
+#ifndef DHT_SENSOR_H
+#define DHT_SENSOR_H
+
+#include <DHTesp.h>
+
+#include "ClimateSensor.h"
+
+class DhtSensor : public ClimateSensor {
+public:
+  explicit DhtSensor(uint8_t pin);
+
+  const char* name() const override { return "dht"; }
+  bool begin() override;
+  ClimateReading read() override;
+  uint32_t minInterval() const override { return 2000; }
+
+private:
+  DHTesp dht;
+  uint8_t pin;
+  bool started;
+};
+
+#endif
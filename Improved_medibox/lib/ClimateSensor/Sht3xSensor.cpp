@@ -0,0 +1,70 @@
+#include "Sht3xSensor.h"
+
+#include <Arduino.h>
+
+#define SHT3X_SOFT_RESET 0x30A2
+#define SHT3X_READ_STATUS 0xF32D
+#define SHT3X_MEASURE_HIGH 0x2400
+#define SHT3X_RESET_MS 2
+#define SHT3X_MEASURE_MS 16
+#define SHT3X_CLOCK I2C_FAST_PLUS_CLOCK
+
+Sht3xSensor::Sht3xSensor(I2cBus& sensor_bus, uint8_t sensor_address) : bus(sensor_bus), address(sensor_address) {
+}
+
+uint8_t Sht3xSensor::crc(const uint8_t* data, int length) {
+  uint8_t sum = 0xff;
+  for (int i = 0; i < length; i++) {
+    sum ^= data[i];
+    for (int bit = 0; bit < 8; bit++) {
+      sum = sum & 0x80 ? (sum << 1) ^ 0x31 : sum << 1;
+    }
+  }
+  return sum;
+}
+
+bool Sht3xSensor::command(uint16_t code) {
+  uint8_t data[2] = {(uint8_t)(code >> 8), (uint8_t)code};
+  I2cTransaction transaction(bus, SHT3X_CLOCK);
+  return bus.write(address, data, sizeof(data));
+}
+
+bool Sht3xSensor::begin() {
+  if (!command(SHT3X_SOFT_RESET)) {
+    return false;
+  }
+  delay(SHT3X_RESET_MS);
+
+  uint8_t status[3];
+  bool answered;
+  {
+    I2cTransaction transaction(bus, SHT3X_CLOCK);
+    uint8_t code[2] = {SHT3X_READ_STATUS >> 8, SHT3X_READ_STATUS & 0xff};
+    answered = bus.write(address, code, sizeof(code)) && bus.read(address, status, sizeof(status));
+  }
+  return answered && crc(status, 2) == status[2];
+}
+
+ClimateReading Sht3xSensor::read() {
+  ClimateReading reading = {NAN, NAN};
+  if (!command(SHT3X_MEASURE_HIGH)) {
+    return reading;
+  }
+  // Converting; the bus is free meanwhile
+  delay(SHT3X_MEASURE_MS);
+
+  uint8_t data[6];
+  bool received;
+  {
+    I2cTransaction transaction(bus, SHT3X_CLOCK);
+    received = bus.read(address, data, sizeof(data));
+  }
+  if (!received || crc(data, 2) != data[2] || crc(data + 3, 2) != data[5]) {
+    return reading;
+  }
+  uint16_t raw_temperature = (uint16_t)(data[0] << 8 | data[1]);
+  uint16_t raw_humidity = (uint16_t)(data[3] << 8 | data[4]);
+  reading.temperature = -45.0f + 175.0f * raw_temperature / 65535.0f;
+  reading.humidity = 100.0f * raw_humidity / 65535.0f;
+  return reading;
+}
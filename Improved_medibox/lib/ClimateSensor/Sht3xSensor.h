@@ -0,0 +1,32 @@
+#ifndef SHT3X_SENSOR_H
+#define SHT3X_SENSOR_H
+
+#include <I2cBus.h>
+
+#include "ClimateSensor.h"
+
+#define SHT3X_DEFAULT_ADDRESS 0x44
+
+// Single-shot, high repeatability measurements without clock stretching:
+// the command is sent, the bus is released during the 15 ms conversion
+// and the result is fetched with its CRCs.
+class Sht3xSensor : public ClimateSensor {
+public:
+  Sht3xSensor(I2cBus& bus, uint8_t address = SHT3X_DEFAULT_ADDRESS);
+
+  const char* name() const override { return "sht3x"; }
+  bool begin() override;
+  ClimateReading read() override;
+  uint32_t minInterval() const override { return 100; }
+
+  // CRC-8 of the SHT3x data words, polynomial 0x31, initial 0xff
+  static uint8_t crc(const uint8_t* data, int length);
+
+private:
+  bool command(uint16_t code);
+
+  I2cBus& bus;
+  uint8_t address;
+};
+
+#endif
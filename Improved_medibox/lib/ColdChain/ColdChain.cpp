@@ -0,0 +1,115 @@
+#include "ColdChain.h"
+
+#include <math.h>
+
+#define KELVIN 273.15f
+#define MKT_REFERENCE (25.0f + KELVIN)
+#define MKT_TABLE_SIZE (MKT_TABLE_MAX - MKT_TABLE_MIN + 1)
+
+// exp(dH/R * (1/Tref - 1/T)) at each whole degree, filled on first use
+static float weights[MKT_TABLE_SIZE];
+static bool weights_ready = false;
+
+static void build_weights() {
+  for (int i = 0; i < MKT_TABLE_SIZE; i++) {
+    float kelvin = MKT_TABLE_MIN + i + KELVIN;
+    weights[i] = expf(MKT_ACTIVATION_K * (1.0f / MKT_REFERENCE - 1.0f / kelvin));
+  }
+  weights_ready = true;
+}
+
+float ColdChain::weight(float celsius) {
+  if (!weights_ready) {
+    build_weights();
+  }
+  // Beyond the table the sensor is broken anyway; hold the end values
+  float x = celsius - MKT_TABLE_MIN;
+  if (x <= 0) {
+    return weights[0];
+  }
+  if (x >= MKT_TABLE_SIZE - 1) {
+    return weights[MKT_TABLE_SIZE - 1];
+  }
+  int i = (int)x;
+  float frac = x - i;
+  return weights[i] + frac * (weights[i + 1] - weights[i]);
+}
+
+ColdChain::ColdChain() : edges_used(0) {
+  // The storage range of EnvironmentCheck
+  static const float DEFAULT_EDGES[] = {24, 32};
+  setEdges(DEFAULT_EDGES, 2);
+  if (!weights_ready) {
+    build_weights();
+  }
+}
+
+bool ColdChain::setEdges(const float* new_edges, int new_count) {
+  if (new_count < 1 || new_count > COLD_CHAIN_MAX_EDGES) {
+    return false;
+  }
+  for (int i = 0; i < new_count; i++) {
+    if (isnan(new_edges[i]) || (i > 0 && new_edges[i] <= new_edges[i - 1])) {
+      return false;
+    }
+  }
+  for (int i = 0; i < new_count; i++) {
+    edges[i] = new_edges[i];
+  }
+  edges_used = new_count;
+  reset();
+  return true;
+}
+
+void ColdChain::reset() {
+  have_previous = false;
+  previous_valid = false;
+  previous_ms = 0;
+  previous = 0;
+  count = 0;
+  weighted_ms = 0;
+  covered_ms = 0;
+  unknown_ms = 0;
+  for (int i = 0; i <= COLD_CHAIN_MAX_EDGES; i++) {
+    band_ms[i] = 0;
+  }
+}
+
+int ColdChain::band(float celsius) const {
+  int b = 0;
+  while (b < edges_used && celsius >= edges[b]) {
+    b++;
+  }
+  return b;
+}
+
+void ColdChain::add(uint32_t t_ms, float celsius) {
+  if (have_previous) {
+    uint32_t span = t_ms - previous_ms;
+    if (!previous_valid || span > COLD_CHAIN_MAX_GAP) {
+      unknown_ms += span;
+    }
+    else {
+      // The previous reading holds until this one
+      weighted_ms += (double)weight(previous) * span;
+      covered_ms += span;
+      band_ms[band(previous)] += span;
+    }
+  }
+
+  have_previous = true;
+  previous_ms = t_ms;
+  previous_valid = !isnan(celsius);
+  previous = celsius;
+  if (previous_valid) {
+    count++;
+  }
+}
+
+float ColdChain::mkt() const {
+  if (covered_ms == 0) {
+    return NAN;
+  }
+  double mean = weighted_ms / (double)covered_ms;
+  return (float)(MKT_ACTIVATION_K / (MKT_ACTIVATION_K / MKT_REFERENCE - log(mean)) - KELVIN);
+}
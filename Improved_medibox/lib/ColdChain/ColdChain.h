@@ -0,0 +1,80 @@
+#ifndef COLD_CHAIN_H
+#define COLD_CHAIN_H
+
+#include <stdint.h>
+
+// Storage temperature analytics: Mean Kinetic Temperature and time spent
+// in each temperature band.
+//
+// MKT weighs each temperature by the Arrhenius rate of degradation it
+// causes, so a short hot spell counts for more than the arithmetic mean
+// suggests:
+//
+//   MKT = (dH/R) / -ln( sum(w_i * exp(-dH / (R * T_i))) / sum(w_i) )
+//
+// with T in kelvin. Samples are not evenly spaced once sampling is
+// adaptive, so each one is weighted by the time until the next. Only the
+// two sums are kept, so memory is constant however long it runs. The
+// exponential comes from a 1 C table, scaled to 1 at 25 C and linearly
+// interpolated; that is within 0.02 C of the exact MKT.
+//
+// Band time is accumulated the same way: the time from one sample to the
+// next goes to the band of the first. A gap longer than COLD_CHAIN_MAX_GAP
+// (sensor failing, task stalled) is counted as unknown instead.
+
+// dH/R for dH = 83.144 kJ/mol, the USP <1160> default
+#define MKT_ACTIVATION_K 10000.0f
+#define MKT_TABLE_MIN -40
+#define MKT_TABLE_MAX 80
+
+#define COLD_CHAIN_MAX_EDGES 4
+#define COLD_CHAIN_MAX_GAP 600000
+
+class ColdChain {
+public:
+  ColdChain();
+
+  // Band edges in C, ascending; 1 to COLD_CHAIN_MAX_EDGES edges make one
+  // band more than that.
+  // Restarts the band times. On error the previous bands are kept.
+  bool setEdges(const float* edges, int count);
+  int edgeCount() const { return edges_used; }
+  float edge(int i) const { return edges[i]; }
+
+  // A reading taken at 't_ms'. After a NaN (failed read) the time until
+  // the next reading is unknown.
+  void add(uint32_t t_ms, float celsius);
+
+  // MKT in C over the time covered so far, NaN before any is
+  float mkt() const;
+
+  uint32_t samples() const { return count; }
+  uint32_t coveredSeconds() const { return (uint32_t)(covered_ms / 1000); }
+  uint32_t unknownSeconds() const { return (uint32_t)(unknown_ms / 1000); }
+  // Seconds in band 'band' (0 is below the first edge)
+  uint32_t bandSeconds(int band) const { return (uint32_t)(band_ms[band] / 1000); }
+
+  void reset();
+
+  // Arrhenius weight of 'celsius' relative to 25 C, from the table
+  static float weight(float celsius);
+
+private:
+  int band(float celsius) const;
+
+  float edges[COLD_CHAIN_MAX_EDGES];
+  int edges_used;
+
+  bool have_previous;
+  bool previous_valid;
+  uint32_t previous_ms;
+  float previous;
+  uint32_t count;
+
+  double weighted_ms;     // sum of weight * duration
+  uint64_t covered_ms;
+  uint64_t unknown_ms;
+  uint64_t band_ms[COLD_CHAIN_MAX_EDGES + 1];
+};
+
+#endif
@@ -0,0 +1,48 @@
+#include "ConfigCoalescer.h"
+
+ConfigCoalescer::ConfigCoalescer()
+    : window(CONFIG_DEFAULT_WINDOW), opened(0), pending(0),
+      generations(0), staged_count(0), superseded_count(0) {
+  for (int i = 0; i < CONFIG_MAX_PARAMETERS; i++) {
+    values[i] = 0;
+  }
+}
+
+void ConfigCoalescer::setWindow(uint32_t window_ms) {
+  window = window_ms;
+}
+
+void ConfigCoalescer::stage(uint8_t parameter, float value, uint32_t now) {
+  if (parameter >= CONFIG_MAX_PARAMETERS) {
+    return;
+  }
+  uint32_t bit = 1UL << parameter;
+  if (pending == 0) {
+    opened = now;
+  }
+  if (pending & bit) {
+    superseded_count++;
+  }
+  pending |= bit;
+  values[parameter] = value;
+  staged_count++;
+}
+
+bool ConfigCoalescer::ready(uint32_t now) const {
+  // Unsigned difference, so millis() wrapping is harmless
+  return pending != 0 && now - opened >= window;
+}
+
+uint32_t ConfigCoalescer::take(float* out) {
+  uint32_t taken = pending;
+  for (int i = 0; i < CONFIG_MAX_PARAMETERS; i++) {
+    if (taken & (1UL << i)) {
+      out[i] = values[i];
+    }
+  }
+  pending = 0;
+  if (taken != 0) {
+    generations++;
+  }
+  return taken;
+}
@@ -0,0 +1,57 @@
+#ifndef CONFIG_COALESCER_H
+#define CONFIG_COALESCER_H
+
+#include <stdint.h>
+
+// Batches bursts of configuration updates into generations.
+//
+// A dashboard slider being dragged sends a stream of values for the same
+// parameter. Each update is staged here instead of being applied; the
+// first one opens a window, later ones for the same parameter replace the
+// staged value (last writer wins), and when the window has passed the
+// caller takes all staged values at once and applies them as one config
+// generation. A drag then costs one reaction per window, and the window
+// bounds the delay of the first update.
+
+// Up to 32, the bits of the changed mask
+#define CONFIG_MAX_PARAMETERS 16
+#define CONFIG_DEFAULT_WINDOW 200
+
+class ConfigCoalescer {
+public:
+  ConfigCoalescer();
+
+  void setWindow(uint32_t window_ms);
+
+  // Stage 'value' for 'parameter' (below CONFIG_MAX_PARAMETERS)
+  void stage(uint8_t parameter, float value, uint32_t now);
+
+  // True while values are staged, and once the window has run its
+  // length at 'now'
+  bool isOpen() const { return pending != 0; }
+  bool ready(uint32_t now) const;
+
+  // Close the window. The staged values are copied to 'values' by
+  // parameter; the returned mask has a bit set for each one staged.
+  uint32_t take(float* values);
+
+  // When the open (or last taken) window opened
+  uint32_t openedAt() const { return opened; }
+
+  uint32_t generation() const { return generations; }
+  // Updates staged, and those replaced before they were applied
+  uint32_t staged() const { return staged_count; }
+  uint32_t superseded() const { return superseded_count; }
+
+private:
+  uint32_t window;
+  uint32_t opened;
+  uint32_t pending;     // mask of staged parameters
+  float values[CONFIG_MAX_PARAMETERS];
+
+  uint32_t generations;
+  uint32_t staged_count;
+  uint32_t superseded_count;
+};
+
+#endif
@@ -0,0 +1,79 @@
+#include "ConfigMessage.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Parse the whole of 'text' as a number within [low, high]
+static bool number(const char* text, double low, double high, double& value) {
+  char* end;
+  value = strtod(text, &end);
+  return end != text && *end == '\0' && value >= low && value <= high;
+}
+
+static bool integer(const char* text, double low, double high, double& value) {
+  return number(text, low, high, value) && value == (long)value;
+}
+
+bool parseConfig(const char* text, MediboxConfig& config) {
+  MediboxConfig next = config;
+  bool versioned = false;
+
+  char buffer[CONFIG_MESSAGE_LENGTH];
+  if (strlen(text) >= sizeof(buffer)) {
+    return false;
+  }
+  strcpy(buffer, text);
+
+  char* save;
+  for (char* field = strtok_r(buffer, " ", &save); field != nullptr; field = strtok_r(nullptr, " ", &save)) {
+    char* value = strchr(field, '=');
+    if (value == nullptr) {
+      return false;
+    }
+    *value++ = '\0';
+
+    double v;
+    if (strcmp(field, "v") == 0) {
+      if (!integer(value, CONFIG_MESSAGE_VERSION, CONFIG_MESSAGE_VERSION, v)) {
+        return false;
+      }
+      versioned = true;
+    }
+    else if (strcmp(field, "sample_s") == 0 && integer(value, 1, 60, v)) {
+      next.sampling_s = (unsigned int)v;
+    }
+    else if (strcmp(field, "send_s") == 0 && integer(value, 10, 600, v)) {
+      next.sending_s = (unsigned int)v;
+    }
+    else if (strcmp(field, "theta_offset") == 0 && integer(value, 0, 120, v)) {
+      next.theta_offset = (int)v;
+    }
+    else if (strcmp(field, "light_intensity") == 0 && number(value, 0, 1, v)) {
+      next.light_intensity = (float)v;
+    }
+    else if (strcmp(field, "controlling_factor") == 0 && number(value, 0, 1, v)) {
+      next.controlling_factor = (float)v;
+    }
+    else if (strcmp(field, "ideal_storage_temp") == 0 && integer(value, 10, 40, v)) {
+      next.ideal_storage_temp = (int)v;
+    }
+    else {
+      return false;
+    }
+  }
+
+  if (!versioned) {
+    return false;
+  }
+  config = next;
+  return true;
+}
+
+int formatConfig(char* out, size_t size, const MediboxConfig& config) {
+  return snprintf(out, size,
+                  "v=%d sample_s=%u send_s=%u theta_offset=%d light_intensity=%.2f "
+                  "controlling_factor=%.2f ideal_storage_temp=%d",
+                  CONFIG_MESSAGE_VERSION, config.sampling_s, config.sending_s, config.theta_offset,
+                  config.light_intensity, config.controlling_factor, config.ideal_storage_temp);
+}
@@ -0,0 +1,35 @@
+#ifndef CONFIG_MESSAGE_H
+#define CONFIG_MESSAGE_H
+
+#include <stddef.h>
+
+// The device settings as one versioned text message.
+//
+//   v=1 sample_s=5 send_s=120 theta_offset=30 light_intensity=0.50
+//   controlling_factor=0.75 ideal_storage_temp=30
+//
+// The same format carries bulk configuration to the device and the state
+// snapshot back, so a dashboard can send a snapshot back as it is. When
+// parsing, "v" is required and the other keys are optional: the ones that
+// are present replace the current values. Any unknown key, out-of-range
+// value or other version rejects the whole message.
+
+#define CONFIG_MESSAGE_VERSION 1
+#define CONFIG_MESSAGE_LENGTH 160
+
+struct MediboxConfig {
+  unsigned int sampling_s;      // 1-60
+  unsigned int sending_s;       // 10-600
+  int theta_offset;             // 0-120 degrees
+  float light_intensity;        // 0-1
+  float controlling_factor;     // 0-1
+  int ideal_storage_temp;       // 10-40 C
+};
+
+// Apply 'text' on top of 'config'. On error 'config' is left untouched.
+bool parseConfig(const char* text, MediboxConfig& config);
+
+// Write every field of 'config'; returns the length like snprintf
+int formatConfig(char* out, size_t size, const MediboxConfig& config);
+
+#endif
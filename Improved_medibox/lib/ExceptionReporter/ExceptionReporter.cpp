@@ -0,0 +1,110 @@
+#include "ExceptionReporter.h"
+
+#include <math.h>
+
+ExceptionReporter::ExceptionReporter()
+    : report_mode(REPORT_ALWAYS), deadband(0), heartbeat_s(0),
+      have_archived(false), archived(), pending_count(0), slope_upper(0), slope_lower(0),
+      report_stats() {
+}
+
+void ExceptionReporter::configure(ReportMode mode, float new_deadband, uint32_t new_heartbeat_s) {
+  report_mode = mode;
+  deadband = new_deadband > 0 ? new_deadband : 0;
+  heartbeat_s = new_heartbeat_s;
+  // Start over from the next value
+  have_archived = false;
+  pending_count = 0;
+}
+
+void ExceptionReporter::resetStats() {
+  report_stats = ReportStats();
+}
+
+void ExceptionReporter::addError(float error) {
+  report_stats.resolved++;
+  report_stats.error_sum += error;
+  if (error > report_stats.error_max) {
+    report_stats.error_max = error;
+  }
+}
+
+bool ExceptionReporter::send(const ReportPoint& point, ReportPoint& out) {
+  archived = point;
+  have_archived = true;
+  out = point;
+  report_stats.sent++;
+  return true;
+}
+
+void ExceptionReporter::resolve(const ReportPoint& end, uint8_t count) {
+  float span = (float)(end.t - archived.t);
+  for (uint8_t i = 0; i < count; i++) {
+    float fraction = span > 0 ? (pending[i].t - archived.t) / span : 1;
+    float line = archived.value + (end.value - archived.value) * fraction;
+    addError(fabsf(pending[i].value - line));
+  }
+}
+
+// Start a new segment at the archived point with 'point' as its first value
+void ExceptionReporter::openDoor(const ReportPoint& point) {
+  float dt = point.t > archived.t ? (float)(point.t - archived.t) : 1;
+  slope_upper = (point.value - deadband - archived.value) / dt;
+  slope_lower = (point.value + deadband - archived.value) / dt;
+  pending[0] = point;
+  pending_count = 1;
+}
+
+bool ExceptionReporter::offer(uint32_t t, float value, ReportPoint& out) {
+  report_stats.offered++;
+  ReportPoint point = {t, value};
+
+  if (report_mode == REPORT_ALWAYS || !have_archived) {
+    pending_count = 0;
+    return send(point, out);
+  }
+
+  bool heartbeat = heartbeat_s > 0 && t - archived.t >= heartbeat_s;
+
+  if (report_mode == REPORT_DEADBAND) {
+    if (heartbeat || fabsf(value - archived.value) > deadband) {
+      return send(point, out);
+    }
+    // The receiver keeps showing the last value sent
+    addError(fabsf(value - archived.value));
+    return false;
+  }
+
+  // Swinging door
+  if (pending_count == 0) {
+    if (heartbeat) {
+      return send(point, out);
+    }
+    openDoor(point);
+    return false;
+  }
+
+  float dt = t > archived.t ? (float)(t - archived.t) : 1;
+  float upper = fmaxf(slope_upper, (value - deadband - archived.value) / dt);
+  float lower = fminf(slope_lower, (value + deadband - archived.value) / dt);
+
+  if (upper > lower) {
+    // No line from the archived point covers this value too: the segment
+    // ends at the previous value, which is sent, and a new one starts
+    ReportPoint end = pending[pending_count - 1];
+    resolve(end, pending_count - 1);
+    send(end, out);
+    openDoor(point);
+    return true;
+  }
+  if (heartbeat || pending_count == REPORT_PENDING) {
+    resolve(point, pending_count);
+    pending_count = 0;
+    return send(point, out);
+  }
+
+  slope_upper = upper;
+  slope_lower = lower;
+  pending[pending_count++] = point;
+  return false;
+}
@@ -0,0 +1,79 @@
+#ifndef EXCEPTION_REPORTER_H
+#define EXCEPTION_REPORTER_H
+
+#include <stdint.h>
+
+// Report-by-exception filter for one telemetry channel.
+//
+// Each averaging interval offers its value; the filter decides whether it
+// goes on the air.
+//
+//   REPORT_ALWAYS         every value (the original behaviour)
+//   REPORT_DEADBAND       when it moves more than the deadband from the
+//                         last value sent; the receiver holds that value
+//   REPORT_SWINGING_DOOR  the end points of straight segments that stay
+//                         within the deadband of every value in between;
+//                         the receiver interpolates linearly, so the point
+//                         sent is usually an earlier one, with its time
+//
+// In every mode a value goes out once the channel has been silent for the
+// heartbeat interval. The filter also measures what suppression costs:
+// for each value held back, the distance between it and what the receiver
+// reconstructs in its place.
+
+enum ReportMode {
+  REPORT_ALWAYS = 0,
+  REPORT_DEADBAND,
+  REPORT_SWINGING_DOOR
+};
+
+struct ReportPoint {
+  uint32_t t;     // seconds
+  float value;
+};
+
+struct ReportStats {
+  uint32_t offered;
+  uint32_t sent;
+  uint32_t resolved;    // held-back values whose reconstruction is known
+  float error_sum;
+  float error_max;
+};
+
+#define REPORT_PENDING 32
+
+class ExceptionReporter {
+public:
+  ExceptionReporter();
+
+  void configure(ReportMode mode, float deadband, uint32_t heartbeat_s);
+  ReportMode mode() const { return report_mode; }
+
+  // Offer the value for time 't'; true when 'out' should be published
+  bool offer(uint32_t t, float value, ReportPoint& out);
+
+  const ReportStats& stats() const { return report_stats; }
+  void resetStats();
+
+private:
+  bool send(const ReportPoint& point, ReportPoint& out);
+  // Account for pending values against the line from 'archived' to 'end'
+  void resolve(const ReportPoint& end, uint8_t count);
+  void openDoor(const ReportPoint& point);
+  void addError(float error);
+
+  ReportMode report_mode;
+  float deadband;
+  uint32_t heartbeat_s;
+
+  bool have_archived;
+  ReportPoint archived;      // last point sent
+  ReportPoint pending[REPORT_PENDING];   // offered since, oldest first
+  uint8_t pending_count;
+  float slope_upper;
+  float slope_lower;
+
+  ReportStats report_stats;
+};
+
+#endif
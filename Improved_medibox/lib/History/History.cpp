@@ -0,0 +1,338 @@
+#include "History.h"
+
+#include <math.h>
+#include <string.h>
+
+#define EMPTY_LDR 0xffff
+#define CHUNK_HEADER 3
+// Worst case encoded size of one record
+#define RAW_RECORD_MAX (5 + 3 * 5)
+#define BUCKET_RECORD_MAX (5 + 9 * 5)
+// Slots of the ring file read or written at a time
+#define QUARTER_BLOCK 32
+
+static size_t put_varint(uint8_t* out, uint32_t value) {
+  size_t n = 0;
+  while (value >= 0x80) {
+    out[n++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  out[n++] = (uint8_t)value;
+  return n;
+}
+
+static size_t put_signed(uint8_t* out, int32_t value) {
+  return put_varint(out, ((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+}
+
+History::History()
+    : raw_head(0), raw_count(0), query_active(false), query_id(0), query_tier(0),
+      query_seq(0), query_pos(0), query_end(0), query_from(0) {
+  for (uint32_t i = 0; i < HISTORY_MINUTE_BUCKETS; i++) {
+    minute[i].ldr[2] = EMPTY_LDR;
+  }
+  for (uint8_t tier = 0; tier < HISTORY_TIERS; tier++) {
+    have_bucket[tier] = false;
+    last_sealed[tier] = 0;
+  }
+}
+
+void History::begin(const char* quarter_path) {
+  QuarterSlot block[QUARTER_BLOCK];
+  const size_t size = HISTORY_QUARTER_BUCKETS * sizeof(QuarterSlot);
+
+  if (LittleFS.exists(quarter_path)) {
+    quarter = LittleFS.open(quarter_path, "r+");
+  }
+  if (!quarter || quarter.size() != size) {
+    // New, or written with another layout: start from an empty ring
+    if (quarter) {
+      quarter.close();
+    }
+    File file = LittleFS.open(quarter_path, FILE_WRITE);
+    if (!file) {
+      return;
+    }
+    memset(block, 0, sizeof(block));
+    for (int i = 0; i < QUARTER_BLOCK; i++) {
+      block[i].bucket.ldr[2] = EMPTY_LDR;
+    }
+    for (uint32_t i = 0; i < HISTORY_QUARTER_BUCKETS; i += QUARTER_BLOCK) {
+      file.write((const uint8_t*)block, sizeof(block));
+    }
+    file.close();
+    quarter = LittleFS.open(quarter_path, "r+");
+    return;
+  }
+
+  // The ring outlives a reboot; pick up where it stopped
+  quarter.seek(0);
+  for (uint32_t i = 0; i < HISTORY_QUARTER_BUCKETS; i += QUARTER_BLOCK) {
+    size_t got = quarter.read((uint8_t*)block, sizeof(block)) / sizeof(QuarterSlot);
+    for (size_t j = 0; j < got; j++) {
+      if (block[j].index > last_sealed[HISTORY_QUARTER] && block[j].bucket.ldr[2] != EMPTY_LDR) {
+        last_sealed[HISTORY_QUARTER] = block[j].index;
+      }
+    }
+  }
+}
+
+bool History::bucket(uint8_t tier, uint32_t index, Bucket& out) {
+  if (tier == HISTORY_MINUTE) {
+    out = minute[index % HISTORY_MINUTE_BUCKETS];
+    return out.ldr[2] != EMPTY_LDR;
+  }
+
+  QuarterSlot slot;
+  if (!quarter || !quarter.seek((index % HISTORY_QUARTER_BUCKETS) * sizeof(slot)) ||
+      quarter.read((uint8_t*)&slot, sizeof(slot)) != sizeof(slot) || slot.index != index) {
+    return false;
+  }
+  out = slot.bucket;
+  return out.ldr[2] != EMPTY_LDR;
+}
+
+uint32_t History::capacity(uint8_t tier) {
+  switch (tier) {
+    case HISTORY_RAW: return HISTORY_RAW_SAMPLES;
+    case HISTORY_MINUTE: return HISTORY_MINUTE_BUCKETS;
+    default: return HISTORY_QUARTER_BUCKETS;
+  }
+}
+
+void History::accumulate(Accumulator& a, const int32_t* min, const int32_t* mean, const int32_t* max, uint32_t count) {
+  for (int c = 0; c < 3; c++) {
+    if (a.count == 0 || min[c] < a.min[c]) a.min[c] = min[c];
+    if (a.count == 0 || max[c] > a.max[c]) a.max[c] = max[c];
+    a.sum[c] += (int64_t)mean[c] * count;
+  }
+  a.count += count;
+}
+
+// Close the tier's open bucket if 'index' starts a new one
+void History::flush(uint8_t tier, uint32_t index) {
+  Accumulator& a = acc[tier];
+  if (have_bucket[tier] && a.index != index) {
+    seal(tier, a);
+  }
+  if (!have_bucket[tier] || a.index != index) {
+    memset(&a, 0, sizeof(a));
+    a.index = index;
+    have_bucket[tier] = true;
+  }
+}
+
+void History::seal(uint8_t tier, const Accumulator& a) {
+  // Minutes skipped over (no samples) must not show what was there a lap
+  // ago; the ring file's slots carry their index instead
+  if (tier == HISTORY_MINUTE && last_sealed[tier] != 0) {
+    uint32_t cleared = 0;
+    for (uint32_t b = last_sealed[tier] + 1; b < a.index && cleared < HISTORY_MINUTE_BUCKETS; b++, cleared++) {
+      minute[b % HISTORY_MINUTE_BUCKETS].ldr[2] = EMPTY_LDR;
+    }
+  }
+
+  int32_t mean[3];
+  for (int c = 0; c < 3; c++) {
+    mean[c] = (int32_t)llround((double)a.sum[c] / a.count);
+  }
+
+  Bucket sealed;
+  sealed.ldr[0] = a.min[0];
+  sealed.ldr[1] = mean[0];
+  sealed.ldr[2] = a.max[0];
+  sealed.temperature[0] = a.min[1];
+  sealed.temperature[1] = mean[1];
+  sealed.temperature[2] = a.max[1];
+  sealed.humidity[0] = a.min[2];
+  sealed.humidity[1] = mean[2];
+  sealed.humidity[2] = a.max[2];
+  if (tier == HISTORY_MINUTE) {
+    minute[a.index % HISTORY_MINUTE_BUCKETS] = sealed;
+  }
+  else if (quarter) {
+    QuarterSlot slot;
+    slot.index = a.index;
+    slot.bucket = sealed;
+    quarter.seek((a.index % HISTORY_QUARTER_BUCKETS) * sizeof(slot));
+    quarter.write((const uint8_t*)&slot, sizeof(slot));
+    quarter.flush();
+  }
+  last_sealed[tier] = a.index;
+
+  // Each sealed minute feeds the quarter-hour tier
+  if (tier == HISTORY_MINUTE) {
+    flush(HISTORY_QUARTER, a.index * width(HISTORY_MINUTE) / width(HISTORY_QUARTER));
+    accumulate(acc[HISTORY_QUARTER], a.min, mean, a.max, a.count);
+  }
+}
+
+void History::add(uint32_t utc_s, uint16_t ldr, float temperature, float humidity) {
+  // Failed DHT reads are not stored
+  if (isnan(temperature) || isnan(humidity)) {
+    return;
+  }
+  if (raw_count > 0 && utc_s <= raw[(raw_head + HISTORY_RAW_SAMPLES - 1) % HISTORY_RAW_SAMPLES].t) {
+    return;
+  }
+
+  Sample& s = raw[raw_head];
+  s.t = utc_s;
+  s.ldr = ldr > 4095 ? 4095 : ldr;
+  s.temperature = (int16_t)lroundf(temperature * 10);
+  long h = lroundf(humidity);
+  s.humidity = h < 0 ? 0 : h > 100 ? 100 : (uint8_t)h;
+  raw_head = (raw_head + 1) % HISTORY_RAW_SAMPLES;
+  if (raw_count < HISTORY_RAW_SAMPLES) {
+    raw_count++;
+  }
+
+  int32_t values[3] = {s.ldr, s.temperature, s.humidity};
+  flush(HISTORY_MINUTE, utc_s / width(HISTORY_MINUTE));
+  accumulate(acc[HISTORY_MINUTE], values, values, values, 1);
+}
+
+uint32_t History::oldest(uint8_t tier) {
+  if (tier == HISTORY_RAW) {
+    return raw_count > 0 ? raw[(raw_head + HISTORY_RAW_SAMPLES - raw_count) % HISTORY_RAW_SAMPLES].t : 0;
+  }
+  if (last_sealed[tier] == 0) {
+    return 0;
+  }
+  uint32_t n = capacity(tier);
+  uint32_t first = last_sealed[tier] >= n ? last_sealed[tier] - n + 1 : 0;
+  Bucket b;
+  for (uint32_t index = first; index <= last_sealed[tier]; index++) {
+    if (bucket(tier, index, b)) {
+      return index * width(tier);
+    }
+  }
+  return 0;
+}
+
+bool History::startQuery(uint8_t request_id, uint8_t tier, uint32_t from, uint32_t to) {
+  if (from > to) {
+    return false;
+  }
+
+  if (tier == HISTORY_AUTO) {
+    // Finest tier reaching back to 'from', else the one reaching back furthest
+    tier = HISTORY_TIERS;
+    uint32_t furthest = 0;
+    for (uint8_t t = 0; t < HISTORY_TIERS; t++) {
+      uint32_t start = oldest(t);
+      if (start == 0) {
+        continue;
+      }
+      if (start <= from) {
+        tier = t;
+        break;
+      }
+      if (tier == HISTORY_TIERS || start < furthest) {
+        tier = t;
+        furthest = start;
+      }
+    }
+    if (tier == HISTORY_TIERS) {
+      tier = HISTORY_RAW;
+    }
+  }
+  if (tier >= HISTORY_TIERS) {
+    return false;
+  }
+
+  query_active = true;
+  query_id = request_id;
+  query_tier = tier;
+  query_seq = 0;
+  if (tier == HISTORY_RAW) {
+    query_from = from;
+    query_end = to;
+  } else {
+    query_pos = from / width(tier);
+    query_end = to / width(tier);
+  }
+  return true;
+}
+
+size_t History::nextChunk(uint8_t* out, size_t capacity_bytes) {
+  if (!query_active || capacity_bytes < CHUNK_HEADER + BUCKET_RECORD_MAX) {
+    return 0;
+  }
+
+  out[0] = query_id;
+  out[1] = query_seq++;
+  size_t n = CHUNK_HEADER;
+  bool last = false;
+  bool first = true;
+  int32_t previous[10];
+
+  if (query_tier == HISTORY_RAW) {
+    // Walk from the oldest sample; the ring may have moved since the last chunk
+    uint32_t i = 0;
+    while (i < raw_count && raw[(raw_head + HISTORY_RAW_SAMPLES - raw_count + i) % HISTORY_RAW_SAMPLES].t < query_from) {
+      i++;
+    }
+    while (true) {
+      if (i >= raw_count) {
+        last = true;
+        break;
+      }
+      const Sample& s = raw[(raw_head + HISTORY_RAW_SAMPLES - raw_count + i) % HISTORY_RAW_SAMPLES];
+      if (s.t > query_end) {
+        last = true;
+        break;
+      }
+      if (n + RAW_RECORD_MAX > capacity_bytes) {
+        break;
+      }
+      int32_t record[4] = {(int32_t)s.t, s.ldr, s.temperature, s.humidity};
+      n += put_varint(out + n, first ? s.t : s.t - previous[0]);
+      for (int c = 1; c < 4; c++) {
+        n += put_signed(out + n, first ? record[c] : record[c] - previous[c]);
+      }
+      memcpy(previous, record, sizeof(record));
+      first = false;
+      query_from = s.t + 1;
+      i++;
+    }
+  } else {
+    uint32_t cap = capacity(query_tier);
+    uint32_t newest = last_sealed[query_tier];
+    uint32_t retained = newest >= cap ? newest - cap + 1 : 0;
+    if (query_pos < retained) {
+      query_pos = retained;
+    }
+    while (true) {
+      if (last_sealed[query_tier] == 0 || query_pos > query_end || query_pos > newest) {
+        last = true;
+        break;
+      }
+      Bucket b;
+      if (!bucket(query_tier, query_pos, b)) {
+        query_pos++;
+        continue;
+      }
+      if (n + BUCKET_RECORD_MAX > capacity_bytes) {
+        break;
+      }
+      int32_t record[10] = {(int32_t)query_pos,
+                            b.ldr[0], b.ldr[1], b.ldr[2],
+                            b.temperature[0], b.temperature[1], b.temperature[2],
+                            b.humidity[0], b.humidity[1], b.humidity[2]};
+      n += put_varint(out + n, first ? query_pos : query_pos - previous[0]);
+      for (int c = 1; c < 10; c++) {
+        n += put_signed(out + n, first ? record[c] : record[c] - previous[c]);
+      }
+      memcpy(previous, record, sizeof(record));
+      first = false;
+      query_pos++;
+    }
+  }
+
+  out[2] = (uint8_t)(query_tier << 4) | (last ? 1 : 0);
+  if (last) {
+    query_active = false;
+  }
+  return n;
+}
@@ -0,0 +1,125 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed-size time-series store for LDR, temperature and humidity.
+//
+// Three tiers: the raw samples of the last hour (at the default 5 s
+// sampling), then 1-minute and 15-minute buckets holding min/mean/max for
+// a day and a month. Buckets are aligned to UTC and fed from the tier
+// below, so the store never grows and old data ages out on its own.
+//
+// The raw and 1-minute tiers live in RAM (about 32 KB). The month of
+// 15-minute buckets would take another 46 KB, so it is a fixed-size ring
+// file in LittleFS instead, written once per quarter hour. Each slot
+// carries its bucket index, so a slot left over from an earlier lap or
+// an earlier boot is never mistaken for the bucket asked for.
+//
+// Range queries are streamed as chunks that each decode on their own:
+//
+//   byte 0    request id
+//   byte 1    chunk sequence number
+//   byte 2    tier in the high nibble, bit 0 set on the last chunk
+//   records   time as a varint in tier units (raw: UTC seconds, tiers:
+//             UTC / bucket width), then each value as a zigzag varint.
+//             Within a chunk, the first record is absolute and the rest
+//             are deltas from the record before.
+//
+// Raw records carry LDR, temperature (0.1 C) and humidity (%); bucket
+// records carry min, mean and max of each, in that order per channel.
+
+#define HISTORY_RAW_SAMPLES 720
+#define HISTORY_MINUTE_BUCKETS 1440
+#define HISTORY_QUARTER_BUCKETS 2880
+
+enum HistoryTier {
+  HISTORY_RAW = 0,
+  HISTORY_MINUTE,
+  HISTORY_QUARTER,
+  HISTORY_TIERS,
+  HISTORY_AUTO = 0x0f   // finest tier that reaches back far enough
+};
+
+class History {
+public:
+  History();
+
+  // Open (or create) the 15-minute ring file. Call once after
+  // LittleFS.begin(); without it that tier stays empty.
+  void begin(const char* quarter_path);
+
+  // Add a sample; samples older than the last one are dropped
+  void add(uint32_t utc_s, uint16_t ldr, float temperature, float humidity);
+
+  // Oldest time the tier still covers (0 when empty)
+  uint32_t oldest(uint8_t tier);
+
+  // Start streaming [from, to]; replaces any running query
+  bool startQuery(uint8_t request_id, uint8_t tier, uint32_t from, uint32_t to);
+  bool querying() const { return query_active; }
+
+  // Encode the next chunk into 'out'; returns its length
+  size_t nextChunk(uint8_t* out, size_t capacity);
+
+private:
+  struct Sample {
+    uint32_t t;
+    uint16_t ldr;
+    int16_t temperature;   // 0.1 C
+    uint8_t humidity;      // %
+  };
+
+  // min, mean, max; ldr[2] == 0xffff marks an empty bucket
+  struct Bucket {
+    uint16_t ldr[3];
+    int16_t temperature[3];
+    uint8_t humidity[3];
+  };
+
+  // One slot of the 15-minute ring file
+  struct QuarterSlot {
+    uint32_t index;   // bucket index stored here, 0 for never written
+    Bucket bucket;
+  };
+
+  // Running min/max/sum of the bucket being filled
+  struct Accumulator {
+    uint32_t index;
+    uint32_t count;
+    int32_t min[3];
+    int32_t max[3];
+    int64_t sum[3];
+  };
+
+  void accumulate(Accumulator& acc, const int32_t* min, const int32_t* mean, const int32_t* max, uint32_t count);
+  void flush(uint8_t tier, uint32_t index);
+  void seal(uint8_t tier, const Accumulator& acc);
+  // Bucket 'index' of a tier; false when that bucket has no samples
+  bool bucket(uint8_t tier, uint32_t index, Bucket& out);
+  static uint32_t capacity(uint8_t tier);
+  static uint32_t width(uint8_t tier) { return tier == HISTORY_MINUTE ? 60 : 900; }
+
+  Sample raw[HISTORY_RAW_SAMPLES];
+  uint32_t raw_head;    // next slot to write
+  uint32_t raw_count;
+
+  Bucket minute[HISTORY_MINUTE_BUCKETS];
+  File quarter;
+  Accumulator acc[HISTORY_TIERS];   // [HISTORY_RAW] unused
+  bool have_bucket[HISTORY_TIERS];
+  uint32_t last_sealed[HISTORY_TIERS];
+
+  bool query_active;
+  uint8_t query_id;
+  uint8_t query_tier;
+  uint8_t query_seq;
+  uint32_t query_pos;    // raw: samples from the oldest, tiers: bucket index
+  uint32_t query_end;
+  uint32_t query_from;
+};
+
+#endif
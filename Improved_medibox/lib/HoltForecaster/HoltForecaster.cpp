@@ -0,0 +1,109 @@
+#include "HoltForecaster.h"
+
+#include <math.h>
+#include <string.h>
+
+HoltForecaster::HoltForecaster()
+    : horizon_ms(FORECAST_DEFAULT_HORIZON), level_tau(FORECAST_DEFAULT_LEVEL_TAU),
+      trend_tau(FORECAST_DEFAULT_TREND_TAU), count(0), last_ms(0), smoothed(0), slope(0),
+      pending_head(0), pending_count(0), last_filed(0) {
+  memset(&score, 0, sizeof(score));
+}
+
+bool HoltForecaster::setHorizon(uint32_t new_horizon) {
+  if (new_horizon == 0 || new_horizon > FORECAST_MAX_HORIZON) {
+    return false;
+  }
+  horizon_ms = new_horizon;
+  pending_count = 0;
+  return true;
+}
+
+void HoltForecaster::setTimeConstants(float new_level_tau, float new_trend_tau) {
+  level_tau = new_level_tau;
+  trend_tau = new_trend_tau;
+}
+
+float HoltForecaster::forecast() const {
+  return smoothed + slope * (horizon_ms / 1000.0f);
+}
+
+float HoltForecaster::skill() const {
+  if (score.settled == 0 || score.persistence_abs_sum == 0) {
+    return 0;
+  }
+  return 1 - score.abs_sum / score.persistence_abs_sum;
+}
+
+// Score the pending forecasts whose target this reading has reached
+void HoltForecaster::settle(uint32_t t_ms, float value) {
+  while (pending_count > 0) {
+    const Pending& p = pending[pending_head];
+    // Unsigned difference, so millis() wrapping is harmless
+    if ((int32_t)(t_ms - p.target) < 0) {
+      break;
+    }
+    if (t_ms - p.target > FORECAST_FILE_INTERVAL) {
+      score.expired++;
+    }
+    else {
+      float error = p.forecast - value;
+      score.settled++;
+      score.abs_sum += fabsf(error);
+      score.square_sum += error * error;
+      score.bias_sum += error;
+      if (fabsf(error) > score.abs_max) {
+        score.abs_max = fabsf(error);
+      }
+      score.persistence_abs_sum += fabsf(p.persistence - value);
+    }
+    pending_head = (pending_head + 1) % FORECAST_PENDING;
+    pending_count--;
+  }
+}
+
+void HoltForecaster::add(uint32_t t_ms, float value) {
+  if (isnan(value)) {
+    return;
+  }
+  settle(t_ms, value);
+
+  if (count == 0) {
+    smoothed = value;
+    slope = 0;
+  }
+  else {
+    float dt = (t_ms - last_ms) / 1000.0f;
+    if (dt <= 0) {
+      return;
+    }
+    float alpha = 1 - expf(-dt / level_tau);
+    float beta = 1 - expf(-dt / trend_tau);
+    float previous = smoothed;
+    smoothed = alpha * value + (1 - alpha) * (smoothed + slope * dt);
+    if (count == 1) {
+      // First trend estimate
+      slope = (smoothed - previous) / dt;
+    }
+    else {
+      slope = beta * (smoothed - previous) / dt + (1 - beta) * slope;
+    }
+  }
+  last_ms = t_ms;
+  count++;
+
+  if (ready() && t_ms - last_filed >= FORECAST_FILE_INTERVAL) {
+    last_filed = t_ms;
+    // A full ring only happens if readings stall; the oldest goes
+    if (pending_count == FORECAST_PENDING) {
+      pending_head = (pending_head + 1) % FORECAST_PENDING;
+      pending_count--;
+      score.expired++;
+    }
+    Pending& p = pending[(pending_head + pending_count) % FORECAST_PENDING];
+    p.target = t_ms + horizon_ms;
+    p.forecast = forecast();
+    p.persistence = value;
+    pending_count++;
+  }
+}
@@ -0,0 +1,91 @@
+#ifndef HOLT_FORECASTER_H
+#define HOLT_FORECASTER_H
+
+#include <stdint.h>
+
+// Short-horizon forecast of one sensor channel by Holt's linear (double
+// exponential) smoothing.
+//
+// A smoothed level and trend are updated from every reading; the forecast
+// is level + trend * horizon. Readings are not evenly spaced once sampling
+// is adaptive, so the smoothing factors follow from time constants and
+// the time since the previous reading, 1 - exp(-dt / tau), rather than
+// being fixed per reading.
+//
+// The forecaster keeps score of itself. Once a minute it files the
+// forecast it makes, and the reading at or after the horizon settles it.
+// Its errors are set against persistence, the reading at filing time
+// taken as the forecast, which is what acting on the current reading
+// amounts to. A skill above zero means the forecast pays off.
+
+#define FORECAST_PENDING 16
+#define FORECAST_FILE_INTERVAL 60000
+#define FORECAST_MAX_HORIZON (FORECAST_PENDING * FORECAST_FILE_INTERVAL - FORECAST_FILE_INTERVAL)
+#define FORECAST_WARMUP 5
+
+#define FORECAST_DEFAULT_HORIZON 600000
+#define FORECAST_DEFAULT_LEVEL_TAU 120.0f
+#define FORECAST_DEFAULT_TREND_TAU 600.0f
+
+struct ForecastStats {
+  uint32_t settled;
+  uint32_t expired;       // no reading within a filing interval of the target
+  float abs_sum;
+  float square_sum;
+  float bias_sum;         // forecast minus reading
+  float abs_max;
+  float persistence_abs_sum;
+};
+
+class HoltForecaster {
+public:
+  HoltForecaster();
+
+  // Horizon in ms, up to FORECAST_MAX_HORIZON; pending forecasts are dropped
+  bool setHorizon(uint32_t horizon_ms);
+  uint32_t horizon() const { return horizon_ms; }
+  // Smoothing time constants in seconds
+  void setTimeConstants(float level_tau, float trend_tau);
+
+  // A reading taken at 't_ms'; NaN (failed read) is skipped
+  void add(uint32_t t_ms, float value);
+
+  // Enough readings for the trend to mean something
+  bool ready() const { return count >= FORECAST_WARMUP; }
+  uint32_t samples() const { return count; }
+  float level() const { return smoothed; }
+  // Units per second
+  float trend() const { return slope; }
+  // Value expected 'horizon' after the last reading
+  float forecast() const;
+
+  const ForecastStats& stats() const { return score; }
+  // Mean absolute error relative to persistence, 1 - mae / persistence mae
+  float skill() const;
+
+private:
+  struct Pending {
+    uint32_t target;
+    float forecast;
+    float persistence;
+  };
+
+  void settle(uint32_t t_ms, float value);
+
+  uint32_t horizon_ms;
+  float level_tau;
+  float trend_tau;
+
+  uint32_t count;
+  uint32_t last_ms;
+  float smoothed;
+  float slope;
+
+  Pending pending[FORECAST_PENDING];
+  uint8_t pending_head;
+  uint8_t pending_count;
+  uint32_t last_filed;
+  ForecastStats score;
+};
+
+#endif
@@ -0,0 +1,69 @@
+#include "I2cBus.h"
+
+I2cBus::I2cBus(TwoWire& bus_wire)
+    : wire(bus_wire), lock(nullptr), max_clock(I2C_FAST_CLOCK), clock(0),
+      transaction_count(0), max_wait_us(0) {
+}
+
+void I2cBus::begin(int sda, int scl, uint32_t new_max_clock) {
+  lock = xSemaphoreCreateMutex();
+  max_clock = new_max_clock;
+  clock = max_clock;
+  wire.begin(sda, scl, clock);
+}
+
+void I2cBus::setMaxClock(uint32_t new_max_clock) {
+  max_clock = new_max_clock;
+}
+
+void I2cBus::acquire(uint32_t device_clock) {
+  unsigned long start = micros();
+  xSemaphoreTake(lock, portMAX_DELAY);
+  unsigned long waited = micros() - start;
+  if (waited > max_wait_us) {
+    max_wait_us = waited;
+  }
+  transaction_count++;
+
+  uint32_t wanted = device_clock < max_clock ? device_clock : max_clock;
+  if (wanted != clock) {
+    wire.setClock(wanted);
+    clock = wanted;
+  }
+}
+
+void I2cBus::release() {
+  xSemaphoreGive(lock);
+}
+
+bool I2cBus::write(uint8_t address, const uint8_t* data, size_t length) {
+  wire.beginTransmission(address);
+  for (size_t i = 0; i < length; i++) {
+    wire.write(data[i]);
+  }
+  return wire.endTransmission() == 0;
+}
+
+bool I2cBus::read(uint8_t address, uint8_t* data, size_t length) {
+  if (wire.requestFrom(address, (uint8_t)length) != length) {
+    return false;
+  }
+  for (size_t i = 0; i < length; i++) {
+    data[i] = wire.read();
+  }
+  return true;
+}
+
+bool I2cBus::writeRegister(uint8_t address, uint8_t reg, uint8_t value) {
+  uint8_t data[2] = {reg, value};
+  return write(address, data, sizeof(data));
+}
+
+bool I2cBus::readRegisters(uint8_t address, uint8_t reg, uint8_t* data, size_t length) {
+  wire.beginTransmission(address);
+  wire.write(reg);
+  if (wire.endTransmission(false) != 0) {
+    return false;
+  }
+  return read(address, data, length);
+}
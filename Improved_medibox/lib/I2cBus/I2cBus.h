@@ -0,0 +1,76 @@
+#ifndef I2C_BUS_H
+#define I2C_BUS_H
+
+#include <Wire.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+// One I2C bus shared by the display and the sensors.
+//
+// Every access is a transaction: the bus is taken for it with a mutex, so
+// a sensor read from the sampling task never lands in the middle of a
+// display flush from loop(), and the other way round. A transaction also
+// sets the clock: the fastest both the device and the bus allow, e.g.
+// fast mode plus for a sensor and fast mode for the display on the same
+// wires. The clock is only reprogrammed when it changes.
+//
+//   {
+//     I2cTransaction transaction(bus, I2C_FAST_PLUS_CLOCK);
+//     bus.writeRegister(address, reg, value);
+//   }
+
+#define I2C_STANDARD_CLOCK 100000
+#define I2C_FAST_CLOCK 400000
+#define I2C_FAST_PLUS_CLOCK 1000000
+
+class I2cBus {
+public:
+  explicit I2cBus(TwoWire& wire);
+
+  void begin(int sda, int scl, uint32_t max_clock);
+  // Highest clock any transaction runs at, e.g. I2C_FAST_CLOCK when the
+  // wiring is too long for fast mode plus
+  void setMaxClock(uint32_t clock);
+  uint32_t maxClock() const { return max_clock; }
+
+  // Take and give back the bus; see I2cTransaction
+  void acquire(uint32_t device_clock);
+  void release();
+
+  // Within a transaction. A register read writes the register address and
+  // reads back with a repeated start.
+  bool write(uint8_t address, const uint8_t* data, size_t length);
+  bool read(uint8_t address, uint8_t* data, size_t length);
+  bool writeRegister(uint8_t address, uint8_t reg, uint8_t value);
+  bool readRegisters(uint8_t address, uint8_t reg, uint8_t* data, size_t length);
+
+  uint32_t transactions() const { return transaction_count; }
+  // Longest a transaction waited for the bus, in microseconds
+  uint32_t maxWait() const { return max_wait_us; }
+
+private:
+  TwoWire& wire;
+  SemaphoreHandle_t lock;
+  uint32_t max_clock;
+  uint32_t clock;
+
+  uint32_t transaction_count;
+  uint32_t max_wait_us;
+};
+
+// Holds the bus for the lifetime of the object
+class I2cTransaction {
+public:
+  I2cTransaction(I2cBus& transaction_bus, uint32_t device_clock) : bus(transaction_bus) {
+    bus.acquire(device_clock);
+  }
+  ~I2cTransaction() { bus.release(); }
+
+private:
+  I2cTransaction(const I2cTransaction&);
+  I2cTransaction& operator=(const I2cTransaction&);
+
+  I2cBus& bus;
+};
+
+#endif
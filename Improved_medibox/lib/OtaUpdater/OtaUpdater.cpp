@@ -0,0 +1,224 @@
+#include "OtaUpdater.h"
+
+#include <Update.h>
+#include <esp_ota_ops.h>
+
+// Abort a download that delivers no data for this long
+#define OTA_STALL_TIMEOUT 15000
+#define OTA_CHUNK_SIZE 1024
+// GET() blocks loop() until the server answers; keep that short
+#define OTA_CONNECT_TIMEOUT 3000
+#define OTA_READ_TIMEOUT 3000
+
+OtaUpdater::OtaUpdater()
+    : status_callback(nullptr), current_state(OTA_IDLE), stream(nullptr),
+      expected_size(0), written(0), last_data_time(0),
+      pending_verify(false), health_checked(false) {
+  url[0] = '\0';
+  memset(expected_digest, 0, sizeof(expected_digest));
+}
+
+void OtaUpdater::begin() {
+  // Find out whether this boot is the first one of a new image
+  const esp_partition_t* running = esp_ota_get_running_partition();
+  esp_ota_img_states_t img_state;
+  if (running != nullptr && esp_ota_get_state_partition(running, &img_state) == ESP_OK) {
+    pending_verify = img_state == ESP_OTA_IMG_PENDING_VERIFY;
+  }
+}
+
+void OtaUpdater::setStatusCallback(StatusCallback callback) {
+  status_callback = callback;
+}
+
+void OtaUpdater::report(const char* status) {
+  Serial.print("OTA: ");
+  Serial.println(status);
+  if (status_callback != nullptr) {
+    status_callback(status);
+  }
+}
+
+void OtaUpdater::fail(const char* reason) {
+  Update.abort();
+  http.end();
+  stream = nullptr;
+  mbedtls_sha256_free(&sha);
+  current_state = OTA_FAILED;
+  report(reason);
+}
+
+static int hex_value(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+bool OtaUpdater::parseDigest(const char* hex) {
+  if (strlen(hex) != 64) {
+    return false;
+  }
+  for (int i = 0; i < 32; i++) {
+    int high = hex_value(hex[2 * i]);
+    int low = hex_value(hex[2 * i + 1]);
+    if (high < 0 || low < 0) {
+      return false;
+    }
+    expected_digest[i] = (high << 4) | low;
+  }
+  return true;
+}
+
+bool OtaUpdater::start(const char* trigger) {
+  if (busy()) {
+    report("busy");
+    return false;
+  }
+
+  // "<url> <sha256-hex> [size]"
+  char digest[65];
+  unsigned long size = 0;
+  int fields = sscanf(trigger, "%159s %64s %lu", url, digest, &size);
+  if (fields < 2 || !parseDigest(digest)) {
+    report("bad trigger");
+    return false;
+  }
+  expected_size = size;
+
+  // The request itself waits for step(), outside the MQTT callback
+  current_state = OTA_CONNECTING;
+  report("queued");
+  return true;
+}
+
+void OtaUpdater::connect() {
+  http.setConnectTimeout(OTA_CONNECT_TIMEOUT);
+  http.setTimeout(OTA_READ_TIMEOUT);
+  if (!http.begin(url)) {
+    current_state = OTA_FAILED;
+    report("bad url");
+    return;
+  }
+  int code = http.GET();
+  if (code != HTTP_CODE_OK) {
+    http.end();
+    current_state = OTA_FAILED;
+    report("http error");
+    return;
+  }
+
+  // Prefer the advertised size so a truncated transfer is caught
+  int content_length = http.getSize();
+  if (expected_size == 0 && content_length > 0) {
+    expected_size = content_length;
+  }
+
+  if (!Update.begin(expected_size > 0 ? expected_size : UPDATE_SIZE_UNKNOWN)) {
+    http.end();
+    current_state = OTA_FAILED;
+    report(Update.errorString());
+    return;
+  }
+
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts(&sha, 0);
+
+  stream = http.getStreamPtr();
+  written = 0;
+  last_data_time = millis();
+  current_state = OTA_DOWNLOADING;
+  report("downloading");
+}
+
+void OtaUpdater::step(size_t budget_bytes) {
+  if (current_state == OTA_CONNECTING) {
+    // One loop pass for the request, the data from the next one on
+    connect();
+    return;
+  }
+  if (current_state != OTA_DOWNLOADING) {
+    return;
+  }
+
+  uint8_t chunk[OTA_CHUNK_SIZE];
+  size_t budget = budget_bytes;
+
+  while (budget > 0 && (expected_size == 0 || written < expected_size)) {
+    int available = stream->available();
+    if (available <= 0) {
+      break;
+    }
+
+    size_t want = available;
+    if (want > sizeof(chunk)) want = sizeof(chunk);
+    if (want > budget) want = budget;
+    if (expected_size > 0 && want > expected_size - written) want = expected_size - written;
+
+    size_t got = stream->readBytes(chunk, want);
+    if (got == 0) {
+      break;
+    }
+
+    if (Update.write(chunk, got) != got) {
+      fail(Update.errorString());
+      return;
+    }
+    mbedtls_sha256_update(&sha, chunk, got);
+
+    written += got;
+    budget -= got;
+    last_data_time = millis();
+  }
+
+  bool complete = expected_size > 0 ? written >= expected_size
+                                    : (!stream->connected() && stream->available() <= 0);
+
+  if (!complete) {
+    if (millis() - last_data_time > OTA_STALL_TIMEOUT) {
+      fail("stalled");
+    }
+    return;
+  }
+
+  uint8_t digest[32];
+  mbedtls_sha256_finish(&sha, digest);
+  mbedtls_sha256_free(&sha);
+  http.end();
+  stream = nullptr;
+
+  if (memcmp(digest, expected_digest, sizeof(digest)) != 0) {
+    Update.abort();
+    current_state = OTA_FAILED;
+    report("sha256 mismatch");
+    return;
+  }
+
+  // Switches the boot partition; the old image stays for rollback
+  if (!Update.end(expected_size == 0)) {
+    current_state = OTA_FAILED;
+    report(Update.errorString());
+    return;
+  }
+
+  current_state = OTA_SUCCEEDED;
+  report("verified, rebooting");
+}
+
+void OtaUpdater::checkHealth(bool healthy, unsigned long uptime_ms, unsigned long deadline_ms) {
+  if (!pending_verify || health_checked) {
+    return;
+  }
+
+  if (healthy) {
+    esp_ota_mark_app_valid_cancel_rollback();
+    pending_verify = false;
+    health_checked = true;
+    report("image confirmed");
+  }
+  else if (uptime_ms > deadline_ms) {
+    health_checked = true;
+    report("health check failed, rolling back");
+    esp_ota_mark_app_invalid_rollback_and_reboot();
+  }
+}
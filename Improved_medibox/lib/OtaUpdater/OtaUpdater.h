@@ -0,0 +1,84 @@
+#ifndef OTA_UPDATER_H
+#define OTA_UPDATER_H
+
+#include <Arduino.h>
+#include <HTTPClient.h>
+#include <mbedtls/sha256.h>
+
+// Over-the-air firmware update into the inactive app partition.
+//
+// The image is streamed from an HTTP URL straight into flash in small
+// chunks (never buffered whole in RAM) while a SHA-256 digest is computed
+// on the fly. The new partition only becomes the boot partition when the
+// digest matches the one given in the trigger. start() only parses the
+// trigger, so it is safe from the MQTT callback; the HTTP request and the
+// download happen in step(), which does a bounded amount of work per call
+// so it can run from loop() without stalling alarms.
+//
+// After rebooting into a new image the app stays "pending verify" until
+// markHealthy() is called; if that does not happen before the health
+// deadline, checkHealth() rolls back to the previous partition.
+
+enum OtaState {
+  OTA_IDLE = 0,
+  OTA_CONNECTING,  // trigger accepted, request made on the next step()
+  OTA_DOWNLOADING,
+  OTA_SUCCEEDED,   // image written and verified, reboot pending
+  OTA_FAILED
+};
+
+class OtaUpdater {
+public:
+  typedef void (*StatusCallback)(const char* status);
+
+  OtaUpdater();
+
+  // Read the state of the running partition. Call once from setup().
+  void begin();
+
+  void setStatusCallback(StatusCallback callback);
+
+  // Parse an MQTT trigger of the form "<url> <sha256-hex> [size]" and queue
+  // the download for step(). Returns false if the trigger is malformed or
+  // busy.
+  bool start(const char* trigger);
+
+  // Make the queued request, or write at most 'budget_bytes' of the image.
+  // Call from loop().
+  void step(size_t budget_bytes = 4096);
+
+  OtaState state() const { return current_state; }
+  bool busy() const { return current_state == OTA_CONNECTING || current_state == OTA_DOWNLOADING; }
+
+  // Post-boot health check of a freshly updated image. 'healthy' is the
+  // application's own verdict (e.g. network and MQTT up). Rolls back if the
+  // image is still unconfirmed after 'deadline_ms' of uptime.
+  void checkHealth(bool healthy, unsigned long uptime_ms, unsigned long deadline_ms);
+
+  // True while running an image that has not been confirmed yet
+  bool pendingVerify() const { return pending_verify; }
+
+private:
+  void fail(const char* reason);
+  void report(const char* status);
+  bool parseDigest(const char* hex);
+  void connect();
+
+  StatusCallback status_callback;
+  OtaState current_state;
+
+  HTTPClient http;
+  WiFiClient* stream;
+  mbedtls_sha256_context sha;
+
+  char url[160];
+  uint8_t expected_digest[32];
+  size_t expected_size;     // 0 when unknown
+  size_t written;
+  unsigned long last_data_time;
+
+  bool pending_verify;
+  bool health_checked;
+};
+
+#endif
@@ -0,0 +1,60 @@
+#include "Profiler.h"
+
+Profiler::Profiler()
+    : head(0), count(0), overwritten_count(0), last_cycles(0), wraps(0), depth(0), stall_cycles(0),
+      is_frozen(false) {
+}
+
+uint64_t Profiler::begin() {
+  uint32_t now = ESP.getCycleCount();
+  if (now < last_cycles) {
+    wraps++;
+  }
+  last_cycles = now;
+  depth++;
+  return (uint64_t)wraps << 32 | now;
+}
+
+void Profiler::end(const char* name, uint64_t start) {
+  // Unsigned difference survives the counter wrap
+  uint32_t cycles = ESP.getCycleCount() - (uint32_t)start;
+  depth--;
+  if (is_frozen) {
+    return;
+  }
+
+  uint16_t slot = head + count;
+  if (slot >= PROFILE_SPANS) {
+    slot -= PROFILE_SPANS;
+  }
+  if (count == PROFILE_SPANS) {
+    head = head + 1 == PROFILE_SPANS ? 0 : head + 1;
+    overwritten_count++;
+  }
+  else {
+    count++;
+  }
+  spans[slot].start = start;
+  spans[slot].name = name;
+  spans[slot].cycles = cycles;
+
+  if (depth == 0 && stall_cycles > 0 && cycles > stall_cycles) {
+    is_frozen = true;
+  }
+}
+
+void Profiler::setStallLimit(uint32_t cycles) {
+  stall_cycles = cycles;
+}
+
+void Profiler::resume() {
+  head = 0;
+  count = 0;
+  overwritten_count = 0;
+  is_frozen = false;
+}
+
+const ProfileSpan& Profiler::span(uint16_t i) const {
+  uint16_t slot = head + i;
+  return spans[slot >= PROFILE_SPANS ? slot - PROFILE_SPANS : slot];
+}
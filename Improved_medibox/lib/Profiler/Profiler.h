@@ -0,0 +1,99 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <Arduino.h>
+#include <stdint.h>
+
+// Spans of the loop's hot path, timed with the CPU cycle counter into a
+// fixed RAM ring, to see where a stalled loop spent its time.
+//
+// A span is one scope, opened and closed by a ProfileScope:
+//
+//   void update_time() {
+//     ProfileScope<true> scope(&profiler, "update_time");
+//     ...
+//   }
+//
+// Opening a span reads the 32-bit cycle counter and extends it to 64 bits
+// (it wraps every 18 s at 240 MHz, spans open far more often); closing it
+// stores the name, start and length, two counter reads and a few stores in
+// all. The ring keeps the newest PROFILE_SPANS spans.
+//
+// Spans are recorded from one task only, the loop: there is no lock, and
+// the cycle counter is per core.
+//
+// With a stall limit the ring freezes at the first outermost span longer
+// than the limit, and holds the stall and what led up to it until it is
+// dumped and resumed. ProfileScope<false> is empty, so profiling that is
+// compiled out costs nothing.
+
+#define PROFILE_SPANS 512
+
+struct ProfileSpan {
+  uint64_t start;     // cycles since boot
+  const char* name;   // a string literal
+  uint32_t cycles;
+};
+
+class Profiler {
+public:
+  Profiler();
+
+  // Open a span: its start in cycles
+  uint64_t begin();
+  // Close the span opened at 'start'
+  void end(const char* name, uint64_t start);
+
+  // Freeze at the first outermost span over 'cycles'; 0 never does
+  void setStallLimit(uint32_t cycles);
+  uint32_t stallLimit() const { return stall_cycles; }
+
+  // A frozen ring drops new spans
+  void freeze() { is_frozen = true; }
+  bool frozen() const { return is_frozen; }
+  // Empty the ring and record again
+  void resume();
+
+  // Spans in the ring, oldest first
+  uint16_t size() const { return count; }
+  const ProfileSpan& span(uint16_t i) const;
+  // Spans lost to a full ring since the last resume()
+  uint32_t overwritten() const { return overwritten_count; }
+
+private:
+  ProfileSpan spans[PROFILE_SPANS];
+  uint16_t head;      // oldest span
+  uint16_t count;
+  uint32_t overwritten_count;
+
+  uint32_t last_cycles;
+  uint32_t wraps;
+  uint8_t depth;      // spans open
+  uint32_t stall_cycles;
+  bool is_frozen;
+};
+
+// Times the scope it lives in as one span
+template <bool Enabled>
+class ProfileScope {
+public:
+  ProfileScope(Profiler* scope_profiler, const char* scope_name)
+      : profiler(scope_profiler), name(scope_name), start(scope_profiler->begin()) {}
+  ~ProfileScope() { profiler->end(name, start); }
+
+private:
+  ProfileScope(const ProfileScope&);
+  ProfileScope& operator=(const ProfileScope&);
+
+  Profiler* profiler;
+  const char* name;
+  uint64_t start;
+};
+
+template <>
+class ProfileScope<false> {
+public:
+  ProfileScope(Profiler*, const char*) {}
+};
+
+#endif
@@ -0,0 +1,57 @@
+#include "PublishScheduler.h"
+
+static int64_t floor_div(int64_t a, int64_t b) {
+  return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
+PublishScheduler::PublishScheduler()
+    : interval(120000), seed(0), slot_index(0), slot_count(0),
+      have_next(false), next_aligned(false), next(0) {
+}
+
+void PublishScheduler::setInterval(uint32_t interval_ms) {
+  interval = interval_ms > 0 ? interval_ms : 1;
+  have_next = false;
+}
+
+void PublishScheduler::setSeed(uint32_t new_seed) {
+  seed = new_seed;
+  have_next = false;
+}
+
+void PublishScheduler::setSlot(uint16_t slot, uint16_t count) {
+  slot_index = count > 0 ? slot % count : 0;
+  slot_count = count;
+  have_next = false;
+}
+
+uint32_t PublishScheduler::offset() const {
+  if (slot_count > 0) {
+    return (uint32_t)((uint64_t)interval * slot_index / slot_count);
+  }
+  return seed % interval;
+}
+
+// First publish time strictly after 'now'
+void PublishScheduler::schedule(int64_t now) {
+  int64_t off = offset();
+  next = floor_div(now - off, interval) * interval + off;
+  if (next <= now) {
+    next += interval;
+  }
+  have_next = true;
+}
+
+bool PublishScheduler::due(int64_t now, bool aligned) {
+  // A new time base, or a clock step back by more than an interval
+  if (!have_next || aligned != next_aligned || next - now > (int64_t)interval) {
+    next_aligned = aligned;
+    schedule(now);
+    return false;
+  }
+  if (now < next) {
+    return false;
+  }
+  schedule(now);
+  return true;
+}
@@ -0,0 +1,49 @@
+#ifndef PUBLISH_SCHEDULER_H
+#define PUBLISH_SCHEDULER_H
+
+#include <stdint.h>
+
+// Places a device's periodic publishes at a fixed offset within the
+// publish interval, so a fleet that boots together does not publish
+// together.
+//
+// The offset is either derived from a per-device seed (e.g. a hash of the
+// device id) or a slot assigned by the server: slot i of n sits at i/n of
+// the interval. Once the clock is synced, publish times are aligned to UTC
+// so the offsets hold across the whole fleet; before that they are
+// relative to boot.
+
+class PublishScheduler {
+public:
+  PublishScheduler();
+
+  void setInterval(uint32_t interval_ms);
+  void setSeed(uint32_t seed);
+
+  // Server-assigned slot; a count of 0 goes back to the seeded offset
+  void setSlot(uint16_t slot, uint16_t count);
+  uint16_t slot() const { return slot_index; }
+  uint16_t slotCount() const { return slot_count; }
+
+  // This device's offset within the interval
+  uint32_t offset() const;
+
+  // True once per interval. 'now' is UTC ms when 'aligned', otherwise
+  // monotonic ms; a change of time base reschedules. Missed publish times
+  // are skipped rather than made up.
+  bool due(int64_t now, bool aligned);
+
+private:
+  void schedule(int64_t now);
+
+  uint32_t interval;
+  uint32_t seed;
+  uint16_t slot_index;
+  uint16_t slot_count;
+
+  bool have_next;
+  bool next_aligned;
+  int64_t next;
+};
+
+#endif
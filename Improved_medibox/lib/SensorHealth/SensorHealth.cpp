@@ -0,0 +1,115 @@
+#include "SensorHealth.h"
+
+#include <math.h>
+
+// Weight of a new change in the running mean square
+#define NOISE_WEIGHT 0.1f
+
+SensorHealth::SensorHealth()
+    : have_accepted(false), accepted(0), have_previous(false), previous(0), previous_change(0), repeats(0),
+      step_candidate(0), step_run(0), noise(0), run_flags(0), run_length(0),
+      checked_count(0), quarantined_count(0) {
+  limits.min = -INFINITY;
+  limits.max = INFINITY;
+  limits.max_step = 0;
+  limits.stuck_readings = 0;
+  limits.noise_rms = 0;
+  for (int i = 0; i < SENSOR_FAULT_KINDS; i++) {
+    fault_counts[i] = 0;
+  }
+}
+
+void SensorHealth::setLimits(const SensorLimits& new_limits) {
+  limits = new_limits;
+}
+
+float SensorHealth::noiseRms() const {
+  return sqrtf(noise);
+}
+
+uint8_t SensorHealth::faults() const {
+  uint8_t flags = run_length >= SENSOR_FAULT_RUN ? run_flags : 0;
+  if (limits.stuck_readings > 0 && repeats + 1 >= limits.stuck_readings) {
+    flags |= SENSOR_FAULT_STUCK;
+  }
+  if (limits.noise_rms > 0 && noise > limits.noise_rms * limits.noise_rms) {
+    flags |= SENSOR_FAULT_NOISE;
+  }
+  return flags;
+}
+
+uint8_t SensorHealth::check(float value) {
+  checked_count++;
+  uint8_t flags = 0;
+
+  if (isnan(value)) {
+    flags = SENSOR_FAULT_NAN;
+  }
+  else if (value < limits.min || value > limits.max) {
+    flags = SENSOR_FAULT_RANGE;
+  }
+  else {
+    // Repeats count every plausible reading, kept or not
+    if (have_previous) {
+      if (value != previous) {
+        repeats = 0;
+      }
+      else if (repeats < UINT16_MAX) {
+        repeats++;
+      }
+    }
+    have_previous = true;
+    previous = value;
+
+    if (limits.max_step > 0 && have_accepted && fabsf(value - accepted) > limits.max_step) {
+      // A glitch, unless the next readings land at the new level too
+      if (step_run > 0 && fabsf(value - step_candidate) <= limits.max_step) {
+        step_run++;
+      }
+      else {
+        step_run = 1;
+      }
+      step_candidate = value;
+      if (step_run < SENSOR_STEP_CONFIRM) {
+        flags = SENSOR_FAULT_STEP;
+      }
+    }
+  }
+
+  // Stuck and noisy are counted for the readings taken in that state
+  uint8_t condition = faults();
+  if (condition & SENSOR_FAULT_STUCK) {
+    fault_counts[3]++;
+  }
+  if (condition & SENSOR_FAULT_NOISE) {
+    fault_counts[4]++;
+  }
+  if (flags == 0) {
+    // Noise makes consecutive changes alternate in sign: for white noise
+    // the mean of -change * previous change is its variance, while a step
+    // or a ramp adds nothing. Glitches quarantined as steps stay out.
+    if (have_accepted) {
+      float change = value - accepted;
+      noise += NOISE_WEIGHT * (fmaxf(0, -change * previous_change) - noise);
+      previous_change = change;
+    }
+    have_accepted = true;
+    accepted = value;
+    step_run = 0;
+    run_flags = 0;
+    run_length = 0;
+    return 0;
+  }
+
+  quarantined_count++;
+  for (int i = 0; i < 3; i++) {
+    if (flags & (1 << i)) {
+      fault_counts[i]++;
+    }
+  }
+  run_flags |= flags;
+  if (run_length < 255) {
+    run_length++;
+  }
+  return flags;
+}
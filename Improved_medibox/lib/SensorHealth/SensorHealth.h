@@ -0,0 +1,93 @@
+#ifndef SENSOR_HEALTH_H
+#define SENSOR_HEALTH_H
+
+#include <stdint.h>
+
+// Streaming health check of one sensor channel, O(1) per reading.
+//
+// Each reading is judged before it reaches any aggregate. It is
+// quarantined when it is
+//
+//   SENSOR_FAULT_NAN    a failed read
+//   SENSOR_FAULT_RANGE  outside what the sensor can physically report
+//   SENSOR_FAULT_STEP   further from the last accepted reading than the
+//                       channel can move between two readings. A jump
+//                       that the next readings confirm is a real change,
+//                       and the channel follows it.
+//
+// Two more faults describe the channel rather than a reading:
+//
+//   SENSOR_FAULT_STUCK  the same value more times in a row than a live
+//                       sensor repeats itself
+//   SENSOR_FAULT_NOISE  reading-to-reading noise above its RMS limit
+//
+// Their readings are still used. A stuck value cannot be told from a
+// steady signal, such as a simulated sensor, and averaging takes care
+// of noise; the channel is reported as faulty instead.
+//
+// faults() is the channel condition for alerting. A run of quarantined
+// readings raises it, not a single one, and a good reading clears it.
+
+enum SensorFault {
+  SENSOR_FAULT_NAN = 0x01,
+  SENSOR_FAULT_RANGE = 0x02,
+  SENSOR_FAULT_STEP = 0x04,
+  SENSOR_FAULT_STUCK = 0x08,
+  SENSOR_FAULT_NOISE = 0x10
+};
+
+#define SENSOR_FAULT_KINDS 5
+// Quarantined readings in a row that make a fault
+#define SENSOR_FAULT_RUN 3
+// Consecutive readings that confirm a step as a real change
+#define SENSOR_STEP_CONFIRM 3
+
+struct SensorLimits {
+  float min;
+  float max;
+  float max_step;          // per reading; 0 disables the step check
+  uint16_t stuck_readings; // 0 disables the stuck check
+  float noise_rms;         // 0 disables the noise check
+};
+
+class SensorHealth {
+public:
+  SensorHealth();
+
+  void setLimits(const SensorLimits& limits);
+
+  // Judge a reading: 0 to use it, otherwise the SensorFault bit (NAN,
+  // RANGE or STEP) it is quarantined for
+  uint8_t check(float value);
+
+  // Current condition of the channel (SensorFault bits)
+  uint8_t faults() const;
+
+  uint32_t checked() const { return checked_count; }
+  uint32_t quarantined() const { return quarantined_count; }
+  // Readings flagged with SensorFault bit 'kind' (0 = NAN ... 4 = NOISE)
+  uint32_t count(int kind) const { return fault_counts[kind]; }
+  float noiseRms() const;
+
+private:
+  SensorLimits limits;
+
+  bool have_accepted;
+  float accepted;          // last accepted reading
+  bool have_previous;
+  float previous;          // last in-range reading, accepted or not
+  float previous_change;   // between the last two accepted readings
+  uint16_t repeats;        // of 'previous'
+  float step_candidate;    // level a run of steps points to
+  uint8_t step_run;
+  float noise;             // exponentially weighted noise variance
+
+  uint8_t run_flags;       // of the current run of quarantined readings
+  uint8_t run_length;
+
+  uint32_t checked_count;
+  uint32_t quarantined_count;
+  uint32_t fault_counts[SENSOR_FAULT_KINDS];
+};
+
+#endif
@@ -0,0 +1,66 @@
+#include "ShadeMath.h"
+
+#include <math.h>
+
+// Normalized intensity at raw = 0, 256, ... 4096 for the photoresistor
+// module (LDR to ground under a 2k pull-up, RL10 = 50k, gamma = 0.7):
+// log10(lux) / 5, so 1 lux reads 0 and 100 klux (full sun) reads 1.
+static const uint16_t LDR_TABLE[17] = {
+  32767, 25796, 22697, 20747, 19252, 17991, 16862, 15807, 14785,
+  13763, 12707, 11578, 10316, 8819, 6867, 3760, 0
+};
+
+ShadeMath::ShadeMath(uint8_t compartments)
+    : count(compartments < SHADE_MAX_COMPARTMENTS ? compartments : SHADE_MAX_COMPARTMENTS), log_ratio(0) {
+  for (uint8_t c = 0; c < SHADE_MAX_COMPARTMENTS; c++) {
+    offset[c] = 30;
+    gain_q16[c] = 0;
+    factor_q16[c] = 0;
+    intensity_q15[c] = SHADE_Q15_ONE / 2;
+  }
+}
+
+void ShadeMath::setIntervals(uint32_t sampling_ms, uint32_t sending_ms) {
+  // Only runs when a slider moves, so the libm call is fine here
+  log_ratio = (sampling_ms > 0 && sending_ms > 0)
+      ? (int32_t)lround(log((double)sampling_ms / sending_ms) * 65536.0) : 0;
+}
+
+void ShadeMath::setParameters(uint8_t c, int theta_offset, float controlling_factor, int ideal_temperature) {
+  offset[c] = theta_offset;
+  factor_q16[c] = ideal_temperature != 0
+      ? (int32_t)lroundf(controlling_factor * 65536.0f / ideal_temperature) : 0;
+  updateGain(c);
+}
+
+void ShadeMath::setIntensity(uint8_t c, uint16_t intensity) {
+  intensity_q15[c] = intensity > SHADE_Q15_ONE ? SHADE_Q15_ONE : intensity;
+  updateGain(c);
+}
+
+// Both shifts round to nearest; truncating them put the angle over a
+// degree below the float formula
+void ShadeMath::updateGain(uint8_t c) {
+  gain_q16[c] = (int32_t)(((int64_t)(180 - offset[c]) * intensity_q15[c] * factor_q16[c] + (1 << 14)) >> 15);
+}
+
+int ShadeMath::angle(uint8_t c, int temperature) const {
+  int32_t angle = offset[c] + (int32_t)(((int64_t)gain_q16[c] * temperature + (1 << 15)) >> 16);
+  if (angle < 0) angle = 0;
+  if (angle > 180) angle = 180;
+  return angle;
+}
+
+void ShadeMath::angles(int temperature, int* out) const {
+  for (uint8_t c = 0; c < count; c++) {
+    out[c] = angle(c, temperature);
+  }
+}
+
+uint16_t ShadeMath::normalizeLdr(int raw) {
+  if (raw <= 0) return LDR_TABLE[0];
+  if (raw >= 4096) return LDR_TABLE[16];
+  int i = raw >> 8;
+  int fraction = raw & 0xff;
+  return LDR_TABLE[i] - (((LDR_TABLE[i] - LDR_TABLE[i + 1]) * fraction) >> 8);
+}
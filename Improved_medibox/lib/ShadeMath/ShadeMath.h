@@ -0,0 +1,63 @@
+#ifndef SHADE_MATH_H
+#define SHADE_MATH_H
+
+#include <stdint.h>
+
+// Shade (servo) angles in fixed point, one per compartment.
+//
+//   angle = offset + (180 - offset) * I * gamma * T / Tmed
+//
+// Everything but the temperature T only changes when a dashboard slider
+// moves or an averaging interval closes, so the product of those terms is
+// folded into one Q16 gain at that point and an angle costs two integer
+// multiplies. I is kept in Q15 (0..1).
+//
+// The terms are stored one array per term (struct of arrays). angles()
+// walks only the offsets and gains, which sit next to each other for all
+// compartments, so a pass over a cabinet costs one multiply-add per
+// compartment.
+//
+// The README's formula also has a ln(ts/tu) factor. It is computed here
+// whenever the intervals change and exposed through logRatio(), but neither
+// applied nor published: with the sampling interval shorter than the upload
+// interval it is negative and would pin the shade at 0 degrees, which is
+// why the firmware never used it.
+
+#define SHADE_Q15_ONE 32768
+#define SHADE_MAX_COMPARTMENTS 8
+
+class ShadeMath {
+public:
+  explicit ShadeMath(uint8_t compartments = 1);
+
+  uint8_t compartments() const { return count; }
+
+  // Sampling (ts) and upload (tu) intervals, shared by all compartments
+  void setIntervals(uint32_t sampling_ms, uint32_t sending_ms);
+  // ln(ts/tu) in Q16
+  int32_t logRatio() const { return log_ratio; }
+
+  void setParameters(uint8_t compartment, int theta_offset, float controlling_factor, int ideal_temperature);
+  void setIntensity(uint8_t compartment, uint16_t intensity_q15);
+  uint16_t intensity(uint8_t compartment) const { return intensity_q15[compartment]; }
+
+  // Shade angle for a temperature in whole degrees, clamped to 0..180
+  int angle(uint8_t compartment, int temperature) const;
+  // Every compartment's angle in one pass
+  void angles(int temperature, int* out) const;
+
+  // Averaged 12-bit LDR reading to normalized intensity (Q15)
+  static uint16_t normalizeLdr(int raw);
+
+private:
+  void updateGain(uint8_t compartment);
+
+  uint8_t count;
+  int32_t offset[SHADE_MAX_COMPARTMENTS];
+  int32_t gain_q16[SHADE_MAX_COMPARTMENTS];       // (180 - offset) * I * factor
+  int32_t factor_q16[SHADE_MAX_COMPARTMENTS];     // controlling factor / ideal temperature
+  uint16_t intensity_q15[SHADE_MAX_COMPARTMENTS];
+  int32_t log_ratio;
+};
+
+#endif
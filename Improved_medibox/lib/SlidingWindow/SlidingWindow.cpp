@@ -0,0 +1,108 @@
+#include "SlidingWindow.h"
+
+#include <math.h>
+
+SlidingWindow::SlidingWindow() : channels(), window_ms(120000), overwritten_count(0) {
+}
+
+void SlidingWindow::setLength(uint32_t length_ms) {
+  window_ms = length_ms > 0 ? length_ms : 1;
+
+  // Re-admit buffered samples a longer window now covers; expire() trims
+  // a shorter one on the next read
+  for (uint8_t c = 0; c < WINDOW_CHANNELS; c++) {
+    Channel& channel = channels[c];
+    if (channel.size == 0) {
+      continue;
+    }
+    uint32_t newest = channel.t[(channel.head + channel.size - 1) % WINDOW_CAPACITY];
+    while (channel.in_window < channel.size) {
+      uint16_t i = (channel.head + channel.size - channel.in_window - 1) % WINDOW_CAPACITY;
+      if (newest - channel.t[i] >= window_ms) {
+        break;
+      }
+      channel.sum += channel.value[i];
+      channel.in_window++;
+    }
+  }
+}
+
+void SlidingWindow::add(uint8_t channel_index, uint32_t t_ms, float value) {
+  if (channel_index >= WINDOW_CHANNELS || isnan(value)) {
+    return;
+  }
+  Channel& channel = channels[channel_index];
+  if (channel.size == WINDOW_CAPACITY) {
+    // The oldest sample may still be in the window
+    if (channel.in_window == channel.size) {
+      channel.sum -= channel.value[channel.head];
+      channel.in_window--;
+      overwritten_count++;
+    }
+    channel.head = (channel.head + 1) % WINDOW_CAPACITY;
+    channel.size--;
+  }
+  uint16_t i = (channel.head + channel.size) % WINDOW_CAPACITY;
+  channel.t[i] = t_ms;
+  channel.value[i] = value;
+  channel.size++;
+  channel.in_window++;
+  channel.sum += value;
+}
+
+// Take samples that have aged out off the running sum; they stay in the
+// buffer in case the window is lengthened
+void SlidingWindow::expire(Channel& channel, uint32_t now_ms) {
+  while (channel.in_window > 0) {
+    uint16_t i = (channel.head + channel.size - channel.in_window) % WINDOW_CAPACITY;
+    // Unsigned difference survives the millis() wrap
+    if ((int32_t)(now_ms - channel.t[i]) < (int32_t)window_ms) {
+      break;
+    }
+    channel.sum -= channel.value[i];
+    channel.in_window--;
+  }
+  if (channel.in_window == 0) {
+    // Clear accumulated rounding
+    channel.sum = 0;
+  }
+}
+
+uint16_t SlidingWindow::newer(const Channel& channel, uint32_t now_ms, double& sum) const {
+  uint16_t n = 0;
+  sum = 0;
+  while (n < channel.in_window) {
+    uint16_t i = (channel.head + channel.size - 1 - n) % WINDOW_CAPACITY;
+    if ((int32_t)(channel.t[i] - now_ms) <= 0) {
+      break;
+    }
+    sum += channel.value[i];
+    n++;
+  }
+  return n;
+}
+
+bool SlidingWindow::mean(uint8_t channel_index, uint32_t now_ms, float& out) {
+  if (channel_index >= WINDOW_CHANNELS) {
+    return false;
+  }
+  Channel& channel = channels[channel_index];
+  expire(channel, now_ms);
+  double newer_sum;
+  uint16_t n = channel.in_window - newer(channel, now_ms, newer_sum);
+  if (n == 0) {
+    return false;
+  }
+  out = (float)((channel.sum - newer_sum) / n);
+  return true;
+}
+
+uint16_t SlidingWindow::count(uint8_t channel_index, uint32_t now_ms) {
+  if (channel_index >= WINDOW_CHANNELS) {
+    return 0;
+  }
+  Channel& channel = channels[channel_index];
+  expire(channel, now_ms);
+  double newer_sum;
+  return channel.in_window - newer(channel, now_ms, newer_sum);
+}
@@ -0,0 +1,60 @@
+#ifndef SLIDING_WINDOW_H
+#define SLIDING_WINDOW_H
+
+#include <stdint.h>
+
+#include <MediboxFeatures.h>
+
+// Sliding means over the last 'length' ms for a few sensor channels.
+//
+// Every channel keeps its samples in a fixed circular buffer with a running
+// sum, so adding a sample and reading a mean are O(1) (amortized over the
+// samples that age out). All channels share one window length and are read
+// at the same instant, so their windows always cover the same span.
+// Changing the length keeps the samples: a longer window is filled from
+// history as far as the buffer reaches, a shorter one just drops the tail.
+
+// The light in each compartment and the temperature
+#define WINDOW_CHANNELS (MEDIBOX_COMPARTMENTS + 1)
+// Samples per channel; a 10 minute window at 1 s sampling fits
+#define WINDOW_CAPACITY 640
+
+class SlidingWindow {
+public:
+  SlidingWindow();
+
+  void setLength(uint32_t length_ms);
+  uint32_t length() const { return window_ms; }
+
+  // NaN samples (failed reads) are ignored
+  void add(uint8_t channel, uint32_t t_ms, float value);
+
+  // Mean of the channel's samples in (now - length, now]; false if none.
+  // Samples stamped after 'now', added by a sampling task since the
+  // window closed, are left for the next window.
+  bool mean(uint8_t channel, uint32_t now_ms, float& out);
+  uint16_t count(uint8_t channel, uint32_t now_ms);
+
+  // Samples pushed out by a full buffer before they aged out of the window
+  uint32_t overwritten() const { return overwritten_count; }
+
+private:
+  struct Channel {
+    uint32_t t[WINDOW_CAPACITY];
+    float value[WINDOW_CAPACITY];
+    uint16_t head;      // oldest sample
+    uint16_t size;
+    uint16_t in_window; // newest samples inside the window
+    double sum;         // of those
+  };
+
+  void expire(Channel& channel, uint32_t now_ms);
+  // Samples in the window stamped after 'now', and their sum
+  uint16_t newer(const Channel& channel, uint32_t now_ms, double& sum) const;
+
+  Channel channels[WINDOW_CHANNELS];
+  uint32_t window_ms;
+  uint32_t overwritten_count;
+};
+
+#endif
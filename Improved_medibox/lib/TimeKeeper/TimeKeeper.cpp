@@ -0,0 +1,150 @@
+#include "TimeKeeper.h"
+
+#include <math.h>
+
+// Accuracy of a single SNTP result
+#define SNTP_ERROR_MS 50
+// A manual set is entered to the minute
+#define MANUAL_ERROR_MS 30000
+// Offsets up to this size are slewed in, larger ones are stepped
+#define SLEW_LIMIT_MS 1000
+// Slew at 5%: one ms of correction per 20 ms
+#define SLEW_RATE 20
+// Drift is only measured over intervals at least this long
+#define MIN_DRIFT_INTERVAL_MS 600000ULL
+// Anything beyond this is a bad sync, not a crystal
+#define MAX_DRIFT_PPM 500.0f
+// Assumed crystal tolerance before drift has been measured
+#define UNKNOWN_DRIFT_PPM 50.0f
+#define MIN_DRIFT_UNCERTAINTY_PPM 2.0f
+#define DRIFT_GAIN 0.25f
+
+TimeKeeper::TimeKeeper()
+    : reference(TIME_UNSET), anchor_utc(0), anchor_mono(0), anchor_error(0),
+      have_sync(false), sync_utc(0), sync_mono(0), last_sync_mono(0),
+      slew_total(0), slew_start(0), slew_duration(0),
+      drift_ppm(0), drift_uncertainty_ppm(UNKNOWN_DRIFT_PPM), drift_samples(0),
+      sync_count(0), holdover_after(7200000) {
+}
+
+void TimeKeeper::setDrift(float ppm) {
+  if (fabsf(ppm) > MAX_DRIFT_PPM) {
+    return;
+  }
+  drift_ppm = ppm;
+  // Trust a stored value less than a fresh measurement
+  drift_uncertainty_ppm = 10.0f;
+  drift_samples = 1;
+}
+
+void TimeKeeper::anchor(int64_t utc_ms, uint64_t mono, uint32_t error_ms, TimeSyncState source) {
+  anchor_utc = utc_ms;
+  anchor_mono = mono;
+  anchor_error = error_ms;
+  slew_total = 0;
+  reference = source;
+}
+
+void TimeKeeper::seed(int64_t utc_ms, uint64_t mono, uint32_t error_ms) {
+  anchor(utc_ms, mono, error_ms, TIME_ESTIMATED);
+}
+
+void TimeKeeper::setManual(int64_t utc_ms, uint64_t mono) {
+  // The last SNTP pair is kept: it still measures drift at the next sync
+  anchor(utc_ms, mono, MANUAL_ERROR_MS, TIME_MANUAL);
+}
+
+int64_t TimeKeeper::extrapolate(uint64_t mono) const {
+  int64_t elapsed = (int64_t)(mono - anchor_mono);
+  int64_t utc = anchor_utc + elapsed + (int64_t)llround(elapsed * (double)drift_ppm * 1e-6);
+
+  if (slew_total != 0) {
+    uint64_t progress = mono - slew_start;
+    if (progress >= slew_duration) {
+      utc += slew_total;
+    } else {
+      utc += (int64_t)slew_total * (int64_t)progress / (int64_t)slew_duration;
+    }
+  }
+  return utc;
+}
+
+int64_t TimeKeeper::now(uint64_t mono) const {
+  return extrapolate(mono);
+}
+
+void TimeKeeper::onSync(int64_t utc_ms, uint64_t mono) {
+  sync_count++;
+
+  // Measure the crystal against true time between two SNTP samples
+  if (have_sync && mono - sync_mono >= MIN_DRIFT_INTERVAL_MS) {
+    double local_elapsed = (double)(mono - sync_mono);
+    double true_elapsed = (double)(utc_ms - sync_utc);
+    float sample = (float)((true_elapsed - local_elapsed) / local_elapsed * 1e6);
+
+    if (fabsf(sample) <= MAX_DRIFT_PPM) {
+      if (drift_samples == 0) {
+        drift_ppm = sample;
+        drift_uncertainty_ppm = UNKNOWN_DRIFT_PPM / 5;
+      } else {
+        float residual = sample - drift_ppm;
+        drift_ppm += DRIFT_GAIN * residual;
+        drift_uncertainty_ppm += DRIFT_GAIN * (fabsf(residual) - drift_uncertainty_ppm);
+      }
+      drift_samples++;
+    }
+  }
+
+  bool disciplined = reference == TIME_SYNCED || reference == TIME_HOLDOVER;
+  int64_t predicted = extrapolate(mono);
+  int64_t offset = utc_ms - predicted;
+
+  if (disciplined && offset <= SLEW_LIMIT_MS && offset >= -SLEW_LIMIT_MS) {
+    anchor(predicted, mono, SNTP_ERROR_MS, TIME_SYNCED);
+    slew_total = (int32_t)offset;
+    slew_start = mono;
+    slew_duration = (uint32_t)(offset < 0 ? -offset : offset) * SLEW_RATE;
+  } else {
+    anchor(utc_ms, mono, SNTP_ERROR_MS, TIME_SYNCED);
+  }
+
+  have_sync = true;
+  sync_utc = utc_ms;
+  sync_mono = mono;
+  last_sync_mono = mono;
+}
+
+TimeSyncState TimeKeeper::state(uint64_t mono) const {
+  if (reference == TIME_SYNCED && mono - last_sync_mono > holdover_after) {
+    return TIME_HOLDOVER;
+  }
+  return reference;
+}
+
+uint32_t TimeKeeper::errorEstimate(uint64_t mono) const {
+  if (reference == TIME_UNSET) {
+    return UINT32_MAX;
+  }
+
+  float uncertainty = UNKNOWN_DRIFT_PPM;
+  if (drift_samples > 0) {
+    uncertainty = drift_uncertainty_ppm > MIN_DRIFT_UNCERTAINTY_PPM
+                    ? drift_uncertainty_ppm : MIN_DRIFT_UNCERTAINTY_PPM;
+  }
+
+  double elapsed = (double)(mono - anchor_mono);
+  double error = anchor_error + elapsed * uncertainty * 1e-6;
+
+  // Correction not slewed in yet
+  if (slew_total != 0 && mono - slew_start < slew_duration) {
+    int64_t applied = (int64_t)slew_total * (int64_t)(mono - slew_start) / (int64_t)slew_duration;
+    int64_t remaining = slew_total - applied;
+    error += remaining < 0 ? -remaining : remaining;
+  }
+
+  return error > UINT32_MAX ? UINT32_MAX : (uint32_t)error;
+}
+
+uint64_t TimeKeeper::sinceSync(uint64_t mono) const {
+  return have_sync ? mono - last_sync_mono : 0;
+}
@@ -0,0 +1,88 @@
+#ifndef TIME_KEEPER_H
+#define TIME_KEEPER_H
+
+#include <stdint.h>
+
+// Disciplined software clock.
+//
+// UTC is extrapolated from the last reference point (an SNTP sync, a manual
+// set or a saved estimate) using the monotonic uptime counter, corrected for
+// the crystal drift measured between successive SNTP syncs. That keeps the
+// clock close to true time through network outages and lets the box report
+// how far off it may be.
+//
+// All times are milliseconds: UTC as Unix time, 'mono' as the monotonic
+// uptime counter (never wraps, never steps).
+
+enum TimeSyncState {
+  TIME_UNSET = 0,    // no reference yet
+  TIME_ESTIMATED,    // seeded from a saved estimate after a warm reset
+  TIME_MANUAL,       // set by hand from the menu
+  TIME_SYNCED,       // recent SNTP sync
+  TIME_HOLDOVER      // SNTP lost, running on drift compensation
+};
+
+class TimeKeeper {
+public:
+  TimeKeeper();
+
+  // SNTP syncs older than this put the clock into holdover
+  void setHoldoverAfter(uint32_t ms) { holdover_after = ms; }
+
+  // Drift measured in an earlier session (e.g. from NVS)
+  void setDrift(float ppm);
+
+  // Start from a saved estimate whose accuracy is 'error_ms'
+  void seed(int64_t utc_ms, uint64_t mono, uint32_t error_ms);
+
+  // Manual time set. Holds until the next SNTP sync.
+  void setManual(int64_t utc_ms, uint64_t mono);
+
+  // SNTP result. Small offsets are slewed in rather than stepped so the
+  // displayed time never jumps back and alarms are not skipped or doubled.
+  void onSync(int64_t utc_ms, uint64_t mono);
+
+  bool valid() const { return reference != TIME_UNSET; }
+  int64_t now(uint64_t mono) const;
+  TimeSyncState state(uint64_t mono) const;
+
+  // Worst-case distance from true UTC at 'mono'
+  uint32_t errorEstimate(uint64_t mono) const;
+
+  float driftPpm() const { return drift_ppm; }
+  bool driftKnown() const { return drift_samples > 0; }
+  uint32_t syncCount() const { return sync_count; }
+
+  // Time since the last SNTP sync (0 if never synced)
+  uint64_t sinceSync(uint64_t mono) const;
+
+private:
+  int64_t extrapolate(uint64_t mono) const;
+  void anchor(int64_t utc_ms, uint64_t mono, uint32_t error_ms, TimeSyncState source);
+
+  TimeSyncState reference;
+
+  // Reference point everything is extrapolated from
+  int64_t anchor_utc;
+  uint64_t anchor_mono;
+  uint32_t anchor_error;
+
+  // Last SNTP sample, used to measure drift over the next interval
+  bool have_sync;
+  int64_t sync_utc;
+  uint64_t sync_mono;
+  uint64_t last_sync_mono;
+
+  // Pending correction being slewed in
+  int32_t slew_total;
+  uint64_t slew_start;
+  uint32_t slew_duration;
+
+  float drift_ppm;
+  float drift_uncertainty_ppm;
+  uint32_t drift_samples;
+  uint32_t sync_count;
+  uint32_t holdover_after;
+};
+
+#endif
@@ -0,0 +1,240 @@
+#include "TimeZone.h"
+
+#include <string.h>
+
+#define SECONDS_PER_DAY 86400
+
+// Days since 1970-01-01 of a proleptic Gregorian date
+static int64_t days_from_civil(int64_t y, int m, int d) {
+  y -= m <= 2;
+  int64_t era = (y >= 0 ? y : y - 399) / 400;
+  int64_t yoe = y - era * 400;
+  int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+static int year_from_days(int64_t days) {
+  days += 719468;
+  int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+  int64_t doe = days - era * 146097;
+  int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  int64_t mp = (5 * doy + 2) / 153;
+  int m = mp < 10 ? mp + 3 : mp - 9;
+  return (int)(yoe + era * 400 + (m <= 2));
+}
+
+static bool is_leap(int year) {
+  return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+static int days_in_month(int year, int month) {
+  static const int days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  return month == 2 && is_leap(year) ? 29 : days[month - 1];
+}
+
+static int64_t floor_div(int64_t a, int64_t b) {
+  return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
+// Parsing helpers: each advances 'p' and returns false on malformed input
+
+static bool parse_name(const char*& p) {
+  if (*p == '<') {
+    const char* end = strchr(p, '>');
+    if (end == nullptr || end == p + 1) return false;
+    p = end + 1;
+    return true;
+  }
+  const char* start = p;
+  while ((*p >= 'A' && *p <= 'Z') || (*p >= 'a' && *p <= 'z')) p++;
+  return p - start >= 3;
+}
+
+static bool parse_number(const char*& p, int max, int& value) {
+  if (*p < '0' || *p > '9') return false;
+  value = 0;
+  while (*p >= '0' && *p <= '9') {
+    value = value * 10 + (*p - '0');
+    if (value > max) return false;
+    p++;
+  }
+  return true;
+}
+
+// [+|-]hh[:mm[:ss]] in seconds, sign as written
+static bool parse_time(const char*& p, int max_hours, int32_t& seconds) {
+  int sign = 1;
+  if (*p == '+' || *p == '-') {
+    sign = *p == '-' ? -1 : 1;
+    p++;
+  }
+  int h, m = 0, s = 0;
+  if (!parse_number(p, max_hours, h)) return false;
+  if (*p == ':') {
+    p++;
+    if (!parse_number(p, 59, m)) return false;
+    if (*p == ':') {
+      p++;
+      if (!parse_number(p, 59, s)) return false;
+    }
+  }
+  seconds = sign * (h * 3600 + m * 60 + s);
+  return true;
+}
+
+TimeZone::TimeZone()
+    : std_offset(0), dst_offset(0), has_dst(false),
+      span_start(INT64_MIN), span_end(INT64_MAX), span_offset(0), span_dst(false) {
+  strcpy(tz, "UTC0");
+  dst_start = dst_end = {'M', 1, 1, 0, 0};
+}
+
+bool TimeZone::set(const char* posix_tz) {
+  if (posix_tz == nullptr || strlen(posix_tz) >= TZ_MAX_LENGTH || !parse(posix_tz)) {
+    return false;
+  }
+  strcpy(tz, posix_tz);
+  return true;
+}
+
+bool TimeZone::parse(const char* posix_tz) {
+  const char* p = posix_tz;
+  int32_t offset;
+
+  // std offset: POSIX counts hours west of UTC
+  if (!parse_name(p) || !parse_time(p, 24, offset)) return false;
+  int32_t new_std = -offset;
+  int32_t new_dst = new_std;
+  bool new_has_dst = false;
+  Rule rules[2] = {{'M', 3, 2, 0, 7200}, {'M', 11, 1, 0, 7200}};   // US default
+
+  if (*p != '\0') {
+    if (!parse_name(p)) return false;
+    new_has_dst = true;
+    new_dst = new_std + 3600;
+    if (*p == '+' || *p == '-' || (*p >= '0' && *p <= '9')) {
+      if (!parse_time(p, 24, offset)) return false;
+      new_dst = -offset;
+    }
+
+    if (*p == ',') {
+      for (int i = 0; i < 2; i++) {
+        if (*p++ != ',') return false;
+        Rule& rule = rules[i];
+        rule.time = 7200;
+        if (*p == 'M') {
+          p++;
+          rule.kind = 'M';
+          if (!parse_number(p, 12, rule.month) || rule.month < 1 || *p++ != '.') return false;
+          if (!parse_number(p, 5, rule.week) || rule.week < 1 || *p++ != '.') return false;
+          if (!parse_number(p, 6, rule.day)) return false;
+        } else if (*p == 'J') {
+          p++;
+          rule.kind = 'J';
+          if (!parse_number(p, 365, rule.day) || rule.day < 1) return false;
+        } else {
+          rule.kind = 'D';
+          if (!parse_number(p, 365, rule.day)) return false;
+        }
+        if (*p == '/') {
+          p++;
+          // RFC 8536 extension allows -167..167 hours
+          if (!parse_time(p, 167, rule.time)) return false;
+        }
+      }
+    }
+    if (*p != '\0') return false;
+  }
+
+  std_offset = new_std;
+  dst_offset = new_dst;
+  has_dst = new_has_dst;
+  dst_start = rules[0];
+  dst_end = rules[1];
+
+  // Force the span to be recomputed on the next lookup
+  span_start = INT64_MAX;
+  span_end = INT64_MIN;
+  return true;
+}
+
+// UTC instant of a rule in 'year'. Rule times are local wall time as it
+// reads before the change.
+int64_t TimeZone::transitionUtc(int year, const Rule& rule, int32_t offset_before) const {
+  int64_t jan1 = days_from_civil(year, 1, 1);
+  int64_t day;
+
+  if (rule.kind == 'M') {
+    int64_t first = days_from_civil(year, rule.month, 1);
+    int weekday = (int)(((first + 4) % 7 + 7) % 7);   // 1970-01-01 was a Thursday
+    int mday = 1 + (rule.day - weekday + 7) % 7 + (rule.week - 1) * 7;
+    while (mday > days_in_month(year, rule.month)) {
+      mday -= 7;   // week 5 means "last"
+    }
+    day = first + mday - 1;
+  } else if (rule.kind == 'J') {
+    // 1..365, February 29th is never counted
+    day = jan1 + rule.day - 1 + (is_leap(year) && rule.day >= 60 ? 1 : 0);
+  } else {
+    day = jan1 + rule.day;
+  }
+
+  return day * SECONDS_PER_DAY + rule.time - offset_before;
+}
+
+void TimeZone::refresh(int64_t utc) {
+  if (!has_dst) {
+    span_start = INT64_MIN;
+    span_end = INT64_MAX;
+    span_offset = std_offset;
+    span_dst = false;
+    return;
+  }
+
+  // Transitions of the surrounding years, in time order. Southern
+  // hemisphere rules end DST before they start it in the same year.
+  int year = year_from_days(floor_div(utc, SECONDS_PER_DAY));
+  int64_t at[6];
+  bool to_dst[6];
+  int n = 0;
+  for (int y = year - 1; y <= year + 1; y++) {
+    at[n] = transitionUtc(y, dst_start, std_offset);
+    to_dst[n++] = true;
+    at[n] = transitionUtc(y, dst_end, dst_offset);
+    to_dst[n++] = false;
+  }
+  for (int i = 1; i < n; i++) {
+    for (int j = i; j > 0 && at[j] < at[j - 1]; j--) {
+      int64_t t = at[j]; at[j] = at[j - 1]; at[j - 1] = t;
+      bool d = to_dst[j]; to_dst[j] = to_dst[j - 1]; to_dst[j - 1] = d;
+    }
+  }
+
+  span_start = INT64_MIN;
+  span_end = INT64_MAX;
+  span_dst = !to_dst[0];
+  for (int i = 0; i < n; i++) {
+    if (at[i] <= utc) {
+      span_start = at[i];
+      span_dst = to_dst[i];
+    } else {
+      span_end = at[i];
+      break;
+    }
+  }
+  span_offset = span_dst ? dst_offset : std_offset;
+}
+
+int32_t TimeZone::offsetAt(int64_t utc) {
+  if (utc < span_start || utc >= span_end) {
+    refresh(utc);
+  }
+  return span_offset;
+}
+
+bool TimeZone::isDst(int64_t utc) {
+  offsetAt(utc);
+  return span_dst;
+}
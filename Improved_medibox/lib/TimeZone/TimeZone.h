@@ -0,0 +1,59 @@
+#ifndef TIME_ZONE_H
+#define TIME_ZONE_H
+
+#include <stdint.h>
+
+// POSIX TZ rule ("CET-1CEST,M3.5.0,M10.5.0/3") with a cached transition span.
+//
+// The UTC offset only changes at DST transitions, so the offset in effect is
+// computed once together with the UTC instants at which it starts and ends.
+// Until the clock crosses the end of that span, offsetAt() is a compare and
+// a load; the next span is computed when the transition is reached.
+
+#define TZ_MAX_LENGTH 48
+
+class TimeZone {
+public:
+  TimeZone();
+
+  // Accepts a POSIX TZ string. On error the previous rule is kept.
+  bool set(const char* posix_tz);
+  const char* rule() const { return tz; }
+
+  // Offset east of UTC in seconds at 'utc' (Unix seconds)
+  int32_t offsetAt(int64_t utc);
+  bool isDst(int64_t utc);
+
+  // Start of the next offset change after the cached span, or INT64_MAX
+  // for zones without DST. Valid after offsetAt().
+  int64_t nextTransition() const { return span_end; }
+
+private:
+  struct Rule {
+    char kind;      // 'M', 'J' or 'D' (zero-based day of year)
+    int month;
+    int week;
+    int day;        // day of week for 'M', day of year otherwise
+    int32_t time;   // seconds after local midnight
+  };
+
+  bool parse(const char* posix_tz);
+  int64_t transitionUtc(int year, const Rule& rule, int32_t offset_before) const;
+  void refresh(int64_t utc);
+
+  char tz[TZ_MAX_LENGTH];
+
+  int32_t std_offset;   // seconds east of UTC
+  int32_t dst_offset;
+  bool has_dst;
+  Rule dst_start;
+  Rule dst_end;
+
+  // Cached span [span_start, span_end) and its offset
+  int64_t span_start;
+  int64_t span_end;
+  int32_t span_offset;
+  bool span_dst;
+};
+
+#endif
@@ -0,0 +1,287 @@
+#include "TraceLog.h"
+
+#include <math.h>
+#include <string.h>
+
+#define FLAG_SET 0x10
+
+static uint64_t zigzag(int64_t value) {
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+TraceWriter::TraceWriter()
+    : sink(nullptr), used(0), written(0), last_t(0),
+      digital_known(0), digital_level(0),
+      dht_known(false), dht_temperature(0), dht_humidity(0), dht_failed(false) {
+}
+
+void TraceWriter::begin(Sink new_sink) {
+  sink = new_sink;
+  used = 0;
+  written = 0;
+  last_t = 0;
+  digital_known = 0;
+  dht_known = false;
+  putBytes(TRACE_MAGIC, 4);
+}
+
+void TraceWriter::end() {
+  if (sink == nullptr) {
+    return;
+  }
+  flush();
+  sink = nullptr;
+}
+
+void TraceWriter::flush() {
+  if (sink != nullptr && used > 0) {
+    sink(buffer, used);
+  }
+  used = 0;
+}
+
+void TraceWriter::put(uint8_t b) {
+  if (used == sizeof(buffer)) {
+    flush();
+  }
+  buffer[used++] = b;
+  written++;
+}
+
+void TraceWriter::putBytes(const void* data, size_t length) {
+  const uint8_t* bytes = (const uint8_t*)data;
+  for (size_t i = 0; i < length; i++) {
+    put(bytes[i]);
+  }
+}
+
+void TraceWriter::putVarint(uint64_t value) {
+  while (value >= 0x80) {
+    put((uint8_t)(value | 0x80));
+    value >>= 7;
+  }
+  put((uint8_t)value);
+}
+
+void TraceWriter::putSigned(int64_t value) {
+  putVarint(zigzag(value));
+}
+
+void TraceWriter::header(uint8_t type, uint8_t flags, uint32_t t_ms) {
+  put(type | flags);
+  // millis() wraps after 49 days; the unsigned difference survives that
+  putVarint((uint32_t)(t_ms - last_t));
+  last_t = t_ms;
+}
+
+void TraceWriter::analog(uint32_t t_ms, uint8_t pin, int value) {
+  if (sink == nullptr) {
+    return;
+  }
+  header(TRACE_ANALOG, 0, t_ms);
+  put(pin);
+  putVarint(value < 0 ? 0 : value);
+}
+
+void TraceWriter::digital(uint32_t t_ms, uint8_t pin, bool level) {
+  if (sink == nullptr || pin >= TRACE_MAX_PIN) {
+    return;
+  }
+  uint64_t bit = 1ULL << pin;
+  if ((digital_known & bit) && ((digital_level & bit) != 0) == level) {
+    return;
+  }
+  digital_known |= bit;
+  digital_level = level ? digital_level | bit : digital_level & ~bit;
+
+  header(TRACE_DIGITAL, level ? FLAG_SET : 0, t_ms);
+  put(pin);
+}
+
+void TraceWriter::dht(uint32_t t_ms, float temperature, float humidity) {
+  if (sink == nullptr) {
+    return;
+  }
+  bool failed = isnan(temperature) || isnan(humidity);
+  int32_t t10 = failed ? 0 : (int32_t)lroundf(temperature * 10);
+  int32_t h10 = failed ? 0 : (int32_t)lroundf(humidity * 10);
+
+  if (dht_known && failed == dht_failed && t10 == dht_temperature && h10 == dht_humidity) {
+    return;
+  }
+  dht_known = true;
+  dht_failed = failed;
+  dht_temperature = t10;
+  dht_humidity = h10;
+
+  header(TRACE_DHT, failed ? FLAG_SET : 0, t_ms);
+  if (!failed) {
+    putSigned(t10);
+    putSigned(h10);
+  }
+}
+
+void TraceWriter::mqtt(uint32_t t_ms, const char* topic, const uint8_t* payload, size_t length) {
+  if (sink == nullptr) {
+    return;
+  }
+  size_t topic_length = strlen(topic);
+  if (topic_length >= TRACE_MAX_TOPIC || length > TRACE_MAX_PAYLOAD) {
+    return;
+  }
+  header(TRACE_MQTT, 0, t_ms);
+  putVarint(topic_length);
+  putBytes(topic, topic_length);
+  putVarint(length);
+  putBytes(payload, length);
+}
+
+void TraceWriter::sntp(uint32_t t_ms, int64_t utc_ms) {
+  if (sink == nullptr) {
+    return;
+  }
+  header(TRACE_SNTP, 0, t_ms);
+  putSigned(utc_ms);
+}
+
+void TraceWriter::pref(const char* key, const void* value, size_t length) {
+  if (sink == nullptr) {
+    return;
+  }
+  size_t key_length = strlen(key);
+  if (key_length >= TRACE_MAX_KEY || length > TRACE_MAX_PAYLOAD) {
+    return;
+  }
+  header(TRACE_PREF, 0, last_t);
+  putVarint(key_length);
+  putBytes(key, key_length);
+  putVarint(length);
+  putBytes(value, length);
+}
+
+TraceReader::TraceReader(const uint8_t* trace, size_t trace_length)
+    : data(trace), length(trace_length), pos(0), t(0), header_ok(false), bad(false) {
+  if (length >= 4 && memcmp(data, TRACE_MAGIC, 4) == 0) {
+    header_ok = true;
+    pos = 4;
+  }
+}
+
+bool TraceReader::get(uint8_t& b) {
+  if (pos >= length) {
+    return false;
+  }
+  b = data[pos++];
+  return true;
+}
+
+bool TraceReader::getVarint(uint64_t& value) {
+  value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    uint8_t b;
+    if (!get(b)) {
+      return false;
+    }
+    value |= (uint64_t)(b & 0x7f) << shift;
+    if ((b & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool TraceReader::getSigned(int64_t& value) {
+  uint64_t raw;
+  if (!getVarint(raw)) {
+    return false;
+  }
+  value = unzigzag(raw);
+  return true;
+}
+
+bool TraceReader::getBlock(uint8_t* out, size_t capacity, size_t& block_length) {
+  uint64_t n;
+  if (!getVarint(n) || n > capacity || n > length - pos) {
+    return false;
+  }
+  memcpy(out, data + pos, n);
+  pos += n;
+  block_length = n;
+  return true;
+}
+
+bool TraceReader::next(TraceRecord& record) {
+  if (!header_ok || bad || pos >= length) {
+    return false;
+  }
+
+  uint8_t head;
+  uint64_t delta;
+  if (!get(head) || !getVarint(delta)) {
+    bad = true;
+    return false;
+  }
+  t += delta;
+
+  record.type = head & 0x0f;
+  record.t_ms = t;
+  bool flag = (head & FLAG_SET) != 0;
+  bool ok = true;
+
+  switch (record.type) {
+    case TRACE_ANALOG: {
+      uint64_t value = 0;
+      ok = get(record.pin) && getVarint(value);
+      record.value = (int)value;
+      break;
+    }
+    case TRACE_DIGITAL:
+      ok = get(record.pin);
+      record.level = flag;
+      break;
+    case TRACE_DHT: {
+      record.dht_failed = flag;
+      record.temperature = NAN;
+      record.humidity = NAN;
+      if (!flag) {
+        int64_t t10 = 0, h10 = 0;
+        ok = getSigned(t10) && getSigned(h10);
+        record.temperature = t10 / 10.0f;
+        record.humidity = h10 / 10.0f;
+      }
+      break;
+    }
+    case TRACE_MQTT: {
+      size_t topic_length;
+      ok = getBlock((uint8_t*)record.topic, sizeof(record.topic) - 1, topic_length) &&
+           getBlock(record.payload, sizeof(record.payload), record.payload_length);
+      if (ok) {
+        record.topic[topic_length] = '\0';
+      }
+      break;
+    }
+    case TRACE_SNTP:
+      ok = getSigned(record.utc_ms);
+      break;
+    case TRACE_PREF: {
+      size_t key_length;
+      ok = getBlock((uint8_t*)record.key, sizeof(record.key) - 1, key_length) &&
+           getBlock(record.payload, sizeof(record.payload), record.payload_length);
+      if (ok) {
+        record.key[key_length] = '\0';
+      }
+      break;
+    }
+    default:
+      ok = false;
+  }
+
+  if (!ok) {
+    bad = true;
+  }
+  return ok;
+}
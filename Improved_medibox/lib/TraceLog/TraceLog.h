@@ -0,0 +1,127 @@
+#ifndef TRACE_LOG_H
+#define TRACE_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Compact binary log of everything the firmware reads from the outside
+// world, so a session can be replayed deterministically on the host.
+//
+// Layout: "MBT1" followed by records. Each record is a header byte (type in
+// the low nibble, flags in the high nibble), the time since the previous
+// record as a varint in ms, and a type specific payload:
+//
+//   TRACE_ANALOG   pin, value (varint)
+//   TRACE_DIGITAL  pin; level in flag bit 0
+//   TRACE_DHT      temperature and humidity in 0.1 units (zigzag varints);
+//                  flag bit 0 marks a failed (NaN) read without payload
+//   TRACE_MQTT     topic length, topic, payload length, payload
+//   TRACE_SNTP     UTC ms (zigzag varint)
+//   TRACE_PREF     key length, key, value length, value (NVS state at boot)
+//
+// Digital and DHT reads are only logged when they change, so a button that
+// is polled every loop costs two records per press.
+
+#define TRACE_MAGIC "MBT1"
+#define TRACE_MAX_TOPIC 96
+#define TRACE_MAX_PAYLOAD 512
+#define TRACE_MAX_KEY 16
+#define TRACE_MAX_PIN 64
+
+enum TraceRecordType {
+  TRACE_ANALOG = 1,
+  TRACE_DIGITAL,
+  TRACE_DHT,
+  TRACE_MQTT,
+  TRACE_SNTP,
+  TRACE_PREF
+};
+
+class TraceWriter {
+public:
+  typedef void (*Sink)(const uint8_t* data, size_t length);
+
+  TraceWriter();
+
+  // Start a trace; everything encoded is handed to 'sink' in blocks
+  void begin(Sink sink);
+  void end();
+  bool active() const { return sink != nullptr; }
+  uint32_t bytesWritten() const { return written; }
+
+  void analog(uint32_t t_ms, uint8_t pin, int value);
+  void digital(uint32_t t_ms, uint8_t pin, bool level);
+  void dht(uint32_t t_ms, float temperature, float humidity);
+  void mqtt(uint32_t t_ms, const char* topic, const uint8_t* payload, size_t length);
+  void sntp(uint32_t t_ms, int64_t utc_ms);
+  void pref(const char* key, const void* value, size_t length);
+
+  // Hand buffered bytes to the sink
+  void flush();
+
+private:
+  void header(uint8_t type, uint8_t flags, uint32_t t_ms);
+  void put(uint8_t b);
+  void putBytes(const void* data, size_t length);
+  void putVarint(uint64_t value);
+  void putSigned(int64_t value);
+
+  Sink sink;
+  uint8_t buffer[256];
+  size_t used;
+  uint32_t written;
+  uint32_t last_t;
+
+  uint64_t digital_known;
+  uint64_t digital_level;
+  bool dht_known;
+  int32_t dht_temperature;
+  int32_t dht_humidity;
+  bool dht_failed;
+};
+
+struct TraceRecord {
+  uint8_t type;
+  uint64_t t_ms;         // since the start of the trace
+
+  uint8_t pin;
+  int value;             // analog value
+  bool level;            // digital level
+
+  bool dht_failed;
+  float temperature;
+  float humidity;
+
+  char topic[TRACE_MAX_TOPIC];
+  char key[TRACE_MAX_KEY];
+  uint8_t payload[TRACE_MAX_PAYLOAD];   // MQTT payload or pref value
+  size_t payload_length;
+
+  int64_t utc_ms;
+};
+
+class TraceReader {
+public:
+  TraceReader(const uint8_t* data, size_t length);
+
+  bool valid() const { return header_ok; }
+
+  // Decode the next record. Returns false at the end or on corruption.
+  bool next(TraceRecord& record);
+  bool corrupt() const { return bad; }
+
+private:
+  bool get(uint8_t& b);
+  bool getVarint(uint64_t& value);
+  bool getSigned(int64_t& value);
+  bool getBlock(uint8_t* out, size_t capacity, size_t& length);
+
+  const uint8_t* data;
+  size_t length;
+  size_t pos;
+  uint64_t t;
+  bool header_ok;
+  bool bad;
+};
+
+#endif
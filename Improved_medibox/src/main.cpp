@@ -1,17 +1,56 @@
 #include <Wire.h>
 #include <Adafruit_GFX.h>
 #include <Adafruit_SSD1306.h>
-#include <DHTesp.h>
 #include <WiFi.h>
 #include <PubSubClient.h>
 #include <ESP32Servo.h>
 #include <cmath>
+#include <Preferences.h>
+#include <esp_system.h>
+#include <sys/time.h>
+#include <esp_sntp.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <TimeKeeper.h>
+#include <TimeZone.h>
+#include <Annunciator.h>
+#include <OtaUpdater.h>
+#include <LittleFS.h>
+#include <TraceLog.h>
+#include <PublishScheduler.h>
+#include <History.h>
+#include <AdherenceLog.h>
+#include <ShadeMath.h>
+#include <AdaptiveSampler.h>
+#include <ExceptionReporter.h>
+#include <SlidingWindow.h>
+#include <ConfigCoalescer.h>
+#include <ConfigMessage.h>
+#include <ColdChain.h>
+#include <HoltForecaster.h>
+#include <SensorHealth.h>
+#include <I2cBus.h>
+#include <ClimateSensor.h>
+#include <DhtSensor.h>
+#include <Sht3xSensor.h>
+#include <Bme280Sensor.h>
+#include <Profiler.h>
+#include <MediboxFeatures.h>
+#include <MediboxUi.h>
+#include <AlarmTable.h>
+#include <EnvironmentCheck.h>
 
 
 #define SCREEN_WIDTH 128
 #define SCREEN_HEIGHT 64
 #define OLED_RESET -1
 #define SCREEN_ADDRESS 0x3c
+// The SSD1306 is only specified up to fast mode; sensors on the same bus
+// may run faster between flushes
+#define OLED_I2C_CLOCK I2C_FAST_CLOCK
 
 #define BUZZER 5
 #define LED_1 18
@@ -20,20 +59,104 @@
 #define PB_UP 33
 #define PB_DOWN 35
 #define DHTPIN 12
-#define LDR_PIN 36
-#define servoMotorPin 14
+
+// Shaded compartments (MEDIBOX_COMPARTMENTS, see MediboxFeatures.h), each
+// with a light sensor and a servo. The LDRs need ADC1 pins, as ADC2 is
+// taken by WiFi; 37 and 38 are only brought out on some modules.
+#define COMPARTMENTS MEDIBOX_COMPARTMENTS
+#define ALL_COMPARTMENTS ((1U << COMPARTMENTS) - 1)
+const uint8_t LDR_PINS[] = {36, 39, 37, 38};
+const uint8_t SERVO_PINS[] = {14, 27, 26, 25};
+static_assert(COMPARTMENTS >= 1 && COMPARTMENTS <= sizeof(LDR_PINS), "MEDIBOX_COMPARTMENTS is 1 to 4");
 
 
 #define NTP_SERVER     "pool.ntp.org"
-#define UTC_OFFSET     0
-#define UTC_OFFSET_DST 0
+#define NTP_SERVER_2   "time.google.com"
+#define NTP_SERVER_3   "time.cloudflare.com"
+
+// A new OTA image must reach the broker within this long or it is rolled back
+#define OTA_HEALTH_DEADLINE 300000
+#define OTA_HEALTH_MIN_UPTIME 30000
+
+// Reconnect backoff: doubles from MIN to MAX, each wait jittered by +-50%
+// so that a fleet coming back from a broker or power outage spreads out
+#define MQTT_RETRY_MIN 2000
+#define MQTT_RETRY_MAX 60000
+// The first connection after boot waits up to this long
+#define MQTT_STARTUP_JITTER 5000
+// Report publish latency this often
+#define PUBLISH_STATS_INTERVAL 600000
+
+// History range replies: chunk payload size and chunks sent per loop; the
+// 15-minute tier is kept in flash
+#define HISTORY_FILE "/history.bin"
+#define HISTORY_CHUNK 384
+#define HISTORY_CHUNKS_PER_LOOP 4
+
+// Medication adherence log: a dose acknowledged within ON_TIME counts as on
+// time, one still open after MISSED_AFTER is logged as missed (seconds)
+#define ADHERENCE_FILE "/adherence.log"
+#define ADHERENCE_MAX_BYTES 16384
+#define ADHERENCE_ON_TIME 900
+#define ADHERENCE_MISSED_AFTER 3600
+#define ADHERENCE_ROWS_PER_CHUNK 10
+// Records read per loop for a range reply, matching or not
+#define ADHERENCE_SCAN_PER_LOOP 64
+
+// Sensor sampling runs in its own task, woken by one esp_timer per channel,
+// so menus and other blocking code in loop() no longer stall it
+#define SAMPLE_QUEUE_LENGTH 8
+#define SAMPLE_TASK_STACK 4096
+#define SAMPLE_TASK_PRIORITY 2
+#define SAMPLE_TASK_CORE 1
+
+// Sensor health limits: physical range, largest step between readings,
+// identical readings in a row that mean a stuck sensor, and the RMS change
+// that means a noisy one. An LDR reading on the ADC rails is an open or
+// shorted divider; a live one never repeats itself 30 times.
+const SensorLimits LDR_LIMITS = {1, 4094, 0, 30, 400};
+const SensorLimits DHT_LIMITS = {-40, 80, 5, 360, 1.0f};
+
+// Dashboard sliders: updates are staged in sliderConfig and applied
+// together once per CONFIG_DEFAULT_WINDOW, however fast they arrive. The
+// ideal temperature is shared; the other three are per compartment, at
+// SLIDER_<NAME> + SLIDER_COMPARTMENT * c.
+#define SLIDER_IDEAL_STORAGE_TEMP 0
+#define SLIDER_THETA_OFFSET 1
+#define SLIDER_LIGHT_INTENSITY 2
+#define SLIDER_CONTROLLING_FACTOR 3
+#define SLIDER_COMPARTMENT 3
+static_assert(1 + SLIDER_COMPARTMENT * COMPARTMENTS <= CONFIG_MAX_PARAMETERS, "too many sliders");
+
+// Marks a valid time estimate in RTC memory
+#define RTC_TIME_MAGIC 0x4D424F59
+// Assumed accuracy of the RTC memory estimate after a warm reset
+#define RTC_ESTIMATE_ERROR 5000
+// Publish time sync status this often
+#define TIME_STATUS_INTERVAL 600000
+
+// Input trace for host replay (see host/), recorded from boot when armed
+#define TRACE_FILE "/trace.bin"
+#define TRACE_MAX_BYTES 524288
+#define TRACE_CHUNK 384
+
+// Hot path spans (MEDIBOX_FEATURE_PROFILING), dumped this many to an MQTT
+// message; a span line is at most about 50 characters
+#define PROFILE_CHUNK 8
+
+#define DEVICE_ID_LENGTH 16
+// Longest topic name, "Ideal_Storage_Temperature_Config"
+#define TOPIC_NAME_LENGTH 32
+// "<name>_<device_id>_<compartment>": the name, the id with its NUL, and
+// room for the separators and compartment number
+#define TOPIC_LENGTH (TOPIC_NAME_LENGTH + DEVICE_ID_LENGTH + 8)
 
 //Declare functions
 
-void print_line(String text, int column, int row, int text_size);
 void update_time();
 void update_time_with_check_alarm(void);
 void ring_alarm(int alarm_index);
+void stop_alarm();
 void go_to_menu();
 void set_time();
 void set_alarm(int alarm);
@@ -43,37 +166,125 @@ void set_time_zone();
 void view_alarms();
 void delete_alarm();
 void Warning_alarm();
+void update_annunciator();
+void handle_alarm_buttons();
+void handle_warning_buttons();
 void setupMqtt();
 void connectToBroker();
 void receiveCallback(char* topic, byte* payload, unsigned int length);
+void update_ota();
+void save_alarms();
+void save_time_zone();
+void update_network();
+uint64_t monotonic_ms();
+void stop_trace();
+void dump_profile_serial();
 
 //Declare objects
-Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET);
-DHTesp dhtSensor;
-Servo servoMotor;
+I2cBus i2cBus(Wire);
+Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET, OLED_I2C_CLOCK, OLED_I2C_CLOCK);
+MediboxUi ui(display, {PB_UP, PB_DOWN, PB_OK, PB_CANCEL});
+DhtSensor dhtDriver(DHTPIN);
+Sht3xSensor sht3xDriver(i2cBus);
+Bme280Sensor bme280Driver(i2cBus);
+ClimateSensor* const climate_drivers[] = {&dhtDriver, &sht3xDriver, &bme280Driver};
+// Selected from config; the DHT unless an I2C sensor answers
+ClimateSensor* climateSensor = &dhtDriver;
+FeatureSlot<MediboxFeatures::servo, Servo> servoMotor[COMPARTMENTS];
+Annunciator annunciator;
+OtaUpdater otaUpdater;
+TimeKeeper timeKeeper;
+TimeZone timeZone;
+TraceWriter traceWriter;
+FeatureSlot<MediboxFeatures::profiling, Profiler> profiler;
+PublishScheduler publishScheduler;
+History history;
+AdherenceLog adherenceLog;
+ShadeMath shadeMath(COMPARTMENTS);
+AdaptiveSampler ldrSampler[COMPARTMENTS];
+AdaptiveSampler dhtSampler;
+ExceptionReporter ldrReporter[COMPARTMENTS];
+ExceptionReporter temperatureReporter;
+SlidingWindow readingWindow;
+ConfigCoalescer sliderConfig;
+ColdChain coldChain;
+HoltForecaster temperatureForecast;
+SensorHealth ldrHealth[COMPARTMENTS];
+SensorHealth temperatureHealth;
 
 
 //improved version
 WiFiClient espClient;
-PubSubClient mqttClient(espClient);
+FeatureSlot<MediboxFeatures::mqtt, PubSubClient> mqttClient(espClient);
+Preferences preferences;
 
 
 //global variables
-float utc_offset = 0.0;
 int days = 0;
 int seconds = 0;
 int minutes = 0;
 int hours = 0;
-char intensityAr[6];
-char temperatureAr[6];
-
-
-bool alarm_enabled = true;
+char intensityAr[24];
+char temperatureAr[24];
+bool time_valid = false;
+
+// Last known UTC time, kept in RTC memory so that a warm reset (brownout,
+// watchdog, software restart) resumes with a clock before NTP answers
+struct RtcTimeEstimate {
+  uint32_t magic;
+  int64_t utc_ms;
+};
+RTC_NOINIT_ATTR RtcTimeEstimate rtc_time_estimate;
+
+// Boot milestones in ms since reset (0 = not reached yet)
+unsigned long boot_alarm_check_ms = 0;
+unsigned long boot_wifi_ms = 0;
+unsigned long boot_time_ms = 0;
+unsigned long boot_mqtt_ms = 0;
+bool boot_time_from_rtc = false;
+bool boot_report_sent = false;
+unsigned long lastConnectAttempt = 0;
+unsigned long mqtt_retry_delay = 0;
+unsigned long mqtt_backoff = MQTT_RETRY_MIN;
+bool mqtt_was_connected = false;
+
+// Latest SNTP result, handed over from the SNTP task to loop()
+volatile bool sntp_pending = false;
+volatile int64_t sntp_utc_ms = 0;
+volatile uint64_t sntp_mono = 0;
+unsigned long lastTimeStatusTime = 0;
+bool time_status_due = false;
+
+// Trace recording and dump state
+File traceFile;
+long trace_dump_pos = -1;
+
+// Times the enclosing scope as a span named 'name'; compiled out unless
+// profiling is built in
+#define PROFILE_SCOPE(name) ProfileScope<MediboxFeatures::profiling> profile_scope(profiler.operator->(), name)
+// Next span of a profile dump to publish, -1 if none; -2 is the header
+int profile_dump_pos = -1;
+bool profile_stall_reported = false;
+
+
+AlarmTable alarms;
 bool Warning_given = false;
-int n_alarms = 2;
-int alarm_hours[] = {-1, -1};
-int alarm_minute[] = {-1, -1};
-bool alarm_triggered[] = {false, false};
+
+// Open dose per alarm: scheduled UTC seconds (0 = none) and snoozes so far.
+// A dose opens when its alarm first rings and closes on PB_CANCEL or miss.
+uint32_t dose_scheduled[ALARM_SLOTS] = {};
+uint16_t dose_snoozes[ALARM_SLOTS] = {};
+// UTC seconds a snoozed dose rings again (0 = not snoozed). Kept in RAM
+// only: a snooze never moves the alarm time saved in NVS.
+uint32_t dose_snoozed_until[ALARM_SLOTS] = {};
+
+// Running adherence range reply, streamed from loop()
+AdherenceReader adherence_query;
+bool adherence_querying = false;
+uint32_t adherence_from = 0;
+uint32_t adherence_to = 0;
+unsigned int adherence_id = 0;
+unsigned long adherence_rows = 0;
 
 int n_notes = 8;
 int C = 262;
@@ -87,871 +298,2442 @@ int C_H = 523;
 int notes[] = {C, D, E, F, G, A, B, C_H};
 int Warning_notes[] = {C, C_H};
 
+// Medication alarm currently ringing (-1 when none)
+int ringing_alarm = -1;
+int current_note = 0;
+
 int current_mode = 0;
 int max_modes = 7;
+// Time zones offered by the menu, as POSIX TZ rules (DST included)
+int n_zones = 10;
+String zone_names[] = {"UTC", "Colombo", "London", "Berlin", "Helsinki", "New York", "Chicago", "Los Angeles", "Sydney", "Fixed offset"};
+const char* zone_rules[] = {"UTC0", "<+0530>-5:30", "GMT0BST,M3.5.0/1,M10.5.0", "CET-1CEST,M3.5.0,M10.5.0/3",
+                            "EET-2EEST,M3.5.0/3,M10.5.0/4", "EST5EDT,M3.2.0,M11.1.0", "CST6CDT,M3.2.0,M11.1.0",
+                            "PST8PDT,M3.2.0,M11.1.0", "AEST-10AEDT,M10.1.0,M4.1.0/3", nullptr};
+
 String modes[] = {"1 - Set Time", "2 - Set Alarm 1", "3 - Set Alarm 2", "4- Disable Alarms", "5- View Alarms", "6- Delete Alarms", "7- Set Time Zone"};
 
 //Default LDR sampling configuration
 unsigned long samplingInterval = 5000;    
 unsigned long sendingInterval = 120000;   
 
+// Channels of readingWindow: the light in each compartment and the
+// temperature. The published averages are sliding means over the last
+// sendingInterval, taken at the same instant for all of them.
+#define WINDOW_LIGHT(c) (c)
+#define WINDOW_TEMPERATURE COMPARTMENTS
+
+// Sampling timers: one reads every compartment's LDR, the other the
+// climate sensor
+#define SAMPLE_LDR 0
+#define SAMPLE_TEMPERATURE 1
+#define SAMPLE_CHANNELS 2
+
 // LDR reading variables
-int ldrReadingsCount = 0;
-unsigned long ldrSum = 0;
 unsigned long lastReadingTime = 0;
-unsigned long lastPublishTime = 0;
-int ldrAverage = 0;
 
 //temperature reading variables
-int temperatureReadingsCount = 0;
-unsigned long temperatureSum = 0;
-unsigned long lastTemperatureReadingTime = 0;
-unsigned long lastTemperaturePublishTime = 0;
 int temperatureAverage = 0;
 
+// A timer tick asking the sampling task for one reading
+struct SampleRequest {
+  uint8_t channel;
+  int64_t t_us;
+};
+
+// Per channel: timer ticks, ticks dropped on a full queue (both counted by
+// the timer) and requests gone stale before the task got to them (counted
+// by the task). Read by loop().
+struct SampleCounters {
+  volatile uint32_t ticks;
+  volatile uint32_t dropped;
+  volatile uint32_t stale;
+};
+SampleCounters sample_counters[SAMPLE_CHANNELS] = {};
+// Counters at the last publish, for per-window deltas
+SampleCounters reported_counters[SAMPLE_CHANNELS] = {};
+
+// Readings behind each channel's last published average
+uint16_t window_counts[WINDOW_CHANNELS] = {};
+
+esp_timer_handle_t sample_timers[SAMPLE_CHANNELS];
+QueueHandle_t sample_queue;
+// Guards the readings, samplers, window and trace writer shared between
+// the sampling task and loop()
+SemaphoreHandle_t sample_lock;
+// Guards the climate driver, which may wait out a conversion, so that
+// the wait is not spent holding sample_lock
+SemaphoreHandle_t climate_lock;
+
+// Set for the loop in which this device's publish slot comes up, with
+// the millis() both channel windows end at
+bool telemetry_due = false;
+unsigned long telemetry_time = 0;
+
+// Latest readings, kept for the on-device history
+float last_temperature = NAN;
+float last_humidity = NAN;
+unsigned long lastHistorySampleTime = 0;
+
+// Publish latency: broker round trip of a probe sent after each telemetry
+// publish, and time spent inside publish() (socket backpressure)
+struct PublishStats {
+  unsigned long probes;
+  unsigned long rtt_sum_ms;
+  unsigned long rtt_max_ms;
+  unsigned long call_sum_us;
+  unsigned long call_max_us;
+  unsigned long calls;
+  unsigned long reconnects;
+};
+PublishStats publish_stats = {};
+unsigned long probe_sent_us = 0;
+bool probe_pending = false;
+unsigned long lastPublishStatsTime = 0;
+// Sensor reads at the last stats report
+uint32_t reported_ldr_reads = 0;
+uint32_t reported_dht_reads = 0;
+
 //parameters for servo motor calculations
-int theta_offset = 30;
-float light_intensity = 0.5;
-float controlling_factor = 0.75;
+#define DEFAULT_THETA_OFFSET 30
+#define DEFAULT_LIGHT_INTENSITY 0.5f
+#define DEFAULT_CONTROLLING_FACTOR 0.75f
 int ideal_storage_temp = 30;
 
-// MQTT topics
-const char* LDR_PUBLISH_TOPIC = "LDR_Value_220316V";
-const char* LDR_SAMPLE_CONFIG_TOPIC = "LDR_Sample_Config_220316V";
-const char* LDR_SEND_CONFIG_TOPIC = "LDR_Send_Config_220316V";
-const char* Temperature_PUBLISH_TOPIC = "Temperature_Value_220316V";
-const char* THETA_OFFSET_TOPIC = "Theta_Offset_Config_220316V";
-const char* LIGHT_INTENSITY_TOPIC = "Light_Intensity_Config_220316V";
-const char* CONTROLLING_FACTOR_TOPIC = "Controlling_Factor_Config_220316V";
-const char* IDEAL_STORAGE_TEMP_TOPIC = "Ideal_Storage_Temperature_Config_220316V";
-
+// Per compartment state, one array per field (struct of arrays), so that a
+// pass over the compartments reads each field from consecutive memory
+struct CompartmentState {
+  int ldr_average[COMPARTMENTS];
+  int last_ldr[COMPARTMENTS];       // latest accepted reading
+  int theta_offset[COMPARTMENTS];
+  float light_intensity[COMPARTMENTS];
+  float controlling_factor[COMPARTMENTS];
+};
+CompartmentState compartments;
+// A bit per compartment, set whenever an input of its shade angle
+// changes; the servos follow
+uint8_t shade_changed = ALL_COMPARTMENTS;
+
+// Temperature expected temperatureForecast.horizon() ahead, NaN until the
+// forecaster has warmed up. The shade and the temperature warning act on
+// it instead of the last average/reading when enabled.
+float forecast_temperature = NAN;
+uint32_t forecast_samples = 0;
+bool forecast_shade = true;
+bool forecast_warning = false;
+
+// Sensor_Fault_<id> as last published, per readingWindow channel; not
+// sent republishes
+uint8_t sensor_faults[WINDOW_CHANNELS] = {};
+bool sensor_faults_sent = false;
+
+// Device identity: NVS "device_id" if set, otherwise the low half of the
+// chip MAC. Every topic carries it as a suffix so units share a broker.
+char device_id[DEVICE_ID_LENGTH];
+char mqtt_client_id[DEVICE_ID_LENGTH + 8];
+
+// MQTT topics, "<name>_<device_id>", filled in by setup_identity()
+// Per compartment, see make_compartment_topics()
+char LDR_PUBLISH_TOPIC[COMPARTMENTS][TOPIC_LENGTH];
+char LDR_SAMPLE_CONFIG_TOPIC[TOPIC_LENGTH];
+char LDR_SEND_CONFIG_TOPIC[TOPIC_LENGTH];
+char Temperature_PUBLISH_TOPIC[TOPIC_LENGTH];
+char THETA_OFFSET_TOPIC[COMPARTMENTS][TOPIC_LENGTH];
+char LIGHT_INTENSITY_TOPIC[COMPARTMENTS][TOPIC_LENGTH];
+char CONTROLLING_FACTOR_TOPIC[COMPARTMENTS][TOPIC_LENGTH];
+char IDEAL_STORAGE_TEMP_TOPIC[TOPIC_LENGTH];
+char OTA_UPDATE_TOPIC[TOPIC_LENGTH];
+char OTA_STATUS_TOPIC[TOPIC_LENGTH];
+char BOOT_TIME_TOPIC[TOPIC_LENGTH];
+char TIME_STATUS_TOPIC[TOPIC_LENGTH];
+char TIME_ZONE_TOPIC[TOPIC_LENGTH];
+char TRACE_CONTROL_TOPIC[TOPIC_LENGTH];
+char TRACE_DATA_TOPIC[TOPIC_LENGTH];
+char PROFILE_CONTROL_TOPIC[TOPIC_LENGTH];
+char PROFILE_DATA_TOPIC[TOPIC_LENGTH];
+char DEVICE_ID_TOPIC[TOPIC_LENGTH];
+char PUBLISH_SLOT_TOPIC[TOPIC_LENGTH];
+char LATENCY_PROBE_TOPIC[TOPIC_LENGTH];
+char PUBLISH_STATS_TOPIC[TOPIC_LENGTH];
+char HISTORY_REQUEST_TOPIC[TOPIC_LENGTH];
+char HISTORY_DATA_TOPIC[TOPIC_LENGTH];
+char ADAPTIVE_SAMPLING_TOPIC[TOPIC_LENGTH];
+char REPORT_CONFIG_TOPIC[TOPIC_LENGTH];
+char REPORT_STATS_TOPIC[TOPIC_LENGTH];
+char SAMPLE_COVERAGE_TOPIC[TOPIC_LENGTH];
+char ADHERENCE_REQUEST_TOPIC[TOPIC_LENGTH];
+char ADHERENCE_DATA_TOPIC[TOPIC_LENGTH];
+char ADHERENCE_STATS_TOPIC[TOPIC_LENGTH];
+char CONFIG_APPLIED_TOPIC[COMPARTMENTS][TOPIC_LENGTH];
+char COLD_CHAIN_TOPIC[TOPIC_LENGTH];
+char COLD_CHAIN_CONFIG_TOPIC[TOPIC_LENGTH];
+char FORECAST_TOPIC[TOPIC_LENGTH];
+char FORECAST_CONFIG_TOPIC[TOPIC_LENGTH];
+char SENSOR_FAULT_TOPIC[TOPIC_LENGTH];
+char SENSOR_HEALTH_TOPIC[TOPIC_LENGTH];
+char SENSOR_HEALTH_CONFIG_TOPIC[TOPIC_LENGTH];
+char SENSOR_TYPE_CONFIG_TOPIC[TOPIC_LENGTH];
+char CONFIG_TOPIC[COMPARTMENTS][TOPIC_LENGTH];
+char STATE_TOPIC[COMPARTMENTS][TOPIC_LENGTH];
+char STATUS_TOPIC[TOPIC_LENGTH];
+
+
+void make_topic(char* topic, const char* name) {
+  snprintf(topic, TOPIC_LENGTH, "%s_%s", name, device_id);
+}
 
-void update_light_intensity(){
-  unsigned long currentMillis = millis();
-
-  // Take reading every samplingInterval milliseconds
-  if (currentMillis - lastReadingTime >= samplingInterval) {
-    lastReadingTime = currentMillis;
-    
-    int sensorValue = analogRead(LDR_PIN);
-    ldrSum += sensorValue;
-    ldrReadingsCount++;
-    
-    Serial.print("LDR reading: ");
-    Serial.println(sensorValue);
-  }
-
-  // Publish average every sendingInterval milliseconds
-  if (currentMillis - lastPublishTime >= sendingInterval && ldrReadingsCount > 0) {
-    lastPublishTime = currentMillis;
-    
-    // Calculate average
-    ldrAverage = ldrSum / ldrReadingsCount;
-    
-    // Convert to string and publish
-    String(ldrAverage).toCharArray(intensityAr, 6);
-    mqttClient.publish(LDR_PUBLISH_TOPIC, intensityAr);
-    
-    Serial.print("Published LDR average: ");
-    Serial.println(ldrAverage);
-    
-    // Reset for next averaging period
-    ldrSum = 0;
-    ldrReadingsCount = 0;
+// One topic per compartment: "<name>_<device_id>" in a single compartment
+// box, "<name>_<device_id>_<n>" for compartment n (from 1) in a cabinet
+void make_compartment_topics(char topics[][TOPIC_LENGTH], const char* name) {
+  for (uint8_t c = 0; c < COMPARTMENTS; c++) {
+    if (COMPARTMENTS == 1) {
+      make_topic(topics[c], name);
+    }
+    else {
+      snprintf(topics[c], TOPIC_LENGTH, "%s_%s_%u", name, device_id, c + 1);
+    }
   }
 }
 
-void update_temperature(){
-  unsigned long currentMillis = millis();
-
-  // Take reading every samplingInterval milliseconds
-  if (currentMillis - lastTemperatureReadingTime >= samplingInterval) {
-    lastTemperatureReadingTime = currentMillis;
-    
-    TempAndHumidity data = dhtSensor.getTempAndHumidity();
-    int temperature = data.temperature;
-    temperatureSum += temperature;
-    temperatureReadingsCount++;
-    
-    Serial.print("Temperature reading: ");
-    Serial.println(temperature);
-  }
-
-  // Publish average every sendingInterval milliseconds
-  if (currentMillis - lastTemperaturePublishTime >= sendingInterval && temperatureReadingsCount > 0) {
-    lastTemperaturePublishTime = currentMillis;
-    
-    // Calculate average
-    temperatureAverage = temperatureSum / temperatureReadingsCount;
-    
-    // Convert to string and publish
-    String(temperatureAverage).toCharArray(temperatureAr, 6);
-    mqttClient.publish(Temperature_PUBLISH_TOPIC, temperatureAr);
-    
-    Serial.print("Published temperature average: ");
-    Serial.println(temperatureAverage);
-    
-    // Reset for next averaging period
-    temperatureSum = 0;
-    temperatureReadingsCount = 0;
-  }
-}
-
-int servoAngle(){
-  // Cast to float before division to avoid integer division problem
-  float ratio = float(samplingInterval)/float(sendingInterval);
-  
-  // Add protection against negative or zero values for log
-  float logValue = ratio > 0 ? log(ratio) : 0;
-  
-  // Adjust formula to handle negative log values appropriately
-  int angle = (int)(theta_offset + (180 - theta_offset) * light_intensity * 
-                   controlling_factor * (temperatureAverage / float(ideal_storage_temp)));
-  
-  // Limit angle to valid servo range (0-180)
-  if (angle < 0) angle = 0;
-  if (angle > 180) angle = 180;
-  
-  Serial.print("Servo angle: ");
-  Serial.println(angle);
-  
-  return angle;
+// Compartment a per compartment topic belongs to, -1 if none
+int compartment_of(const char* topic, const char topics[][TOPIC_LENGTH]) {
+  for (uint8_t c = 0; c < COMPARTMENTS; c++) {
+    if (strcmp(topic, topics[c]) == 0) {
+      return c;
+    }
+  }
+  return -1;
 }
 
-void setupMqtt() {
-  //setting up mqtt server
-  mqttClient.setServer("broker.hivemq.com", 1883);
-  // Set the callback function for receiving messages
-  mqttClient.setCallback(receiveCallback);
+// Compartment c's light channel in reports and config messages: "ldr" in
+// a single compartment box, "ldr1", "ldr2"... in a cabinet
+const char* light_name(uint8_t c) {
+  static const char* const NAMES[] = {"ldr1", "ldr2", "ldr3", "ldr4"};
+  return COMPARTMENTS == 1 ? "ldr" : NAMES[c];
 }
 
-void connectToBroker(){
-  while (!mqttClient.connected()){
-    Serial.print("Attempting MQTT connection");
-    if(mqttClient.connect("ESP32_220316V")){
-      Serial.println("connected");
-      // Subscribe to configuration topics
-      mqttClient.subscribe(LDR_SAMPLE_CONFIG_TOPIC);
-      mqttClient.subscribe(LDR_SEND_CONFIG_TOPIC);
-      mqttClient.subscribe(THETA_OFFSET_TOPIC);
-      mqttClient.subscribe(LIGHT_INTENSITY_TOPIC);
-      mqttClient.subscribe(CONTROLLING_FACTOR_TOPIC);
-      mqttClient.subscribe(IDEAL_STORAGE_TEMP_TOPIC);
-    }else{
-      Serial.print("failed");
-      Serial.print(mqttClient.state());
-      delay(5000);
+// Compartments a channel name in a config message selects, as a mask:
+// "ldr" is all of them, "ldr<n>" compartment n
+uint8_t light_channels(const char* name) {
+  if (strcmp(name, "ldr") == 0) {
+    return ALL_COMPARTMENTS;
+  }
+  for (uint8_t c = 0; c < COMPARTMENTS; c++) {
+    if (strcmp(name, light_name(c)) == 0) {
+      return 1 << c;
     }
   }
+  return 0;
 }
 
-// Add the MQTT callback function to handle incoming messages
-void receiveCallback(char* topic, byte* payload, unsigned int length) {
-  Serial.print("Message arrived [");
-  Serial.print(topic);
-  Serial.print("] ");
-  
-  // Convert payload to string for easier processing
-  char payloadStr[length + 1];
-  for (int i = 0; i < length; i++) {
-    payloadStr[i] = (char)payload[i];
-    Serial.print((char)payload[i]);
-  }
-  payloadStr[length] = '\0';
-  Serial.println();
-  
-  // Handle sampling interval configuration
-  if (strcmp(topic, LDR_SAMPLE_CONFIG_TOPIC) == 0) {
-    int newInterval = atoi(payloadStr);
-    if (newInterval >= 1 && newInterval <= 60) {
-      samplingInterval = newInterval * 1000; // Convert seconds to milliseconds
-      Serial.print("Updated sampling interval to: ");
-      Serial.println(samplingInterval);
-    }
+bool valid_device_id(const char* id) {
+  size_t length = strlen(id);
+  if (length == 0 || length >= DEVICE_ID_LENGTH) {
+    return false;
   }
-  
-  // Handle sending interval configuration
-  else if (strcmp(topic, LDR_SEND_CONFIG_TOPIC) == 0) {
-    int newInterval = atoi(payloadStr);
-    if (newInterval >= 10 && newInterval <= 600) {
-      sendingInterval = newInterval * 1000; // Convert seconds to milliseconds
-      Serial.print("Updated sending interval to: ");
-      Serial.println(sendingInterval);
-      
-      // Reset the timer and counters for the new interval
-      lastPublishTime = millis();
-      ldrSum = 0;
-      ldrReadingsCount = 0;
+  for (size_t i = 0; i < length; i++) {
+    if (!isalnum((unsigned char)id[i]) && id[i] != '_' && id[i] != '-') {
+      return false;
     }
   }
+  return true;
+}
 
-  // Handle theta offset configuration
-  else if (strcmp(topic, THETA_OFFSET_TOPIC) == 0) {
-    int newThetaOffset = atoi(payloadStr);
-    if (newThetaOffset >= 0 && newThetaOffset <= 120) {
-      theta_offset = newThetaOffset;
-      Serial.print("Updated theta offset to: ");
-      Serial.println(theta_offset);
-    }
-  }
-  // Handle light intensity configuration
-  else if (strcmp(topic, LIGHT_INTENSITY_TOPIC) == 0) {
-    float newLightIntensity = atof(payloadStr);
-    if (newLightIntensity >= 0 && newLightIntensity <= 1) {
-      light_intensity = newLightIntensity;
-      Serial.print("Updated light intensity to: ");
-      Serial.println(light_intensity);
-    }
+void setup_identity() {
+  if (preferences.getString("device_id", device_id, sizeof(device_id)) == 0 || !valid_device_id(device_id)) {
+    uint8_t mac[6];
+    esp_efuse_mac_get_default(mac);
+    snprintf(device_id, sizeof(device_id), "%02X%02X%02X", mac[3], mac[4], mac[5]);
   }
-  // Handle controlling factor configuration
-  else if (strcmp(topic, CONTROLLING_FACTOR_TOPIC) == 0) {
-    float newControllingFactor = atof(payloadStr);
-    if (newControllingFactor >= 0 && newControllingFactor <= 1) {
-      controlling_factor = newControllingFactor;
-      Serial.print("Updated controlling factor to: ");
-      Serial.println(controlling_factor);
-    }
+  snprintf(mqtt_client_id, sizeof(mqtt_client_id), "ESP32_%s", device_id);
+
+  make_compartment_topics(LDR_PUBLISH_TOPIC, "LDR_Value");
+  make_topic(LDR_SAMPLE_CONFIG_TOPIC, "LDR_Sample_Config");
+  make_topic(LDR_SEND_CONFIG_TOPIC, "LDR_Send_Config");
+  make_topic(Temperature_PUBLISH_TOPIC, "Temperature_Value");
+  make_compartment_topics(THETA_OFFSET_TOPIC, "Theta_Offset_Config");
+  make_compartment_topics(LIGHT_INTENSITY_TOPIC, "Light_Intensity_Config");
+  make_compartment_topics(CONTROLLING_FACTOR_TOPIC, "Controlling_Factor_Config");
+  make_topic(IDEAL_STORAGE_TEMP_TOPIC, "Ideal_Storage_Temperature_Config");
+  make_topic(OTA_UPDATE_TOPIC, "OTA_Update");
+  make_topic(OTA_STATUS_TOPIC, "OTA_Status");
+  make_topic(BOOT_TIME_TOPIC, "Boot_Time");
+  make_topic(TIME_STATUS_TOPIC, "Time_Status");
+  make_topic(TIME_ZONE_TOPIC, "Time_Zone_Config");
+  make_topic(TRACE_CONTROL_TOPIC, "Trace_Control");
+  make_topic(TRACE_DATA_TOPIC, "Trace_Data");
+  if (MediboxFeatures::profiling) {
+    make_topic(PROFILE_CONTROL_TOPIC, "Profile_Control");
+    make_topic(PROFILE_DATA_TOPIC, "Profile_Data");
   }
-  // Handle ideal storage temperature configuration
-  else if (strcmp(topic, IDEAL_STORAGE_TEMP_TOPIC) == 0) {
-    int newIdealStorageTemp = atoi(payloadStr);
-    if (newIdealStorageTemp >= 10 && newIdealStorageTemp <= 40) {
-      ideal_storage_temp = newIdealStorageTemp;
-      Serial.print("Updated ideal storage temperature to: ");
-      Serial.println(ideal_storage_temp);
-    }
+  make_topic(DEVICE_ID_TOPIC, "Device_Id_Config");
+  make_topic(PUBLISH_SLOT_TOPIC, "Publish_Slot_Config");
+  make_topic(LATENCY_PROBE_TOPIC, "Latency_Probe");
+  make_topic(PUBLISH_STATS_TOPIC, "Publish_Stats");
+  make_topic(HISTORY_REQUEST_TOPIC, "History_Request");
+  make_topic(HISTORY_DATA_TOPIC, "History_Data");
+  make_topic(ADAPTIVE_SAMPLING_TOPIC, "Adaptive_Sampling_Config");
+  make_topic(REPORT_CONFIG_TOPIC, "Report_Config");
+  make_topic(REPORT_STATS_TOPIC, "Report_Stats");
+  make_topic(SAMPLE_COVERAGE_TOPIC, "Sample_Coverage");
+  make_topic(ADHERENCE_REQUEST_TOPIC, "Adherence_Request");
+  make_topic(ADHERENCE_DATA_TOPIC, "Adherence_Data");
+  make_topic(ADHERENCE_STATS_TOPIC, "Adherence_Stats");
+  make_compartment_topics(CONFIG_APPLIED_TOPIC, "Config_Applied");
+  make_topic(COLD_CHAIN_TOPIC, "Cold_Chain");
+  make_topic(COLD_CHAIN_CONFIG_TOPIC, "Cold_Chain_Config");
+  make_topic(FORECAST_TOPIC, "Forecast");
+  make_topic(FORECAST_CONFIG_TOPIC, "Forecast_Config");
+  make_topic(SENSOR_FAULT_TOPIC, "Sensor_Fault");
+  make_topic(SENSOR_HEALTH_TOPIC, "Sensor_Health");
+  make_topic(SENSOR_HEALTH_CONFIG_TOPIC, "Sensor_Health_Config");
+  make_topic(SENSOR_TYPE_CONFIG_TOPIC, "Sensor_Type_Config");
+  make_compartment_topics(CONFIG_TOPIC, "Config");
+  make_compartment_topics(STATE_TOPIC, "State");
+  make_topic(STATUS_TOPIC, "Status");
+
+  // Publish phase from the id (FNV-1a), until the server assigns a slot
+  uint32_t hash = 2166136261u;
+  for (const char* c = device_id; *c; c++) {
+    hash = (hash ^ (uint8_t)*c) * 16777619u;
   }
+  publishScheduler.setSeed(hash);
+
+  Serial.print("Device id: ");
+  Serial.println(device_id);
+}
 
+// Every outside input goes through these, so that a trace can replay it
+int read_ldr(uint8_t c) {
+  int value = analogRead(LDR_PINS[c]);
+  if (MediboxFeatures::logging) {
+    traceWriter.analog(millis(), LDR_PINS[c], value);
+  }
+  return value;
 }
 
+// Called without sample_lock: an I2C sensor waits out its conversion
+ClimateReading read_climate() {
+  xSemaphoreTake(climate_lock, portMAX_DELAY);
+  ClimateReading data = climateSensor->read();
+  xSemaphoreGive(climate_lock);
+  return data;
+}
 
+int read_button(int pin) {
+  int level = digitalRead(pin);
+  if (MediboxFeatures::logging) {
+    xSemaphoreTake(sample_lock, portMAX_DELAY);
+    traceWriter.digital(millis(), pin, level == HIGH);
+    xSemaphoreGive(sample_lock);
+  }
+  return level;
+}
 
-void print_line(String text, int column, int row, int text_size) {
+// All broker traffic goes through these two, so that it compiles out
+// together with the client when MQTT is not built in
+bool mqtt_connected() {
+  return MediboxFeatures::mqtt && mqttClient->connected();
+}
 
-  //display a custom message
-  display.setTextSize(text_size);
-  display.setTextColor(SSD1306_WHITE);
-  display.setCursor(column, row);
-  display.println(text);
-  display.display();
-  //delay(2000);
+bool mqtt_publish(const char* topic, const char* payload) {
+  return MediboxFeatures::mqtt && mqttClient->publish(topic, payload);
+}
 
+bool mqtt_publish(const char* topic, const uint8_t* payload, size_t length) {
+  return MediboxFeatures::mqtt && mqttClient->publish(topic, payload, length);
 }
 
-void print_time_now(void) {
-  print_line(String(days), 0, 0, 2);
-  print_line(":", 20, 0, 2);
-  print_line(String(hours), 30, 0, 2);
-  print_line(":", 50, 0, 2);
-  print_line(String(minutes), 60, 0, 2);
-  print_line(":", 80, 0, 2);
-  print_line(String(seconds), 90, 0, 2);
+// Kept by the broker and handed to every new subscriber
+bool mqtt_publish_retained(const char* topic, const char* payload) {
+  return MediboxFeatures::mqtt && mqttClient->publish(topic, payload, true);
+}
 
+bool publish_timed(const char* topic, const char* payload) {
+  unsigned long start = micros();
+  bool sent = mqtt_publish(topic, payload);
+  unsigned long took = micros() - start;
+  publish_stats.calls++;
+  publish_stats.call_sum_us += took;
+  if (took > publish_stats.call_max_us) {
+    publish_stats.call_max_us = took;
+  }
+  return sent;
 }
 
-//time update function and fetch current time from NTP Server
-void update_time() {
-  struct tm timeinfo;
-  if (!getLocalTime(&timeinfo)) {
-    display.clearDisplay();
-    print_line("Failed to get time", 0, 0, 1);
-    delay(2000);
-    return;
+// Run an interval average through the channel's report-by-exception
+// filter. Swinging door mode sends a segment end point from the past,
+// so its payload carries the time: "<value> <seconds>", UTC once synced.
+bool report_reading(ExceptionReporter& reporter, int value, char* payload, size_t size) {
+  uint32_t t = time_valid ? (uint32_t)(timeKeeper.now(monotonic_ms()) / 1000) : millis() / 1000;
+  ReportPoint point;
+  if (!reporter.offer(t, value, point)) {
+    return false;
   }
+  if (reporter.mode() == REPORT_SWINGING_DOOR) {
+    snprintf(payload, size, "%d %lu", (int)lroundf(point.value), (unsigned long)point.t);
+  } else {
+    snprintf(payload, size, "%d", (int)lroundf(point.value));
+  }
+  return true;
+}
+
+void append_report_stats(char* report, size_t size, const char* name, const ExceptionReporter& reporter) {
+  static const char* MODE_NAMES[] = {"always", "deadband", "door"};
+  const ReportStats& stats = reporter.stats();
+  size_t used = strlen(report);
+  snprintf(report + used, size - used,
+           "%s%s_mode=%s %s_offered=%lu %s_sent=%lu %s_suppressed_pct=%lu %s_err_mean=%.2f %s_err_max=%.2f",
+           used > 0 ? " " : "", name, MODE_NAMES[reporter.mode()],
+           name, (unsigned long)stats.offered, name, (unsigned long)stats.sent,
+           name, stats.offered ? (unsigned long)((stats.offered - stats.sent) * 100 / stats.offered) : 0,
+           name, stats.resolved ? stats.error_sum / stats.resolved : 0.0f, name, stats.error_max);
+}
 
-  // Extract hours, minutes, seconds, and days
-  char timeHour[3];
-  strftime(timeHour, 3, "%H", &timeinfo);
-  hours = atoi(timeHour);
+// How much report-by-exception saves per channel, and the worst the
+// dashboard's reconstruction was off by
+void publish_report_stats() {
+  char report[160 * WINDOW_CHANNELS] = "";
+  for (uint8_t c = 0; c < COMPARTMENTS; c++) {
+    append_report_stats(report, sizeof(report), light_name(c), ldrReporter[c]);
+    ldrReporter[c].resetStats();
+  }
+  append_report_stats(report, sizeof(report), "temp", temperatureReporter);
+  mqtt_publish(REPORT_STATS_TOPIC, report);
+  Serial.println(report);
+  temperatureReporter.resetStats();
+}
 
-  char timeMinute[3];
-  strftime(timeMinute, 3, "%M", &timeinfo);
-  minutes = atoi(timeMinute);
+// Interval of a sampling timer; the LDRs are read as fast as any
+// compartment's sampler asks for
+uint32_t channel_interval(uint8_t channel) {
+  if (channel == SAMPLE_TEMPERATURE) {
+    return dhtSampler.interval();
+  }
+  uint32_t interval = ldrSampler[0].interval();
+  for (uint8_t c = 1; c < COMPARTMENTS; c++) {
+    interval = min(interval, ldrSampler[c].interval());
+  }
+  return interval;
+}
 
-  char timeSecond[3];
-  strftime(timeSecond, 3, "%S", &timeinfo);
-  seconds = atoi(timeSecond);
+// esp_timer callback: hand the reading to the sampling task. Never blocks;
+// a full queue means the task is behind and the tick is lost.
+void sample_tick(void* arg) {
+  uint8_t channel = (uint8_t)(uintptr_t)arg;
+  SampleRequest request = {channel, esp_timer_get_time()};
+  sample_counters[channel].ticks++;
+  if (xQueueSend(sample_queue, &request, 0) != pdTRUE) {
+    sample_counters[channel].dropped++;
+  }
+}
 
-  char timeDay[3];
-  strftime(timeDay, 3, "%d", &timeinfo);
-  days = atoi(timeDay);
+// (Re)arm a channel's timer at its sampler's current interval
+void start_sample_timer(uint8_t channel) {
+  if (sample_timers[channel] == nullptr) {
+    return;   // channel not built in
+  }
+  uint32_t interval = channel_interval(channel);
+  // No faster than the climate sensor can measure
+  if (channel == SAMPLE_TEMPERATURE && interval < climateSensor->minInterval()) {
+    interval = climateSensor->minInterval();
+  }
+  esp_timer_stop(sample_timers[channel]);
+  esp_timer_start_periodic(sample_timers[channel], (uint64_t)interval * 1000);
 }
 
-void ring_alarm(int alarm_index) {
-  display.clearDisplay();
-  print_line("MEDICINE TIME", 0, 0, 2);
+// The driver called 'name', nullptr for none
+ClimateSensor* find_climate_sensor(const char* name) {
+  for (size_t i = 0; i < sizeof(climate_drivers) / sizeof(climate_drivers[0]); i++) {
+    if (strcmp(name, climate_drivers[i]->name()) == 0) {
+      return climate_drivers[i];
+    }
+  }
+  return nullptr;
+}
 
-  digitalWrite(LED_1, HIGH);
+// Switch the temperature channel to the driver called 'name'. One that
+// does not answer leaves the DHT in its place. False for an unknown name.
+bool select_climate_sensor(const char* name) {
+  ClimateSensor* chosen = find_climate_sensor(name);
+  if (chosen == nullptr) {
+    return false;
+  }
 
-  bool break_happened = false;
+  xSemaphoreTake(climate_lock, portMAX_DELAY);
+  if (!chosen->begin()) {
+    Serial.print("No ");
+    Serial.print(chosen->name());
+    Serial.println(" sensor, using the DHT");
+    chosen = &dhtDriver;
+    chosen->begin();
+  }
+  climateSensor = chosen;
+  xSemaphoreGive(climate_lock);
+  start_sample_timer(SAMPLE_TEMPERATURE);
+  return true;
+}
 
-  // Ring the buzzer
-  while (!break_happened) {
-    for (int i = 0; i < n_notes; i++) {
-      if (digitalRead(PB_CANCEL) == LOW) {
-        // Stop the alarm
-        delay(200);
-        break_happened = true;
-        alarm_triggered[alarm_index] = true; // Mark alarm as triggered
-        break;
-      }
+// Take the reading a tick asked for. Readings are stamped with the tick
+// time, so the windows see the schedule rather than when the task ran.
+void sample_task(void* arg) {
+  (void)arg;
+  SampleRequest request;
+  for (;;) {
+    xQueueReceive(sample_queue, &request, portMAX_DELAY);
+    uint8_t channel = request.channel;
+
+    // A request older than its period has been overtaken by the next one
+    uint32_t interval = channel_interval(channel);
+    if (esp_timer_get_time() - request.t_us > (int64_t)interval * 1000) {
+      sample_counters[channel].stale++;
+      continue;
+    }
 
-      if (digitalRead(PB_OK) == LOW) {
-        // Snooze the alarm for 5 minutes
-        delay(200);
-        alarm_triggered[alarm_index] = false; // Reset the triggered state
-        Serial.println("Snoozing alarm for 5 minutes");
-        Serial.println(alarm_triggered[alarm_index]);
-        alarm_minute[alarm_index] += 5; // Add 5 minutes to the alarm time
-        if (alarm_minute[alarm_index] >= 60) {
-          alarm_minute[alarm_index] -= 60;
-          alarm_hours[alarm_index] = (alarm_hours[alarm_index] + 1) % 24;
+    uint32_t t_ms = (uint32_t)(request.t_us / 1000);
+    ClimateReading data = {NAN, NAN};
+    if (channel != SAMPLE_LDR) {
+      data = read_climate();
+    }
+    // Logged once the lock is released; Serial can block when its buffer
+    // is full
+    char log_line[32 * COMPARTMENTS];
+    size_t log_length = 0;
+    xSemaphoreTake(sample_lock, portMAX_DELAY);
+    // Quarantined readings go on as failed (NaN) ones, which every
+    // aggregate skips
+    if (channel == SAMPLE_LDR) {
+      // Every compartment in one pass
+      for (uint8_t c = 0; c < COMPARTMENTS; c++) {
+        int sensorValue = read_ldr(c);
+        bool good = ldrHealth[c].check(sensorValue) == 0;
+        ldrSampler[c].add(good ? sensorValue : NAN);
+        if (good) {
+          compartments.last_ldr[c] = sensorValue;
+          lastReadingTime = t_ms;
+          readingWindow.add(WINDOW_LIGHT(c), t_ms, sensorValue);
+        }
+        if (COMPARTMENTS > 1) {
+          log_length += snprintf(log_line + log_length, sizeof(log_line) - log_length,
+                                 "LDR%u reading: %d\n", c + 1, sensorValue);
+        } else {
+          log_length += snprintf(log_line + log_length, sizeof(log_line) - log_length,
+                                 "LDR reading: %d\n", sensorValue);
         }
-        break_happened = true;
-        break;
       }
+    }
+    else {
+      if (MediboxFeatures::logging) {
+        traceWriter.dht(millis(), data.temperature, data.humidity);
+      }
+      float temperature = temperatureHealth.check(data.temperature) == 0 ? data.temperature : NAN;
+      dhtSampler.add(temperature);
+      if (!isnan(temperature)) {
+        last_temperature = temperature;
+        last_humidity = data.humidity;
+      }
+      readingWindow.add(WINDOW_TEMPERATURE, t_ms, temperature);
+      coldChain.add(t_ms, temperature);
+      temperatureForecast.add(t_ms, temperature);
+      snprintf(log_line, sizeof(log_line), "Temperature reading: %.2f\n", data.temperature);
+    }
+    bool retune = channel_interval(channel) != interval;
+    xSemaphoreGive(sample_lock);
+    Serial.print(log_line);
 
-      tone(BUZZER, notes[i]);
-      delay(500);
-      noTone(BUZZER);
-      delay(2);
+    // The adaptive rate moved
+    if (retune) {
+      start_sample_timer(channel);
     }
   }
-
-  digitalWrite(LED_1, LOW);
-  display.clearDisplay();
 }
 
-void update_time_with_check_alarm(void) {
-  update_time();
-  print_time_now();
-
-  if (alarm_enabled == true) {
-    for (int i = 0; i < n_alarms; i++) {
-      if (alarm_triggered[i] == false && alarm_hours[i] == hours && alarm_minute[i] == minutes) {
-        alarm_triggered[i] = true;
-        ring_alarm(i);
-        
-      }
+void start_sampling() {
+  sample_queue = xQueueCreate(SAMPLE_QUEUE_LENGTH, sizeof(SampleRequest));
+  xTaskCreatePinnedToCore(sample_task, "sampler", SAMPLE_TASK_STACK, nullptr,
+                          SAMPLE_TASK_PRIORITY, nullptr, SAMPLE_TASK_CORE);
+  for (uint8_t c = 0; c < SAMPLE_CHANNELS; c++) {
+    if (c == SAMPLE_LDR && !MediboxFeatures::ldr) {
+      continue;
     }
+    esp_timer_create_args_t args = {};
+    args.callback = sample_tick;
+    args.arg = (void*)(uintptr_t)c;
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = c == SAMPLE_LDR ? "ldr" : "dht";
+    esp_timer_create(&args, &sample_timers[c]);
+    start_sample_timer(c);
   }
 }
 
-int wait_for_button_press() {
+// Window mean and sample count of a channel at the publish instant
+bool window_mean(uint8_t channel, float& mean, uint16_t& count) {
+  xSemaphoreTake(sample_lock, portMAX_DELAY);
+  bool have = readingWindow.mean(channel, telemetry_time, mean);
+  count = readingWindow.count(channel, telemetry_time);
+  xSemaphoreGive(sample_lock);
+  return have;
+}
 
-  while (true) {
-    if (digitalRead(PB_UP) == LOW) {
-      delay(200);
-      return PB_UP;
+void update_light_intensity(){
+  PROFILE_SCOPE("update_light_intensity");
+  // Publish averages in this device's slot, every sendingInterval milliseconds
+  for (uint8_t c = 0; c < COMPARTMENTS; c++) {
+    float mean;
+    if (!telemetry_due || !window_mean(WINDOW_LIGHT(c), mean, window_counts[WINDOW_LIGHT(c)])) {
+      continue;
     }
-
-    else if (digitalRead(PB_DOWN) == LOW) {
-      delay(200);
-      return PB_DOWN;
+    int average = (int)lroundf(mean);
+    compartments.ldr_average[c] = average;
+
+    // The shade follows the measured light, normalized to 0-1
+    shadeMath.setIntensity(c, ShadeMath::normalizeLdr(average));
+    compartments.light_intensity[c] = shadeMath.intensity(c) / float(SHADE_Q15_ONE);
+    shade_changed |= 1 << c;
+
+    // Convert to string and publish, unless it is held back as unchanged
+    if (MediboxFeatures::telemetry && report_reading(ldrReporter[c], average, intensityAr, sizeof(intensityAr))) {
+      publish_timed(LDR_PUBLISH_TOPIC[c], intensityAr);
+      Serial.print("Published LDR average: ");
+      Serial.println(intensityAr);
     }
+  }
+}
 
-    else if (digitalRead(PB_OK) == LOW) {
-      delay(200);
-      return PB_OK;
+void update_temperature(){
+  PROFILE_SCOPE("update_temperature");
+  // Publish average in this device's slot, every sendingInterval milliseconds
+  float mean;
+  if (telemetry_due && window_mean(WINDOW_TEMPERATURE, mean, window_counts[WINDOW_TEMPERATURE])) {
+    temperatureAverage = (int)lroundf(mean);
+    shade_changed = ALL_COMPARTMENTS;
+
+    // Convert to string and publish, unless it is held back as unchanged
+    if (MediboxFeatures::telemetry &&
+        report_reading(temperatureReporter, temperatureAverage, temperatureAr, sizeof(temperatureAr))) {
+      publish_timed(Temperature_PUBLISH_TOPIC, temperatureAr);
+      Serial.print("Published temperature average: ");
+      Serial.println(temperatureAr);
     }
+  }
+}
 
-    else if (digitalRead(PB_CANCEL) == LOW) {
-      delay(200);
-      return PB_CANCEL;
-    }
+// Pick up the forecast after each temperature reading
+void update_forecast() {
+  xSemaphoreTake(sample_lock, portMAX_DELAY);
+  uint32_t samples = temperatureForecast.samples();
+  bool ready = temperatureForecast.ready();
+  float forecast = temperatureForecast.forecast();
+  xSemaphoreGive(sample_lock);
 
-    update_time();
+  if (samples == forecast_samples || !ready) {
+    return;
+  }
+  forecast_samples = samples;
+  forecast_temperature = forecast;
+  if (forecast_shade) {
+    shade_changed = ALL_COMPARTMENTS;
   }
 }
 
-void go_to_menu() {
-  while (digitalRead(PB_CANCEL) == HIGH) {
-    display.clearDisplay();
-    print_line(modes[current_mode], 0, 0, 2);
+// The forecast and how it has fared against persistence (acting on the
+// reading at forecast time); skill above 0 means it pays off
+void publish_forecast() {
+  xSemaphoreTake(sample_lock, portMAX_DELAY);
+  HoltForecaster forecaster = temperatureForecast;
+  xSemaphoreGive(sample_lock);
+
+  const ForecastStats& stats = forecaster.stats();
+  uint32_t n = stats.settled > 0 ? stats.settled : 1;
+  char report[320];
+  snprintf(report, sizeof(report),
+           "horizon_s=%lu level=%.2f trend_c_per_h=%.2f forecast=%.2f shade=%d warn=%d settled=%lu expired=%lu "
+           "mae=%.3f rmse=%.3f bias=%.3f max=%.2f persistence_mae=%.3f skill=%.2f",
+           (unsigned long)(forecaster.horizon() / 1000), forecaster.level(), forecaster.trend() * 3600,
+           forecaster.ready() ? forecaster.forecast() : NAN, forecast_shade, forecast_warning,
+           (unsigned long)stats.settled, (unsigned long)stats.expired, stats.abs_sum / n, sqrtf(stats.square_sum / n),
+           stats.bias_sum / n, stats.abs_max, stats.persistence_abs_sum / n, forecaster.skill());
+  mqtt_publish(FORECAST_TOPIC, report);
+  Serial.println(report);
+}
 
-    int pressed = wait_for_button_press();
+// What each published average is made of: readings in its window, timer
+// ticks over the same span, ticks lost, and the ratio of the first two
+// (every compartment's light is read on the same ticks)
+void publish_sample_coverage() {
+  SampleCounters now[SAMPLE_CHANNELS];
+  for (uint8_t c = 0; c < SAMPLE_CHANNELS; c++) {
+    now[c] = sample_counters[c];
+  }
+  char report[96 * WINDOW_CHANNELS] = "";
+  size_t used = 0;
+  for (uint8_t w = 0; w < WINDOW_CHANNELS; w++) {
+    uint8_t c = w == WINDOW_TEMPERATURE ? SAMPLE_TEMPERATURE : SAMPLE_LDR;
+    const char* name = w == WINDOW_TEMPERATURE ? "temp" : light_name(w);
+    const SampleCounters& last = reported_counters[c];
+    uint32_t expected = now[c].ticks - last.ticks;
+    uint32_t missed = (now[c].dropped - last.dropped) + (now[c].stale - last.stale);
+    float coverage = expected > 0 ? min(1.0f, window_counts[w] / (float)expected) : 1.0f;
+    used += snprintf(report + used, sizeof(report) - used,
+                     "%s%s_n=%u %s_expected=%lu %s_missed=%lu %s_coverage=%.2f",
+                     w > 0 ? " " : "", name, window_counts[w], name, (unsigned long)expected,
+                     name, (unsigned long)missed, name, coverage);
+    window_counts[w] = 0;
+  }
+  for (uint8_t c = 0; c < SAMPLE_CHANNELS; c++) {
+    reported_counters[c] = now[c];
+  }
+  mqtt_publish(SAMPLE_COVERAGE_TOPIC, report);
+  Serial.println(report);
+}
 
-    if (pressed == PB_UP) {
-      delay(200);
-      current_mode += 1;
-      current_mode = current_mode % max_modes;
+// Mean Kinetic Temperature and the time in each band since boot or the
+// last reset, e.g. "mkt=26.71 samples=1440 covered_s=7195 unknown_s=0
+// below_24_s=2100 24_32_s=4895 above_32_s=200"
+void publish_cold_chain() {
+  xSemaphoreTake(sample_lock, portMAX_DELAY);
+  ColdChain chain = coldChain;
+  xSemaphoreGive(sample_lock);
+
+  char report[256];
+  size_t used = snprintf(report, sizeof(report), "mkt=%.2f samples=%lu covered_s=%lu unknown_s=%lu",
+                         chain.mkt(), (unsigned long)chain.samples(), (unsigned long)chain.coveredSeconds(),
+                         (unsigned long)chain.unknownSeconds());
+  for (int b = 0; b <= chain.edgeCount(); b++) {
+    char name[32];
+    if (b == 0) {
+      snprintf(name, sizeof(name), "below_%g", chain.edge(0));
     }
-
-    if (pressed == PB_DOWN) {
-      delay(200);
-      current_mode -= 1;
-
-      if (current_mode < 0 ) {
-        current_mode = max_modes - 1;
-      }
+    else if (b == chain.edgeCount()) {
+      snprintf(name, sizeof(name), "above_%g", chain.edge(b - 1));
     }
-
-    else if (pressed == PB_OK) {
-      delay(200);
-      Serial.println(current_mode);
-      run_mode(current_mode);
+    else {
+      snprintf(name, sizeof(name), "%g_%g", chain.edge(b - 1), chain.edge(b));
     }
+    used += snprintf(report + used, sizeof(report) - used, " %s_s=%lu", name,
+                     (unsigned long)chain.bandSeconds(b));
+  }
+  mqtt_publish(COLD_CHAIN_TOPIC, report);
+  Serial.println(report);
+}
 
-    else if (pressed == PB_CANCEL) {
-      delay(200);
-      break;
+void append_fault_names(char* report, size_t size, const char* name, uint8_t faults) {
+  static const char* FAULT_NAMES[SENSOR_FAULT_KINDS] = {"nan", "range", "step", "stuck", "noise"};
+  size_t used = strlen(report);
+  used += snprintf(report + used, size - used, "%s%s=%s", used > 0 ? " " : "", name, faults ? "" : "ok");
+  for (int i = 0; i < SENSOR_FAULT_KINDS; i++) {
+    if (faults & (1 << i)) {
+      used += snprintf(report + used, size - used, "%s%s", report[used - 1] == '=' ? "" : ",", FAULT_NAMES[i]);
     }
   }
 }
 
-void run_mode(int mode) {
-  if (mode == 0) {
-    set_time();
+// Raise or clear the sensor fault alert, retained on Sensor_Fault_<id>,
+// e.g. "ldr=ok temp=stuck"
+void update_sensor_health() {
+  uint8_t faults[WINDOW_CHANNELS];
+  xSemaphoreTake(sample_lock, portMAX_DELAY);
+  for (uint8_t c = 0; c < COMPARTMENTS; c++) {
+    faults[WINDOW_LIGHT(c)] = ldrHealth[c].faults();
   }
+  faults[WINDOW_TEMPERATURE] = temperatureHealth.faults();
+  xSemaphoreGive(sample_lock);
 
-  if (mode == 1 || mode == 2) {
-    set_alarm(mode - 1);
+  if ((sensor_faults_sent && memcmp(faults, sensor_faults, sizeof(faults)) == 0) || !mqtt_connected()) {
+    return;
   }
-
-  else if (mode == 3) {
-    alarm_enabled = false;
+  char report[48 * WINDOW_CHANNELS] = "";
+  for (uint8_t c = 0; c < COMPARTMENTS; c++) {
+    append_fault_names(report, sizeof(report), light_name(c), faults[WINDOW_LIGHT(c)]);
   }
-  
-  else if (mode == 4) {
-    view_alarms();
+  append_fault_names(report, sizeof(report), "temp", faults[WINDOW_TEMPERATURE]);
+  if (mqtt_publish_retained(SENSOR_FAULT_TOPIC, report)) {
+    memcpy(sensor_faults, faults, sizeof(faults));
+    sensor_faults_sent = true;
   }
+  Serial.print("Sensor health: ");
+  Serial.println(report);
+}
 
-  else if (mode == 5) {
-    delete_alarm();
-  }
+void append_health_stats(char* report, size_t size, const char* name, const SensorHealth& health) {
+  size_t used = strlen(report);
+  snprintf(report + used, size - used,
+           "%s%s_checked=%lu %s_quarantined=%lu %s_nan=%lu %s_range=%lu %s_step=%lu %s_stuck=%lu %s_noise=%lu "
+           "%s_noise_rms=%.2f",
+           used > 0 ? " " : "", name, (unsigned long)health.checked(), name, (unsigned long)health.quarantined(),
+           name, (unsigned long)health.count(0), name, (unsigned long)health.count(1),
+           name, (unsigned long)health.count(2), name, (unsigned long)health.count(3),
+           name, (unsigned long)health.count(4), name, health.noiseRms());
+}
 
-  else if (mode == 6) {
-    set_time_zone();
+// Fault counters since boot, per channel
+void publish_sensor_health() {
+  SensorHealth ldr[COMPARTMENTS];
+  xSemaphoreTake(sample_lock, portMAX_DELAY);
+  for (uint8_t c = 0; c < COMPARTMENTS; c++) {
+    ldr[c] = ldrHealth[c];
   }
+  SensorHealth temperature = temperatureHealth;
+  xSemaphoreGive(sample_lock);
 
+  char report[192 * WINDOW_CHANNELS] = "";
+  for (uint8_t c = 0; c < COMPARTMENTS; c++) {
+    append_health_stats(report, sizeof(report), light_name(c), ldr[c]);
+  }
+  append_health_stats(report, sizeof(report), "temp", temperature);
+  mqtt_publish(SENSOR_HEALTH_TOPIC, report);
+  Serial.println(report);
 }
 
-void set_time() {
-  int temp_hours = hours;
-
-  while (true) {
-    display.clearDisplay();
-    print_line("Enter hour: " + String(temp_hours), 0, 0, 2);
-
-    int pressed = wait_for_button_press();
-
-    if (pressed == PB_UP) {
-      delay(200);
-      temp_hours += 1;
-      temp_hours = temp_hours % 24;
-
-    }
-
-    if (pressed == PB_DOWN) {
-      delay(200);
-      temp_hours -= 1;
-      if (temp_hours < 0) {
-        temp_hours = 23;
-
-      }
-    }
-
-    else if (pressed == PB_OK) {
-      delay(200);
-      hours = temp_hours;
+// The probe comes back through the broker; see receiveCallback()
+void send_latency_probe() {
+  char probe[16];
+  probe_sent_us = micros();
+  snprintf(probe, sizeof(probe), "%lu", probe_sent_us);
+  probe_pending = mqtt_publish(LATENCY_PROBE_TOPIC, probe);
+}
 
-    }
+void publish_latency_stats() {
+  char report[320];
+  snprintf(report, sizeof(report),
+           "slot=%u/%u offset_ms=%lu probes=%lu rtt_avg_ms=%lu rtt_max_ms=%lu call_avg_us=%lu call_max_us=%lu reconnects=%lu "
+           "ldr_reads=%lu ldr_ms=%lu dht_reads=%lu dht_ms=%lu climate=%s i2c_transactions=%lu i2c_wait_max_us=%lu",
+           publishScheduler.slot(), publishScheduler.slotCount(), (unsigned long)publishScheduler.offset(),
+           publish_stats.probes, publish_stats.probes ? publish_stats.rtt_sum_ms / publish_stats.probes : 0,
+           publish_stats.rtt_max_ms, publish_stats.calls ? publish_stats.call_sum_us / publish_stats.calls : 0,
+           publish_stats.call_max_us, publish_stats.reconnects,
+           (unsigned long)(ldrSampler[0].samples() - reported_ldr_reads), (unsigned long)channel_interval(SAMPLE_LDR),
+           (unsigned long)(dhtSampler.samples() - reported_dht_reads), (unsigned long)dhtSampler.interval(),
+           climateSensor->name(), (unsigned long)i2cBus.transactions(), (unsigned long)i2cBus.maxWait());
+  mqtt_publish(PUBLISH_STATS_TOPIC, report);
+  Serial.println(report);
+  publish_stats = {};
+  reported_ldr_reads = ldrSampler[0].samples();
+  reported_dht_reads = dhtSampler.samples();
+}
 
-    else if (pressed == PB_CANCEL) {
-      delay(200);
-      break;
-    }
+// "<from> <to> [raw|1m|15m|auto] [id]" in UTC seconds; values <= 0 are
+// relative to now, so "-3600 0" is the last hour
+void start_history_query(const char* request) {
+  long from, to;
+  char tier_name[8] = "auto";
+  unsigned int id = 0;
+  if (!time_valid || sscanf(request, "%ld %ld %7s %u", &from, &to, tier_name, &id) < 2) {
+    return;
   }
+  long now = (long)(timeKeeper.now(monotonic_ms()) / 1000);
+  if (from <= 0) from += now;
+  if (to <= 0) to += now;
 
+  uint8_t tier = HISTORY_AUTO;
+  if (strcmp(tier_name, "raw") == 0) tier = HISTORY_RAW;
+  else if (strcmp(tier_name, "1m") == 0) tier = HISTORY_MINUTE;
+  else if (strcmp(tier_name, "15m") == 0) tier = HISTORY_QUARTER;
 
-  int temp_minutes = minutes;
+  history.startQuery(id, tier, from < 0 ? 0 : from, to < 0 ? 0 : to);
+}
 
-  while (true) {
-    display.clearDisplay();
-    print_line("Enter minutes: " + String(temp_minutes), 0, 0, 2);
+// Store each new sample and stream a running range reply
+void update_history() {
+  xSemaphoreTake(sample_lock, portMAX_DELAY);
+  bool sampled = lastReadingTime != lastHistorySampleTime;
+  // The history keeps one light column, the first compartment's
+  int ldr = compartments.last_ldr[0];
+  float temperature = last_temperature;
+  float humidity = last_humidity;
+  lastHistorySampleTime = lastReadingTime;
+  xSemaphoreGive(sample_lock);
+  if (sampled && time_valid) {
+    history.add((uint32_t)(timeKeeper.now(monotonic_ms()) / 1000), ldr, temperature, humidity);
+  }
 
-    int pressed = wait_for_button_press();
+  for (int i = 0; i < HISTORY_CHUNKS_PER_LOOP && history.querying() && mqtt_connected(); i++) {
+    uint8_t chunk[HISTORY_CHUNK];
+    size_t n = history.nextChunk(chunk, sizeof(chunk));
+    mqtt_publish(HISTORY_DATA_TOPIC, chunk, n);
+  }
+}
 
-    if (pressed == PB_UP) {
-      delay(200);
-      temp_minutes += 1;
-      temp_minutes = temp_minutes % 60;
+void log_dose(int alarm, uint8_t outcome, uint32_t now) {
+  DoseRecord record;
+  record.scheduled = dose_scheduled[alarm];
+  record.alarm = alarm;
+  record.outcome = outcome;
+  record.snoozes = dose_snoozes[alarm];
+  record.delay = outcome == DOSE_TAKEN ? now - dose_scheduled[alarm] : 0;
+  if (MediboxFeatures::logging) {
+    adherenceLog.append(record);
+  }
+  dose_scheduled[alarm] = 0;
+  dose_snoozes[alarm] = 0;
+  dose_snoozed_until[alarm] = 0;
 
-    }
+  Serial.print(outcome == DOSE_TAKEN ? "Dose taken, delay s: " : "Dose missed, alarm ");
+  Serial.println(outcome == DOSE_TAKEN ? (unsigned long)record.delay : (unsigned long)alarm);
+}
 
-    if (pressed == PB_DOWN) {
-      delay(200);
-      temp_minutes -= 1;
-      if (temp_minutes < 0) {
-        temp_minutes = 59;
+// "log <from> <to> [id]" streams the doses in range as CSV on the data
+// topic; "stats <from> <to>" replies with a summary. Times are UTC seconds,
+// values <= 0 relative to now, so "stats -604800 0" covers the last week.
+void handle_adherence_request(const char* request) {
+  char command[8];
+  long from, to;
+  unsigned int id = 0;
+  if (!time_valid || sscanf(request, "%7s %ld %ld %u", command, &from, &to, &id) < 3) {
+    return;
+  }
+  long now = (long)(timeKeeper.now(monotonic_ms()) / 1000);
+  if (from <= 0) from += now;
+  if (to <= 0) to += now;
+  from = max(from, 0L);
+  to = max(to, 0L);
+
+  if (strcmp(command, "stats") == 0) {
+    AdherenceStats stats = adherenceLog.stats(from, to, ADHERENCE_ON_TIME);
+    char report[128];
+    snprintf(report, sizeof(report),
+             "doses=%lu taken=%lu on_time_pct=%lu missed=%lu mean_delay_s=%lu snoozes=%lu",
+             (unsigned long)stats.doses, (unsigned long)stats.taken,
+             stats.doses ? (unsigned long)(stats.on_time * 100 / stats.doses) : 0,
+             (unsigned long)stats.missed,
+             stats.taken ? (unsigned long)(stats.delay_sum / stats.taken) : 0,
+             (unsigned long)stats.snoozes);
+    mqtt_publish(ADHERENCE_STATS_TOPIC, report);
+  }
+  else if (strcmp(command, "log") == 0) {
+    adherence_query.close();
+    adherence_querying = adherence_query.open(adherenceLog.path());
+    adherence_from = from;
+    adherence_to = to;
+    adherence_id = id;
+    adherence_rows = 0;
+  }
+}
 
+// Close doses left open too long and stream a running range reply,
+// a few rows per loop so the log is never read whole
+void update_adherence() {
+  if (time_valid) {
+    uint32_t now = (uint32_t)(timeKeeper.now(monotonic_ms()) / 1000);
+    for (int i = 0; i < ALARM_SLOTS; i++) {
+      if (dose_scheduled[i] != 0 && now - dose_scheduled[i] >= ADHERENCE_MISSED_AFTER) {
+        log_dose(i, DOSE_MISSED, now);
+        if (ringing_alarm == i) {
+          stop_alarm();
+        }
       }
     }
+  }
 
-    else if (pressed == PB_OK) {
-      delay(200);
-      minutes = temp_minutes;
-
-    }
-
-    else if (pressed == PB_CANCEL) {
-      delay(200);
-      break;
+  if (!adherence_querying || !mqtt_connected()) {
+    return;
+  }
+  char chunk[448];
+  int length = snprintf(chunk, sizeof(chunk), "id=%u\n", adherence_id);
+  int rows = 0;
+  int scanned = 0;
+  DoseRecord record;
+  bool more = true;
+  while (rows < ADHERENCE_ROWS_PER_CHUNK && scanned < ADHERENCE_SCAN_PER_LOOP &&
+         (more = adherence_query.next(record))) {
+    scanned++;
+    if (record.scheduled < adherence_from || record.scheduled > adherence_to) {
+      continue;
     }
+    length += snprintf(chunk + length, sizeof(chunk) - length, "%lu,%u,%s,%u,%lu\n",
+                       (unsigned long)record.scheduled, record.alarm,
+                       record.outcome == DOSE_TAKEN ? "taken" : "missed",
+                       record.snoozes, (unsigned long)record.delay);
+    rows++;
   }
-
-  display.clearDisplay();
-  print_line("Time is set", 0, 0, 2);
-  delay(2000);
+  adherence_rows += rows;
+  if (!more) {
+    snprintf(chunk + length, sizeof(chunk) - length, "end rows=%lu\n", adherence_rows);
+    adherence_query.close();
+    adherence_querying = false;
+  }
+  else if (rows == 0) {
+    // Only skipped records this time; the next loop reads on
+    return;
+  }
+  mqtt_publish(ADHERENCE_DATA_TOPIC, chunk);
 }
 
-void set_alarm (int alarm) {
-  int temp_hour = alarm_hours[alarm];
-
-  while (true) {
-    display.clearDisplay();
-    print_line("Enter hour: " + String(temp_hour), 0, 0, 2);
-
-    int pressed = wait_for_button_press();
+// Sample, and publish in this device's slot
+void update_telemetry() {
+  uint64_t mono = monotonic_ms();
+  bool aligned = time_valid;
+  telemetry_due = publishScheduler.due(aligned ? timeKeeper.now(mono) : (int64_t)mono, aligned);
+  telemetry_time = millis();
 
-    if (pressed == PB_UP) {
-      delay(200);
-      temp_hour += 1;
-      temp_hour = temp_hour % 24;
+  if (MediboxFeatures::ldr) {
+    update_light_intensity();
+  }
+  update_temperature();
+  update_forecast();
+  update_history();
 
-    }
+  if (!MediboxFeatures::telemetry) {
+    return;
+  }
+  if (telemetry_due && mqtt_connected()) {
+    publish_sample_coverage();
+    publish_cold_chain();
+    publish_forecast();
+    send_latency_probe();
+  }
+  if (mqtt_connected() && millis() - lastPublishStatsTime >= PUBLISH_STATS_INTERVAL) {
+    lastPublishStatsTime = millis();
+    publish_latency_stats();
+    publish_report_stats();
+    publish_sensor_health();
+  }
+}
 
-    if (pressed == PB_DOWN) {
-      delay(200);
-      temp_hour -= 1;
-      if (temp_hour < 0) {
-        temp_hour = 23;
+// Fold the slider values into the fixed-point shade kernel; called
+// whenever one of them changes
+void update_shade_parameters() {
+  for (uint8_t c = 0; c < COMPARTMENTS; c++) {
+    shadeMath.setParameters(c, compartments.theta_offset[c], compartments.controlling_factor[c], ideal_storage_temp);
+  }
+  shadeMath.setIntervals(samplingInterval, sendingInterval);
+  shade_changed = ALL_COMPARTMENTS;
+}
 
-      }
-    }
+void set_light_intensity(uint8_t c, float intensity) {
+  shadeMath.setIntensity(c, (uint16_t)lroundf(intensity * SHADE_Q15_ONE));
+  compartments.light_intensity[c] = intensity;
+  shade_changed |= 1 << c;
+}
 
-    else if (pressed == PB_OK) {
-      delay(200);
-      alarm_hours[alarm] = temp_hour;
-      alarm_triggered[alarm] = false;
+// Slider a topic sets, -1 if it is not a slider
+int slider_of(const char* topic) {
+  if (strcmp(topic, IDEAL_STORAGE_TEMP_TOPIC) == 0) {
+    return SLIDER_IDEAL_STORAGE_TEMP;
+  }
+  int c;
+  if ((c = compartment_of(topic, THETA_OFFSET_TOPIC)) >= 0) {
+    return SLIDER_THETA_OFFSET + SLIDER_COMPARTMENT * c;
+  }
+  if ((c = compartment_of(topic, LIGHT_INTENSITY_TOPIC)) >= 0) {
+    return SLIDER_LIGHT_INTENSITY + SLIDER_COMPARTMENT * c;
+  }
+  if ((c = compartment_of(topic, CONTROLLING_FACTOR_TOPIC)) >= 0) {
+    return SLIDER_CONTROLLING_FACTOR + SLIDER_COMPARTMENT * c;
+  }
+  return -1;
+}
 
-    }
+// Stage a slider update; returns false if 'topic' is not a slider. Out of
+// range values are dropped. Nothing is echoed, a drag sends dozens.
+bool stage_slider(const char* topic, const byte* payload, unsigned int length) {
+  int parameter = slider_of(topic);
+  if (parameter < 0) {
+    return false;
+  }
+  // The same kind of slider in every compartment
+  int kind = parameter == SLIDER_IDEAL_STORAGE_TEMP ? parameter : (parameter - 1) % SLIDER_COMPARTMENT + 1;
+
+  char text[16];
+  size_t n = min((size_t)length, sizeof(text) - 1);
+  memcpy(text, payload, n);
+  text[n] = '\0';
+
+  float value;
+  bool valid;
+  if (kind == SLIDER_THETA_OFFSET) {
+    value = atoi(text);
+    valid = value >= 0 && value <= 120;
+  }
+  else if (kind == SLIDER_IDEAL_STORAGE_TEMP) {
+    value = atoi(text);
+    valid = value >= 10 && value <= 40;
+  }
+  else {
+    value = atof(text);
+    valid = value >= 0 && value <= 1;
+  }
 
-    else if (pressed == PB_CANCEL) {
-      delay(200);
-      break;
-    }
+  if (valid) {
+    sliderConfig.stage(parameter, value, millis());
   }
+  return true;
+}
 
+void set_sampling_interval(unsigned long interval) {
+  samplingInterval = interval;
+  Serial.print("Updated sampling interval to: ");
+  Serial.println(samplingInterval);
+  xSemaphoreTake(sample_lock, portMAX_DELAY);
+  for (uint8_t c = 0; c < COMPARTMENTS; c++) {
+    ldrSampler[c].setFixed(samplingInterval);
+  }
+  dhtSampler.setFixed(samplingInterval);
+  xSemaphoreGive(sample_lock);
+  start_sample_timer(SAMPLE_LDR);
+  start_sample_timer(SAMPLE_TEMPERATURE);
+}
 
-  int temp_minutes = alarm_minute[alarm];
+void set_sending_interval(unsigned long interval) {
+  sendingInterval = interval;
+  Serial.print("Updated sending interval to: ");
+  Serial.println(sendingInterval);
 
-  while (true) {
-    display.clearDisplay();
-    print_line("Enter minutes: " + String(temp_minutes), 0, 0, 2);
+  // Reschedule; both windows stretch or shrink over the samples kept
+  publishScheduler.setInterval(sendingInterval);
+  readingWindow.setLength(sendingInterval);
+}
 
-    int pressed = wait_for_button_press();
+// Settings in force in compartment c; the intervals and the ideal
+// temperature are the same in all of them
+MediboxConfig current_config(uint8_t c) {
+  MediboxConfig config;
+  config.sampling_s = samplingInterval / 1000;
+  config.sending_s = sendingInterval / 1000;
+  config.theta_offset = compartments.theta_offset[c];
+  config.light_intensity = compartments.light_intensity[c];
+  config.controlling_factor = compartments.controlling_factor[c];
+  config.ideal_storage_temp = ideal_storage_temp;
+  return config;
+}
 
-    if (pressed == PB_UP) {
-      delay(200);
-      temp_minutes += 1;
-      temp_minutes = temp_minutes % 60;
+// Retained snapshot of the settings in force on State_<id>, so a dashboard
+// (re)connecting gets them in one message; one per compartment
+void publish_state() {
+  for (uint8_t c = 0; c < COMPARTMENTS; c++) {
+    char state[CONFIG_MESSAGE_LENGTH];
+    formatConfig(state, sizeof(state), current_config(c));
+    mqtt_publish_retained(STATE_TOPIC[c], state);
+  }
+}
 
+// Apply the staged slider values as one config generation, so the shade
+// kernel is rebuilt and the servos move once per window, and confirm the
+// settings now in force on Config_Applied_<id>, for each compartment
+// whose sliders moved (all of them for the ideal temperature)
+void apply_sliders(unsigned long now) {
+  unsigned long wait_ms = now - sliderConfig.openedAt();
+  float values[CONFIG_MAX_PARAMETERS];
+  uint32_t changed = sliderConfig.take(values);
+
+  if (changed & (1UL << SLIDER_IDEAL_STORAGE_TEMP)) {
+    ideal_storage_temp = (int)values[SLIDER_IDEAL_STORAGE_TEMP];
+  }
+  uint8_t applied = changed & (1UL << SLIDER_IDEAL_STORAGE_TEMP) ? ALL_COMPARTMENTS : 0;
+  for (uint8_t c = 0; c < COMPARTMENTS; c++) {
+    int first = SLIDER_COMPARTMENT * c;
+    if (changed & (1UL << (SLIDER_THETA_OFFSET + first))) {
+      compartments.theta_offset[c] = (int)values[SLIDER_THETA_OFFSET + first];
     }
-
-    if (pressed == PB_DOWN) {
-      delay(200);
-      temp_minutes -= 1;
-      if (temp_minutes < 0) {
-        temp_minutes = 59;
-
-      }
+    if (changed & (1UL << (SLIDER_CONTROLLING_FACTOR + first))) {
+      compartments.controlling_factor[c] = values[SLIDER_CONTROLLING_FACTOR + first];
     }
-
-    else if (pressed == PB_OK) {
-      delay(200);
-      alarm_minute[alarm] = temp_minutes;
-
+    if (changed & (0x7UL << (SLIDER_THETA_OFFSET + first))) {
+      applied |= 1 << c;
+    }
+  }
+  update_shade_parameters();
+  for (uint8_t c = 0; c < COMPARTMENTS; c++) {
+    int slider = SLIDER_LIGHT_INTENSITY + SLIDER_COMPARTMENT * c;
+    if (changed & (1UL << slider)) {
+      // Holds until the next light average replaces it
+      set_light_intensity(c, values[slider]);
     }
+  }
 
-    else if (pressed == PB_CANCEL) {
-      delay(200);
-      break;
+  for (uint8_t c = 0; c < COMPARTMENTS; c++) {
+    if (!(applied & (1 << c))) {
+      continue;
     }
+    char report[192];
+    snprintf(report, sizeof(report),
+             "gen=%lu theta_offset=%d light_intensity=%.2f controlling_factor=%.2f ideal_storage_temp=%d "
+             "staged=%lu superseded=%lu wait_ms=%lu",
+             (unsigned long)sliderConfig.generation(), compartments.theta_offset[c],
+             compartments.light_intensity[c], compartments.controlling_factor[c], ideal_storage_temp,
+             (unsigned long)sliderConfig.staged(), (unsigned long)sliderConfig.superseded(), wait_ms);
+    mqtt_publish(CONFIG_APPLIED_TOPIC[c], report);
+    Serial.print("Config applied: ");
+    Serial.println(report);
+  }
+  publish_state();
+}
 
+void update_config() {
+  unsigned long now = millis();
+  if (sliderConfig.ready(now)) {
+    apply_sliders(now);
   }
 }
 
-// Function to set the time zone offset (supports fractional offsets)
-void set_time_zone() {
-  float temp_offset = utc_offset;
+// Bulk configuration on Config_<id>: every setting of compartment c in one
+// message, applied all-or-nothing. Slider values still staged arrived
+// earlier, so they are applied first and the bulk message wins.
+void apply_bulk_config(uint8_t c, const char* text) {
+  if (sliderConfig.isOpen()) {
+    apply_sliders(millis());
+  }
+  MediboxConfig config = current_config(c);
+  if (!parseConfig(text, config)) {
+    Serial.println("Bulk config rejected");
+    return;
+  }
 
-  while (true) {
-    display.clearDisplay();
-    print_line("UTC Offset: " + String(temp_offset, 1), 0, 0, 2); // Display with 1 decimal place
+  if (config.sampling_s * 1000 != samplingInterval) {
+    set_sampling_interval(config.sampling_s * 1000);
+  }
+  if (config.sending_s * 1000 != sendingInterval) {
+    set_sending_interval(config.sending_s * 1000);
+  }
+  compartments.theta_offset[c] = config.theta_offset;
+  compartments.controlling_factor[c] = config.controlling_factor;
+  ideal_storage_temp = config.ideal_storage_temp;
+  update_shade_parameters();
+  if (config.light_intensity != compartments.light_intensity[c]) {
+    set_light_intensity(c, config.light_intensity);
+  }
+  publish_state();
+}
 
-    int pressed = wait_for_button_press();
+// Move the servos whose angle inputs changed. All angles come out of one
+// pass over the shade kernel; slider terms are pre-multiplied, see
+// update_shade_parameters().
+void update_shade() {
+  if (!MediboxFeatures::servo) {
+    return;
+  }
+  PROFILE_SCOPE("update_shade");
+  // Shading for the forecast moves before the box has warmed up
+  int temperature = temperatureAverage;
+  if (forecast_shade && !isnan(forecast_temperature)) {
+    temperature = (int)lroundf(forecast_temperature);
+  }
+  int angles[COMPARTMENTS];
+  shadeMath.angles(temperature, angles);
+
+  for (uint8_t c = 0; c < COMPARTMENTS; c++) {
+    if (!(shade_changed & (1 << c))) {
+      continue;
+    }
+    Serial.print("Servo angle: ");
+    Serial.println(angles[c]);
+    servoMotor[c]->write(angles[c]);
+  }
+  shade_changed = 0;
+}
+
+void setupMqtt() {
+  if (!MediboxFeatures::mqtt) {
+    return;
+  }
+  //setting up mqtt server
+  mqttClient->setServer("broker.hivemq.com", 1883);
+  // Set the callback function for receiving messages
+  mqttClient->setCallback(receiveCallback);
+  // Room for OTA triggers (URL + SHA-256)
+  mqttClient->setBufferSize(512);
+}
+
+// 'base' +-50%
+unsigned long jittered(unsigned long base) {
+  return base / 2 + random(base + 1);
+}
+
+// Single connection attempt, rate limited so that an unreachable broker
+// never holds up the clock and alarms
+void connectToBroker(){
+  if (!MediboxFeatures::mqtt || WiFi.status() != WL_CONNECTED) {
+    return;
+  }
+  if (millis() - lastConnectAttempt < mqtt_retry_delay) {
+    return;
+  }
+  lastConnectAttempt = millis();
+  PROFILE_SCOPE("connect");
+
+  Serial.print("Attempting MQTT connection");
+  // The broker marks the device offline on Status_<id> if it drops off
+  if(mqttClient->connect(mqtt_client_id, STATUS_TOPIC, 1, true, "offline")){
+    Serial.println("connected");
+    mqtt_backoff = MQTT_RETRY_MIN;
+    if (boot_mqtt_ms == 0) {
+      boot_mqtt_ms = millis();
+    }
+    // Subscribe to configuration topics
+    mqttClient->subscribe(LDR_SAMPLE_CONFIG_TOPIC);
+    mqttClient->subscribe(LDR_SEND_CONFIG_TOPIC);
+    for (uint8_t c = 0; c < COMPARTMENTS; c++) {
+      mqttClient->subscribe(THETA_OFFSET_TOPIC[c]);
+      mqttClient->subscribe(LIGHT_INTENSITY_TOPIC[c]);
+      mqttClient->subscribe(CONTROLLING_FACTOR_TOPIC[c]);
+    }
+    mqttClient->subscribe(IDEAL_STORAGE_TEMP_TOPIC);
+    mqttClient->subscribe(OTA_UPDATE_TOPIC);
+    mqttClient->subscribe(TIME_ZONE_TOPIC);
+    mqttClient->subscribe(TRACE_CONTROL_TOPIC);
+    if (MediboxFeatures::profiling) {
+      mqttClient->subscribe(PROFILE_CONTROL_TOPIC);
+    }
+    mqttClient->subscribe(DEVICE_ID_TOPIC);
+    mqttClient->subscribe(PUBLISH_SLOT_TOPIC);
+    mqttClient->subscribe(LATENCY_PROBE_TOPIC);
+    mqttClient->subscribe(HISTORY_REQUEST_TOPIC);
+    mqttClient->subscribe(ADAPTIVE_SAMPLING_TOPIC);
+    mqttClient->subscribe(REPORT_CONFIG_TOPIC);
+    mqttClient->subscribe(ADHERENCE_REQUEST_TOPIC);
+    for (uint8_t c = 0; c < COMPARTMENTS; c++) {
+      mqttClient->subscribe(CONFIG_TOPIC[c]);
+    }
+    mqttClient->subscribe(COLD_CHAIN_CONFIG_TOPIC);
+    mqttClient->subscribe(FORECAST_CONFIG_TOPIC);
+    mqttClient->subscribe(SENSOR_HEALTH_CONFIG_TOPIC);
+    mqttClient->subscribe(SENSOR_TYPE_CONFIG_TOPIC);
+
+    // New subscribers sync from these two retained messages
+    mqtt_publish_retained(STATUS_TOPIC, "online");
+    publish_state();
+    sensor_faults_sent = false;
+  }else{
+    Serial.print("failed");
+    Serial.println(mqttClient->state());
+    mqtt_retry_delay = jittered(mqtt_backoff);
+    mqtt_backoff = min(mqtt_backoff * 2, (unsigned long)MQTT_RETRY_MAX);
+  }
+}
+
+// Report_Config_<id> for one channel; an invalid mode leaves it as it is
+void configure_reporter(ExceptionReporter& reporter, const char* mode_name, float band, unsigned int heartbeat_s) {
+  bool banded = band > 0 && heartbeat_s <= 86400;
+  if (strcmp(mode_name, "always") == 0) {
+    reporter.configure(REPORT_ALWAYS, 0, 0);
+  }
+  else if (banded && strcmp(mode_name, "deadband") == 0) {
+    reporter.configure(REPORT_DEADBAND, band, heartbeat_s);
+  }
+  else if (banded && strcmp(mode_name, "door") == 0) {
+    reporter.configure(REPORT_SWINGING_DOOR, band, heartbeat_s);
+  }
+}
 
-    if (pressed == PB_UP) {
-      delay(200);
-      temp_offset += 0.5; 
+// Add the MQTT callback function to handle incoming messages
+void receiveCallback(char* topic, byte* payload, unsigned int length) {
+  PROFILE_SCOPE("receiveCallback");
+  if (MediboxFeatures::logging) {
+    xSemaphoreTake(sample_lock, portMAX_DELAY);
+    traceWriter.mqtt(millis(), topic, payload, length);
+    xSemaphoreGive(sample_lock);
+  }
 
-      // Wrap around if it exceeds the maximum offset
-      if(temp_offset > 14.0) {
-        temp_offset = -12.0; 
+  // Latency probes are frequent; keep them off the serial log
+  if (strcmp(topic, LATENCY_PROBE_TOPIC) == 0) {
+    if (probe_pending) {
+      probe_pending = false;
+      unsigned long rtt = (micros() - probe_sent_us) / 1000;
+      publish_stats.probes++;
+      publish_stats.rtt_sum_ms += rtt;
+      if (rtt > publish_stats.rtt_max_ms) {
+        publish_stats.rtt_max_ms = rtt;
       }
     }
+    return;
+  }
 
-    if (pressed == PB_DOWN) {
-      delay(200);
-      temp_offset -= 0.5; // Decrement by 0.5
+  // Slider storms are staged quietly; see update_config()
+  if (stage_slider(topic, payload, length)) {
+    return;
+  }
 
-      // Wrap around to the maximum offset
-      if(temp_offset < -12.0) {
-        temp_offset = 14.0; 
+  Serial.print("Message arrived [");
+  Serial.print(topic);
+  Serial.print("] ");
+  
+  // Convert payload to string for easier processing
+  char payloadStr[length + 1];
+  for (int i = 0; i < length; i++) {
+    payloadStr[i] = (char)payload[i];
+    Serial.print((char)payload[i]);
+  }
+  payloadStr[length] = '\0';
+  Serial.println();
+  
+  // Handle sampling interval configuration
+  if (strcmp(topic, LDR_SAMPLE_CONFIG_TOPIC) == 0) {
+    int newInterval = atoi(payloadStr);
+    if (newInterval >= 1 && newInterval <= 60) {
+      set_sampling_interval(newInterval * 1000); // Convert seconds to milliseconds
+      update_shade_parameters();
+      publish_state();
+    }
+  }
+
+  // Handle adaptive sampling: "<ldr|temp> <min_s> <max_s> <step>" where a
+  // reading changing by more than 'step' (ADC counts or degrees) switches
+  // the channel to its fast rate; "<ldr|temp> off" or "off" for all
+  // goes back to samplingInterval. "ldr<n>" is compartment n only.
+  else if (strcmp(topic, ADAPTIVE_SAMPLING_TOPIC) == 0) {
+    char channel[8] = "";
+    unsigned int min_s = 0, max_s = 0;
+    float step = 0;
+    sscanf(payloadStr, "%7s %u %u %f", channel, &min_s, &max_s, &step);
+    bool valid = min_s >= 1 && max_s >= min_s && max_s <= 3600 && step > 0;
+    uint8_t lights = strcmp(payloadStr, "off") == 0 ? ALL_COMPARTMENTS : light_channels(channel);
+    xSemaphoreTake(sample_lock, portMAX_DELAY);
+    for (uint8_t c = 0; c < COMPARTMENTS; c++) {
+      if (lights & (1 << c)) {
+        ldrSampler[c].setAdaptive(valid ? min_s * 1000 : 0, max_s * 1000, step);
       }
     }
+    if (strcmp(payloadStr, "off") == 0 || strcmp(channel, "temp") == 0) {
+      dhtSampler.setAdaptive(valid ? min_s * 1000 : 0, max_s * 1000, step);
+    }
+    xSemaphoreGive(sample_lock);
+    start_sample_timer(SAMPLE_LDR);
+    start_sample_timer(SAMPLE_TEMPERATURE);
+    Serial.print("Adaptive sampling ldr/temp: ");
+    for (uint8_t c = 0; c < COMPARTMENTS; c++) {
+      Serial.print(ldrSampler[c].adaptive() ? "on" : "off");
+      Serial.print("/");
+    }
+    Serial.println(dhtSampler.adaptive() ? "on" : "off");
+  }
 
-    else if (pressed == PB_OK) {
-      delay(200);
-      utc_offset = temp_offset;
-      configTime(utc_offset * 3600, UTC_OFFSET_DST, NTP_SERVER); // Convert offset to seconds
-      break;
+  // Handle report-by-exception: "<ldr|temp> always", or
+  // "<ldr|temp> <deadband|door> <band> <heartbeat_s>" with the band in
+  // ADC counts or degrees; "ldr<n>" is compartment n only
+  else if (strcmp(topic, REPORT_CONFIG_TOPIC) == 0) {
+    char channel[8] = "";
+    char mode_name[12] = "";
+    float band = 0;
+    unsigned int heartbeat_s = 0;
+    sscanf(payloadStr, "%7s %11s %f %u", channel, mode_name, &band, &heartbeat_s);
+    uint8_t lights = light_channels(channel);
+    for (uint8_t c = 0; c < COMPARTMENTS; c++) {
+      if (lights & (1 << c)) {
+        configure_reporter(ldrReporter[c], mode_name, band, heartbeat_s);
+      }
+    }
+    if (strcmp(channel, "temp") == 0) {
+      configure_reporter(temperatureReporter, mode_name, band, heartbeat_s);
     }
+    Serial.print("Report mode ldr/temp: ");
+    for (uint8_t c = 0; c < COMPARTMENTS; c++) {
+      Serial.print(ldrReporter[c].mode());
+      Serial.print("/");
+    }
+    Serial.println(temperatureReporter.mode());
+  }
+  
+  // Handle sending interval configuration
+  else if (strcmp(topic, LDR_SEND_CONFIG_TOPIC) == 0) {
+    int newInterval = atoi(payloadStr);
+    if (newInterval >= 10 && newInterval <= 600) {
+      set_sending_interval(newInterval * 1000); // Convert seconds to milliseconds
+      update_shade_parameters();
+      publish_state();
+    }
+  }
 
-    else if (pressed == PB_CANCEL) {
-      delay(200);
-      break;
+  // Handle cold chain analytics: "reset" starts MKT and band times over,
+  // "<edge> [edge...]" (C, ascending) sets the bands and resets them
+  else if (strcmp(topic, COLD_CHAIN_CONFIG_TOPIC) == 0) {
+    float edges[COLD_CHAIN_MAX_EDGES];
+    int count = sscanf(payloadStr, "%f %f %f %f", &edges[0], &edges[1], &edges[2], &edges[3]);
+    bool valid = true;
+    xSemaphoreTake(sample_lock, portMAX_DELAY);
+    if (strcmp(payloadStr, "reset") == 0) {
+      coldChain.reset();
     }
+    else {
+      valid = count > 0 && coldChain.setEdges(edges, count);
+    }
+    xSemaphoreGive(sample_lock);
+    Serial.println(valid ? "Cold chain restarted" : "Cold chain config rejected");
   }
 
-  display.clearDisplay();
-  print_line("Time Zone Set", 0, 0, 2);
-  delay(2000);
-}
+  // Handle sensor health limits: "<ldr|temp> <min> <max> <max_step>
+  // <stuck_readings> <noise_rms>"; 0 turns the last three checks off
+  else if (strcmp(topic, SENSOR_HEALTH_CONFIG_TOPIC) == 0) {
+    char channel[8] = "";
+    SensorLimits limits;
+    unsigned int stuck = 0;
+    int fields = sscanf(payloadStr, "%7s %f %f %f %u %f", channel, &limits.min, &limits.max, &limits.max_step,
+                        &stuck, &limits.noise_rms);
+    limits.stuck_readings = stuck;
+    uint8_t lights = light_channels(channel);
+    bool valid = fields == 6 && limits.min < limits.max && limits.max_step >= 0 && stuck <= UINT16_MAX &&
+                 limits.noise_rms >= 0 && (lights != 0 || strcmp(channel, "temp") == 0);
+    if (valid) {
+      xSemaphoreTake(sample_lock, portMAX_DELAY);
+      for (uint8_t c = 0; c < COMPARTMENTS; c++) {
+        if (lights & (1 << c)) {
+          ldrHealth[c].setLimits(limits);
+        }
+      }
+      if (lights == 0) {
+        temperatureHealth.setLimits(limits);
+      }
+      xSemaphoreGive(sample_lock);
+      Serial.print("Updated sensor health limits for ");
+      Serial.println(channel);
+    }
+  }
 
-// Function to view active alarms
-void view_alarms() {
-  while(true){
-  display.clearDisplay();
-  int row = 0;
-  for (int i = 0; i < n_alarms; i++) {
-    if(alarm_hours[i] == -1 || alarm_minute[i] == -1) {
-      continue;
+  // Handle the climate sensor: "<dht|sht3x|bme280> [bus_khz]", where the
+  // bus clock (400 or 1000) caps the sensor transactions, e.g. "sht3x
+  // 1000". The display library sets its own clock, so it is not lowered
+  // below the display's. Kept across reboots.
+  else if (strcmp(topic, SENSOR_TYPE_CONFIG_TOPIC) == 0) {
+    char name[8] = "";
+    unsigned long bus_khz = i2cBus.maxClock() / 1000;
+    int fields = sscanf(payloadStr, "%7s %lu", name, &bus_khz);
+    bool valid = fields >= 1 && (bus_khz == 400 || bus_khz == 1000) && find_climate_sensor(name) != nullptr;
+    if (valid) {
+      // In force before the chosen driver probes for its sensor
+      xSemaphoreTake(climate_lock, portMAX_DELAY);
+      i2cBus.setMaxClock(bus_khz * 1000);
+      xSemaphoreGive(climate_lock);
+      select_climate_sensor(name);
     }
+    if (valid) {
+      preferences.putString("climate", name);
+      preferences.putUInt("i2c_khz", bus_khz);
+    }
+    Serial.print("Climate sensor: ");
+    Serial.println(climateSensor->name());
+  }
 
-    print_line("Alarm " + String(i + 1) + ": " + String(alarm_hours[i]) + ":" + String(alarm_minute[i]), 0, i * 15, 2);
-    row++;
+  // Handle forecast configuration: "<horizon_s> [shade] [warn]", where the
+  // words name what acts on the forecast, e.g. "900 shade warn"; "600"
+  // only publishes it
+  else if (strcmp(topic, FORECAST_CONFIG_TOPIC) == 0) {
+    unsigned long horizon_s = strtoul(payloadStr, nullptr, 10);
+    // Range checked in seconds; in milliseconds a huge value would wrap
+    bool valid = horizon_s <= FORECAST_MAX_HORIZON / 1000;
+    if (valid) {
+      xSemaphoreTake(sample_lock, portMAX_DELAY);
+      valid = temperatureForecast.setHorizon(horizon_s * 1000);
+      xSemaphoreGive(sample_lock);
+    }
+    if (valid) {
+      forecast_shade = strstr(payloadStr, "shade") != nullptr;
+      forecast_warning = strstr(payloadStr, "warn") != nullptr;
+      forecast_temperature = NAN;
+      forecast_samples = 0;
+      shade_changed = ALL_COMPARTMENTS;
+      Serial.print("Updated forecast horizon to: ");
+      Serial.println(horizon_s);
+    }
+  }
+
+  // Handle bulk configuration, see ConfigMessage.h
+  else if (compartment_of(topic, CONFIG_TOPIC) >= 0) {
+    apply_bulk_config(compartment_of(topic, CONFIG_TOPIC), payloadStr);
   }
 
-    // If no active alarms, display a message
-    if (row == 0) {
-      print_line("No Active Alarms", 0, 0, 2);
+  // Handle time zone configuration (POSIX TZ rule, e.g. "CET-1CEST,M3.5.0,M10.5.0/3")
+  else if (strcmp(topic, TIME_ZONE_TOPIC) == 0) {
+    if (timeZone.set(payloadStr)) {
+      save_time_zone();
+      Serial.print("Updated time zone to: ");
+      Serial.println(timeZone.rule());
+    }
+  }
+  // Handle OTA trigger: "<url> <sha256-hex> [size]"
+  else if (strcmp(topic, OTA_UPDATE_TOPIC) == 0) {
+    otaUpdater.start(payloadStr);
+  }
+  // Handle publish slot assignment: "<slot> <count>", "0 0" for the default
+  else if (strcmp(topic, PUBLISH_SLOT_TOPIC) == 0) {
+    unsigned int slot, count;
+    if (sscanf(payloadStr, "%u %u", &slot, &count) == 2 && count <= 3600 && (count == 0 || slot < count)) {
+      publishScheduler.setSlot(slot, count);
+      preferences.putUInt("slot", (slot << 16) | count);
+      Serial.print("Publish slot offset: ");
+      Serial.println(publishScheduler.offset());
+    }
+  }
+  // Handle history range requests; the reply streams from loop()
+  else if (strcmp(topic, HISTORY_REQUEST_TOPIC) == 0) {
+    start_history_query(payloadStr);
+  }
+  // Handle adherence log and summary requests
+  else if (MediboxFeatures::logging && strcmp(topic, ADHERENCE_REQUEST_TOPIC) == 0) {
+    handle_adherence_request(payloadStr);
+  }
+  // Handle renaming the device; topics change with it, so restart
+  else if (strcmp(topic, DEVICE_ID_TOPIC) == 0) {
+    if (valid_device_id(payloadStr)) {
+      preferences.putString("device_id", payloadStr);
+      ESP.restart();
+    }
+  }
+  // Handle trace control: "arm" (record from the next boot), "stop", "dump"
+  else if (MediboxFeatures::logging && strcmp(topic, TRACE_CONTROL_TOPIC) == 0) {
+    if (strcmp(payloadStr, "arm") == 0) {
+      preferences.putBool("trace", true);
+      ESP.restart();
+    }
+    else if (strcmp(payloadStr, "stop") == 0) {
+      stop_trace();
+    }
+    else if (strcmp(payloadStr, "dump") == 0) {
+      stop_trace();
+      traceFile = LittleFS.open(TRACE_FILE, FILE_READ);
+      trace_dump_pos = traceFile ? 0 : -1;
+    }
+  }
+  // Handle profiling: "dump" (to Profile_Data_<id>), "serial" (to the
+  // serial log), "stall <ms>" (freeze at the first slower loop; 0 never
+  // does), "resume"
+  else if (MediboxFeatures::profiling && strcmp(topic, PROFILE_CONTROL_TOPIC) == 0) {
+    if (strcmp(payloadStr, "dump") == 0) {
+      profiler->freeze();
+      profile_dump_pos = -2;
+    }
+    else if (strcmp(payloadStr, "serial") == 0) {
+      profiler->freeze();
+      dump_profile_serial();
     }
+    else if (strncmp(payloadStr, "stall ", 6) == 0) {
+      unsigned long stall_ms = strtoul(payloadStr + 6, nullptr, 10);
+      profiler->setStallLimit(min(stall_ms, 10000UL) * ESP.getCpuFreqMHz() * 1000);
+      Serial.print("Profile stall limit: ");
+      Serial.println(stall_ms);
+    }
+    else if (strcmp(payloadStr, "resume") == 0) {
+      profiler->resume();
+      profile_stall_reported = false;
+    }
+  }
 
-  int pressed = wait_for_button_press();
+}
 
-  if (pressed == PB_CANCEL) {
-    delay(200);
-    break;
+
+
+void publish_ota_status(const char* status) {
+  mqtt_publish(OTA_STATUS_TOPIC, status);
+}
+
+// Keep the arduino core from confirming a new image at boot, so that
+// update_ota() can decide after it has proven it reaches the broker
+bool verifyRollbackLater() {
+  return true;
+}
+
+void update_ota() {
+  // Stream a slice of a running download into flash
+  otaUpdater.step();
+
+  if (otaUpdater.state() == OTA_SUCCEEDED) {
+    delay(500); // let the status publish go out
+    ESP.restart();
   }
+
+  bool healthy = mqtt_connected() && millis() > OTA_HEALTH_MIN_UPTIME;
+  otaUpdater.checkHealth(healthy, millis(), OTA_HEALTH_DEADLINE);
+}
+
+// Alarms and time zone survive power loss in NVS
+void load_persisted_state() {
+  preferences.begin("medibox", false);
+  preferences.getBytes("alarm_h", alarms.hours, sizeof(alarms.hours));
+  preferences.getBytes("alarm_m", alarms.minutes, sizeof(alarms.minutes));
+  alarms.enabled = preferences.getBool("alarms_on", alarms.enabled);
+  char tz[TZ_MAX_LENGTH];
+  if (preferences.getString("tz", tz, sizeof(tz)) > 0) {
+    timeZone.set(tz);
+  }
+  if (preferences.isKey("drift_ppm")) {
+    timeKeeper.setDrift(preferences.getFloat("drift_ppm", 0));
+  }
+  uint32_t slot = preferences.getUInt("slot", 0);
+  publishScheduler.setSlot(slot >> 16, slot & 0xffff);
+  i2cBus.setMaxClock(preferences.getUInt("i2c_khz", OLED_I2C_CLOCK / 1000) * 1000);
+  char climate[8];
+  if (preferences.getString("climate", climate, sizeof(climate)) > 0) {
+    select_climate_sensor(climate);
   }
 }
 
-// Function to delete a specific alarm
-void delete_alarm() {
-  int alarm_to_delete = 0;
+void save_alarms() {
+  preferences.putBytes("alarm_h", alarms.hours, sizeof(alarms.hours));
+  preferences.putBytes("alarm_m", alarms.minutes, sizeof(alarms.minutes));
+  preferences.putBool("alarms_on", alarms.enabled);
+}
 
-  while (true) {
-    display.clearDisplay();
-    print_line("Del Alarm: " + String(alarm_to_delete + 1), 0, 0, 2);
+void save_time_zone() {
+  preferences.putString("tz", timeZone.rule());
+}
 
-    int pressed = wait_for_button_press();
+// Uptime in ms that never wraps, the time base of the TimeKeeper
+uint64_t monotonic_ms() {
+  return esp_timer_get_time() / 1000;
+}
 
-    if (pressed == PB_UP) {
-      delay(200);
-      alarm_to_delete = (alarm_to_delete + 1) % n_alarms;
-    }
+// Runs in the SNTP task; the result is applied from update_time()
+void on_sntp_sync(struct timeval* tv) {
+  sntp_utc_ms = (int64_t)tv->tv_sec * 1000 + tv->tv_usec / 1000;
+  sntp_mono = monotonic_ms();
+  sntp_pending = true;
+}
 
-    if (pressed == PB_DOWN) {
-      delay(200);
-      alarm_to_delete = (alarm_to_delete - 1 + n_alarms) % n_alarms;
-    }
+const char* time_state_name(TimeSyncState state) {
+  switch (state) {
+    case TIME_ESTIMATED: return "estimated";
+    case TIME_MANUAL: return "manual";
+    case TIME_SYNCED: return "synced";
+    case TIME_HOLDOVER: return "holdover";
+    default: return "unset";
+  }
+}
+
+void publish_time_status() {
+  uint64_t mono = monotonic_ms();
+  char status[128];
+  snprintf(status, sizeof(status), "state=%s err_ms=%lu drift_ppm=%.2f since_sync_s=%lu syncs=%lu",
+           time_state_name(timeKeeper.state(mono)),
+           (unsigned long)timeKeeper.errorEstimate(mono), timeKeeper.driftPpm(),
+           (unsigned long)(timeKeeper.sinceSync(mono) / 1000),
+           (unsigned long)timeKeeper.syncCount());
+  mqtt_publish(TIME_STATUS_TOPIC, status);
+  Serial.println(status);
+}
+
+// After a warm reset, seed the clock from the estimate in RTC
+// memory so alarms work before NTP answers. SNTP corrects it later.
+void restore_rtc_time() {
+  if (esp_reset_reason() == ESP_RST_POWERON || rtc_time_estimate.magic != RTC_TIME_MAGIC) {
+    rtc_time_estimate.magic = 0;
+    return;
+  }
+
+  timeKeeper.seed(rtc_time_estimate.utc_ms, monotonic_ms(), RTC_ESTIMATE_ERROR);
+  boot_time_from_rtc = true;
+  Serial.println("Restored time estimate from RTC memory");
+}
+
+// Track WiFi/MQTT bring-up in the background and report boot timing once
+void update_network() {
+  if (boot_wifi_ms == 0 && WiFi.status() == WL_CONNECTED) {
+    boot_wifi_ms = millis();
+    Serial.print("Connected to WIFI after ");
+    Serial.print(boot_wifi_ms);
+    Serial.println(" ms");
+    Serial.print("Free heap: ");
+    Serial.println(ESP.getFreeHeap());
+  }
+
+  // A dropped connection waits a jittered moment before the first retry,
+  // so units that lost the same broker do not all come back at once
+  bool connected = mqtt_connected();
+  if (mqtt_was_connected && !connected) {
+    lastConnectAttempt = millis();
+    mqtt_retry_delay = random(MQTT_RETRY_MIN);
+    publish_stats.reconnects++;
+  }
+  mqtt_was_connected = connected;
+
+  if (MediboxFeatures::mqtt && !connected) {
+    connectToBroker();
+  }
+
+  if (!boot_report_sent && mqtt_connected()) {
+    char report[96];
+    snprintf(report, sizeof(report), "reset=%d rtc=%d alarm_check=%lu wifi=%lu time=%lu mqtt=%lu",
+             (int)esp_reset_reason(), boot_time_from_rtc ? 1 : 0, boot_alarm_check_ms,
+             boot_wifi_ms, boot_time_ms, boot_mqtt_ms);
+    mqtt_publish(BOOT_TIME_TOPIC, report);
+    Serial.println(report);
+    boot_report_sent = true;
+  }
+
+  if (mqtt_connected() &&
+      (time_status_due || millis() - lastTimeStatusTime >= TIME_STATUS_INTERVAL)) {
+    lastTimeStatusTime = millis();
+    time_status_due = false;
+    publish_time_status();
+  }
+}
+
+void trace_sink(const uint8_t* data, size_t length) {
+  traceFile.write(data, length);
+}
+
+// Record NVS as the firmware reads it at boot. Values are written in
+// their in-memory layout, which is what the host Preferences expects.
+void trace_snapshot_prefs() {
+  int values[ALARM_SLOTS];
+  if (preferences.getBytes("alarm_h", values, sizeof(values)) == sizeof(values)) {
+    traceWriter.pref("alarm_h", values, sizeof(values));
+  }
+  if (preferences.getBytes("alarm_m", values, sizeof(values)) == sizeof(values)) {
+    traceWriter.pref("alarm_m", values, sizeof(values));
+  }
+  if (preferences.isKey("alarms_on")) {
+    bool on = preferences.getBool("alarms_on");
+    traceWriter.pref("alarms_on", &on, sizeof(on));
+  }
+  char tz[TZ_MAX_LENGTH];
+  size_t tz_length = preferences.getString("tz", tz, sizeof(tz));
+  if (tz_length > 0) {
+    traceWriter.pref("tz", tz, strlen(tz) + 1);
+  }
+  if (preferences.isKey("drift_ppm")) {
+    float drift = preferences.getFloat("drift_ppm");
+    traceWriter.pref("drift_ppm", &drift, sizeof(drift));
+  }
+  if (preferences.isKey("slot")) {
+    uint32_t slot = preferences.getUInt("slot");
+    traceWriter.pref("slot", &slot, sizeof(slot));
+  }
+  if (preferences.isKey("i2c_khz")) {
+    uint32_t bus_khz = preferences.getUInt("i2c_khz");
+    traceWriter.pref("i2c_khz", &bus_khz, sizeof(bus_khz));
+  }
+  char climate[8];
+  if (preferences.getString("climate", climate, sizeof(climate)) > 0) {
+    traceWriter.pref("climate", climate, strlen(climate) + 1);
+  }
+  // The identity in use, so a replay subscribes to the same topics
+  traceWriter.pref("device_id", device_id, strlen(device_id) + 1);
+}
+
+// Record this boot if a trace was armed. Arming is one-shot, so a crash
+// loop does not keep overwriting the trace.
+void begin_trace() {
+  if (!preferences.getBool("trace", false)) {
+    return;
+  }
+  preferences.remove("trace");
+
+  traceFile = LittleFS.open(TRACE_FILE, FILE_WRITE);
+  if (!traceFile) {
+    Serial.println("Cannot open trace file");
+    return;
+  }
+  traceWriter.begin(trace_sink);
+  trace_snapshot_prefs();
+  Serial.println("Recording input trace");
+}
+
+void stop_trace() {
+  if (!traceWriter.active()) {
+    return;
+  }
+  xSemaphoreTake(sample_lock, portMAX_DELAY);
+  traceWriter.end();
+  traceFile.close();
+  xSemaphoreGive(sample_lock);
+  Serial.print("Trace stopped at ");
+  Serial.print(traceWriter.bytesWritten());
+  Serial.println(" bytes");
+}
+
+// Cap the trace size and stream a requested dump one chunk per loop. Each
+// chunk is the 4 byte big endian file offset followed by data; a chunk
+// without data ends the dump.
+void update_trace() {
+  if (traceWriter.active() && traceWriter.bytesWritten() >= TRACE_MAX_BYTES) {
+    stop_trace();
+  }
+
+  if (trace_dump_pos < 0 || !mqtt_connected()) {
+    return;
+  }
+  uint8_t chunk[4 + TRACE_CHUNK];
+  chunk[0] = trace_dump_pos >> 24;
+  chunk[1] = trace_dump_pos >> 16;
+  chunk[2] = trace_dump_pos >> 8;
+  chunk[3] = trace_dump_pos;
+  size_t n = traceFile.read(chunk + 4, TRACE_CHUNK);
+  if (!mqtt_publish(TRACE_DATA_TOPIC, chunk, 4 + n)) {
+    traceFile.seek(trace_dump_pos);   // retry this chunk next loop
+    return;
+  }
+  trace_dump_pos += n;
+  if (n == 0) {
+    traceFile.close();
+    trace_dump_pos = -1;
+  }
+}
+
+// A profile dump, on Profile_Data_<id> or the serial log: the header
+// "profile cpu_mhz=<n> spans=<n> overwritten=<n>", a line
+// "<i> <start_cycles> <cycles> <name>" per span, oldest first, and "end".
+// tools/profile_fetch.py turns it into a Chrome trace.
+void format_profile_header(char* line, size_t size) {
+  if (!MediboxFeatures::profiling) {
+    return;
+  }
+  snprintf(line, size, "profile cpu_mhz=%lu spans=%u overwritten=%lu", (unsigned long)ESP.getCpuFreqMHz(),
+           profiler->size(), (unsigned long)profiler->overwritten());
+}
 
-    else if (pressed == PB_OK) {
-      delay(200);
-      alarm_hours[alarm_to_delete] = -1; // Mark alarm as deleted
-      alarm_minute[alarm_to_delete] = -1;
-      alarm_triggered[alarm_to_delete] = false;
-      break;
+size_t format_profile_span(char* line, size_t size, uint16_t i) {
+  if (!MediboxFeatures::profiling) {
+    return 0;
+  }
+  const ProfileSpan& span = profiler->span(i);
+  int n = snprintf(line, size, "%u %llu %lu %s\n", i, (unsigned long long)span.start,
+                   (unsigned long)span.cycles, span.name);
+  return n < 0 ? 0 : min((size_t)n, size - 1);
+}
+
+// All at once, for a device without a broker; the loop stalls meanwhile
+void dump_profile_serial() {
+  if (!MediboxFeatures::profiling) {
+    return;
+  }
+  char line[64];
+  format_profile_header(line, sizeof(line));
+  Serial.println(line);
+  for (uint16_t i = 0; i < profiler->size(); i++) {
+    format_profile_span(line, sizeof(line), i);
+    Serial.print(line);
+  }
+  Serial.println("end");
+  profiler->resume();
+  profile_stall_reported = false;
+}
+
+// Report a stall once, and stream a requested dump PROFILE_CHUNK spans per
+// loop. Recording resumes once the dump is out.
+void update_profile() {
+  if (!MediboxFeatures::profiling) {
+    return;
+  }
+  if (profiler->frozen() && profiler->stallLimit() > 0 && !profile_stall_reported && profile_dump_pos == -1 &&
+      profiler->size() > 0) {
+    char line[64];
+    const ProfileSpan& stall = profiler->span(profiler->size() - 1);
+    snprintf(line, sizeof(line), "stall %s us=%lu", stall.name,
+             (unsigned long)(stall.cycles / ESP.getCpuFreqMHz()));
+    Serial.println(line);
+    mqtt_publish(PROFILE_DATA_TOPIC, line);
+    profile_stall_reported = true;
+  }
+
+  if (profile_dump_pos == -1 || !mqtt_connected()) {
+    return;
+  }
+  char chunk[PROFILE_CHUNK * 64];
+  if (profile_dump_pos == -2) {
+    format_profile_header(chunk, sizeof(chunk));
+  }
+  else if (profile_dump_pos >= profiler->size()) {
+    strcpy(chunk, "end");
+  }
+  else {
+    size_t used = 0;
+    for (uint16_t i = profile_dump_pos; i < profiler->size() && i < profile_dump_pos + PROFILE_CHUNK; i++) {
+      used += format_profile_span(chunk + used, sizeof(chunk) - used, i);
     }
+  }
+  if (!mqtt_publish(PROFILE_DATA_TOPIC, chunk)) {
+    return;   // retry next loop
+  }
+  if (profile_dump_pos == -2) {
+    profile_dump_pos = 0;
+  }
+  else if (profile_dump_pos >= profiler->size()) {
+    profile_dump_pos = -1;
+    profiler->resume();
+    profile_stall_reported = false;
+  }
+  else {
+    profile_dump_pos = min(profile_dump_pos + PROFILE_CHUNK, (int)profiler->size());
+  }
+}
 
-    else if (pressed == PB_CANCEL) {
-      delay(200);
-      break;
+//time update function, local time from the disciplined clock
+void update_time() {
+  PROFILE_SCOPE("update_time");
+  uint64_t mono = monotonic_ms();
+
+  if (sntp_pending) {
+    sntp_pending = false;
+    timeKeeper.onSync(sntp_utc_ms, sntp_mono);
+    // Traced at the time it is applied, with UTC moved along to match
+    if (MediboxFeatures::logging) {
+      xSemaphoreTake(sample_lock, portMAX_DELAY);
+      traceWriter.sntp(millis(), sntp_utc_ms + (int64_t)(mono - sntp_mono));
+      xSemaphoreGive(sample_lock);
+    }
+    if (timeKeeper.driftKnown()) {
+      preferences.putFloat("drift_ppm", timeKeeper.driftPpm());
     }
+    time_status_due = true;
   }
 
-  display.clearDisplay();
-  print_line("Alarm Deleted", 0, 0, 2);
-  delay(2000);
-}
+  if (!timeKeeper.valid()) {
+    time_valid = false;
+    return;
+  }
 
-void Warning_alarm() {
-  digitalWrite(LED_1, HIGH);
+  time_valid = true;
+  if (boot_time_ms == 0) {
+    boot_time_ms = millis();
+  }
 
+  int64_t utc_ms = timeKeeper.now(mono);
+  rtc_time_estimate.magic = RTC_TIME_MAGIC;
+  rtc_time_estimate.utc_ms = utc_ms;
 
-  bool break_happened = false;
+  // Extract hours, minutes, seconds, and days. The zone offset is cached
+  // until the next DST transition, so this is plain arithmetic per tick.
+  int64_t utc = utc_ms / 1000;
+  time_t local = (time_t)(utc + timeZone.offsetAt(utc));
+  struct tm timeinfo;
+  gmtime_r(&local, &timeinfo);
 
-  // Ring the buzzer
-  while (!break_happened) {
-    for (int i = 0; i < 2; i++) {
-      if (digitalRead(PB_CANCEL) == LOW) {
-        // Stop the alarm
-        delay(200);
-        Warning_given = true;
-        break_happened = true; // Mark alarm as triggered
+  hours = timeinfo.tm_hour;
+  minutes = timeinfo.tm_min;
+  seconds = timeinfo.tm_sec;
+  days = timeinfo.tm_mday;
+}
 
-        break;
-      }
+// Start ringing a medication alarm. The buzzer is driven by the annunciator
+// and the buttons by handle_alarm_buttons(), so the main loop keeps running.
+void ring_alarm(int alarm_index) {
+  ringing_alarm = alarm_index;
 
-      if (!mqttClient.connected()) {
-      connectToBroker();
-     }
+  // A snoozed alarm ringing again continues the same dose
+  if (dose_scheduled[alarm_index] == 0) {
+    uint32_t now = (uint32_t)(timeKeeper.now(monotonic_ms()) / 1000);
+    dose_scheduled[alarm_index] = now - now % 60;
+    dose_snoozes[alarm_index] = 0;
+  }
 
-    // Check for MQTT messages
-    mqttClient.loop();
+  display.clearDisplay();
+  ui.printLine("MEDICINE TIME", 0, 0, 2);
 
-    // Update light intensity with configurable intervals
-    update_light_intensity();
-    update_temperature();
+  // Medication outranks any environmental warning already sounding
+  annunciator.raise(ANNUNCIATOR_MEDICATION);
+}
+
+void stop_alarm() {
+  ringing_alarm = -1;
+  annunciator.clear(ANNUNCIATOR_MEDICATION);
+  display.clearDisplay();
+}
 
+// Stop or snooze the ringing medication alarm
+void handle_alarm_buttons() {
+  if (ringing_alarm < 0) {
+    return;
+  }
 
+  if (read_button(PB_CANCEL) == LOW) {
+    // Stop the alarm
+    delay(200);
+    alarms.triggered[ringing_alarm] = true; // Mark alarm as triggered
+    log_dose(ringing_alarm, DOSE_TAKEN, (uint32_t)(timeKeeper.now(monotonic_ms()) / 1000));
+    stop_alarm();
+  }
 
-      tone(BUZZER, Warning_notes[i]);
-      delay(500);
+  else if (read_button(PB_OK) == LOW) {
+    // Snooze the alarm for 5 minutes
+    delay(200);
+    dose_snoozes[ringing_alarm]++;
+    Serial.println("Snoozing alarm for 5 minutes");
+    uint32_t now = (uint32_t)(timeKeeper.now(monotonic_ms()) / 1000);
+    dose_snoozed_until[ringing_alarm] = now + ALARM_SNOOZE_MINUTES * 60;
+    stop_alarm();
+  }
+}
+
+// Drive the buzzer and LED from whichever source currently owns them
+void update_annunciator() {
+  int note = annunciator.update(millis());
+
+  if (note != current_note) {
+    if (note > 0) {
+      tone(BUZZER, note);
+    } else {
       noTone(BUZZER);
-      delay(2);
     }
+    current_note = note;
   }
-  digitalWrite(LED_1, LOW);
+
+  digitalWrite(LED_1, annunciator.owner() >= 0 ? HIGH : LOW);
 }
 
-void check_temp() {
-  TempAndHumidity data = dhtSensor.getTempAndHumidity();
-  bool warning = false;
-  if (data.temperature > 35) {
+void update_time_with_check_alarm(void) {
+  update_time();
+
+  // Keep "MEDICINE TIME" on screen while an alarm is ringing
+  if (ringing_alarm < 0 && time_valid) {
+    ui.printTime(days, hours, minutes, seconds);
+  }
+  else if (ringing_alarm < 0) {
     display.clearDisplay();
-    print_line("TEMP HIGH", 0, 35, 1);
+    ui.printLine("Waiting for time", 0, 0, 1);
   }
 
-  if (data.temperature < 35) {
-    display.clearDisplay();
-    print_line("TEMP LOW", 0, 35, 1);
+  if (boot_alarm_check_ms == 0) {
+    boot_alarm_check_ms = millis();
+    Serial.print("Boot to first alarm check: ");
+    Serial.print(boot_alarm_check_ms);
+    Serial.println(" ms");
   }
 
-  if (data.humidity > 40) {
-    display.clearDisplay();
-    print_line("HUMIDITY HIGH", 0, 45, 1);
+  // Without a clock hours/minutes are stale; never ring on them
+  if (ringing_alarm < 0 && time_valid) {
+    int due = alarms.due(hours, minutes);
+    uint32_t now = (uint32_t)(timeKeeper.now(monotonic_ms()) / 1000);
+    for (int i = 0; i < ALARM_SLOTS && due < 0; i++) {
+      if (dose_snoozed_until[i] != 0 && now >= dose_snoozed_until[i]) {
+        dose_snoozed_until[i] = 0;
+        due = i;
+      }
+    }
+    if (due >= 0) {
+      ring_alarm(due);
+    }
   }
+}
 
-  if (data.humidity < 20) {
-    display.clearDisplay();
-    print_line("HUMIDITY LOW", 0, 45, 1);
+// A flush is an I2C transaction, so it never lands in a sensor read
+void flush_display(Adafruit_SSD1306& screen) {
+  PROFILE_SCOPE("print_line");
+  I2cTransaction transaction(i2cBus, OLED_I2C_CLOCK);
+  screen.display();
+}
+
+// While the menu waits for a button the clock and the buzzer keep going
+void menu_idle() {
+  update_time();
+  update_annunciator();
+}
+
+void go_to_menu() {
+  ui.runMenu(modes, max_modes, current_mode, run_mode);
+}
+
+void run_mode(int mode) {
+  if (mode == 0) {
+    set_time();
   }
 
-  if (data.temperature >32 || data.temperature < 24) {
-    display.clearDisplay();
-    print_line("Temperature Warning",0, 25,1);
-    // digitalWrite(LED_1,HIGH);
-    warning = true;
+  if (mode == 1 || mode == 2) {
+    set_alarm(mode - 1);
   }
 
-  if (data.humidity >85 || data.humidity < 65) {
-    display.clearDisplay();
-    print_line("Humidity Warning",0, 30,1);
-    warning = true;
+  else if (mode == 3) {
+    alarms.enabled = false;
+    save_alarms();
+  }
+  
+  else if (mode == 4) {
+    view_alarms();
   }
 
-  if (warning) {
-    Warning_given = false;
-    if(!Warning_given){
-    Warning_alarm();
+  else if (mode == 5) {
+    delete_alarm();
+  }
+
+  else if (mode == 6) {
+    set_time_zone();
+  }
+
+}
+
+// Hand the clock a manually entered local time of day, keeping today's date
+void apply_manual_time(int new_hours, int new_minutes) {
+  uint64_t mono = monotonic_ms();
+
+  // Without any reference the date is unknown; 1 Jan 1970 keeps the clock running
+  int64_t utc = timeKeeper.valid() ? timeKeeper.now(mono) / 1000 : 0;
+  time_t offset = timeZone.offsetAt(utc);
+  time_t local = (time_t)utc + offset;
+  time_t midnight = local - ((local % 86400) + 86400) % 86400;
+  time_t new_local = midnight + new_hours * 3600 + new_minutes * 60;
+
+  timeKeeper.setManual((int64_t)(new_local - offset) * 1000, mono);
+  time_status_due = true;
+}
+
+void set_time() {
+  // Edit copies: update_time() keeps refreshing hours/minutes meanwhile
+  int new_hours = hours;
+  int new_minutes = minutes;
+  bool changed = ui.editNumber("Enter hour: ", new_hours, 24);
+
+  int temp_minutes = minutes;
+  if (ui.editNumber("Enter minutes: ", temp_minutes, 60)) {
+    new_minutes = temp_minutes;
+    changed = true;
+  }
+
+  if (changed) {
+    apply_manual_time(new_hours, new_minutes);
+  }
+
+  ui.notice("Time is set");
+}
+
+void set_alarm (int alarm) {
+  int hour = alarms.hours[alarm];
+  if (ui.editNumber("Enter hour: ", hour, 24)) {
+    alarms.setHour(alarm, hour);
+    save_alarms();
+  }
+
+  int minute = alarms.minutes[alarm];
+  if (ui.editNumber("Enter minutes: ", minute, 60)) {
+    alarms.setMinute(alarm, minute);
+    save_alarms();
+  }
+}
+
+// Pick a fixed UTC offset (supports fractional offsets). Returns false if cancelled.
+bool set_fixed_offset() {
+  uint64_t mono = monotonic_ms();
+  int64_t utc = timeKeeper.valid() ? timeKeeper.now(mono) / 1000 : 0;
+  float offset = timeZone.offsetAt(utc) / 3600.0;
+
+  if (!ui.editOffset(offset)) {
+    return false;
+  }
+
+  // POSIX counts hours west of UTC: UTC+5:30 is "<+0530>-5:30"
+  int total = (int)(offset * 60);
+  int h = abs(total) / 60;
+  int m = abs(total) % 60;
+  char rule[TZ_MAX_LENGTH];
+  snprintf(rule, sizeof(rule), "<%c%02d%02d>%s%d:%02d", total >= 0 ? '+' : '-', h, m,
+           total > 0 ? "-" : "", h, m);
+  return timeZone.set(rule);
+}
+
+// Function to set the time zone from the list of DST-aware zones
+void set_time_zone() {
+  int zone = 0;
+  for (int i = 0; i < n_zones - 1; i++) {
+    if (strcmp(zone_rules[i], timeZone.rule()) == 0) {
+      zone = i;
     }
   }
-  else {
-    digitalWrite(LED_1,LOW);
+
+  bool zone_set = false;
+  zone = ui.pick("Zone: ", n_zones, zone, zone_names);
+  if (zone >= 0) {
+    if (zone_rules[zone] == nullptr) {
+      zone_set = set_fixed_offset();
+    } else {
+      zone_set = timeZone.set(zone_rules[zone]);
+    }
+  }
+
+  if (zone_set) {
+    save_time_zone();
+  }
+
+  ui.notice("Time Zone Set");
+}
+
+// Function to view active alarms
+void view_alarms() {
+  ui.viewAlarms(alarms);
+}
+
+// Function to delete a specific alarm
+void delete_alarm() {
+  int alarm = ui.pick("Del Alarm: ", ALARM_SLOTS, 0, nullptr);
+  if (alarm >= 0) {
+    alarms.remove(alarm);
+    dose_scheduled[alarm] = 0; // No dose is owed any more
+    dose_snoozed_until[alarm] = 0;
+    save_alarms();
   }
 
+  ui.notice("Alarm Deleted");
+}
 
+// Sound the environmental warning in the background. It keeps sounding
+// until acknowledged with PB_CANCEL or until readings are healthy again,
+// and yields the buzzer to any medication alarm in the meantime.
+void Warning_alarm() {
+  annunciator.raise(ANNUNCIATOR_ENVIRONMENT);
+}
+
+// Acknowledge the environmental warning (PB_CANCEL outside of a medication alarm)
+void handle_warning_buttons() {
+  if (!annunciator.isActive(ANNUNCIATOR_ENVIRONMENT)) {
+    return;
+  }
+
+  if (read_button(PB_CANCEL) == LOW) {
+    delay(200);
+    Warning_given = true;
+    annunciator.clear(ANNUNCIATOR_ENVIRONMENT);
+  }
+}
+
+// Judges the sampling task's latest reading; the DHT is only read there
+void check_temp() {
+  PROFILE_SCOPE("check_temp");
+  xSemaphoreTake(sample_lock, portMAX_DELAY);
+  uint8_t status = environmentStatus(last_temperature, last_humidity);
+  xSemaphoreGive(sample_lock);
+  // Warn ahead of an excursion the forecast sees coming
+  if (forecast_warning && !isnan(forecast_temperature)) {
+    status |= environmentStatus(forecast_temperature, NAN) & ENV_TEMP_WARNING;
+  }
+
+  // The ringing medication alarm owns the screen
+  if (ringing_alarm < 0) {
+    ui.showEnvironment(status);
+  }
+
+  if (environmentWarning(status)) {
+    // Stay quiet once acknowledged, until the excursion ends
+    if (!Warning_given) {
+      Warning_alarm();
+    }
+  }
+  else {
+    // Re-arm for the next excursion
+    Warning_given = false;
+    annunciator.clear(ANNUNCIATOR_ENVIRONMENT);
+  }
 }
 
 void setup() {
   // put your setup code here, to run once:
+  sample_lock = xSemaphoreCreateMutex();
+  climate_lock = xSemaphoreCreateMutex();
+  ui.setButtonReader(read_button);
+  ui.setIdle(menu_idle);
   pinMode(BUZZER, OUTPUT);
   pinMode(LED_1, OUTPUT);
   pinMode(PB_CANCEL, INPUT);
   pinMode(PB_OK, INPUT);
   pinMode(PB_UP, INPUT);
   pinMode(PB_DOWN, INPUT);
-  pinMode(LDR_PIN,INPUT);
-  servoMotor.attach(servoMotorPin);
-  
+  for (uint8_t c = 0; c < COMPARTMENTS; c++) {
+    if (MediboxFeatures::ldr) {
+      pinMode(LDR_PINS[c],INPUT);
+    }
+    if (MediboxFeatures::servo) {
+      servoMotor[c]->attach(SERVO_PINS[c]);
+    }
+  }
+
+  annunciator.setPattern(ANNUNCIATOR_MEDICATION, notes, n_notes, 500, 2);
+  annunciator.setPattern(ANNUNCIATOR_ENVIRONMENT, Warning_notes, 2, 500, 2);
 
-  dhtSensor.setup(DHTPIN, DHTesp::DHT22);
+  // The DHT until the saved sensor type is loaded
+  dhtDriver.begin();
 
   //Initialize serial monitor and OLED display
   Serial.begin(115200);
-  if (! display.begin(SSD1306_SWITCHCAPVCC, SCREEN_ADDRESS)) {
+  i2cBus.begin(SDA, SCL, OLED_I2C_CLOCK);
+  ui.setFlush(flush_display);
+  bool display_found;
+  {
+    I2cTransaction transaction(i2cBus, OLED_I2C_CLOCK);
+    display_found = display.begin(SSD1306_SWITCHCAPVCC, SCREEN_ADDRESS);
+  }
+  if (! display_found) {
     Serial.println(F("SSD1306 allocation failed"));
     for (;;);
   }
 
   //turn on OLED display
-  display.display();
-  delay(500);
-
-  WiFi.begin("Wokwi-GUEST","",6);
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(250);
-    display.clearDisplay();
-    print_line("Connecting to WIFI", 0, 0, 2);
-  }
-
-  display.clearDisplay();
-  print_line("Connected to WIFI", 0, 0, 2);
-
-  configTime(UTC_OFFSET, UTC_OFFSET_DST, NTP_SERVER);
-
   display.clearDisplay();
+  ui.printLine("Welcome to Medibox!", 10, 20, 2);
+
+  // Alarms, time zone and a clock estimate come up before any networking
+  load_persisted_state();
+  setup_identity();
+  restore_rtc_time();
+  LittleFS.begin(true);
+  history.begin(HISTORY_FILE);
+  if (MediboxFeatures::logging) {
+    begin_trace();
+    adherenceLog.begin(ADHERENCE_FILE, ADHERENCE_MAX_BYTES);
+  }
 
-  print_line("Welcome to Medibox!", 10, 20, 2);
-  delay(2000);
-  display.clearDisplay();
+  // WiFi, SNTP and MQTT come up in the background from loop()
+  WiFi.begin("Wokwi-GUEST","",6);
+  WiFi.setAutoReconnect(true);
+  // libc time stays UTC; the offset is applied in update_time()
+  sntp_set_time_sync_notification_cb(on_sntp_sync);
+  configTime(0, 0, NTP_SERVER, NTP_SERVER_2, NTP_SERVER_3);
 
-  setupMqtt();
+  if (MediboxFeatures::mqtt) {
+    setupMqtt();
+  }
+  publishScheduler.setInterval(sendingInterval);
+  readingWindow.setLength(sendingInterval);
+  for (uint8_t c = 0; c < COMPARTMENTS; c++) {
+    compartments.theta_offset[c] = DEFAULT_THETA_OFFSET;
+    compartments.controlling_factor[c] = DEFAULT_CONTROLLING_FACTOR;
+    set_light_intensity(c, DEFAULT_LIGHT_INTENSITY);
+    ldrSampler[c].setFixed(samplingInterval);
+    ldrHealth[c].setLimits(LDR_LIMITS);
+  }
+  update_shade_parameters();
+  dhtSampler.setFixed(samplingInterval);
+  temperatureHealth.setLimits(DHT_LIMITS);
+  start_sampling();
+  lastConnectAttempt = millis();
+  mqtt_retry_delay = random(MQTT_STARTUP_JITTER);
+
+  otaUpdater.begin();
+  otaUpdater.setStatusCallback(publish_ota_status);
+  if (otaUpdater.pendingVerify()) {
+    Serial.println("Running new firmware image, awaiting health check");
+  }
 
 }
 
 void loop() {
   // put your main code here, to run repeatedly:
-  if (!mqttClient.connected()) {
-    connectToBroker();
-  }
+  {
+    // One span per pass, without the delay
+    PROFILE_SCOPE("loop");
+    update_network();
+
+    // Check for MQTT messages
+    if (MediboxFeatures::mqtt) {
+      PROFILE_SCOPE("mqtt_loop");
+      mqttClient->loop();
+    }
+    update_config();
 
-  // Check for MQTT messages
-  mqttClient.loop();
+    // Sample light and temperature, publish in this device's slot
+    update_telemetry();
+    update_sensor_health();
 
-  // Update light intensity with configurable intervals
-  update_light_intensity();
-  update_temperature();
+    update_time_with_check_alarm();
+    update_adherence();
 
-  update_time_with_check_alarm();
-  if (digitalRead(PB_OK) == LOW) {
-    delay(200); //allow the pushbutton to debounce
-    go_to_menu();
+    // While a medication alarm rings, PB_OK snoozes and PB_CANCEL stops it
+    if (ringing_alarm >= 0) {
+      handle_alarm_buttons();
+    }
+    else {
+      handle_warning_buttons();
+      if (read_button(PB_OK) == LOW) {
+        delay(200); //allow the pushbutton to debounce
+        go_to_menu();
+      }
+    }
+    check_temp();
+    update_annunciator();
+    update_ota();
+    if (MediboxFeatures::logging) {
+      update_trace();
+    }
+    if (MediboxFeatures::profiling) {
+      update_profile();
+    }
+    // An angle only moves when one of its inputs does
+    if (MediboxFeatures::servo && shade_changed) {
+      update_shade();
+    }
   }
-  check_temp();
-  servoMotor.write(servoAngle());
   delay(10); // this speeds up the simulation
 }
\ No newline at end of file
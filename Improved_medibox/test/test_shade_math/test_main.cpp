@@ -0,0 +1,126 @@
+// ShadeMath against the float formula it replaces:
+//
+//   pio test -e native -f test_shade_math
+
+#include <ShadeMath.h>
+#include <math.h>
+#include <stdio.h>
+#include <unity.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+void setUp() {}
+void tearDown() {}
+
+// angle = offset + (180 - offset) * I * gamma * T / Tmed, clamped
+static float reference_angle(int offset, float intensity, float factor, int ideal, int temperature) {
+  float angle = offset + (180 - offset) * intensity * factor * temperature / ideal;
+  return angle < 0 ? 0 : angle > 180 ? 180 : angle;
+}
+
+void test_angle_within_one_degree_of_float() {
+  ShadeMath shade;
+  char message[96];
+  for (int offset = 0; offset <= 120; offset += 10) {
+    for (int f = 0; f <= 20; f++) {
+      float factor = f / 20.0f;
+      for (int ideal = 10; ideal <= 40; ideal += 5) {
+        shade.setParameters(0, offset, factor, ideal);
+        for (int i = 0; i <= 16; i++) {
+          uint16_t intensity_q15 = (uint16_t)(i * SHADE_Q15_ONE / 16);
+          shade.setIntensity(0, intensity_q15);
+          for (int temperature = -10; temperature <= 60; temperature++) {
+            float expected = reference_angle(offset, intensity_q15 / float(SHADE_Q15_ONE), factor, ideal, temperature);
+            int angle = shade.angle(0, temperature);
+            if (fabsf(angle - expected) > 1.0f) {
+              snprintf(message, sizeof(message), "offset=%d factor=%.2f ideal=%d intensity=%d/16 T=%d",
+                       offset, factor, ideal, i, temperature);
+              TEST_FAIL_MESSAGE(message);
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+void test_angle_clamped() {
+  ShadeMath shade;
+  shade.setParameters(0, 30, 1.0f, 10);
+  shade.setIntensity(0, SHADE_Q15_ONE);
+  TEST_ASSERT_EQUAL_INT(180, shade.angle(0, 60));
+  TEST_ASSERT_EQUAL_INT(0, shade.angle(0, -60));
+}
+
+void test_angles_match_angle_per_compartment() {
+  ShadeMath shade(4);
+  for (uint8_t c = 0; c < 4; c++) {
+    shade.setParameters(c, 10 + 30 * c, 0.25f * (c + 1), 20 + 5 * c);
+    shade.setIntensity(c, (uint16_t)(8000 * (c + 1)));
+  }
+  int angles[4];
+  shade.angles(28, angles);
+  for (uint8_t c = 0; c < 4; c++) {
+    TEST_ASSERT_EQUAL_INT(shade.angle(c, 28), angles[c]);
+  }
+}
+
+void test_normalize_ldr_endpoints() {
+  // Dark reads full scale, bright reads 0, beyond the ADC range clamps
+  TEST_ASSERT_EQUAL_UINT16(32767, ShadeMath::normalizeLdr(0));
+  TEST_ASSERT_EQUAL_UINT16(32767, ShadeMath::normalizeLdr(-5));
+  TEST_ASSERT_EQUAL_UINT16(0, ShadeMath::normalizeLdr(4096));
+  TEST_ASSERT_EQUAL_UINT16(0, ShadeMath::normalizeLdr(5000));
+  TEST_ASSERT_UINT16_WITHIN(16, 0, ShadeMath::normalizeLdr(4095));
+}
+
+void test_normalize_ldr_interpolates() {
+  // Table points every 256 counts, linear in between and never rising
+  uint16_t previous = ShadeMath::normalizeLdr(0);
+  for (int raw = 1; raw <= 4096; raw++) {
+    uint16_t value = ShadeMath::normalizeLdr(raw);
+    TEST_ASSERT_TRUE(value <= previous);
+    previous = value;
+  }
+  for (int i = 0; i < 16; i++) {
+    int low = ShadeMath::normalizeLdr(i * 256);
+    int high = ShadeMath::normalizeLdr((i + 1) * 256);
+    TEST_ASSERT_INT_WITHIN(1, (low + high) / 2, ShadeMath::normalizeLdr(i * 256 + 128));
+  }
+}
+
+void test_log_ratio() {
+  ShadeMath shade;
+  shade.setIntervals(5000, 120000);
+  TEST_ASSERT_INT_WITHIN(1, (int)lround(log(5.0 / 120) * 65536), shade.logRatio());
+  shade.setIntervals(60000, 60000);
+  TEST_ASSERT_EQUAL_INT(0, shade.logRatio());
+  shade.setIntervals(0, 60000);
+  TEST_ASSERT_EQUAL_INT(0, shade.logRatio());
+}
+
+int run_tests() {
+  UNITY_BEGIN();
+  RUN_TEST(test_angle_within_one_degree_of_float);
+  RUN_TEST(test_angle_clamped);
+  RUN_TEST(test_angles_match_angle_per_compartment);
+  RUN_TEST(test_normalize_ldr_endpoints);
+  RUN_TEST(test_normalize_ldr_interpolates);
+  RUN_TEST(test_log_ratio);
+  return UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup() {
+  delay(2000);   // let the test runner open the serial port
+  run_tests();
+}
+
+void loop() {}
+#else
+int main() {
+  return run_tests();
+}
+#endif
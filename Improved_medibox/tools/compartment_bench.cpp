@@ -0,0 +1,103 @@
+// Per-tick cost of the compartment pipeline against the number of
+// compartments, on the host.
+//
+// Runs the firmware's per-compartment work over the library code the
+// firmware uses, for 1 to MEDIBOX_COMPARTMENTS compartments:
+//
+//   sense      every sampling tick: health check, adaptive sampler and
+//              sliding window add, per compartment
+//   aggregate  every publish: window mean, shade intensity and report
+//              by exception, per compartment
+//   shade      every angle update: one ShadeMath::angles() pass
+//
+// and prints ns per pass and per compartment; with the state kept as
+// struct of arrays the cost per compartment should stay flat.
+//
+//   cd Improved_medibox
+//   libs="ShadeMath SlidingWindow SensorHealth AdaptiveSampler ExceptionReporter"
+//   g++ -std=gnu++17 -O2 -DMEDIBOX_COMPARTMENTS=4 -I ../lib/MediboxCore $(for l in $libs; do echo -I lib/$l lib/$l/$l.cpp; done) tools/compartment_bench.cpp -o compartment_bench
+//   ./compartment_bench [passes]
+//
+// Host numbers: they show how the cost grows, not what it is on the ESP32.
+
+#include <AdaptiveSampler.h>
+#include <ExceptionReporter.h>
+#include <SensorHealth.h>
+#include <ShadeMath.h>
+#include <SlidingWindow.h>
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define COMPARTMENTS MEDIBOX_COMPARTMENTS
+
+static const SensorLimits LDR_LIMITS = {0, 4095, 1200, 600, 400};
+
+// Keeps the results alive, so the passes are not optimized away
+static volatile long sink;
+
+static double ns_per_pass(std::chrono::steady_clock::time_point start, long passes) {
+  std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / passes;
+}
+
+int main(int argc, char** argv) {
+  long passes = argc > 1 ? atol(argv[1]) : 200000;
+
+  printf("compartments  sense_ns  per_c  aggregate_ns  per_c  shade_ns  per_c\n");
+  for (uint8_t n = 1; n <= COMPARTMENTS; n++) {
+    static SlidingWindow window;
+    SensorHealth health[COMPARTMENTS];
+    AdaptiveSampler sampler[COMPARTMENTS];
+    ExceptionReporter reporter[COMPARTMENTS];
+    ShadeMath shade(n);
+    window.setLength(120000);
+    for (uint8_t c = 0; c < n; c++) {
+      health[c].setLimits(LDR_LIMITS);
+      sampler[c].setAdaptive(1000, 10000, 100);
+      reporter[c].configure(REPORT_DEADBAND, 50, 600);
+      shade.setParameters(c, 30, 0.75f, 30);
+    }
+
+    // One reading per compartment per tick, a slow ramp with some noise
+    uint32_t t = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (long i = 0; i < passes; i++) {
+      t += 1000;
+      for (uint8_t c = 0; c < n; c++) {
+        float value = 1500 + (i >> 6) % 1000 + ((i * 7 + c) & 15);
+        if (health[c].check(value) == 0) {
+          window.add(c, t, value);
+        }
+        sampler[c].add(value);
+      }
+    }
+    double sense = ns_per_pass(start, passes);
+
+    start = std::chrono::steady_clock::now();
+    for (long i = 0; i < passes; i++) {
+      for (uint8_t c = 0; c < n; c++) {
+        float mean;
+        if (window.mean(c, t, mean)) {
+          shade.setIntensity(c, ShadeMath::normalizeLdr((int)mean));
+          ReportPoint point;
+          sink += reporter[c].offer(i, mean + (i & 63), point);
+        }
+      }
+    }
+    double aggregate = ns_per_pass(start, passes);
+
+    int angles[COMPARTMENTS];
+    start = std::chrono::steady_clock::now();
+    for (long i = 0; i < passes; i++) {
+      shade.angles(20 + (i & 15), angles);
+      sink += angles[n - 1];
+    }
+    double angle = ns_per_pass(start, passes);
+
+    printf("%12u  %8.1f  %5.1f  %12.1f  %5.1f  %8.1f  %5.1f\n", n, sense, sense / n, aggregate,
+           aggregate / n, angle, angle / n);
+  }
+  return 0;
+}
@@ -0,0 +1,63 @@
+#!/usr/bin/env python3
+"""Report the flash and RAM each compile-time feature costs.
+
+    python tools/feature_sizes.py                # all features of esp32dev
+    python tools/feature_sizes.py --env esp32dev MQTT SERVO
+
+The firmware is built once with every feature on, once with each feature
+off in turn and once with all of them off; a feature's cost is what the
+build saves without it. Features are the MEDIBOX_FEATURE_<NAME> flags of
+lib/MediboxCore/MediboxFeatures.h at the repository root. Each build has
+its own build directory, so reruns are incremental. Also available as
+"pio run -e esp32dev -t feature_sizes".
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+
+FEATURES = ["MQTT", "SERVO", "LDR", "TELEMETRY", "LOGGING", "PROFILING"]
+
+# PlatformIO's summary after linking, e.g.
+#   RAM:   [=         ]  14.1% (used 46212 bytes from 327680 bytes)
+USED = re.compile(r"^(RAM|Flash):.*\(used (\d+) bytes", re.MULTILINE)
+
+
+def build(project, env, enabled, name):
+    flags = " ".join("-DMEDIBOX_FEATURE_%s=%d" % (f, f in enabled) for f in FEATURES)
+    environ = dict(os.environ)
+    environ["PLATFORMIO_BUILD_DIR"] = os.path.join(project, ".pio", "features", name)
+    result = subprocess.run(["pio", "run", "-e", env, "-d", project, "-O", "build_flags = " + flags],
+                            env=environ, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True)
+    if result.returncode != 0:
+        sys.stderr.write(result.stdout)
+        sys.exit("build without %s failed" % name)
+    used = dict(USED.findall(result.stdout))
+    return int(used["Flash"]), int(used["RAM"])
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("features", nargs="*", default=FEATURES, help="features to measure")
+    parser.add_argument("--env", default="esp32dev")
+    args = parser.parse_args()
+    project = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    features = [f.upper() for f in args.features]
+    unknown = set(features) - set(FEATURES)
+    if unknown:
+        sys.exit("unknown feature(s): " + ", ".join(sorted(unknown)))
+
+    flash, ram = build(project, args.env, FEATURES, "all")
+    print("%-10s %9s %9s" % ("feature", "flash", "ram"))
+    for feature in features:
+        without = build(project, args.env, [f for f in FEATURES if f != feature], feature.lower())
+        print("%-10s %9d %9d" % (feature.lower(), flash - without[0], ram - without[1]))
+    bare = build(project, args.env, [], "none")
+    print("%-10s %9d %9d" % ("core", bare[0], bare[1]))
+    print("%-10s %9d %9d" % ("total", flash, ram))
+
+
+if __name__ == "__main__":
+    main()
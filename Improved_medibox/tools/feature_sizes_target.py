@@ -0,0 +1,10 @@
+# PlatformIO extra script: "pio run -e esp32dev -t feature_sizes" prints the
+# flash and RAM of each compile-time feature, see feature_sizes.py
+Import("env")
+
+env.AddCustomTarget(
+    name="feature_sizes",
+    dependencies=None,
+    actions=['"$PYTHONEXE" "$PROJECT_DIR/tools/feature_sizes.py" --env $PIOENV'],
+    title="Feature sizes",
+    description="Flash and RAM per compile-time feature")
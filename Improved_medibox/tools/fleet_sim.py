@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+"""Run a fleet of simulated MediBoxes against one MQTT broker.
+
+Each box is a live host build of the firmware (pio run -e native) with its
+own MAC, so it derives its own device id and topics, and simulated sensors.
+The fleet reports broker fan-in while it runs and per-device connection and
+publish counts at the end.
+
+    pio run -e native
+    python tools/fleet_sim.py -n 200 --duration 600 --speed 10
+
+--spawn-broker starts a private mosquitto on --port; with --restart-at the
+broker is killed and restarted mid-run to trigger a reconnect storm. Needs
+the mosquitto binaries (mosquitto, mosquitto_sub).
+
+A peak fan-in close to the mean shows the publish slots are doing their
+job; devices report their broker round trip on Publish_Stats_<id> every
+10 minutes of device time.
+"""
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import threading
+import time
+
+PROGRAM = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", ".pio", "build", "native", "program")
+
+
+def start_broker(port):
+    return subprocess.Popen(["mosquitto", "-p", str(port)], stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+
+def count_messages(broker, port, counts, latency, stop):
+    """Count every message on the broker per wall second, and keep each
+    device's latest publish latency report."""
+    sub = subprocess.Popen(["mosquitto_sub", "-h", broker, "-p", str(port), "-t", "#", "-F", "%t %p"],
+                           stdout=subprocess.PIPE, text=True, errors="replace")
+    for line in sub.stdout:
+        second = int(time.monotonic())
+        counts[second] = counts.get(second, 0) + 1
+        topic, _, payload = line.rstrip("\n").partition(" ")
+        if topic.startswith("Publish_Stats_"):
+            latency[topic[len("Publish_Stats_"):]] = dict(f.split("=", 1) for f in payload.split() if "=" in f)
+        if stop.is_set():
+            break
+    sub.terminate()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("-n", "--devices", type=int, default=10)
+    parser.add_argument("--broker", default="localhost")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--duration", type=float, default=300, help="virtual seconds each device runs")
+    parser.add_argument("--speed", type=float, default=1, help="virtual seconds per wall second")
+    parser.add_argument("--stagger", type=float, default=0, help="wall seconds between device starts")
+    parser.add_argument("--spawn-broker", action="store_true", help="run a private mosquitto on --port")
+    parser.add_argument("--restart-at", type=float, help="wall second to restart the spawned broker at")
+    parser.add_argument("--program", default=PROGRAM)
+    args = parser.parse_args()
+
+    if args.restart_at is not None and not args.spawn_broker:
+        sys.exit("--restart-at needs --spawn-broker")
+    if not os.path.exists(args.program):
+        sys.exit(f"{args.program} not found; run 'pio run -e native' first")
+
+    broker = start_broker(args.port) if args.spawn_broker else None
+    time.sleep(0.5 if broker else 0)
+
+    counts = {}
+    latency = {}
+    stop = threading.Event()
+    counter = threading.Thread(target=count_messages, args=(args.broker, args.port, counts, latency, stop),
+                               daemon=True)
+    counter.start()
+
+    start = time.monotonic()
+    devices = []
+    for i in range(args.devices):
+        mac = "24:0a:c4:%02x:%02x:%02x" % ((i >> 16) & 0xff, (i >> 8) & 0xff, i & 0xff)
+        devices.append(subprocess.Popen([args.program, "--live", "--broker", f"{args.broker}:{args.port}",
+                                         "--mac", mac, "--seed", str(i + 1), "--speed", str(args.speed),
+                                         "--run-s", str(args.duration)],
+                                        stdout=subprocess.PIPE, text=True))
+        if args.stagger:
+            time.sleep(args.stagger)
+
+    if args.restart_at is not None:
+        time.sleep(max(0, start + args.restart_at - time.monotonic()))
+        print(f"restarting broker at {time.monotonic() - start:.1f} s")
+        broker.terminate()
+        broker.wait()
+        broker = start_broker(args.port)
+
+    results = []
+    for device in devices:
+        out, _ = device.communicate()
+        for line in out.splitlines():
+            if line.startswith("{"):
+                results.append(json.loads(line))
+    stop.set()
+    if broker:
+        broker.terminate()
+
+    wall = time.monotonic() - start
+    total = lambda key: sum(r[key] for r in results)
+    rates = [counts[s] for s in sorted(counts)]
+    print(f"{len(results)}/{args.devices} devices reported after {wall:.1f} s wall")
+    print(f"published {total('published')} messages, {total('publish_bytes')} payload bytes")
+    print(f"connects {total('connects')}, failures {total('connect_failures')}, disconnects {total('disconnects')}")
+    if rates:
+        mean = sum(rates) / len(rates)
+        print(f"broker fan-in: mean {mean:.1f} msg/s, peak {max(rates)} msg/s ({max(rates) / mean:.1f}x mean)")
+    if latency:
+        rtt_max = [int(r.get("rtt_max_ms", 0)) for r in latency.values()]
+        rtt_avg = [int(r.get("rtt_avg_ms", 0)) for r in latency.values()]
+        print(f"publish latency from {len(latency)} devices: avg {sum(rtt_avg) / len(rtt_avg):.0f} ms, "
+              f"worst {max(rtt_max)} ms")
+    worst = max(results, key=lambda r: r["connect_failures"], default=None)
+    if worst and worst["connect_failures"]:
+        print(f"most connect failures: {worst['mac']} with {worst['connect_failures']}")
+
+
+if __name__ == "__main__":
+    main()
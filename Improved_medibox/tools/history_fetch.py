@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+"""Fetch a range of the MediBox's on-device history as CSV.
+
+    python tools/history_fetch.py -3600 0 --device 3A9F10                      # last hour
+    python tools/history_fetch.py -604800 0 --device 3A9F10 --tier 15m > week.csv
+
+Times are UTC seconds; values <= 0 are relative to the device's clock.
+--device is the id the box prints as "Device id:" on the serial console at
+boot, by default the last three bytes of its MAC in hex.
+The reply is decoded as described in lib/History/History.h. Needs the
+mosquitto clients (mosquitto_pub/mosquitto_sub).
+"""
+
+import argparse
+import random
+import subprocess
+import sys
+
+TIERS = {0: ("raw", 1), 1: ("1m", 60), 2: ("15m", 900)}
+
+
+def varint(data, pos):
+    value = shift = 0
+    while True:
+        b = data[pos]
+        pos += 1
+        value |= (b & 0x7F) << shift
+        shift += 7
+        if not b & 0x80:
+            return value, pos
+
+
+def signed(data, pos):
+    value, pos = varint(data, pos)
+    return (value >> 1) ^ -(value & 1), pos
+
+
+def decode_chunk(chunk):
+    """Returns (request id, sequence, last, tier name, rows) for one chunk."""
+    request_id, seq, flags = chunk[0], chunk[1], chunk[2]
+    name, width = TIERS[flags >> 4]
+    fields = 3 if name == "raw" else 9
+    rows, previous, pos = [], None, 3
+    while pos < len(chunk):
+        t, pos = varint(chunk, pos)
+        values = []
+        for _ in range(fields):
+            v, pos = signed(chunk, pos)
+            values.append(v)
+        if previous is not None:
+            t += previous[0]
+            values = [v + p for v, p in zip(values, previous[1])]
+        previous = (t, values)
+        rows.append([t * width] + values)
+    return request_id, seq, bool(flags & 1), name, rows
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("start", type=int)
+    parser.add_argument("end", type=int)
+    parser.add_argument("--tier", default="auto", choices=["auto", "raw", "1m", "15m"])
+    parser.add_argument("--broker", default="localhost")
+    parser.add_argument("--device", required=True, help="device id suffix of the history topics")
+    parser.add_argument("--timeout", type=int, default=60)
+    args = parser.parse_args()
+
+    request_id = random.randrange(256)
+    sub = subprocess.Popen(["mosquitto_sub", "-h", args.broker, "-t", f"History_Data_{args.device}",
+                            "-F", "%x", "-W", str(args.timeout)],
+                           stdout=subprocess.PIPE, text=True)
+    subprocess.run(["mosquitto_pub", "-h", args.broker, "-t", f"History_Request_{args.device}",
+                    "-m", f"{args.start} {args.end} {args.tier} {request_id}"], check=True)
+
+    expected = 0
+    header = False
+    for line in sub.stdout:
+        chunk = bytes.fromhex(line.strip())
+        if len(chunk) < 3 or chunk[0] != request_id:
+            continue
+        _, seq, last, tier, rows = decode_chunk(chunk)
+        if seq != expected:
+            sys.exit(f"chunk {expected} lost; request again")
+        expected = (seq + 1) % 256
+        if not header:
+            if tier == "raw":
+                print("utc,ldr,temperature,humidity")
+            else:
+                print("utc,ldr_min,ldr_mean,ldr_max,temp_min,temp_mean,temp_max,hum_min,hum_mean,hum_max")
+            header = True
+        # temperatures are in 0.1 C
+        tenths = {2} if tier == "raw" else {4, 5, 6}
+        for row in rows:
+            print(",".join(str(v / 10 if i in tenths else v) for i, v in enumerate(row)))
+        if last:
+            break
+    sub.terminate()
+
+
+if __name__ == "__main__":
+    main()
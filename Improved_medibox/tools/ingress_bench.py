@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+"""Measure how fast a MediBox takes slider config updates off the broker.
+
+A live host build of the firmware (pio run -e native) is driven with bursts
+of Theta_Offset_Config messages, as a dragged Node-RED slider sends them, at
+each of a list of rates. The device applies each coalescing window as one
+config generation and acks it on Config_Applied_<id> with its running
+staged count, so the bench sees how many updates were taken in and when the
+last one reached the servo.
+
+    pio run -e native
+    python tools/ingress_bench.py --spawn-broker --rates 10 50 200 1000
+
+Per rate it prints the updates sent and taken in, the rate taken in, the
+generations they were applied in, and the latency from the last update
+sent to the generation that applied it. Needs the mosquitto binaries
+(mosquitto_pub, mosquitto_sub, and mosquitto for --spawn-broker).
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+import threading
+import time
+
+PROGRAM = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", ".pio", "build", "native", "program")
+
+MAC = "24:0a:c4:00:00:01"
+DEVICE_ID = "000001"
+
+
+def watch_acks(broker, port, acks, changed):
+    """Keep every Config_Applied ack with its wall arrival time."""
+    sub = subprocess.Popen(["mosquitto_sub", "-h", broker, "-p", str(port),
+                            "-t", "Config_Applied_" + DEVICE_ID, "-F", "%p"],
+                           stdout=subprocess.PIPE, text=True, errors="replace")
+    for line in sub.stdout:
+        fields = dict(f.split("=", 1) for f in line.split() if "=" in f)
+        with changed:
+            acks.append((time.monotonic(), int(fields.get("gen", 0)), int(fields.get("staged", 0))))
+            changed.notify_all()
+
+
+def burst(broker, port, rate, seconds):
+    """Publish slider values at 'rate' per second for 'seconds'; returns the
+    number sent and the wall time the last one was handed to the broker."""
+    pub = subprocess.Popen(["mosquitto_pub", "-h", broker, "-p", str(port),
+                            "-t", "Theta_Offset_Config_" + DEVICE_ID, "-l"],
+                           stdin=subprocess.PIPE, text=True)
+    count = max(1, int(rate * seconds))
+    start = time.monotonic()
+    for i in range(count):
+        time.sleep(max(0, start + i / rate - time.monotonic()))
+        pub.stdin.write("%d\n" % (i % 121))
+        pub.stdin.flush()
+    last = time.monotonic()
+    pub.stdin.close()
+    pub.wait()
+    return count, last
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--rates", type=float, nargs="+", default=[10, 50, 200, 1000], help="updates per second")
+    parser.add_argument("--burst", type=float, default=3, help="wall seconds each burst lasts")
+    parser.add_argument("--settle", type=float, default=5, help="wall seconds to wait for the last ack")
+    parser.add_argument("--broker", default="localhost")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--spawn-broker", action="store_true", help="run a private mosquitto on --port")
+    parser.add_argument("--program", default=PROGRAM)
+    args = parser.parse_args()
+
+    if not os.path.exists(args.program):
+        sys.exit(f"{args.program} not found; run 'pio run -e native' first")
+
+    broker = None
+    if args.spawn_broker:
+        broker = subprocess.Popen(["mosquitto", "-p", str(args.port)],
+                                  stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        time.sleep(0.5)
+
+    acks = []
+    changed = threading.Condition()
+    threading.Thread(target=watch_acks, args=(args.broker, args.port, acks, changed), daemon=True).start()
+
+    run_s = len(args.rates) * (args.burst + args.settle) + 30
+    device = subprocess.Popen([args.program, "--live", "--broker", f"{args.broker}:{args.port}",
+                               "--mac", MAC, "--run-s", str(run_s)],
+                              stdout=subprocess.DEVNULL)
+    # Let it connect and subscribe before the first burst
+    time.sleep(3)
+
+    print("%8s %6s %6s %9s %5s %10s" % ("rate", "sent", "taken", "taken/s", "gens", "latency"))
+    staged = 0
+    gen = 0
+    for rate in args.rates:
+        with changed:
+            seen = len(acks)
+        first = time.monotonic()
+        sent, last = burst(args.broker, args.port, rate, args.burst)
+
+        # The burst is done once an ack counts everything sent, or nothing
+        # more arrives within --settle
+        deadline = last + args.settle
+        with changed:
+            while (not acks or acks[-1][2] < staged + sent) and time.monotonic() < deadline:
+                changed.wait(deadline - time.monotonic())
+            mine = acks[seen:]
+        if not mine:
+            print("%8g %6d %6d %9s %5d %10s" % (rate, sent, 0, "-", 0, "no ack"))
+            continue
+
+        applied_at, last_gen, last_staged = mine[-1]
+        taken = last_staged - staged
+        latency = "%.0f ms" % ((applied_at - last) * 1000) if taken >= sent else "lost %d" % (sent - taken)
+        print("%8g %6d %6d %9.1f %5d %10s" % (rate, sent, taken, taken / (applied_at - first),
+                                              last_gen - gen, latency))
+        staged = last_staged
+        gen = last_gen
+
+    device.terminate()
+    device.wait()
+    if broker:
+        broker.terminate()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,317 @@
+#!/usr/bin/env python3
+"""Measure MediBox end-to-end latency, dashboard to servo and sensor to dashboard.
+
+A live host build of the firmware (pio run -e native) is driven the way
+the dashboard and the hardware drive a real box, and two paths are timed
+in wall time:
+
+    command  a Theta_Offset_Config_<id> slider value published, until the
+             servo is written at the new angle
+    sensor   the LDR stepped between dark and bright, until the first
+             LDR_Value_<id> on the far side of the step's midpoint
+
+under each of these conditions, every one in a fresh device process:
+
+    idle       nothing else going on
+    menu       the menu was opened with PB_OK just before the stimulus and
+               is left with PB_CANCEL --menu-s later
+    alarm      a medication alarm is ringing (preloaded for the current
+               UTC minute, never stopped)
+    reconnect  the broker connection was lost --drop-lead seconds before
+               the stimulus
+
+    pio run -e native
+    python tools/latency_bench.py --spawn-broker
+    python tools/latency_bench.py --spawn-broker --conditions idle alarm --samples 50
+
+The controlling factor is set to 0 so the servo angle is the offset alone,
+and the LDR is sampled every second and published every --send-s. It
+prints p50/p99/max per condition and path, and the stimuli that got no
+response within --timeout as lost: a command sent while the box is
+offline is dropped by the broker (QoS 0, clean session).
+
+Host numbers: they compare conditions, the broker hop is loopback and the
+radio is not modelled. Needs the mosquitto binaries (mosquitto_pub,
+mosquitto_sub, and mosquitto for --spawn-broker).
+"""
+
+import argparse
+import datetime
+import os
+import random
+import re
+import struct
+import subprocess
+import sys
+import threading
+import time
+
+PROGRAM = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", ".pio", "build", "native", "program")
+
+MAC = "24:0a:c4:00:00:01"
+DEVICE_ID = "000001"
+
+# Wiring of the board in diagram.json
+LDR_PIN = 36
+SERVO_PIN = 14
+PB_OK = 32
+PB_CANCEL = 34
+
+LDR_DARK = 500
+LDR_BRIGHT = 3500
+OFFSETS = [10, 40, 70, 100]
+
+SERVO = re.compile(r" servo (\d+) (-?\d+)$")
+TONE = re.compile(r" tone (\d+) (\d+)$")
+
+
+class Device:
+    """One live firmware process: its servo and tone events from --events,
+    its LDR publishes from the broker, and the --control stdin."""
+
+    def __init__(self, args, prefs):
+        command = [args.program, "--live", "--broker", f"{args.broker}:{args.port}", "--mac", MAC,
+                   "--events", "--control"]
+        for key, value in prefs.items():
+            command += ["--pref", f"{key}={value.hex()}"]
+        self.args = args
+        self.events = []     # (wall time, kind, value)
+        self.angle = None    # last offset the servo was seen at
+        self.bright = False
+        self.sample = 0
+        self.changed = threading.Condition()
+        self.process = subprocess.Popen(command, stdin=subprocess.PIPE, stdout=subprocess.PIPE,
+                                        text=True, errors="replace")
+        self.sub = subprocess.Popen(["mosquitto_sub", "-h", args.broker, "-p", str(args.port),
+                                     "-t", "LDR_Value_" + DEVICE_ID],
+                                    stdout=subprocess.PIPE, text=True, errors="replace")
+        self.pub = subprocess.Popen(["mosquitto_pub", "-h", args.broker, "-p", str(args.port),
+                                     "-t", "Theta_Offset_Config_" + DEVICE_ID, "-l"],
+                                    stdin=subprocess.PIPE, text=True)
+        threading.Thread(target=self.watch_events, daemon=True).start()
+        threading.Thread(target=self.watch_ldr, daemon=True).start()
+
+    def add(self, kind, value):
+        with self.changed:
+            self.events.append((time.monotonic(), kind, value))
+            self.changed.notify_all()
+
+    def watch_events(self):
+        for line in self.process.stdout:
+            servo = SERVO.search(line)
+            tone = TONE.search(line)
+            if servo and int(servo.group(1)) == SERVO_PIN:
+                self.add("servo", int(servo.group(2)))
+            elif tone:
+                self.add("tone", int(tone.group(2)))
+
+    def watch_ldr(self):
+        for line in self.sub.stdout:
+            fields = line.split()
+            if fields and fields[0].lstrip("-").isdigit():
+                self.add("ldr", int(fields[0]))
+
+    def control(self, line):
+        self.process.stdin.write(line + "\n")
+        self.process.stdin.flush()
+
+    def press(self, pin):
+        self.control(f"press {pin}")
+
+    def publish(self, topic, message):
+        subprocess.run(["mosquitto_pub", "-h", self.args.broker, "-p", str(self.args.port),
+                        "-t", f"{topic}_{DEVICE_ID}", "-m", message], check=True)
+
+    def slide(self, offset):
+        self.pub.stdin.write("%d\n" % offset)
+        self.pub.stdin.flush()
+
+    def wait_for(self, since, match, timeout):
+        """Wall time of the first event after 'since' that 'match' accepts,
+        or None after 'timeout' seconds."""
+        deadline = time.monotonic() + timeout
+        with self.changed:
+            seen = 0
+            while True:
+                for t, kind, value in self.events[seen:]:
+                    if t >= since and match(kind, value):
+                        return t
+                seen = len(self.events)
+                left = deadline - time.monotonic()
+                if left <= 0:
+                    return None
+                self.changed.wait(left)
+
+    def close(self):
+        for process in (self.pub, self.sub, self.process):
+            process.terminate()
+        for process in (self.pub, self.sub, self.process):
+            process.wait()
+
+
+def alarm_prefs():
+    """NVS preload that rings alarm 1 in the minute the box first checks
+    its alarms, a few seconds after boot once SNTP has answered."""
+    now = datetime.datetime.now(datetime.timezone.utc)
+    if now.second > 50:
+        time.sleep(61 - now.second)
+        now = datetime.datetime.now(datetime.timezone.utc)
+    return {"alarm_h": struct.pack("<2i", now.hour, -1), "alarm_m": struct.pack("<2i", now.minute, -1),
+            "alarms_on": b"\x01", "tz": b"UTC0\x00"}
+
+
+def setup(device, args):
+    """Wait for the box to take commands, then fix the angle to the offset
+    and the LDR timing. False when it never answers."""
+    device.control(f"analog {LDR_PIN} {LDR_DARK}")
+    deadline = time.monotonic() + args.boot_timeout
+    offset = 0
+    while time.monotonic() < deadline:
+        offset = OFFSETS[0] if offset != OFFSETS[0] else OFFSETS[1]
+        sent = time.monotonic()
+        device.publish("Controlling_Factor_Config", "0")
+        device.slide(offset)
+        if device.wait_for(sent, lambda kind, value: kind == "servo" and value == offset, 2) is not None:
+            break
+    else:
+        return False
+    device.publish("LDR_Sample_Config", "1")
+    device.publish("LDR_Send_Config", str(args.send_s))
+    device.angle = offset
+    time.sleep(1)
+    return True
+
+
+def stimulus(device, condition, args, send):
+    """Bring the box into 'condition', run send() for the wall time the
+    stimulus went out, and undo the condition. Returns that time and the
+    extra seconds allowed for a response."""
+    if condition == "menu":
+        # Seen within a loop pass, then the firmware's 200 ms debounce
+        device.press(PB_OK)
+        time.sleep(1)
+        sent = send()
+        time.sleep(args.menu_s)
+        device.press(PB_CANCEL)
+        return sent, args.menu_s
+    if condition == "reconnect":
+        device.control("drop")
+        time.sleep(args.drop_lead)
+        return send(), 0
+    return send(), 0
+
+
+def measure_command(device, condition, args):
+    offset = OFFSETS[device.sample % len(OFFSETS)]
+    if offset == device.angle:
+        offset = OFFSETS[(device.sample + 1) % len(OFFSETS)]
+    device.sample += 1
+
+    def send():
+        sent = time.monotonic()
+        device.slide(offset)
+        return sent
+
+    sent, extra = stimulus(device, condition, args, send)
+    moved = device.wait_for(sent, lambda kind, value: kind == "servo" and value == offset, args.timeout + extra)
+    if moved is None:
+        # It may still apply late; never take that for the next sample
+        time.sleep(args.timeout)
+        device.angle = None
+        return None
+    device.angle = offset
+    return (moved - sent) * 1000
+
+
+def measure_sensor(device, condition, args):
+    bright = not device.bright
+    level = LDR_BRIGHT if bright else LDR_DARK
+    middle = (LDR_DARK + LDR_BRIGHT) / 2
+
+    # A random phase against the publish window
+    time.sleep(random.uniform(0, args.send_s))
+
+    def send():
+        sent = time.monotonic()
+        device.control(f"analog {LDR_PIN} {level}")
+        return sent
+
+    sent, extra = stimulus(device, condition, args, send)
+    device.bright = bright
+    crossed = device.wait_for(sent, lambda kind, value: kind == "ldr" and (value > middle) == bright,
+                              3 * args.send_s + args.timeout + extra)
+    return None if crossed is None else (crossed - sent) * 1000
+
+
+def percentile(values, p):
+    """Nearest-rank percentile of sorted 'values'."""
+    rank = max(1, -(-p * len(values) // 100))
+    return values[int(rank) - 1]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--conditions", nargs="+", choices=["idle", "menu", "alarm", "reconnect"],
+                        default=["idle", "menu", "alarm", "reconnect"])
+    parser.add_argument("--samples", type=int, default=20, help="commands per condition")
+    parser.add_argument("--sensor-samples", type=int, default=8, help="LDR steps per condition")
+    parser.add_argument("--send-s", type=int, default=10, help="LDR publish interval, 10 to 600")
+    parser.add_argument("--menu-s", type=float, default=2, help="wall seconds the menu stays open")
+    parser.add_argument("--drop-lead", type=float, default=0, help="wall seconds from a drop to the stimulus")
+    parser.add_argument("--timeout", type=float, default=5, help="wall seconds to wait for a command")
+    parser.add_argument("--boot-timeout", type=float, default=30, help="wall seconds to wait for the box")
+    parser.add_argument("--broker", default="localhost")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--spawn-broker", action="store_true", help="run a private mosquitto on --port")
+    parser.add_argument("--program", default=PROGRAM)
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    if not os.path.exists(args.program):
+        sys.exit(f"{args.program} not found; run 'pio run -e native' first")
+    random.seed(args.seed)
+
+    broker = None
+    if args.spawn_broker:
+        broker = subprocess.Popen(["mosquitto", "-p", str(args.port)],
+                                  stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        time.sleep(0.5)
+
+    print("%-10s %-8s %4s %5s %8s %8s %8s" % ("condition", "path", "n", "lost", "p50_ms", "p99_ms", "max_ms"))
+    for condition in args.conditions:
+        device = Device(args, alarm_prefs() if condition == "alarm" else {})
+        try:
+            if not setup(device, args):
+                print("%-10s %-8s %s" % (condition, "-", "box never answered"))
+                continue
+            if condition == "alarm" and device.wait_for(0, lambda kind, value: kind == "tone" and value > 0,
+                                                        args.boot_timeout) is None:
+                print("%-10s %-8s %s" % (condition, "-", "alarm never rang"))
+                continue
+
+            for path, count, measure in (("command", args.samples, measure_command),
+                                         ("sensor", args.sensor_samples, measure_sensor)):
+                latencies = []
+                for _ in range(count):
+                    latency = measure(device, condition, args)
+                    if latency is not None:
+                        latencies.append(latency)
+                    # Let a dropped connection come back before the next one
+                    time.sleep(0.2 if condition != "reconnect" else args.timeout)
+                latencies.sort()
+                if latencies:
+                    print("%-10s %-8s %4d %5d %8.0f %8.0f %8.0f" % (
+                        condition, path, count, count - len(latencies), percentile(latencies, 50),
+                        percentile(latencies, 99), latencies[-1]))
+                else:
+                    print("%-10s %-8s %4d %5d %8s %8s %8s" % (condition, path, count, count, "-", "-", "-"))
+                sys.stdout.flush()
+        finally:
+            device.close()
+
+    if broker:
+        broker.terminate()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,66 @@
+#!/usr/bin/env python3
+"""Local OTA stand-in for the MediBox.
+
+Serves a firmware image over HTTP and publishes the OTA trigger to an MQTT
+broker, so updates can be exercised against a local mosquitto instead of the
+public broker. Needs the mosquitto clients (mosquitto_pub/mosquitto_sub).
+
+    python tools/ota_serve.py .pio/build/esp32dev/firmware.bin \
+        --host 192.168.1.10 --broker localhost --device 3A9F10
+
+--device is the id the box prints as "Device id:" on the serial console at
+boot, by default the last three bytes of its MAC in hex.
+
+Pass --corrupt to advertise a wrong digest and check that the device rejects
+the image.
+"""
+
+import argparse
+import hashlib
+import http.server
+import os
+import subprocess
+import threading
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("image", help="firmware .bin to serve")
+    parser.add_argument("--host", required=True, help="address the device can reach this machine on")
+    parser.add_argument("--port", type=int, default=8070)
+    parser.add_argument("--broker", default="localhost")
+    parser.add_argument("--device", required=True, help="device id suffix of the OTA topics")
+    parser.add_argument("--corrupt", action="store_true", help="send a wrong SHA-256")
+    args = parser.parse_args()
+
+    with open(args.image, "rb") as f:
+        data = f.read()
+    digest = hashlib.sha256(data).hexdigest()
+    if args.corrupt:
+        digest = digest[::-1]
+
+    directory = os.path.dirname(os.path.abspath(args.image))
+    name = os.path.basename(args.image)
+
+    handler = lambda *a, **kw: http.server.SimpleHTTPRequestHandler(*a, directory=directory, **kw)
+    server = http.server.ThreadingHTTPServer(("", args.port), handler)
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+
+    url = f"http://{args.host}:{args.port}/{name}"
+    trigger = f"{url} {digest} {len(data)}"
+    print(f"serving {name} ({len(data)} bytes), sha256 {digest}")
+
+    status = subprocess.Popen(["mosquitto_sub", "-h", args.broker, "-v",
+                               "-t", f"OTA_Status_{args.device}"])
+    subprocess.run(["mosquitto_pub", "-h", args.broker,
+                    "-t", f"OTA_Update_{args.device}", "-m", trigger], check=True)
+
+    try:
+        status.wait()
+    except KeyboardInterrupt:
+        status.terminate()
+        server.shutdown()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+"""Fetch the MediBox hot path profile and convert it to a Chrome trace.
+
+Needs a firmware built with -DMEDIBOX_FEATURE_PROFILING=1. The device keeps
+the newest spans of loop() and the functions it calls in a RAM ring;
+"dump" streams them over MQTT and writes Chrome trace-event JSON, which
+chrome://tracing and ui.perfetto.dev open:
+
+    python tools/profile_fetch.py stall 50 --device 3A9F10   # freeze at a loop over 50 ms
+    python tools/profile_fetch.py dump --device 3A9F10 -o profile.json
+    python tools/profile_fetch.py resume --device 3A9F10
+
+--device is the id the box prints as "Device id:" on the serial console at
+boot, by default the last three bytes of its MAC in hex.
+
+Without a broker, send "serial" to Profile_Control_<id> (or dump from a
+serial console build) and convert the captured serial log:
+
+    python tools/profile_fetch.py convert serial.log -o profile.json
+
+Needs the mosquitto clients (mosquitto_pub/mosquitto_sub) for the MQTT
+commands.
+"""
+
+import argparse
+import json
+import re
+import subprocess
+import sys
+
+HEADER = re.compile(r"profile cpu_mhz=(\d+) spans=(\d+) overwritten=(\d+)")
+SPAN = re.compile(r"(\d+) (\d+) (\d+) (\S+)$")
+
+
+def parse(lines):
+    """Spans of the last complete dump in 'lines': (cpu_mhz, overwritten, [(start, cycles, name)])."""
+    dump = None
+    for line in lines:
+        line = line.strip()
+        header = HEADER.search(line)
+        if header:
+            mhz, count, overwritten = (int(g) for g in header.groups())
+            dump = (mhz, count, overwritten, [])
+            continue
+        if dump is None:
+            continue
+        if line == "end":
+            mhz, count, overwritten, spans = dump
+            if len(spans) != count:
+                sys.exit(f"dump has {len(spans)} of {count} spans; dump again")
+            return mhz, overwritten, spans
+        span = SPAN.match(line)
+        if span:
+            index, start, cycles, name = span.groups()
+            if int(index) != len(dump[3]):
+                sys.exit(f"span {index}, expected {len(dump[3])}; dump again")
+            dump[3].append((int(start), int(cycles), name))
+    sys.exit("no complete profile dump found")
+
+
+def chrome_trace(mhz, overwritten, spans):
+    # Complete ("X") events in microseconds; a parent sorts before the
+    # children that start with it
+    events = [{"name": "thread_name", "ph": "M", "pid": 1, "tid": 1, "args": {"name": "loop"}}]
+    for start, cycles, name in sorted(spans, key=lambda s: (s[0], -s[1])):
+        events.append({"name": name, "ph": "X", "pid": 1, "tid": 1,
+                       "ts": start / mhz, "dur": cycles / mhz})
+    return {"traceEvents": events, "displayTimeUnit": "ms",
+            "otherData": {"cpu_mhz": mhz, "overwritten": overwritten}}
+
+
+def fetch(args):
+    # One message per chunk of span lines; "end" closes the dump
+    sub = subprocess.Popen(["mosquitto_sub", "-h", args.broker, "-t", f"Profile_Data_{args.device}",
+                            "-W", str(args.timeout)],
+                           stdout=subprocess.PIPE, text=True)
+    subprocess.run(["mosquitto_pub", "-h", args.broker, "-t", f"Profile_Control_{args.device}",
+                    "-m", "dump"], check=True)
+    lines = []
+    started = False
+    for line in sub.stdout:
+        started = started or HEADER.search(line) is not None
+        if started:
+            lines.append(line)
+            if line.strip() == "end":
+                break
+    sub.terminate()
+    return lines
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("command", choices=["dump", "stall", "resume", "convert"])
+    parser.add_argument("arg", nargs="?", help="stall: limit in ms (0 for none); convert: serial log")
+    parser.add_argument("--broker", default="localhost")
+    parser.add_argument("--device", help="device id suffix of the profile topics; all but convert need it")
+    parser.add_argument("-o", "--output", default="profile.json")
+    parser.add_argument("--timeout", type=int, default=60, help="seconds to wait for the dump")
+    args = parser.parse_args()
+    if args.command != "convert" and not args.device:
+        parser.error(f"{args.command} needs --device")
+
+    if args.command in ("stall", "resume"):
+        message = "resume" if args.command == "resume" else f"stall {int(args.arg or 0)}"
+        subprocess.run(["mosquitto_pub", "-h", args.broker, "-t", f"Profile_Control_{args.device}",
+                        "-m", message], check=True)
+        return
+
+    if args.command == "convert":
+        if not args.arg:
+            sys.exit("convert needs the serial log")
+        with open(args.arg, errors="replace") as f:
+            lines = f.readlines()
+    else:
+        lines = fetch(args)
+
+    mhz, overwritten, spans = parse(lines)
+    with open(args.output, "w") as f:
+        json.dump(chrome_trace(mhz, overwritten, spans), f)
+    print(f"{len(spans)} spans ({overwritten} overwritten before them) to {args.output}")
+
+
+if __name__ == "__main__":
+    main()
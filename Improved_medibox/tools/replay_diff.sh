@@ -0,0 +1,36 @@
+#!/bin/sh
+# Replay one trace through two firmware revisions and diff what they did.
+#
+#   tools/replay_diff.sh trace.bin [base-rev] [new-rev]
+#
+# Revisions default to HEAD and the working tree. Each revision is built
+# with the native PlatformIO env in a temporary git worktree.
+
+set -e
+
+trace=$(realpath "$1")
+base=${2:-HEAD}
+new=${3:-}
+project=$(cd "$(dirname "$0")/.." && pwd)
+root=$(git -C "$project" rev-parse --show-toplevel)
+subdir=${project#"$root"}
+work=$(mktemp -d)
+trap 'git -C "$root" worktree remove --force "$work/base" >/dev/null 2>&1; [ -n "$new" ] && git -C "$root" worktree remove --force "$work/new" >/dev/null 2>&1; rm -rf "$work"' EXIT
+
+replay() {
+  (cd "$1" && pio run -s -e native)
+  mkdir -p "$work/fs-$2"
+  "$1/.pio/build/native/program" --replay "$trace" --fs "$work/fs-$2" --out "$work/$2.txt"
+}
+
+git -C "$root" worktree add -q --detach "$work/base" "$base"
+replay "$work/base$subdir" base
+
+if [ -n "$new" ]; then
+  git -C "$root" worktree add -q --detach "$work/new" "$new"
+  replay "$work/new$subdir" new
+else
+  replay "$project" new
+fi
+
+diff -u --label "$base" --label "${new:-working tree}" "$work/base.txt" "$work/new.txt" && echo "no differences"
@@ -0,0 +1,68 @@
+#!/usr/bin/env python3
+"""Record and fetch an input trace from the MediBox.
+
+"arm" makes the device restart and record everything it reads (buttons,
+sensors, MQTT, SNTP) from boot; "dump" stops the recording and streams it
+back over MQTT. The result replays on the host build:
+
+    python tools/trace_fetch.py arm --broker localhost --device 3A9F10
+    # ... use the device ...
+    python tools/trace_fetch.py dump --broker localhost --device 3A9F10 -o trace.bin
+    .pio/build/native/program --replay trace.bin
+
+--device is the id the box prints as "Device id:" on the serial console at
+boot, by default the last three bytes of its MAC in hex.
+
+Needs the mosquitto clients (mosquitto_pub/mosquitto_sub).
+"""
+
+import argparse
+import subprocess
+import sys
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("command", choices=["arm", "stop", "dump"])
+    parser.add_argument("--broker", default="localhost")
+    parser.add_argument("--device", required=True, help="device id suffix of the trace topics")
+    parser.add_argument("-o", "--output", default="trace.bin")
+    parser.add_argument("--timeout", type=int, default=60, help="seconds to wait for the dump")
+    args = parser.parse_args()
+
+    control = ["mosquitto_pub", "-h", args.broker, "-t", f"Trace_Control_{args.device}", "-m", args.command]
+    if args.command != "dump":
+        subprocess.run(control, check=True)
+        return
+
+    # Chunks are a 4 byte big endian offset followed by data; an empty one ends the dump
+    sub = subprocess.Popen(["mosquitto_sub", "-h", args.broker, "-t", f"Trace_Data_{args.device}",
+                            "-F", "%x", "-W", str(args.timeout)],
+                           stdout=subprocess.PIPE, text=True)
+    subprocess.run(control, check=True)
+
+    trace = bytearray()
+    done = False
+    for line in sub.stdout:
+        chunk = bytes.fromhex(line.strip())
+        if len(chunk) < 4:
+            continue
+        offset = int.from_bytes(chunk[:4], "big")
+        data = chunk[4:]
+        if offset != len(trace):
+            sys.exit(f"chunk at {offset}, expected {len(trace)}; dump again")
+        trace += data
+        if not data:
+            done = True
+            break
+    sub.terminate()
+
+    if not done:
+        sys.exit(f"dump incomplete after {len(trace)} bytes")
+    with open(args.output, "wb") as f:
+        f.write(trace)
+    print(f"wrote {len(trace)} bytes to {args.output}")
+
+
+if __name__ == "__main__":
+    main()
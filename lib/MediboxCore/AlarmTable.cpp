@@ -0,0 +1,50 @@
+#include "AlarmTable.h"
+
+AlarmTable::AlarmTable() : enabled(true) {
+  for (int i = 0; i < ALARM_SLOTS; i++) {
+    hours[i] = -1;
+    minutes[i] = -1;
+    triggered[i] = false;
+  }
+}
+
+bool AlarmTable::isSet(int alarm) const {
+  return hours[alarm] != -1 && minutes[alarm] != -1;
+}
+
+int AlarmTable::due(int hour, int minute) {
+  if (!enabled) {
+    return -1;
+  }
+  for (int i = 0; i < ALARM_SLOTS; i++) {
+    if (!triggered[i] && hours[i] == hour && minutes[i] == minute) {
+      triggered[i] = true;
+      return i;
+    }
+  }
+  return -1;
+}
+
+void AlarmTable::setHour(int alarm, int hour) {
+  hours[alarm] = hour;
+  triggered[alarm] = false;
+}
+
+void AlarmTable::setMinute(int alarm, int minute) {
+  minutes[alarm] = minute;
+}
+
+void AlarmTable::snooze(int alarm) {
+  triggered[alarm] = false;
+  minutes[alarm] += ALARM_SNOOZE_MINUTES;
+  if (minutes[alarm] >= 60) {
+    minutes[alarm] -= 60;
+    hours[alarm] = (hours[alarm] + 1) % 24;
+  }
+}
+
+void AlarmTable::remove(int alarm) {
+  hours[alarm] = -1;
+  minutes[alarm] = -1;
+  triggered[alarm] = false;
+}
@@ -0,0 +1,35 @@
+#ifndef ALARM_TABLE_H
+#define ALARM_TABLE_H
+
+// The medication alarms both firmware variants keep: a time of day per
+// slot, -1:-1 when unset. The arrays are public so a variant can persist
+// them as they are (the Improved firmware stores them in NVS verbatim).
+
+#define ALARM_SLOTS 2
+#define ALARM_SNOOZE_MINUTES 5
+
+struct AlarmTable {
+  AlarmTable();
+
+  bool isSet(int alarm) const;
+
+  // First slot set to hour:minute that has not rung yet; it is marked as
+  // rung. -1 if none, or if alarms are disabled.
+  int due(int hour, int minute);
+
+  // Take a new time for 'alarm'; it may ring again
+  void setHour(int alarm, int hour);
+  void setMinute(int alarm, int minute);
+
+  // Move the alarm ALARM_SNOOZE_MINUTES later and let it ring again
+  void snooze(int alarm);
+
+  void remove(int alarm);
+
+  bool enabled;
+  int hours[ALARM_SLOTS];
+  int minutes[ALARM_SLOTS];
+  bool triggered[ALARM_SLOTS];
+};
+
+#endif
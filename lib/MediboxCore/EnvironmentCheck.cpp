@@ -0,0 +1,24 @@
+#include "EnvironmentCheck.h"
+
+uint8_t environmentStatus(float temperature, float humidity) {
+  uint8_t status = 0;
+  if (temperature > 35) {
+    status |= ENV_TEMP_HIGH;
+  }
+  if (temperature < 35) {
+    status |= ENV_TEMP_LOW;
+  }
+  if (humidity > 40) {
+    status |= ENV_HUMIDITY_HIGH;
+  }
+  if (humidity < 20) {
+    status |= ENV_HUMIDITY_LOW;
+  }
+  if (temperature > 32 || temperature < 24) {
+    status |= ENV_TEMP_WARNING;
+  }
+  if (humidity > 85 || humidity < 65) {
+    status |= ENV_HUMIDITY_WARNING;
+  }
+  return status;
+}
@@ -0,0 +1,26 @@
+#ifndef ENVIRONMENT_CHECK_H
+#define ENVIRONMENT_CHECK_H
+
+#include <stdint.h>
+
+// Storage condition limits for the medicine compartment. A reading is
+// judged into status flags; the display messages and the warning both
+// follow from those, so the variants only differ in how they sound it.
+// A failed (NaN) reading raises nothing.
+
+enum EnvironmentFlag {
+  ENV_TEMP_HIGH = 0x01,        // above 35 C
+  ENV_TEMP_LOW = 0x02,         // below 35 C
+  ENV_HUMIDITY_HIGH = 0x04,    // above 40 %
+  ENV_HUMIDITY_LOW = 0x08,     // below 20 %
+  ENV_TEMP_WARNING = 0x10,     // outside 24..32 C
+  ENV_HUMIDITY_WARNING = 0x20  // outside 65..85 %
+};
+
+uint8_t environmentStatus(float temperature, float humidity);
+
+inline bool environmentWarning(uint8_t status) {
+  return (status & (ENV_TEMP_WARNING | ENV_HUMIDITY_WARNING)) != 0;
+}
+
+#endif
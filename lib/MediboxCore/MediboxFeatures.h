@@ -0,0 +1,88 @@
+#ifndef MEDIBOX_FEATURES_H
+#define MEDIBOX_FEATURES_H
+
+#include <utility>
+
+// Compile-time feature selection shared by the firmware variants.
+//
+// Each feature is a build flag, -DMEDIBOX_FEATURE_<NAME>=1, that defaults
+// to off. Code tests the constexpr members of MediboxFeatures instead of
+// the macros, so a disabled feature is still compiled and type checked,
+// and is then dropped by the optimizer and the linker's section GC:
+//
+//   if (MediboxFeatures::servo) {
+//     servoMotor->write(angle);
+//   }
+//
+// Objects that belong to a feature live in a FeatureSlot, so that their
+// static constructors do not keep them (and the code they pull in) alive
+// when the feature is off.
+
+#ifndef MEDIBOX_FEATURE_MQTT
+#define MEDIBOX_FEATURE_MQTT 0
+#endif
+#ifndef MEDIBOX_FEATURE_SERVO
+#define MEDIBOX_FEATURE_SERVO 0
+#endif
+#ifndef MEDIBOX_FEATURE_LDR
+#define MEDIBOX_FEATURE_LDR 0
+#endif
+#ifndef MEDIBOX_FEATURE_TELEMETRY
+#define MEDIBOX_FEATURE_TELEMETRY 0
+#endif
+#ifndef MEDIBOX_FEATURE_LOGGING
+#define MEDIBOX_FEATURE_LOGGING 0
+#endif
+#ifndef MEDIBOX_FEATURE_PROFILING
+#define MEDIBOX_FEATURE_PROFILING 0
+#endif
+
+// Shaded compartments, each with its own light sensor and servo. Not a
+// feature, but a build flag the same way: -DMEDIBOX_COMPARTMENTS=<n>.
+#ifndef MEDIBOX_COMPARTMENTS
+#define MEDIBOX_COMPARTMENTS 1
+#endif
+
+template <bool Mqtt, bool Servo, bool Ldr, bool Telemetry, bool Logging, bool Profiling>
+struct MediboxFeatureSet {
+  static constexpr bool mqtt = Mqtt;            // broker connection and remote config
+  static constexpr bool servo = Servo;          // shade servo
+  static constexpr bool ldr = Ldr;              // light sensor channel
+  static constexpr bool telemetry = Telemetry && Mqtt;   // published readings and stats
+  static constexpr bool logging = Logging;      // input traces and the adherence log
+  static constexpr bool profiling = Profiling;  // loop hot path spans, see Profiler.h
+};
+
+typedef MediboxFeatureSet<MEDIBOX_FEATURE_MQTT != 0, MEDIBOX_FEATURE_SERVO != 0, MEDIBOX_FEATURE_LDR != 0,
+                          MEDIBOX_FEATURE_TELEMETRY != 0, MEDIBOX_FEATURE_LOGGING != 0,
+                          MEDIBOX_FEATURE_PROFILING != 0>
+    MediboxFeatures;
+
+// Storage for an object that only exists when 'Enabled'. Access it with
+// '->' behind a test of the same feature in the same function; a disabled
+// slot is empty and hands out a null pointer, and a test made only by the
+// caller leaves gcc warning about a null 'this' (-Wnonnull).
+template <bool Enabled, typename T>
+class FeatureSlot {
+public:
+  template <typename... Args>
+  explicit FeatureSlot(Args&&... args) : value(std::forward<Args>(args)...) {}
+
+  T* operator->() { return &value; }
+  const T* operator->() const { return &value; }
+
+private:
+  T value;
+};
+
+template <typename T>
+class FeatureSlot<false, T> {
+public:
+  template <typename... Args>
+  explicit FeatureSlot(Args&&...) {}
+
+  T* operator->() { return nullptr; }
+  const T* operator->() const { return nullptr; }
+};
+
+#endif
@@ -0,0 +1,255 @@
+#include "MediboxUi.h"
+
+#include "EnvironmentCheck.h"
+
+static int read_pin(int pin) {
+  return digitalRead(pin);
+}
+
+static void flush_display(Adafruit_SSD1306& display) {
+  display.display();
+}
+
+MediboxUi::MediboxUi(Adafruit_SSD1306& ui_display, const MediboxButtons& ui_buttons)
+    : display(ui_display), buttons(ui_buttons), reader(read_pin), idle(nullptr), flush(flush_display) {
+}
+
+void MediboxUi::setButtonReader(ButtonReader button_reader) {
+  reader = button_reader != nullptr ? button_reader : read_pin;
+}
+
+void MediboxUi::setIdle(IdleHook idle_hook) {
+  idle = idle_hook;
+}
+
+void MediboxUi::setFlush(FlushHook flush_hook) {
+  flush = flush_hook != nullptr ? flush_hook : flush_display;
+}
+
+void MediboxUi::printLine(const String& text, int column, int row, int text_size) {
+  display.setTextSize(text_size);
+  display.setTextColor(SSD1306_WHITE);
+  display.setCursor(column, row);
+  display.println(text);
+  flush(display);
+}
+
+void MediboxUi::printTime(int days, int hours, int minutes, int seconds) {
+  printLine(String(days), 0, 0, 2);
+  printLine(":", 20, 0, 2);
+  printLine(String(hours), 30, 0, 2);
+  printLine(":", 50, 0, 2);
+  printLine(String(minutes), 60, 0, 2);
+  printLine(":", 80, 0, 2);
+  printLine(String(seconds), 90, 0, 2);
+}
+
+void MediboxUi::notice(const char* text) {
+  display.clearDisplay();
+  printLine(text, 0, 0, 2);
+  delay(2000);
+}
+
+void MediboxUi::showEnvironment(uint8_t status) {
+  // Each message clears the screen, so the last one raised stays up
+  if (status & ENV_TEMP_HIGH) {
+    display.clearDisplay();
+    printLine("TEMP HIGH", 0, 35, 1);
+  }
+  if (status & ENV_TEMP_LOW) {
+    display.clearDisplay();
+    printLine("TEMP LOW", 0, 35, 1);
+  }
+  if (status & ENV_HUMIDITY_HIGH) {
+    display.clearDisplay();
+    printLine("HUMIDITY HIGH", 0, 45, 1);
+  }
+  if (status & ENV_HUMIDITY_LOW) {
+    display.clearDisplay();
+    printLine("HUMIDITY LOW", 0, 45, 1);
+  }
+  if (status & ENV_TEMP_WARNING) {
+    display.clearDisplay();
+    printLine("Temperature Warning", 0, 25, 1);
+  }
+  if (status & ENV_HUMIDITY_WARNING) {
+    display.clearDisplay();
+    printLine("Humidity Warning", 0, 30, 1);
+  }
+}
+
+int MediboxUi::waitForButton() {
+  while (true) {
+    if (reader(buttons.up) == LOW) {
+      delay(200);
+      return buttons.up;
+    }
+    else if (reader(buttons.down) == LOW) {
+      delay(200);
+      return buttons.down;
+    }
+    else if (reader(buttons.ok) == LOW) {
+      delay(200);
+      return buttons.ok;
+    }
+    else if (reader(buttons.cancel) == LOW) {
+      delay(200);
+      return buttons.cancel;
+    }
+
+    if (idle != nullptr) {
+      idle();
+    }
+  }
+}
+
+void MediboxUi::runMenu(const String* modes, int count, int& current, ModeHandler run) {
+  while (reader(buttons.cancel) == HIGH) {
+    display.clearDisplay();
+    printLine(modes[current], 0, 0, 2);
+
+    int pressed = waitForButton();
+
+    if (pressed == buttons.up) {
+      delay(200);
+      current = (current + 1) % count;
+    }
+    else if (pressed == buttons.down) {
+      delay(200);
+      current -= 1;
+      if (current < 0) {
+        current = count - 1;
+      }
+    }
+    else if (pressed == buttons.ok) {
+      delay(200);
+      Serial.println(current);
+      run(current);
+    }
+    else if (pressed == buttons.cancel) {
+      delay(200);
+      break;
+    }
+  }
+}
+
+bool MediboxUi::editNumber(const char* label, int& value, int count) {
+  int shown = value;
+  bool taken = false;
+
+  while (true) {
+    display.clearDisplay();
+    printLine(String(label) + String(shown), 0, 0, 2);
+
+    int pressed = waitForButton();
+
+    if (pressed == buttons.up) {
+      delay(200);
+      shown = (shown + 1) % count;
+    }
+    else if (pressed == buttons.down) {
+      delay(200);
+      shown -= 1;
+      if (shown < 0) {
+        shown = count - 1;
+      }
+    }
+    else if (pressed == buttons.ok) {
+      delay(200);
+      value = shown;
+      taken = true;
+    }
+    else if (pressed == buttons.cancel) {
+      delay(200);
+      return taken;
+    }
+  }
+}
+
+bool MediboxUi::editOffset(float& offset) {
+  float shown = offset;
+
+  while (true) {
+    display.clearDisplay();
+    printLine("UTC Offset: " + String(shown, 1), 0, 0, 2);
+
+    int pressed = waitForButton();
+
+    if (pressed == buttons.up) {
+      delay(200);
+      shown += 0.5;
+      // Wrap around past the largest offset
+      if (shown > 14.0) {
+        shown = -12.0;
+      }
+    }
+    else if (pressed == buttons.down) {
+      delay(200);
+      shown -= 0.5;
+      if (shown < -12.0) {
+        shown = 14.0;
+      }
+    }
+    else if (pressed == buttons.ok) {
+      delay(200);
+      offset = shown;
+      return true;
+    }
+    else if (pressed == buttons.cancel) {
+      delay(200);
+      return false;
+    }
+  }
+}
+
+int MediboxUi::pick(const char* label, int count, int start, const String* names) {
+  int index = start;
+
+  while (true) {
+    display.clearDisplay();
+    printLine(String(label) + (names != nullptr ? names[index] : String(index + 1)), 0, 0, 2);
+
+    int pressed = waitForButton();
+
+    if (pressed == buttons.up) {
+      delay(200);
+      index = (index + 1) % count;
+    }
+    else if (pressed == buttons.down) {
+      delay(200);
+      index = (index - 1 + count) % count;
+    }
+    else if (pressed == buttons.ok) {
+      delay(200);
+      return index;
+    }
+    else if (pressed == buttons.cancel) {
+      delay(200);
+      return -1;
+    }
+  }
+}
+
+void MediboxUi::viewAlarms(const AlarmTable& alarms) {
+  while (true) {
+    display.clearDisplay();
+    int shown = 0;
+    for (int i = 0; i < ALARM_SLOTS; i++) {
+      if (!alarms.isSet(i)) {
+        continue;
+      }
+      printLine("Alarm " + String(i + 1) + ": " + String(alarms.hours[i]) + ":" + String(alarms.minutes[i]),
+                0, i * 15, 2);
+      shown++;
+    }
+
+    if (shown == 0) {
+      printLine("No Active Alarms", 0, 0, 2);
+    }
+
+    if (waitForButton() == buttons.cancel) {
+      delay(200);
+      break;
+    }
+  }
+}
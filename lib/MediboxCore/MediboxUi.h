@@ -0,0 +1,75 @@
+#ifndef MEDIBOX_UI_H
+#define MEDIBOX_UI_H
+
+#include <Arduino.h>
+#include <Adafruit_SSD1306.h>
+
+#include "AlarmTable.h"
+
+// The OLED and four push buttons: the menu and the editors behind it, as
+// shared by the firmware variants.
+//
+// Every editor blocks until PB_CANCEL, like the menu itself. While waiting
+// for a press the idle hook runs, so a variant can keep its clock (and
+// anything else that must not stall) going. Buttons are read through a
+// replaceable reader so that a variant can record them, and the screen is
+// flushed through a replaceable hook so that a variant can share its bus.
+
+struct MediboxButtons {
+  uint8_t up;
+  uint8_t down;
+  uint8_t ok;
+  uint8_t cancel;
+};
+
+class MediboxUi {
+public:
+  typedef int (*ButtonReader)(int pin);
+  typedef void (*IdleHook)();
+  typedef void (*ModeHandler)(int mode);
+  typedef void (*FlushHook)(Adafruit_SSD1306& display);
+
+  MediboxUi(Adafruit_SSD1306& display, const MediboxButtons& buttons);
+
+  void setButtonReader(ButtonReader reader);
+  void setIdle(IdleHook idle);
+  void setFlush(FlushHook flush);
+
+  int readButton(int pin) const { return reader(pin); }
+
+  void printLine(const String& text, int column, int row, int text_size);
+  void printTime(int days, int hours, int minutes, int seconds);
+  // Full screen message, left up for two seconds
+  void notice(const char* text);
+  // One line per raised EnvironmentCheck flag
+  void showEnvironment(uint8_t status);
+
+  // Block until a button is pressed; returns its pin
+  int waitForButton();
+
+  // Cycle through 'modes' from 'current' and hand the one picked with
+  // PB_OK to 'run', until PB_CANCEL
+  void runMenu(const String* modes, int count, int& current, ModeHandler run);
+
+  // Step 'value' through 0..count-1. PB_OK takes the value shown, PB_CANCEL
+  // leaves. Returns whether anything was taken; 'value' is then the last.
+  bool editNumber(const char* label, int& value, int count);
+
+  // UTC offset in half hours from -12 to +14. Returns false if cancelled.
+  bool editOffset(float& offset);
+
+  // Choose one of 'count' items, shown by name or else by number from 1.
+  // Returns the index, or -1 if cancelled.
+  int pick(const char* label, int count, int start, const String* names);
+
+  void viewAlarms(const AlarmTable& alarms);
+
+private:
+  Adafruit_SSD1306& display;
+  MediboxButtons buttons;
+  ButtonReader reader;
+  IdleHook idle;
+  FlushHook flush;
+};
+
+#endif